@@ -0,0 +1,212 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include <string.h>
+#include <time.h>
+
+/*************************************************************************/
+
+/* glibc lets an executable take over the allocator entry points, as
+   long as it forwards to the real implementation; we do that purely
+   to count calls.  realloc(NULL, n) counts as an allocation, and
+   realloc(p, 0) as a free, to match what the caller actually did. */
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void  __libc_free(void *);
+
+static volatile uint64_t ALLOCS = 0;
+static volatile uint64_t FREES  = 0;
+static __thread  uint64_t MINE   = 0;
+
+void *malloc(size_t n) /* {{{ */
+{
+	__sync_fetch_and_add(&ALLOCS, 1); MINE++;
+	return __libc_malloc(n);
+}
+/* }}} */
+void *calloc(size_t n, size_t size) /* {{{ */
+{
+	__sync_fetch_and_add(&ALLOCS, 1); MINE++;
+	return __libc_calloc(n, size);
+}
+/* }}} */
+void *realloc(void *p, size_t n) /* {{{ */
+{
+	if (!p) {
+		__sync_fetch_and_add(&ALLOCS, 1); MINE++;
+	} else if (n == 0)
+		__sync_fetch_and_add(&FREES, 1);
+	return __libc_realloc(p, n);
+}
+/* }}} */
+void free(void *p) /* {{{ */
+{
+	if (p)
+		__sync_fetch_and_add(&FREES, 1);
+	__libc_free(p);
+}
+/* }}} */
+
+uint64_t bench_allocs(void) { return __sync_fetch_and_add(&ALLOCS, 0); }
+uint64_t bench_frees(void)  { return __sync_fetch_and_add(&FREES,  0); }
+uint64_t bench_thread_allocs(void) { return MINE; }
+
+/*************************************************************************/
+
+uint64_t bench_ns(void) /* {{{ */
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/* }}} */
+
+void bench_lat_add(bench_lat_t *l, uint64_t ns) /* {{{ */
+{
+	if (l->n == l->cap) {
+		l->cap = l->cap ? l->cap * 2 : 1024;
+		l->v = realloc(l->v, l->cap * sizeof(uint64_t));
+		if (!l->v) {
+			perror("bench_lat_add");
+			exit(2);
+		}
+	}
+	l->v[l->n++] = ns;
+}
+/* }}} */
+static int _u64cmp(const void *a, const void *b) /* {{{ */
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+/* }}} */
+uint64_t bench_lat_pct(bench_lat_t *l, double pct) /* {{{ */
+{
+	if (l->n == 0)
+		return 0;
+
+	qsort(l->v, l->n, sizeof(uint64_t), _u64cmp);
+	size_t i = (size_t)(pct / 100.0 * (l->n - 1) + 0.5);
+	return l->v[i >= l->n ? l->n - 1 : i];
+}
+/* }}} */
+double bench_lat_mean(bench_lat_t *l) /* {{{ */
+{
+	size_t i;
+	double sum = 0;
+
+	if (l->n == 0)
+		return 0;
+	for (i = 0; i < l->n; i++)
+		sum += l->v[i];
+	return sum / l->n;
+}
+/* }}} */
+void bench_lat_free(bench_lat_t *l) /* {{{ */
+{
+	free(l->v);
+	memset(l, 0, sizeof(*l));
+}
+/* }}} */
+void bench_lat_yaml(FILE *io, const char *indent, const char *key, bench_lat_t *l) /* {{{ */
+{
+	fprintf(io, "%s%s:\n", indent, key);
+	fprintf(io, "%s  n:        %lu\n",   indent, (unsigned long)l->n);
+	fprintf(io, "%s  mean_us:  %.3f\n",  indent, bench_lat_mean(l) / 1000.0);
+	fprintf(io, "%s  p50_us:   %.3f\n",  indent, bench_lat_pct(l, 50.0)  / 1000.0);
+	fprintf(io, "%s  p90_us:   %.3f\n",  indent, bench_lat_pct(l, 90.0)  / 1000.0);
+	fprintf(io, "%s  p99_us:   %.3f\n",  indent, bench_lat_pct(l, 99.0)  / 1000.0);
+	fprintf(io, "%s  p999_us:  %.3f\n",  indent, bench_lat_pct(l, 99.9)  / 1000.0);
+	fprintf(io, "%s  max_us:   %.3f\n",  indent, bench_lat_pct(l, 100.0) / 1000.0);
+}
+/* }}} */
+
+/*************************************************************************/
+
+static long _proc_status_kb(const char *field) /* {{{ */
+{
+	char line[256];
+	size_t len = strlen(field);
+	long kb = -1;
+
+	FILE *io = fopen("/proc/self/status", "r");
+	if (!io)
+		return -1;
+
+	while (fgets(line, sizeof(line), io)) {
+		if (strncmp(line, field, len) == 0 && line[len] == ':') {
+			kb = strtol(line + len + 1, NULL, 10);
+			break;
+		}
+	}
+	fclose(io);
+	return kb;
+}
+/* }}} */
+long bench_rss_kb(void)      { return _proc_status_kb("VmRSS"); }
+long bench_rss_peak_kb(void) { return _proc_status_kb("VmHWM"); }
+
+uint64_t bench_rand(uint64_t *state) /* {{{ */
+{
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+/* }}} */
+
+int bench_parse_mix(const char *spec, const char **keys, int *vals, int n) /* {{{ */
+{
+	char *copy = strdup(spec);
+	char *tok, *save = NULL;
+	int i, rc = 0;
+
+	for (i = 0; i < n; i++)
+		vals[i] = 0;
+
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		char *eq = strchr(tok, '=');
+		if (!eq) {
+			fprintf(stderr, "bad mix component '%s' (expected type=weight)\n", tok);
+			rc = -1;
+			break;
+		}
+		*eq++ = '\0';
+
+		for (i = 0; i < n; i++)
+			if (strcmp(tok, keys[i]) == 0)
+				break;
+		if (i == n) {
+			fprintf(stderr, "unknown mix component '%s'\n", tok);
+			rc = -1;
+			break;
+		}
+		vals[i] = atoi(eq);
+	}
+
+	free(copy);
+	return rc;
+}
+/* }}} */
@@ -0,0 +1,73 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLO_BENCH_H
+#define BOLO_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+   Shared plumbing for the programs under bench/.
+
+   Every benchmark reports its results as a YAML document on standard
+   output (the same shape `bolo query dump` uses), so that runs can be
+   diffed and graphed by whatever harness wraps them.  Human-readable
+   progress goes to standard error.
+ */
+
+/* monotonic clock, in nanoseconds */
+uint64_t bench_ns(void);
+
+/* a growable array of latency observations, in nanoseconds */
+typedef struct {
+	uint64_t *v;
+	size_t    n;
+	size_t    cap;
+} bench_lat_t;
+
+void     bench_lat_add(bench_lat_t *l, uint64_t ns);
+uint64_t bench_lat_pct(bench_lat_t *l, double pct); /* sorts l in place */
+double   bench_lat_mean(bench_lat_t *l);
+void     bench_lat_free(bench_lat_t *l);
+
+/* emit `key: { n, mean, p50, p90, p99, p999, max }` (in microseconds) */
+void bench_lat_yaml(FILE *io, const char *indent, const char *key, bench_lat_t *l);
+
+/* process-wide allocation counters, maintained by the malloc
+   interposers in bench.c; these cover every thread, including the
+   ones 0MQ runs behind our backs. */
+uint64_t bench_allocs(void);
+uint64_t bench_frees(void);
+
+/* the same, but only counting the calling thread */
+uint64_t bench_thread_allocs(void);
+
+/* resident set size (current and high-water), in kilobytes */
+long bench_rss_kb(void);
+long bench_rss_peak_kb(void);
+
+/* xorshift64*, so that workloads are reproducible from a seed */
+uint64_t bench_rand(uint64_t *state);
+
+/* parse "a=1,b=2,..." into the integer slots named by keys[] */
+int bench_parse_mix(const char *spec, const char **keys, int *vals, int n);
+
+#endif
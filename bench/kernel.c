@@ -0,0 +1,675 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/kernel - drive the bolo kernel reactor over inproc:// sockets
+
+   This links core.c, data.c and config.c directly, generates a
+   configuration with N regex rules per metric type, and then pushes
+   a reproducible mix of PDUs at the kernel listener:
+
+     1. a throughput phase, sending -n messages back-to-back and
+        waiting for a trailing "fence" STATE update to come out the
+        other side of the broadcast socket;
+
+     2. a latency phase, sending -l individual messages, each one
+        followed by a fence, and timing the round trip.  The fence
+        costs something too, so it is reported on its own as the
+        `fence` type; subtract it to get the per-PDU service time.
+
+   The same messages are also pushed through a bare PULL socket that
+   does nothing but receive and free them, to establish how many
+   allocations the 0MQ transport itself is responsible for.
+
+   With -j, the kernel decodes submissions on that many listener
+   threads (see listener.threads), and only applies them itself;
+   run it with -j 0, 1, 2, 4 ... to see how throughput scales.
+
+   With -T, submissions (but not fences) go out as binary TSDP
+   SUBMIT PDUs instead of text, with the same names and values;
+   compare against a run without it to see what parsing costs.
+ */
+
+#include "bench.h"
+#include "../src/bolo.h"
+#include <tsdp.h>
+#include <getopt.h>
+#include <assert.h>
+
+#define BENCH_LISTENER  "inproc://bench/listener"
+#define BENCH_BROADCAST "inproc://bench/broadcast"
+#define BENCH_SINK      "inproc://bench/sink"
+#define FENCE_NAME      "bench.fence"
+
+#define T_STATE   0
+#define T_COUNTER 1
+#define T_SAMPLE  2
+#define T_RATE    3
+#define T_EVENT   4
+#define T_KEYS    5
+#define NTYPES    6
+#define T_FENCE   NTYPES
+
+static const char *TYPES[NTYPES + 1] = {
+	"state", "counter", "sample", "rate", "event", "keys", "fence",
+};
+
+static struct {
+	uint64_t  messages;  /* -n */
+	uint64_t  latency;   /* -l */
+	int       names;     /* -c, per type */
+	int       rules;     /* -r, per type */
+	int       values;    /* -v, per SAMPLE */
+	int       window;    /* -w, seconds */
+	int       step;      /* -t, messages per virtual second (0 = real time) */
+	int       decoders;  /* -j, listener.threads */
+	int       tsdp;      /* -T */
+	int       lanes;     /* fences per fence; see send_fence() */
+	uint64_t  seed;      /* -s */
+	char     *mix;       /* -m */
+	char     *workdir;   /* -d */
+	int       verbose;   /* -D */
+
+	int       weight[NTYPES];
+	int       total;
+} OPTIONS = { 0 };
+
+static struct {
+	uint64_t rng;
+	uint64_t seq;
+	int32_t  start;
+} GEN;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/kernel [options]\n\n");
+	printf("Options:\n");
+	printf("  -n, --messages N     messages to send in the throughput phase (default 200000)\n");
+	printf("  -l, --latency N      messages to time individually (default 20000)\n");
+	printf("  -m, --mix SPEC       PDU mix, as type=weight,... (types: state, counter,\n");
+	printf("                       sample, rate, event, keys)\n");
+	printf("                       (default state=20,counter=30,sample=30,rate=15,event=4,keys=1)\n");
+	printf("  -c, --names N        distinct metric names per type (default 1000)\n");
+	printf("  -r, --rules N        regex rules per type (default 8)\n");
+	printf("  -v, --values N       values per SAMPLE PDU (default 1)\n");
+	printf("  -w, --window N       aggregation window, in seconds (default 60)\n");
+	printf("  -t, --step N         advance the submission clock one second every N\n");
+	printf("                       messages, to force window rollovers (default 0, off)\n");
+	printf("  -s, --seed N         workload random seed (default 1)\n");
+	printf("  -j, --decoders N     decode submissions on N listener threads\n");
+	printf("                       (default 0, the kernel decodes them itself)\n");
+	printf("  -T, --tsdp           send submissions as binary TSDP, not text\n");
+	printf("  -d, --workdir PATH   scratch directory for save/keys files (default /tmp)\n");
+	printf("  -D, --debug          turn on kernel debug logging (slow!)\n");
+}
+/* }}} */
+
+static int32_t next_ts(void) /* {{{ */
+{
+	if (OPTIONS.step > 0)
+		return GEN.start + GEN.seq / OPTIONS.step;
+	return time_s();
+}
+/* }}} */
+static int pick_type(void) /* {{{ */
+{
+	int i, r = bench_rand(&GEN.rng) % OPTIONS.total;
+	for (i = 0; i < NTYPES; i++) {
+		if (r < OPTIONS.weight[i])
+			return i;
+		r -= OPTIONS.weight[i];
+	}
+	return NTYPES - 1;
+}
+/* }}} */
+static pdu_t *make_fence(uint64_t seq, int lane) /* {{{ */
+{
+	pdu_t *p = pdu_make("STATE", 0);
+	pdu_extendf(p, "%i", time_s());
+	pdu_extendf(p, "%s.%i", FENCE_NAME, lane);
+	pdu_extendf(p, "%i", 0);
+	pdu_extendf(p, "%lu", (unsigned long)seq);
+	return p;
+}
+/* }}} */
+static pdu_t *packed(tsdp_t *t) /* {{{ */
+{
+	uint8_t buf[TSDP_STREAM_MAX];
+	int n = tsdp_pack(buf, sizeof(buf), t);
+	assert(n > 0);
+	tsdp_destroy(t);
+
+	pdu_t *p = pdu_new();
+	pdu_extend(p, buf, n);
+	return p;
+}
+/* }}} */
+static pdu_t *make_tsdp(int type, int32_t ts, int id, int re, uint64_t seq) /* {{{ */
+{
+	/* the same submissions as make_pdu(), values and all */
+	static const int PAYLOADS[NTYPES] = {
+		TSDP_PAYLOAD_STATE, TSDP_PAYLOAD_TALLY, TSDP_PAYLOAD_SAMPLE,
+		TSDP_PAYLOAD_DELTA, TSDP_PAYLOAD_EVENT, TSDP_PAYLOAD_FACT,
+	};
+	char name[64];
+	tsdp_t *t;
+	int i;
+
+	if (tsdp_create(&t, TSDP_VERSION, TSDP_OP_SUBMIT) != 0) {
+		perror("tsdp_create");
+		exit(2);
+	}
+	tsdp_set_payloads(t, PAYLOADS[type]);
+	if (type != T_KEYS)
+		tsdp_extend_tstamp(t, ts * 1000LL);
+
+	switch (type) {
+	case T_STATE:
+		snprintf(name, sizeof(name), "bench.state.r%i.m%i", re, id);
+		tsdp_extend_string(t, name);
+		tsdp_set_flags(t, bench_rand(&GEN.rng) % 4);
+		tsdp_extend_string(t, "synthetic state update from bench/kernel");
+		break;
+
+	case T_COUNTER:
+		snprintf(name, sizeof(name), "bench.counter.r%i.m%i", re, id);
+		tsdp_extend_string(t, name);
+		tsdp_extend_uint(t, 1);
+		break;
+
+	case T_SAMPLE:
+		snprintf(name, sizeof(name), "bench.sample.r%i.m%i", re, id);
+		tsdp_extend_string(t, name);
+		for (i = 0; i < OPTIONS.values; i++)
+			tsdp_extend_float(t, (bench_rand(&GEN.rng) % 100000) / 100.0);
+		break;
+
+	case T_RATE:
+		snprintf(name, sizeof(name), "bench.rate.r%i.m%i", re, id);
+		tsdp_extend_string(t, name);
+		tsdp_extend_uint(t, seq);
+		break;
+
+	case T_EVENT:
+		snprintf(name, sizeof(name), "bench.event.m%i", id);
+		tsdp_extend_string(t, name);
+		tsdp_extend_string(t, "synthetic event from bench/kernel");
+		break;
+
+	case T_KEYS:
+		snprintf(name, sizeof(name), "bench.key.m%i", id);
+		tsdp_extend_string(t, name);
+		snprintf(name, sizeof(name), "%lu", (unsigned long)seq);
+		tsdp_extend_string(t, name);
+		break;
+	}
+	return packed(t);
+}
+/* }}} */
+static pdu_t *make_pdu(int type) /* {{{ */
+{
+	int32_t ts = next_ts();
+	int     id = bench_rand(&GEN.rng) % OPTIONS.names;
+	int     re = id % OPTIONS.rules;
+	int     i;
+	pdu_t  *p;
+
+	uint64_t seq = GEN.seq++;
+	if (OPTIONS.tsdp && type != T_FENCE)
+		return make_tsdp(type, ts, id, re, seq);
+
+	switch (type) {
+	case T_STATE:
+		p = pdu_make("STATE", 0);
+		pdu_extendf(p, "%i", ts);
+		pdu_extendf(p, "bench.state.r%i.m%i", re, id);
+		pdu_extendf(p, "%i", (int)(bench_rand(&GEN.rng) % 4));
+		pdu_extendf(p, "%s", "synthetic state update from bench/kernel");
+		return p;
+
+	case T_COUNTER:
+		p = pdu_make("COUNTER", 0);
+		pdu_extendf(p, "%i", ts);
+		pdu_extendf(p, "bench.counter.r%i.m%i", re, id);
+		pdu_extendf(p, "%i", 1);
+		return p;
+
+	case T_SAMPLE:
+		p = pdu_make("SAMPLE", 0);
+		pdu_extendf(p, "%i", ts);
+		pdu_extendf(p, "bench.sample.r%i.m%i", re, id);
+		for (i = 0; i < OPTIONS.values; i++)
+			pdu_extendf(p, "%e", (bench_rand(&GEN.rng) % 100000) / 100.0);
+		return p;
+
+	case T_RATE:
+		p = pdu_make("RATE", 0);
+		pdu_extendf(p, "%i", ts);
+		pdu_extendf(p, "bench.rate.r%i.m%i", re, id);
+		pdu_extendf(p, "%lu", (unsigned long)seq);
+		return p;
+
+	case T_EVENT:
+		p = pdu_make("EVENT", 0);
+		pdu_extendf(p, "%i", ts);
+		pdu_extendf(p, "bench.event.m%i", id);
+		pdu_extendf(p, "%s", "synthetic event from bench/kernel");
+		return p;
+
+	case T_KEYS:
+		p = pdu_make("SET.KEYS", 0);
+		pdu_extendf(p, "bench.key.m%i", id);
+		pdu_extendf(p, "%lu", (unsigned long)seq);
+		return p;
+
+	default: /* T_FENCE */
+		return make_fence(seq, 0);
+	}
+}
+/* }}} */
+
+static char *write_config(void) /* {{{ */
+{
+	char *path = string("%s/bench-kernel.%i.conf", OPTIONS.workdir, getpid());
+	FILE *io = fopen(path, "w");
+	if (!io) {
+		fprintf(stderr, "failed to write %s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+
+	fprintf(io, "# generated by bench/kernel\n");
+	fprintf(io, "listener  %s\n", BENCH_LISTENER);
+	fprintf(io, "broadcast %s\n", BENCH_BROADCAST);
+	fprintf(io, "savefile  %s/bench-kernel.%i.save\n", OPTIONS.workdir, getpid());
+	fprintf(io, "keysfile  %s/bench-kernel.%i.keys\n", OPTIONS.workdir, getpid());
+	fprintf(io, "save.interval 3600\n");
+	fprintf(io, "max.events 10000\n");
+	fprintf(io, "grace.period 1\n");
+	fprintf(io, "listener.threads %i\n\n", OPTIONS.decoders);
+
+	fprintf(io, "type :bench {\n  freshness 3600\n  warning \"no data\"\n}\n");
+	fprintf(io, "window @bench %i\n", OPTIONS.window);
+	int i;
+	for (i = 0; i < OPTIONS.lanes; i++)
+		fprintf(io, "state :bench \"%s.%i\"\n", FENCE_NAME, i);
+
+	for (i = 0; i < OPTIONS.rules; i++) {
+		fprintf(io, "state   :bench m/^bench\\.state\\.r%i\\./\n", i);
+		fprintf(io, "counter @bench m/^bench\\.counter\\.r%i\\./\n", i);
+		fprintf(io, "sample  @bench m/^bench\\.sample\\.r%i\\./\n", i);
+		fprintf(io, "rate    @bench m/^bench\\.rate\\.r%i\\./\n", i);
+	}
+
+	fclose(io);
+	return path;
+}
+/* }}} */
+static void cleanup_files(const char *config) /* {{{ */
+{
+	char *s;
+	unlink(config);
+	s = string("%s/bench-kernel.%i.save", OPTIONS.workdir, getpid()); unlink(s); free(s);
+	s = string("%s/bench-kernel.%i.keys", OPTIONS.workdir, getpid()); unlink(s); free(s);
+}
+/* }}} */
+
+/*************************************************************************/
+
+/* wait for the broadcast of our fence update (in every lane), identified
+   by its summary (the sequence number it was sent with).  Every other
+   STATE broadcast is skipped over. */
+static int await_fence(void *sub, uint64_t seq, int timeout) /* {{{ */
+{
+	char want[32];
+	snprintf(want, sizeof(want), "%lu", (unsigned long)seq);
+	int seen = 0;
+
+	for (;;) {
+		zmq_pollitem_t poller[1] = { { sub, 0, ZMQ_POLLIN } };
+		int rc = zmq_poll(poller, 1, timeout);
+		if (rc <= 0)
+			return -1;
+
+		pdu_t *p = pdu_recv(sub);
+		if (!p)
+			continue;
+
+		int found = 0;
+		if (pdu_size(p) == 6) {
+			char *name = pdu_string(p, 1);
+			char *msg  = pdu_string(p, 5);
+			found = strncmp(name, FENCE_NAME ".", strlen(FENCE_NAME) + 1) == 0
+			     && strcmp(msg, want) == 0;
+			free(name);
+			free(msg);
+		}
+		pdu_free(p);
+		if (found && ++seen == OPTIONS.lanes)
+			return 0;
+	}
+}
+/* }}} */
+static void send_fence(void *push, uint64_t *seq) /* {{{ */
+{
+	/* with -j, decoders each keep their own queue, and submissions
+	   are spread across them by name; a fence has to go down every
+	   one of them to mean anything, so it goes out under enough
+	   names that every decoder (all but certainly) sees one. */
+	int i;
+	*seq = GEN.seq++;
+	for (i = 0; i < OPTIONS.lanes; i++)
+		pdu_send_and_free(make_fence(*seq, i), push);
+}
+/* }}} */
+static void fence(void *push, void *sub) /* {{{ */
+{
+	uint64_t seq;
+	send_fence(push, &seq);
+	if (await_fence(sub, seq, 10 * 1000) != 0) {
+		fprintf(stderr, "timed out waiting for kernel to process fence #%lu\n", (unsigned long)seq);
+		exit(3);
+	}
+}
+/* }}} */
+
+static void * sink_thread(void *zocket) /* {{{ */
+{
+	pdu_t *p;
+	while ((p = pdu_recv(zocket)) != NULL) {
+		int done = strcmp(pdu_type(p), "DONE") == 0;
+		pdu_free(p);
+		if (done)
+			break;
+	}
+	return NULL;
+}
+/* }}} */
+static double transport_allocs(void *zmq) /* {{{ */
+{
+	/* replay the throughput workload into a PULL socket that only
+	   receives and frees, to see what the transport costs us. */
+	void *pull = zmq_socket(zmq, ZMQ_PULL);
+	void *push = zmq_socket(zmq, ZMQ_PUSH);
+	if (!pull || !push
+	 || zmq_bind(pull, BENCH_SINK) != 0
+	 || zmq_connect(push, BENCH_SINK) != 0) {
+		fprintf(stderr, "failed to set up transport baseline sockets: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	pthread_t tid;
+	if (pthread_create(&tid, NULL, sink_thread, pull) != 0) {
+		perror("pthread_create");
+		exit(2);
+	}
+
+	/* only count what the sink thread does; see main() */
+	uint64_t i, mine = bench_thread_allocs(), before = bench_allocs();
+	for (i = 0; i < OPTIONS.messages; i++)
+		pdu_send_and_free(make_pdu(pick_type()), push);
+	pdu_send_and_free(pdu_make("DONE", 0), push);
+	pthread_join(tid, NULL);
+
+	uint64_t theirs = (bench_allocs() - before) - (bench_thread_allocs() - mine);
+	zmq_close(push);
+	zmq_close(pull);
+	return OPTIONS.messages ? (double)theirs / OPTIONS.messages : 0;
+}
+/* }}} */
+
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OPTIONS.messages = 200000;
+	OPTIONS.latency  = 20000;
+	OPTIONS.names    = 1000;
+	OPTIONS.rules    = 8;
+	OPTIONS.values   = 1;
+	OPTIONS.window   = 60;
+	OPTIONS.step     = 0;
+	OPTIONS.seed     = 1;
+	OPTIONS.mix      = strdup("state=20,counter=30,sample=30,rate=15,event=4,keys=1");
+	OPTIONS.workdir  = strdup("/tmp");
+
+	struct option long_opts[] = {
+		{ "help",           no_argument, NULL, 'h' },
+		{ "messages", required_argument, NULL, 'n' },
+		{ "latency",  required_argument, NULL, 'l' },
+		{ "mix",      required_argument, NULL, 'm' },
+		{ "names",    required_argument, NULL, 'c' },
+		{ "rules",    required_argument, NULL, 'r' },
+		{ "values",   required_argument, NULL, 'v' },
+		{ "window",   required_argument, NULL, 'w' },
+		{ "step",     required_argument, NULL, 't' },
+		{ "seed",     required_argument, NULL, 's' },
+		{ "decoders", required_argument, NULL, 'j' },
+		{ "tsdp",           no_argument, NULL, 'T' },
+		{ "workdir",  required_argument, NULL, 'd' },
+		{ "debug",          no_argument, NULL, 'D' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?n:l:m:c:r:v:w:t:s:j:Td:D", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'n': OPTIONS.messages = strtoull(optarg, NULL, 10); break;
+		case 'l': OPTIONS.latency  = strtoull(optarg, NULL, 10); break;
+		case 'm': free(OPTIONS.mix); OPTIONS.mix = strdup(optarg); break;
+		case 'c': OPTIONS.names    = atoi(optarg); break;
+		case 'r': OPTIONS.rules    = atoi(optarg); break;
+		case 'v': OPTIONS.values   = atoi(optarg); break;
+		case 'w': OPTIONS.window   = atoi(optarg); break;
+		case 't': OPTIONS.step     = atoi(optarg); break;
+		case 's': OPTIONS.seed     = strtoull(optarg, NULL, 10); break;
+		case 'j': OPTIONS.decoders = atoi(optarg); break;
+		case 'T': OPTIONS.tsdp     = 1; break;
+		case 'd': free(OPTIONS.workdir); OPTIONS.workdir = strdup(optarg); break;
+		case 'D': OPTIONS.verbose  = 1; break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+
+	if (bench_parse_mix(OPTIONS.mix, TYPES, OPTIONS.weight, NTYPES) != 0)
+		exit(1);
+	int i;
+	for (i = 0; i < NTYPES; i++)
+		OPTIONS.total += OPTIONS.weight[i];
+	if (OPTIONS.total <= 0 || OPTIONS.names < 1 || OPTIONS.rules < 1
+	 || OPTIONS.values < 1 || OPTIONS.window < 1 || OPTIONS.decoders < 0) {
+		fprintf(stderr, "invalid workload; see -h\n");
+		exit(1);
+	}
+	OPTIONS.lanes = OPTIONS.decoders > 0 ? 16 * OPTIONS.decoders : 1;
+
+	/* the kernel complains about the missing save / keys files at
+	   LOG_ERR; that's expected, so we only show critical errors. */
+	log_open("bench/kernel", "stderr");
+	log_level(OPTIONS.verbose ? LOG_DEBUG : LOG_CRIT, NULL);
+
+	char *config = write_config();
+
+	server_t *svr = vmalloc(sizeof(server_t));
+	svr->config.grace_period = DEFAULT_GRACE_PERIOD;
+	svr->config.save_size    = DEFAULT_SAVE_SIZE;
+	svr->config.topk_size     = DEFAULT_TOPK_SIZE;
+	svr->config.topk_interval = DEFAULT_TOPK_INTERVAL;
+	svr->interval.tick       = 1000;
+	svr->interval.freshness  = 2;
+	svr->interval.savestate  = DEFAULT_SAVE_INTERVAL;
+	svr->interval.sweep      = DEFAULT_SWEEP;
+	if (configure(config, svr) != 0) {
+		fprintf(stderr, "failed to configure kernel from generated %s\n", config);
+		exit(2);
+	}
+
+	void *zmq = zmq_ctx_new();
+	if (!zmq) {
+		fprintf(stderr, "failed to initialize 0MQ\n");
+		exit(2);
+	}
+
+	/* we stand in for the supervisor, so that we can shut things down */
+	void *command = zmq_socket(zmq, ZMQ_PUB);
+	if (!command || zmq_bind(command, "inproc://bolo/v1/supervisor.command") != 0) {
+		fprintf(stderr, "failed to bind supervisor.command: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	long rss_base = bench_rss_kb();
+	if (core_kernel_thread(zmq, svr) != 0
+	 || core_scheduler_thread(zmq, 1000) != 0) {
+		fprintf(stderr, "failed to start kernel / scheduler threads: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	/* unlimited high-water mark, so PUB never drops our fences */
+	int hwm = 0;
+	void *sub  = zmq_socket(zmq, ZMQ_SUB);
+	void *push = zmq_socket(zmq, ZMQ_PUSH);
+	if (!sub || !push
+	 || zmq_setsockopt(sub, ZMQ_RCVHWM, &hwm, sizeof(hwm)) != 0
+	 || zmq_setsockopt(sub, ZMQ_SUBSCRIBE, "STATE", 5) != 0
+	 || zmq_connect(sub,  BENCH_BROADCAST) != 0
+	 || zmq_connect(push, BENCH_LISTENER) != 0) {
+		fprintf(stderr, "failed to connect to kernel: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	uint64_t seq, t0, t1, a0, a1;
+	GEN.rng   = OPTIONS.seed ? OPTIONS.seed : 1;
+	GEN.start = time_s();
+
+	/* make sure the kernel is up, and our subscription has made it to
+	   the broadcast socket, before we start timing anything */
+	for (i = 0; ; i++) {
+		send_fence(push, &seq);
+		if (await_fence(sub, seq, 100) == 0)
+			break;
+		if (i == 100) {
+			fprintf(stderr, "kernel never came up\n");
+			exit(3);
+		}
+	}
+
+	/* phase 1: throughput {{{ */
+	fprintf(stderr, "throughput: sending %lu messages...\n", (unsigned long)OPTIONS.messages);
+
+	/* this (main) thread builds, sends and subscribes; none of that is
+	   the kernel's doing, so allocations are counted as everything
+	   that happened on every *other* thread. */
+	uint64_t n, sent[NTYPES] = { 0 };
+	uint64_t mine = bench_thread_allocs();
+	a0 = bench_allocs();
+	t0 = bench_ns();
+	for (n = 0; n < OPTIONS.messages; n++) {
+		int type = pick_type();
+		sent[type]++;
+		pdu_send_and_free(make_pdu(type), push);
+	}
+	fence(push, sub);
+	t1 = bench_ns();
+	a1 = (bench_allocs() - a0) - (bench_thread_allocs() - mine);
+	long rss_after = bench_rss_kb();
+	/* }}} */
+
+	/* phase 2: latency {{{ */
+	fprintf(stderr, "latency: timing %lu messages...\n", (unsigned long)OPTIONS.latency);
+	bench_lat_t lat[NTYPES + 1];
+	memset(lat, 0, sizeof(lat));
+	for (n = 0; n < OPTIONS.latency; n++) {
+		/* every so often, time a bare fence as the baseline */
+		int type = (n % 16 == 0) ? T_FENCE : pick_type();
+		pdu_t *p = type == T_FENCE ? NULL : make_pdu(type);
+
+		uint64_t start = bench_ns();
+		if (p)
+			pdu_send_and_free(p, push);
+		fence(push, sub);
+		bench_lat_add(&lat[type], bench_ns() - start);
+	}
+	/* }}} */
+
+	/* phase 3: transport baseline {{{ */
+	fprintf(stderr, "baseline: replaying workload through a bare PULL socket...\n");
+	GEN.rng = OPTIONS.seed ? OPTIONS.seed : 1;
+	double transport = transport_allocs(zmq);
+	/* }}} */
+
+	double secs = (t1 - t0) / 1e9;
+	double total_allocs = OPTIONS.messages ? (double)a1 / OPTIONS.messages : 0;
+
+	printf("---\n");
+	printf("# generated by bench/kernel\n");
+	printf("benchmark: kernel\n");
+	printf("workload:\n");
+	printf("  messages: %lu\n", (unsigned long)OPTIONS.messages);
+	printf("  latency_samples: %lu\n", (unsigned long)OPTIONS.latency);
+	printf("  mix: \"%s\"\n", OPTIONS.mix);
+	printf("  names_per_type: %i\n", OPTIONS.names);
+	printf("  rules_per_type: %i\n", OPTIONS.rules);
+	printf("  values_per_sample: %i\n", OPTIONS.values);
+	printf("  window: %i\n", OPTIONS.window);
+	printf("  step: %i\n", OPTIONS.step);
+	printf("  seed: %lu\n", (unsigned long)OPTIONS.seed);
+	printf("  decoders: %i\n", OPTIONS.decoders);
+	printf("  wire: %s\n", OPTIONS.tsdp ? "tsdp" : "text");
+	printf("throughput:\n");
+	printf("  seconds: %.6f\n", secs);
+	printf("  msgs_per_sec: %.1f\n", secs > 0 ? OPTIONS.messages / secs : 0);
+	printf("  sent:\n");
+	for (i = 0; i < NTYPES; i++)
+		printf("    %s: %lu\n", TYPES[i], (unsigned long)sent[i]);
+	printf("allocations:\n");
+	printf("  per_msg: %.2f\n", total_allocs);
+	printf("  transport_per_msg: %.2f\n", transport);
+	printf("  kernel_per_msg: %.2f\n", total_allocs - transport);
+	printf("memory:\n");
+	printf("  rss_start_kb: %li\n", rss_base);
+	printf("  rss_end_kb: %li\n", rss_after);
+	printf("  rss_peak_kb: %li\n", bench_rss_peak_kb());
+	printf("latency:\n");
+	for (i = 0; i <= NTYPES; i++) {
+		if (lat[i].n == 0)
+			continue;
+		bench_lat_yaml(stdout, "  ", TYPES[i], &lat[i]);
+		bench_lat_free(&lat[i]);
+	}
+
+	pdu_send_and_free(pdu_make("TERMINATE", 0), command);
+	zmq_close(push);
+	zmq_close(sub);
+	zmq_close(command);
+	/* give the kernel a moment to tear itself down */
+	sleep(1);
+
+	cleanup_files(config);
+	free(config);
+	free(OPTIONS.mix);
+	free(OPTIONS.workdir);
+	return 0;
+}
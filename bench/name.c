@@ -0,0 +1,253 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/name - what qualified names cost, parsed and searched
+
+   This builds -c tagged names, of the sort every metric would get
+   (host=web042,dc=dc3,svc=nginx,m=requests,type=counter), and times:
+
+     parse_cold    bolo_name_parse() of a name it hasn't seen
+     parse_warm    bolo_name_parse() of one it has
+     equal         bolo_name_equal() of two separately parsed names
+     match         bolo_name_match() against a pattern with wildcards
+
+   Then it indexes all of them, and looks up -q patterns (one host's
+   metrics, one service in one datacenter, everything of one type),
+   through bolo_name_index_search() and by bolo_name_match()ing every
+   name in turn.  It reports nanoseconds per query both ways, and the
+   speedup; the two have to find the same number of names, or it
+   exits non-zero.
+ */
+
+#include "bench.h"
+#include <bolo.h>
+#include <string.h>
+#include <getopt.h>
+
+static struct {
+	int       count;     /* -c */
+	int       queries;   /* -q */
+	uint64_t  rounds;    /* -n */
+	uint64_t  seed;      /* -S */
+} OPTIONS = { 0 };
+
+static uint64_t SINK = 0;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/name [options]\n\n");
+	printf("Options:\n");
+	printf("  -c, --count N        distinct names (default 100000)\n");
+	printf("  -q, --queries N      index lookups, each way (default 300)\n");
+	printf("  -n, --rounds N       parses / compares to time (default 2000000)\n");
+	printf("  -S, --seed N         workload random seed (default 1)\n");
+}
+/* }}} */
+
+static char* name_for(int i) /* {{{ */
+{
+	static const char *svc[]  = { "nginx", "postgres", "redis", "haproxy", "bolo", "sshd" };
+	static const char *m[]    = { "requests", "errors", "latency", "conns", "cpu", "mem", "disk" };
+	static const char *type[] = { "counter", "sample", "rate" };
+	char buf[256];
+
+	/* 21 metrics per host, so no two are the same */
+	snprintf(buf, sizeof(buf), "m=%s,host=web%05i,type=%s,dc=dc%i,svc=%s",
+		m[i % 7], i / 21, type[i / 7 % 3], (int)(i / 21 % 8), svc[i / 21 % 6]);
+	return strdup(buf);
+}
+/* }}} */
+static char* pattern_for(int q, uint64_t *rng) /* {{{ */
+{
+	static const char *svc[]  = { "nginx", "postgres", "redis", "haproxy", "bolo", "sshd" };
+	char buf[256];
+
+	switch (q % 3) {
+	case 0:
+		snprintf(buf, sizeof(buf), "host=web%05i,*", (int)(bench_rand(rng) % (OPTIONS.count / 21 + 1)));
+		break;
+	case 1:
+		snprintf(buf, sizeof(buf), "svc=%s,dc=dc%i,m=*,*", svc[bench_rand(rng) % 6], (int)(bench_rand(rng) % 8));
+		break;
+	default:
+		snprintf(buf, sizeof(buf), "type=rate,m=errors,*");
+		break;
+	}
+	return strdup(buf);
+}
+/* }}} */
+
+static int count(bolo_name_t name, void *data, void *arg) /* {{{ */
+{
+	SINK += (uintptr_t)data;
+	return 0;
+}
+/* }}} */
+
+int main(int argc, char **argv)
+{
+	OPTIONS.count   = 100000;
+	OPTIONS.queries = 300;
+	OPTIONS.rounds  = 2000000;
+	OPTIONS.seed    = 1;
+
+	struct option long_opts[] = {
+		{ "help",          no_argument, NULL, 'h' },
+		{ "count",   required_argument, NULL, 'c' },
+		{ "queries", required_argument, NULL, 'q' },
+		{ "rounds",  required_argument, NULL, 'n' },
+		{ "seed",    required_argument, NULL, 'S' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?c:q:n:S:", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'c': OPTIONS.count   = atoi(optarg); break;
+		case 'q': OPTIONS.queries = atoi(optarg); break;
+		case 'n': OPTIONS.rounds  = strtoull(optarg, NULL, 10); break;
+		case 'S': OPTIONS.seed    = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+	if (OPTIONS.count < 1 || OPTIONS.queries < 1 || OPTIONS.rounds < 1) {
+		fprintf(stderr, "bad options; see --help\n");
+		return 1;
+	}
+
+	uint64_t rng = OPTIONS.seed, t0, i, a0;
+	int j, bad = 0;
+
+	fprintf(stderr, "parsing %i names, twice...\n", OPTIONS.count);
+	char **raw = calloc(OPTIONS.count, sizeof(char *));
+	bolo_name_t *names = calloc(OPTIONS.count, sizeof(bolo_name_t));
+	for (j = 0; j < OPTIONS.count; j++)
+		raw[j] = name_for(j);
+
+	t0 = bench_ns();
+	for (j = 0; j < OPTIONS.count; j++)
+		names[j] = bolo_name_parse(raw[j]);
+	double cold = (double)(bench_ns() - t0) / OPTIONS.count;
+
+	a0 = bench_allocs();
+	t0 = bench_ns();
+	for (i = 0; i < OPTIONS.rounds; i++) {
+		bolo_name_t n = bolo_name_parse(raw[i % OPTIONS.count]);
+		SINK += bolo_name_hash(n);
+		bolo_name_free(n);
+	}
+	double warm = (double)(bench_ns() - t0) / OPTIONS.rounds;
+	double allocs = (double)(bench_allocs() - a0) / OPTIONS.rounds;
+
+	fprintf(stderr, "comparing and matching...\n");
+	bolo_name_t *again = calloc(OPTIONS.count, sizeof(bolo_name_t));
+	for (j = 0; j < OPTIONS.count; j++) {
+		again[j] = bolo_name_parse(raw[j]);
+		if (!bolo_name_equal(names[j], again[j]))
+			bad++;
+	}
+	t0 = bench_ns();
+	for (i = 0; i < OPTIONS.rounds; i++)
+		SINK += bolo_name_equal(names[i % OPTIONS.count], again[(i * 7) % OPTIONS.count]);
+	double equal = (double)(bench_ns() - t0) / OPTIONS.rounds;
+
+	bolo_name_t wild = bolo_name_parse("svc=nginx,m=*,*");
+	t0 = bench_ns();
+	for (i = 0; i < OPTIONS.rounds; i++)
+		SINK += bolo_name_match(names[i % OPTIONS.count], wild);
+	double match = (double)(bench_ns() - t0) / OPTIONS.rounds;
+
+	fprintf(stderr, "indexing %i names...\n", OPTIONS.count);
+	bolo_name_index_t idx = bolo_name_index_new();
+	t0 = bench_ns();
+	for (j = 0; j < OPTIONS.count; j++)
+		bolo_name_index_add(idx, names[j], (void *)(uintptr_t)1);
+	double add = (double)(bench_ns() - t0) / OPTIONS.count;
+
+	fprintf(stderr, "running %i queries, each way...\n", OPTIONS.queries);
+	uint64_t indexed = 0, scanned = 0, found = 0;
+	for (j = 0; j < OPTIONS.queries; j++) {
+		char *s = pattern_for(j, &rng);
+		bolo_name_t pattern = bolo_name_parse(s);
+		int k, a = 0, b;
+
+		t0 = bench_ns();
+		b = bolo_name_index_search(idx, pattern, count, NULL);
+		indexed += bench_ns() - t0;
+
+		t0 = bench_ns();
+		for (k = 0; k < OPTIONS.count; k++)
+			if (bolo_name_match(names[k], pattern) == 0)
+				a++;
+		scanned += bench_ns() - t0;
+
+		if (a != b) {
+			fprintf(stderr, "%s: the index found %i names, but there are %i\n", s, b, a);
+			bad++;
+		}
+		found += b;
+		bolo_name_free(pattern);
+		free(s);
+	}
+
+	printf("---\n");
+	printf("# generated by bench/name\n");
+	printf("benchmark: name\n");
+	printf("workload:\n");
+	printf("  count: %i\n",   OPTIONS.count);
+	printf("  queries: %i\n", OPTIONS.queries);
+	printf("  rounds: %lu\n", (unsigned long)OPTIONS.rounds);
+	printf("  seed: %lu\n",   (unsigned long)OPTIONS.seed);
+	printf("parse_cold_ns: %.1f\n", cold);
+	printf("parse_warm_ns: %.1f\n", warm);
+	printf("parse_warm_allocs: %.2f\n", allocs);
+	printf("equal_ns: %.1f\n", equal);
+	printf("match_ns: %.1f\n", match);
+	printf("index_add_ns: %.1f\n", add);
+	printf("search:\n");
+	printf("  found_per_query: %.1f\n", (double)found / OPTIONS.queries);
+	printf("  index_us: %.2f\n", (double)indexed / OPTIONS.queries / 1000.);
+	printf("  scan_us: %.2f\n",  (double)scanned / OPTIONS.queries / 1000.);
+	printf("  speedup: %.1f\n",  indexed ? (double)scanned / indexed : 0);
+	printf("mismatches: %i\n", bad);
+
+	if (SINK == 42) /* keep the work from being optimized away */
+		fprintf(stderr, "\n");
+
+	bolo_name_index_free(idx);
+	bolo_name_free(wild);
+	for (j = 0; j < OPTIONS.count; j++) {
+		bolo_name_free(names[j]);
+		bolo_name_free(again[j]);
+		free(raw[j]);
+	}
+	free(names);
+	free(again);
+	free(raw);
+	return bad ? 1 : 0;
+}
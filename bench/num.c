@@ -0,0 +1,265 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/num - libbolo's number codec, against printf() and strto*()
+
+   This builds -c values of the sort that go through PDU frames:
+   timestamps and counter values (integers), and sample values, which
+   are a mix of short decimals (as submitted) and means of a few of
+   those (as computed).  It then times -n rounds (cycling through
+   them) of each conversion, both the libc way and the libbolo way:
+
+     utoa          "%lu"    vs. bolo_utoa()
+     etoa          "%e"     vs. bolo_etoa()    (what broadcasts use)
+     dtoa          "%.17g"  vs. bolo_dtoa()    (what SAMPLE.AGG uses)
+     strtou        strtoull vs. bolo_strtou()
+     strtod_short  strtod   vs. bolo_strtod(), on short decimals
+     strtod_e      strtod   vs. bolo_strtod(), on "%e" strings
+     strtod_17g    strtod   vs. bolo_strtod(), on "%.17g" strings
+
+   For each, it reports nanoseconds per conversion both ways, and the
+   speedup.  Every libbolo result is checked against libc's (the same
+   string, or the same double); any mismatch is a non-zero exit.
+ */
+
+#include "bench.h"
+#include <bolo.h>
+#include <string.h>
+#include <getopt.h>
+
+static struct {
+	uint64_t  rounds;    /* -n */
+	int       count;     /* -c */
+	uint64_t  seed;      /* -S */
+} OPTIONS = { 0 };
+
+typedef struct {
+	uint64_t  u;
+	double    d;
+	char      s_short[BOLO_NUM_MAX];
+	char      s_e[BOLO_NUM_MAX];
+	char      s_17g[BOLO_NUM_MAX];
+} value_t;
+
+typedef struct {
+	uint64_t libc;
+	uint64_t bolo;
+} result_t;
+
+static uint64_t SINK = 0;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/num [options]\n\n");
+	printf("Options:\n");
+	printf("  -n, --rounds N       conversions per test, each way (default 5000000)\n");
+	printf("  -c, --count N        distinct values to cycle through (default 1000)\n");
+	printf("  -S, --seed N         workload random seed (default 1)\n");
+}
+/* }}} */
+
+static value_t* corpus(void) /* {{{ */
+{
+	value_t *all = calloc(OPTIONS.count, sizeof(value_t));
+	uint64_t rng = OPTIONS.seed;
+	int i, j;
+
+	for (i = 0; i < OPTIONS.count; i++) {
+		value_t *v = &all[i];
+		v->u = i % 2 ? 1476000000 + i : bench_rand(&rng) % 10000000;
+
+		/* half as submitted (1.5, 42.125), half as computed (means) */
+		snprintf(v->s_short, sizeof(v->s_short), "%lu.%0*lu",
+			(unsigned long)(bench_rand(&rng) % 10000), (int)(bench_rand(&rng) % 3 + 1),
+			(unsigned long)(bench_rand(&rng) % 1000));
+		v->d = strtod(v->s_short, NULL);
+		if (i % 2) {
+			int n = bench_rand(&rng) % 8 + 2;
+			for (j = 1; j < n; j++)
+				v->d += (bench_rand(&rng) % 100000) / 100.0;
+			v->d /= n;
+		}
+		snprintf(v->s_e,   sizeof(v->s_e),   "%e",    v->d);
+		snprintf(v->s_17g, sizeof(v->s_17g), "%.17g", v->d);
+	}
+	return all;
+}
+/* }}} */
+
+#define TIME(into, body) do { \
+	uint64_t t0 = bench_ns(); \
+	for (i = 0; i < OPTIONS.rounds; i++) { \
+		value_t *v = &all[i % OPTIONS.count]; \
+		body; \
+	} \
+	(into) = bench_ns() - t0; \
+} while (0)
+
+static result_t bench_format(value_t *all, int what, int *bad) /* {{{ */
+{
+	result_t r;
+	char a[64], b[BOLO_NUM_MAX];
+	uint64_t i;
+
+	switch (what) {
+	case 'u':
+		TIME(r.libc, SINK += snprintf(a, sizeof(a), "%lu", (unsigned long)v->u));
+		TIME(r.bolo, SINK += bolo_utoa(b, v->u));
+		break;
+	case 'e':
+		TIME(r.libc, SINK += snprintf(a, sizeof(a), "%e", v->d));
+		TIME(r.bolo, SINK += bolo_etoa(b, v->d));
+		break;
+	case 'g':
+		TIME(r.libc, SINK += snprintf(a, sizeof(a), "%.17g", v->d));
+		TIME(r.bolo, SINK += bolo_dtoa(b, v->d));
+		break;
+	}
+
+	/* and check what we just timed */
+	for (i = 0; i < (uint64_t)OPTIONS.count; i++) {
+		value_t *v = &all[i];
+		switch (what) {
+		case 'u': snprintf(a, sizeof(a), "%lu", (unsigned long)v->u); bolo_utoa(b, v->u); break;
+		case 'e': snprintf(a, sizeof(a), "%e", v->d);                 bolo_etoa(b, v->d); break;
+		case 'g': snprintf(a, sizeof(a), "%.17g", v->d);              bolo_dtoa(b, v->d); break;
+		}
+		/* dtoa is shorter than %.17g; it only has to read back the same */
+		if (what == 'g' ? strtod(a, NULL) != strtod(b, NULL) : strcmp(a, b) != 0)
+			(*bad)++;
+	}
+	return r;
+}
+/* }}} */
+static result_t bench_parse(value_t *all, int what, int *bad) /* {{{ */
+{
+	result_t r;
+	uint64_t i;
+
+	switch (what) {
+	case 'u':
+		TIME(r.libc, SINK += strtoull(v->s_short, NULL, 10));
+		TIME(r.bolo, SINK += bolo_strtou(v->s_short, NULL));
+		break;
+	case 's':
+		TIME(r.libc, SINK += strtod(v->s_short, NULL));
+		TIME(r.bolo, SINK += bolo_strtod(v->s_short, NULL));
+		break;
+	case 'e':
+		TIME(r.libc, SINK += strtod(v->s_e, NULL));
+		TIME(r.bolo, SINK += bolo_strtod(v->s_e, NULL));
+		break;
+	case 'g':
+		TIME(r.libc, SINK += strtod(v->s_17g, NULL));
+		TIME(r.bolo, SINK += bolo_strtod(v->s_17g, NULL));
+		break;
+	}
+
+	for (i = 0; i < (uint64_t)OPTIONS.count; i++) {
+		value_t *v = &all[i];
+		const char *s = what == 'e' ? v->s_e : what == 'g' ? v->s_17g : v->s_short;
+		if (what == 'u' ? strtoull(s, NULL, 10) != bolo_strtou(s, NULL)
+		                : strtod(s, NULL) != bolo_strtod(s, NULL))
+			(*bad)++;
+	}
+	return r;
+}
+/* }}} */
+
+static void report(const char *key, result_t *r) /* {{{ */
+{
+	printf("%s:\n", key);
+	printf("  libc_ns: %.1f\n", (double)r->libc / OPTIONS.rounds);
+	printf("  bolo_ns: %.1f\n", (double)r->bolo / OPTIONS.rounds);
+	printf("  speedup: %.2f\n", r->bolo ? (double)r->libc / r->bolo : 0);
+}
+/* }}} */
+
+int main(int argc, char **argv)
+{
+	OPTIONS.rounds = 5000000;
+	OPTIONS.count  = 1000;
+	OPTIONS.seed   = 1;
+
+	struct option long_opts[] = {
+		{ "help",         no_argument, NULL, 'h' },
+		{ "rounds", required_argument, NULL, 'n' },
+		{ "count",  required_argument, NULL, 'c' },
+		{ "seed",   required_argument, NULL, 'S' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?n:c:S:", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'n': OPTIONS.rounds = strtoull(optarg, NULL, 10); break;
+		case 'c': OPTIONS.count  = atoi(optarg); break;
+		case 'S': OPTIONS.seed   = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+	if (OPTIONS.rounds < 1 || OPTIONS.count < 1) {
+		fprintf(stderr, "bad options; see --help\n");
+		return 1;
+	}
+
+	fprintf(stderr, "building %i values...\n", OPTIONS.count);
+	value_t *all = corpus();
+	int bad = 0;
+
+	fprintf(stderr, "formatting %lu values, each way...\n", (unsigned long)OPTIONS.rounds);
+	result_t utoa = bench_format(all, 'u', &bad);
+	result_t etoa = bench_format(all, 'e', &bad);
+	result_t dtoa = bench_format(all, 'g', &bad);
+	fprintf(stderr, "parsing %lu values, each way...\n", (unsigned long)OPTIONS.rounds);
+	result_t strtou = bench_parse(all, 'u', &bad);
+	result_t shortd = bench_parse(all, 's', &bad);
+	result_t ed     = bench_parse(all, 'e', &bad);
+	result_t gd     = bench_parse(all, 'g', &bad);
+
+	printf("---\n");
+	printf("# generated by bench/num\n");
+	printf("benchmark: num\n");
+	printf("workload:\n");
+	printf("  rounds: %lu\n", (unsigned long)OPTIONS.rounds);
+	printf("  count: %i\n",   OPTIONS.count);
+	printf("  seed: %lu\n",   (unsigned long)OPTIONS.seed);
+	report("utoa",         &utoa);
+	report("etoa",         &etoa);
+	report("dtoa",         &dtoa);
+	report("strtou",       &strtou);
+	report("strtod_short", &shortd);
+	report("strtod_e",     &ed);
+	report("strtod_17g",   &gd);
+	printf("mismatches: %i\n", bad);
+
+	if (SINK == 42) /* keep the conversions from being optimized away */
+		fprintf(stderr, "\n");
+	free(all);
+	return bad ? 1 : 0;
+}
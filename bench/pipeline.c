@@ -0,0 +1,696 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/pipeline - end-to-end latency, from submission to subscriber
+
+   This spins up a real `bolo aggr` process (with a generated config)
+   on localhost ports, a number of load-generating client threads
+   that PUSH at its listener, and a number of subscriber threads that
+   SUB to its broadcast port.  The subscribers are wired up with the
+   same libbolo scaffolding that the bolo2* subscribers use, and the
+   whole thing is shut down by the subscriber supervisor, when the
+   timer thread sends it a SIGTERM.
+
+   STATE and EVENT submissions carry their send time (on the shared
+   monotonic clock) in the summary / extra fields, so we get a true
+   per-message latency for them.
+
+   COUNTER, SAMPLE and RATE data only comes back out once per window,
+   so for those we track, per metric and window, when the last value
+   was submitted.  Reported are:
+
+     latency             broadcast arrival - last submission in window
+     window_close_delay  broadcast arrival - end of window (wall clock)
+
+   The second number is dominated by the aggregator's grace period
+   and tick interval, and is what a subscriber actually waits for.
+ */
+
+#include "bench.h"
+#include <vigor.h>
+#include <bolo.h>
+
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define T_STATE   0
+#define T_COUNTER 1
+#define T_SAMPLE  2
+#define T_RATE    3
+#define T_EVENT   4
+#define NTYPES    5
+
+static const char *TYPES[NTYPES] = {
+	"state", "counter", "sample", "rate", "event",
+};
+static const char *PDUS[NTYPES] = {
+	"STATE", "COUNTER", "SAMPLE", "RATE", "EVENT",
+};
+
+/* the last few windows each aggregated metric has seen */
+#define WINDOW_SLOTS 4
+typedef struct {
+	int32_t  start;
+	uint64_t last_ns;
+} wslot_t;
+
+static struct {
+	char     *bolo;      /* -b */
+	int       port;      /* -p */
+	int       clients;   /* -C */
+	int       subs;      /* -S */
+	int       rate;      /* -r, per client */
+	int       duration;  /* -d */
+	int       names;     /* -c, per client */
+	int       window;    /* -w */
+	int       grace;     /* -g */
+	char     *mix;       /* -m */
+	char     *workdir;   /* -D */
+	int       verbose;   /* -v */
+
+	int       weight[NTYPES];
+	int       total;
+} OPTIONS = { 0 };
+
+static char *LISTENER;
+static char *BROADCAST;
+
+static wslot_t *WINDOWS[NTYPES];
+static uint64_t SENT[NTYPES];
+
+typedef struct {
+	pthread_t   tid;
+	int         id;
+	void       *control;
+	void       *push;
+	uint64_t    rng;
+	uint64_t    sent[NTYPES];
+} client_t;
+
+typedef struct {
+	pthread_t   tid;
+	void       *control;
+	void       *sub;
+	reactor_t  *reactor;
+
+	uint64_t    received[NTYPES];
+	bench_lat_t latency[NTYPES];
+	bench_lat_t close_delay[NTYPES];
+} subscriber_t;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/pipeline [options]\n\n");
+	printf("Options:\n");
+	printf("  -b, --bolo PATH      path to the bolo binary (default ./bolo)\n");
+	printf("  -p, --port N         base TCP port; uses N (listener), N+1 (controller)\n");
+	printf("                       and N+2 (broadcast) on 127.0.0.1 (default 29990)\n");
+	printf("  -C, --clients N      load-generating clients (default 2)\n");
+	printf("  -S, --subscribers N  subscribers (default 1)\n");
+	printf("  -r, --rate N         messages/second per client, 0 for flat-out (default 5000)\n");
+	printf("  -d, --duration N     seconds to generate load for (default 10)\n");
+	printf("  -c, --names N        distinct metric names per type, per client (default 100)\n");
+	printf("  -m, --mix SPEC       PDU mix, as type=weight,... (types: state, counter,\n");
+	printf("                       sample, rate, event)\n");
+	printf("                       (default state=25,counter=25,sample=25,rate=20,event=5)\n");
+	printf("  -w, --window N       aggregation window, in seconds (default 2)\n");
+	printf("  -g, --grace N        aggregator grace period, in seconds (default 1)\n");
+	printf("  -D, --workdir PATH   scratch directory for config, logs and state (default /tmp)\n");
+	printf("  -v, --verbose        show the aggregator's (info-level) logs on exit\n");
+}
+/* }}} */
+
+static uint64_t wall_ns(void) /* {{{ */
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/* }}} */
+static wslot_t *slot(int type, int client, int id, int32_t start) /* {{{ */
+{
+	size_t i = ((size_t)client * OPTIONS.names + id) * WINDOW_SLOTS
+	         + (start / OPTIONS.window) % WINDOW_SLOTS;
+	return &WINDOWS[type][i];
+}
+/* }}} */
+
+static char *path(const char *file) /* {{{ */
+{
+	return string("%s/bench-pipeline.%i.%s", OPTIONS.workdir, getpid(), file);
+}
+/* }}} */
+static char *write_config(void) /* {{{ */
+{
+	char *file = path("conf");
+	FILE *io = fopen(file, "w");
+	if (!io) {
+		fprintf(stderr, "failed to write %s: %s\n", file, strerror(errno));
+		exit(2);
+	}
+
+	char *s;
+	fprintf(io, "# generated by bench/pipeline\n");
+	fprintf(io, "listener   tcp://127.0.0.1:%i\n", OPTIONS.port);
+	fprintf(io, "controller tcp://127.0.0.1:%i\n", OPTIONS.port + 1);
+	fprintf(io, "broadcast  tcp://127.0.0.1:%i\n", OPTIONS.port + 2);
+	fprintf(io, "log %s daemon\n", OPTIONS.verbose ? "info" : "error");
+	s = path("pid");  fprintf(io, "pidfile  %s\n", s); free(s);
+	s = path("save"); fprintf(io, "savefile %s\n", s); free(s);
+	s = path("keys"); fprintf(io, "keysfile %s\n", s); free(s);
+	fprintf(io, "save.interval 3600\n");
+	fprintf(io, "max.events 1000\n");
+	fprintf(io, "grace.period %i\n\n", OPTIONS.grace);
+
+	fprintf(io, "type :bench {\n  freshness 3600\n  warning \"no data\"\n}\n");
+	fprintf(io, "window @bench %i\n", OPTIONS.window);
+	fprintf(io, "state   :bench m/^bench\\./\n");
+	fprintf(io, "counter @bench m/^bench\\.counter\\./\n");
+	fprintf(io, "sample  @bench m/^bench\\.sample\\./\n");
+	fprintf(io, "rate    @bench m/^bench\\.rate\\./\n");
+
+	fclose(io);
+	return file;
+}
+/* }}} */
+static pid_t spawn_aggregator(const char *config) /* {{{ */
+{
+	char *log = path("log");
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(2);
+	}
+
+	if (pid == 0) {
+		int fd = open(log, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		if (fd >= 0) {
+			dup2(fd, 1);
+			dup2(fd, 2);
+			close(fd);
+		}
+		execl(OPTIONS.bolo, OPTIONS.bolo, "aggr", "-Fc", config, NULL);
+		fprintf(stderr, "exec %s failed: %s\n", OPTIONS.bolo, strerror(errno));
+		exit(127);
+	}
+
+	free(log);
+	return pid;
+}
+/* }}} */
+static void await_aggregator(void *zmq) /* {{{ */
+{
+	/* keep poking the listener with a STATE update until it shows
+	   up on the broadcast port; that also takes care of the 0MQ
+	   "slow joiner" problem for our own subscription. */
+	void *push = zmq_socket(zmq, ZMQ_PUSH);
+	void *sub  = zmq_socket(zmq, ZMQ_SUB);
+	if (!push || !sub
+	 || zmq_setsockopt(sub, ZMQ_SUBSCRIBE, "STATE", 5) != 0
+	 || zmq_connect(push, LISTENER) != 0
+	 || zmq_connect(sub, BROADCAST) != 0) {
+		fprintf(stderr, "failed to connect to aggregator: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	int i;
+	for (i = 0; i < 100; i++) {
+		pdu_send_and_free(bolo_state_pdu("bench.ready", 0, "ready"), push);
+
+		zmq_pollitem_t poller[1] = { { sub, 0, ZMQ_POLLIN } };
+		if (zmq_poll(poller, 1, 100) > 0) {
+			pdu_free(pdu_recv(sub));
+			vzmq_shutdown(push, 0);
+			vzmq_shutdown(sub, 0);
+			return;
+		}
+	}
+	fprintf(stderr, "aggregator never came up; check %s/bench-pipeline.%i.log\n",
+		OPTIONS.workdir, getpid());
+	exit(3);
+}
+/* }}} */
+
+/*************************************************************************/
+
+static int pick_type(uint64_t *rng) /* {{{ */
+{
+	int i, r = bench_rand(rng) % OPTIONS.total;
+	for (i = 0; i < NTYPES; i++) {
+		if (r < OPTIONS.weight[i])
+			return i;
+		r -= OPTIONS.weight[i];
+	}
+	return NTYPES - 1;
+}
+/* }}} */
+static void * _client_thread(void *_) /* {{{ */
+{
+	client_t *client = (client_t*)_;
+	uint64_t start = bench_ns();
+	uint64_t until = start + OPTIONS.duration * 1000000000ULL;
+	uint64_t gap   = OPTIONS.rate > 0 ? 1000000000ULL / OPTIONS.rate : 0;
+	uint64_t n;
+
+	for (n = 0; ; n++) {
+		uint64_t now = bench_ns();
+		if (now >= until)
+			break;
+
+		/* check in with the supervisor now and again */
+		if (n % 256 == 0) {
+			zmq_pollitem_t poller[1] = { { client->control, 0, ZMQ_POLLIN } };
+			if (zmq_poll(poller, 1, 0) > 0)
+				break;
+		}
+
+		if (gap && start + n * gap > now) {
+			uint64_t wait = start + n * gap - now;
+			struct timespec ts = { wait / 1000000000ULL, wait % 1000000000ULL };
+			nanosleep(&ts, NULL);
+		}
+
+		int type = pick_type(&client->rng);
+		int id   = bench_rand(&client->rng) % OPTIONS.names;
+		int32_t ts = time_s();
+		char name[128], t[32];
+
+		pdu_t *p = NULL;
+		snprintf(name, sizeof(name), "bench.%s.c%i.m%i", TYPES[type], client->id, id);
+
+		switch (type) {
+		case T_STATE:
+			snprintf(t, sizeof(t), "%lu", (unsigned long)bench_ns());
+			p = pdu_make("STATE", 0);
+			pdu_extendf(p, "%i", ts);
+			pdu_extendf(p, "%s", name);
+			pdu_extendf(p, "%i", 0);
+			pdu_extendf(p, "%s", t);
+			break;
+
+		case T_EVENT:
+			snprintf(t, sizeof(t), "%lu", (unsigned long)bench_ns());
+			p = pdu_make("EVENT", 0);
+			pdu_extendf(p, "%i", ts);
+			pdu_extendf(p, "%s", name);
+			pdu_extendf(p, "%s", t);
+			break;
+
+		case T_COUNTER:
+			p = pdu_make("COUNTER", 0);
+			pdu_extendf(p, "%i", ts);
+			pdu_extendf(p, "%s", name);
+			pdu_extendf(p, "%i", 1);
+			break;
+
+		case T_SAMPLE:
+			p = pdu_make("SAMPLE", 0);
+			pdu_extendf(p, "%i", ts);
+			pdu_extendf(p, "%s", name);
+			pdu_extendf(p, "%e", (bench_rand(&client->rng) % 100000) / 100.0);
+			break;
+
+		case T_RATE:
+			p = pdu_make("RATE", 0);
+			pdu_extendf(p, "%i", ts);
+			pdu_extendf(p, "%s", name);
+			pdu_extendf(p, "%lu", (unsigned long)n);
+			break;
+		}
+
+		if (type == T_COUNTER || type == T_SAMPLE || type == T_RATE) {
+			int32_t ws = ts - ts % OPTIONS.window;
+			wslot_t *w = slot(type, client->id, id, ws);
+			__atomic_store_n(&w->start, ws, __ATOMIC_RELAXED);
+			__atomic_store_n(&w->last_ns, bench_ns(), __ATOMIC_RELEASE);
+		}
+
+		pdu_send_and_free(p, client->push);
+		client->sent[type]++;
+	}
+
+	vzmq_shutdown(client->push, 500);
+	zmq_close(client->control);
+	return NULL;
+}
+/* }}} */
+static client_t *client_thread(void *zmq, int id) /* {{{ */
+{
+	client_t *client = vmalloc(sizeof(client_t));
+	client->id  = id;
+	client->rng = 0x9e3779b97f4a7c15ULL * (id + 1);
+
+	if (bolo_subscriber_connect_supervisor(zmq, &client->control) != 0)
+		return NULL;
+
+	client->push = zmq_socket(zmq, ZMQ_PUSH);
+	if (!client->push || zmq_connect(client->push, LISTENER) != 0)
+		return NULL;
+
+	if (pthread_create(&client->tid, NULL, _client_thread, client) != 0)
+		return NULL;
+	return client;
+}
+/* }}} */
+
+/*************************************************************************/
+
+static int type_of(const char *pdu) /* {{{ */
+{
+	int i;
+	for (i = 0; i < NTYPES; i++)
+		if (strcmp(pdu, PDUS[i]) == 0)
+			return i;
+	return -1;
+}
+/* }}} */
+static int _subscriber_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
+{
+	subscriber_t *sub = (subscriber_t*)_;
+
+	if (socket == sub->control)
+		return VIGOR_REACTOR_HALT;
+
+	uint64_t now  = bench_ns();
+	uint64_t wall = wall_ns();
+	int type = type_of(pdu_type(pdu));
+	if (type < 0)
+		return VIGOR_REACTOR_CONTINUE;
+
+	char *name, *s, *end;
+	int c, id;
+	uint64_t sent;
+
+	switch (type) {
+	case T_STATE: /* [ STATE | name | ts | stale | code | summary ] */
+	case T_EVENT: /* [ EVENT | ts | name | extra ] */
+		s = pdu_string(pdu, type == T_STATE ? 5 : 3);
+		name = pdu_string(pdu, type == T_STATE ? 1 : 2);
+		sent = strtoull(s, &end, 10);
+		if (strncmp(name, "bench.", 6) == 0 && *s && !*end && sent <= now) {
+			sub->received[type]++;
+			bench_lat_add(&sub->latency[type], now - sent);
+		}
+		free(s);
+		free(name);
+		break;
+
+	default: /* [ COUNTER|SAMPLE|RATE | ts | name | ... ] */
+		s = pdu_string(pdu, 1);
+		int32_t start = strtol(s, NULL, 10);
+		free(s);
+
+		name = pdu_string(pdu, 2);
+		if (sscanf(name, "bench.%*[a-z].c%i.m%i", &c, &id) == 2
+		 && c >= 0 && c < OPTIONS.clients && id >= 0 && id < OPTIONS.names) {
+			wslot_t *w = slot(type, c, id, start);
+			sub->received[type]++;
+
+			sent = __atomic_load_n(&w->last_ns, __ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&w->start, __ATOMIC_RELAXED) == start && sent <= now)
+				bench_lat_add(&sub->latency[type], now - sent);
+
+			uint64_t closed = (uint64_t)(start + OPTIONS.window) * 1000000000ULL;
+			if (wall >= closed)
+				bench_lat_add(&sub->close_delay[type], wall - closed);
+		}
+		free(name);
+		break;
+	}
+
+	return VIGOR_REACTOR_CONTINUE;
+}
+/* }}} */
+static void * _subscriber_thread(void *_) /* {{{ */
+{
+	subscriber_t *sub = (subscriber_t*)_;
+	reactor_go(sub->reactor);
+
+	zmq_close(sub->control);
+	vzmq_shutdown(sub->sub, 0);
+	reactor_free(sub->reactor);
+	return NULL;
+}
+/* }}} */
+static subscriber_t *subscriber_thread(void *zmq) /* {{{ */
+{
+	int hwm = 0;
+	subscriber_t *sub = vmalloc(sizeof(subscriber_t));
+
+	if (bolo_subscriber_connect_supervisor(zmq, &sub->control) != 0)
+		return NULL;
+
+	sub->sub = zmq_socket(zmq, ZMQ_SUB);
+	if (!sub->sub
+	 || zmq_setsockopt(sub->sub, ZMQ_RCVHWM, &hwm, sizeof(hwm)) != 0
+	 || zmq_setsockopt(sub->sub, ZMQ_SUBSCRIBE, "", 0) != 0
+	 || zmq_connect(sub->sub, BROADCAST) != 0)
+		return NULL;
+
+	sub->reactor = reactor_new();
+	if (!sub->reactor
+	 || reactor_set(sub->reactor, sub->control, _subscriber_reactor, sub) != 0
+	 || reactor_set(sub->reactor, sub->sub,     _subscriber_reactor, sub) != 0)
+		return NULL;
+
+	if (pthread_create(&sub->tid, NULL, _subscriber_thread, sub) != 0)
+		return NULL;
+	return sub;
+}
+/* }}} */
+
+static void * _timer_thread(void *_) /* {{{ */
+{
+	/* run the load for the configured duration, then give the
+	   aggregator long enough to close out (and broadcast) the
+	   last window, before asking the supervisor to wind down. */
+	sleep(OPTIONS.duration + OPTIONS.window + OPTIONS.grace + 2);
+	kill(getpid(), SIGTERM);
+	return NULL;
+}
+/* }}} */
+
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OPTIONS.bolo     = strdup("./bolo");
+	OPTIONS.port     = 29990;
+	OPTIONS.clients  = 2;
+	OPTIONS.subs     = 1;
+	OPTIONS.rate     = 5000;
+	OPTIONS.duration = 10;
+	OPTIONS.names    = 100;
+	OPTIONS.window   = 2;
+	OPTIONS.grace    = 1;
+	OPTIONS.mix      = strdup("state=25,counter=25,sample=25,rate=20,event=5");
+	OPTIONS.workdir  = strdup("/tmp");
+
+	struct option long_opts[] = {
+		{ "help",              no_argument, NULL, 'h' },
+		{ "bolo",        required_argument, NULL, 'b' },
+		{ "port",        required_argument, NULL, 'p' },
+		{ "clients",     required_argument, NULL, 'C' },
+		{ "subscribers", required_argument, NULL, 'S' },
+		{ "rate",        required_argument, NULL, 'r' },
+		{ "duration",    required_argument, NULL, 'd' },
+		{ "names",       required_argument, NULL, 'c' },
+		{ "mix",         required_argument, NULL, 'm' },
+		{ "window",      required_argument, NULL, 'w' },
+		{ "grace",       required_argument, NULL, 'g' },
+		{ "workdir",     required_argument, NULL, 'D' },
+		{ "verbose",           no_argument, NULL, 'v' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?b:p:C:S:r:d:c:m:w:g:D:v", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'b': free(OPTIONS.bolo); OPTIONS.bolo = strdup(optarg); break;
+		case 'p': OPTIONS.port     = atoi(optarg); break;
+		case 'C': OPTIONS.clients  = atoi(optarg); break;
+		case 'S': OPTIONS.subs     = atoi(optarg); break;
+		case 'r': OPTIONS.rate     = atoi(optarg); break;
+		case 'd': OPTIONS.duration = atoi(optarg); break;
+		case 'c': OPTIONS.names    = atoi(optarg); break;
+		case 'm': free(OPTIONS.mix); OPTIONS.mix = strdup(optarg); break;
+		case 'w': OPTIONS.window   = atoi(optarg); break;
+		case 'g': OPTIONS.grace    = atoi(optarg); break;
+		case 'D': free(OPTIONS.workdir); OPTIONS.workdir = strdup(optarg); break;
+		case 'v': OPTIONS.verbose  = 1; break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+
+	if (bench_parse_mix(OPTIONS.mix, TYPES, OPTIONS.weight, NTYPES) != 0)
+		exit(1);
+	int i, j;
+	for (i = 0; i < NTYPES; i++)
+		OPTIONS.total += OPTIONS.weight[i];
+	if (OPTIONS.total <= 0 || OPTIONS.clients < 1 || OPTIONS.subs < 1
+	 || OPTIONS.duration < 1 || OPTIONS.names < 1 || OPTIONS.window < 1
+	 || OPTIONS.grace < 0 || OPTIONS.rate < 0) {
+		fprintf(stderr, "invalid workload; see -h\n");
+		exit(1);
+	}
+
+	log_open("bench/pipeline", "stderr");
+	log_level(LOG_ERR, NULL);
+
+	LISTENER  = string("tcp://127.0.0.1:%i", OPTIONS.port);
+	BROADCAST = string("tcp://127.0.0.1:%i", OPTIONS.port + 2);
+	for (i = 0; i < NTYPES; i++)
+		WINDOWS[i] = vcalloc((size_t)OPTIONS.clients * OPTIONS.names * WINDOW_SLOTS, sizeof(wslot_t));
+
+	char *config = write_config();
+	pid_t aggr = spawn_aggregator(config);
+
+	if (bolo_subscriber_init() != 0) {
+		fprintf(stderr, "failed to initialize subscriber architecture\n");
+		exit(2);
+	}
+
+	void *zmq = zmq_ctx_new();
+	if (!zmq) {
+		fprintf(stderr, "failed to initialize 0MQ\n");
+		exit(2);
+	}
+	await_aggregator(zmq);
+
+	subscriber_t **subs = vcalloc(OPTIONS.subs, sizeof(subscriber_t*));
+	for (i = 0; i < OPTIONS.subs; i++) {
+		if (!(subs[i] = subscriber_thread(zmq))) {
+			fprintf(stderr, "failed to start subscriber #%i: %s\n", i, zmq_strerror(errno));
+			exit(2);
+		}
+	}
+	/* let the subscriptions settle before we start sending */
+	usleep(250 * 1000);
+
+	fprintf(stderr, "generating load for %is...\n", OPTIONS.duration);
+	client_t **clients = vcalloc(OPTIONS.clients, sizeof(client_t*));
+	for (i = 0; i < OPTIONS.clients; i++) {
+		if (!(clients[i] = client_thread(zmq, i))) {
+			fprintf(stderr, "failed to start client #%i: %s\n", i, zmq_strerror(errno));
+			exit(2);
+		}
+	}
+
+	pthread_t timer;
+	if (pthread_create(&timer, NULL, _timer_thread, NULL) != 0) {
+		perror("pthread_create");
+		exit(2);
+	}
+
+	/* runs until the timer thread signals us */
+	bolo_subscriber_supervisor(zmq);
+
+	pthread_join(timer, NULL);
+	for (i = 0; i < OPTIONS.clients; i++) {
+		pthread_join(clients[i]->tid, NULL);
+		for (j = 0; j < NTYPES; j++)
+			SENT[j] += clients[i]->sent[j];
+	}
+
+	kill(aggr, SIGTERM);
+	waitpid(aggr, NULL, 0);
+
+	uint64_t total = 0;
+	for (j = 0; j < NTYPES; j++)
+		total += SENT[j];
+
+	/* merge everything the subscribers saw */
+	uint64_t received[NTYPES] = { 0 };
+	bench_lat_t latency[NTYPES], close_delay[NTYPES];
+	memset(latency,     0, sizeof(latency));
+	memset(close_delay, 0, sizeof(close_delay));
+	for (i = 0; i < OPTIONS.subs; i++) {
+		pthread_join(subs[i]->tid, NULL);
+		for (j = 0; j < NTYPES; j++) {
+			size_t k;
+			received[j] += subs[i]->received[j];
+			for (k = 0; k < subs[i]->latency[j].n; k++)
+				bench_lat_add(&latency[j], subs[i]->latency[j].v[k]);
+			for (k = 0; k < subs[i]->close_delay[j].n; k++)
+				bench_lat_add(&close_delay[j], subs[i]->close_delay[j].v[k]);
+			bench_lat_free(&subs[i]->latency[j]);
+			bench_lat_free(&subs[i]->close_delay[j]);
+		}
+	}
+
+	printf("---\n");
+	printf("# generated by bench/pipeline\n");
+	printf("benchmark: pipeline\n");
+	printf("workload:\n");
+	printf("  clients: %i\n", OPTIONS.clients);
+	printf("  subscribers: %i\n", OPTIONS.subs);
+	printf("  rate_per_client: %i\n", OPTIONS.rate);
+	printf("  duration: %i\n", OPTIONS.duration);
+	printf("  names_per_client: %i\n", OPTIONS.names);
+	printf("  mix: \"%s\"\n", OPTIONS.mix);
+	printf("  window: %i\n", OPTIONS.window);
+	printf("  grace_period: %i\n", OPTIONS.grace);
+	printf("throughput:\n");
+	printf("  sent: %lu\n", (unsigned long)total);
+	printf("  msgs_per_sec: %.1f\n", (double)total / OPTIONS.duration);
+	for (j = 0; j < NTYPES; j++) {
+		printf("  %s:\n", TYPES[j]);
+		printf("    sent: %lu\n", (unsigned long)SENT[j]);
+		printf("    received_per_subscriber: %.1f\n", (double)received[j] / OPTIONS.subs);
+	}
+	printf("latency:\n");
+	for (j = 0; j < NTYPES; j++)
+		if (latency[j].n)
+			bench_lat_yaml(stdout, "  ", TYPES[j], &latency[j]);
+	printf("window_close_delay:\n");
+	for (j = 0; j < NTYPES; j++)
+		if (close_delay[j].n)
+			bench_lat_yaml(stdout, "  ", TYPES[j], &close_delay[j]);
+
+	for (j = 0; j < NTYPES; j++) {
+		bench_lat_free(&latency[j]);
+		bench_lat_free(&close_delay[j]);
+	}
+
+	char *s = path("log");
+	if (OPTIONS.verbose)
+		fprintf(stderr, "aggregator log is in %s\n", s);
+	else
+		unlink(s);
+	free(s);
+	s = path("save"); unlink(s); free(s);
+	s = path("keys"); unlink(s); free(s);
+	unlink(config);
+	free(config);
+	return 0;
+}
@@ -0,0 +1,510 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/savefile - time binf_write / binf_sync / binf_read at scale
+
+   This links binf.c, data.c and config.c directly, and synthesizes a
+   state db (by default, a million records spread across the five
+   record types) from a generated configuration.  For each savefile
+   version requested, it then:
+
+     1. writes the db out to a savefile, via binf_write_version;
+     2. forces it to disk, via binf_sync;
+     3. reads it back into a freshly configured db, via binf_read;
+     4. compares every record, field by field, against the original.
+
+   Between rounds, a fraction of the records (-c) are changed, so that
+   v3 savefiles (which only rewrite changed records) can be measured at
+   a steady state; the bytes written by the last save are reported.
+
+   Floating point sample data is compared bitwise, since a savefile
+   that can't reproduce its input exactly is broken, not imprecise.
+   The legacy v1 format is known to fail this (it truncates doubles);
+   any mismatch against the current format is a failure, and causes
+   a non-zero exit.
+ */
+
+#include "bench.h"
+#include "../src/bolo.h"
+#include <getopt.h>
+
+#define T_STATE   0
+#define T_COUNTER 1
+#define T_SAMPLE  2
+#define T_RATE    3
+#define T_EVENT   4
+#define NTYPES    5
+
+static const char *TYPES[NTYPES] = {
+	"state", "counter", "sample", "rate", "event",
+};
+
+static struct {
+	int       count[NTYPES]; /* -S, -C, -A, -R, -E */
+	int       rounds;        /* -n */
+	double    churn;         /* -c */
+	char     *versions;      /* -V */
+	uint64_t  seed;          /* -s */
+	char     *workdir;       /* -d */
+	int       verbose;       /* -D */
+} OPTIONS = { { 0 } };
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/savefile [options]\n\n");
+	printf("Options:\n");
+	printf("  -S, --states N       state records to synthesize (default 200000)\n");
+	printf("  -C, --counters N     counter records to synthesize (default 300000)\n");
+	printf("  -A, --samples N      sample records to synthesize (default 300000)\n");
+	printf("  -R, --rates N        rate records to synthesize (default 150000)\n");
+	printf("  -E, --events N       event records to synthesize (default 50000)\n");
+	printf("  -n, --rounds N       write / sync / read cycles per version (default 3)\n");
+	printf("  -c, --churn PCT      percent of records changed between rounds (default 1)\n");
+	printf("  -V, --versions LIST  savefile versions to exercise (default 1,2,3)\n");
+	printf("  -s, --seed N         workload random seed (default 1)\n");
+	printf("  -d, --workdir PATH   scratch directory for the savefile (default /tmp)\n");
+	printf("  -D, --debug          turn on binf debug logging (slow!)\n");
+}
+/* }}} */
+
+static char *write_config(void) /* {{{ */
+{
+	char *path = string("%s/bench-savefile.%i.conf", OPTIONS.workdir, getpid());
+	FILE *io = fopen(path, "w");
+	if (!io) {
+		fprintf(stderr, "failed to write %s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+
+	fprintf(io, "# generated by bench/savefile\n");
+	fprintf(io, "type :bench {\n  freshness 3600\n  warning \"no data\"\n}\n");
+	fprintf(io, "window @bench 60\n");
+	fprintf(io, "state   :bench m/^bench\\.state\\./\n");
+	fprintf(io, "counter @bench m/^bench\\.counter\\./\n");
+	fprintf(io, "sample  @bench m/^bench\\.sample\\./\n");
+	fprintf(io, "rate    @bench m/^bench\\.rate\\./\n");
+
+	fclose(io);
+	return path;
+}
+/* }}} */
+static server_t *new_server(const char *config) /* {{{ */
+{
+	server_t *svr = vmalloc(sizeof(server_t));
+	svr->config.save_size = DEFAULT_SAVE_SIZE;
+	if (configure(config, svr) != 0) {
+		fprintf(stderr, "failed to configure db from generated %s\n", config);
+		exit(2);
+	}
+	return svr;
+}
+/* }}} */
+static void free_server(server_t *svr) /* {{{ */
+{
+	deconfigure(svr);
+	free(svr);
+}
+/* }}} */
+
+/* an arbitrary, but reproducible, double; these deliberately
+   include fractional, negative and very large values, none of
+   which survive the v1 encoding. */
+static double rand_double(uint64_t *rng) /* {{{ */
+{
+	double v = (bench_rand(rng) % 100000000) / 1000.0;
+	switch (bench_rand(rng) % 4) {
+	case 0:  return v;
+	case 1:  return -v;
+	case 2:  return v * 1e12;
+	default: return v / 7.0;
+	}
+}
+/* }}} */
+static size_t populate(db_t *db, uint64_t seed) /* {{{ */
+{
+	uint64_t rng = seed ? seed : 1;
+	int32_t now = time_s();
+	size_t bytes = 0;
+	char name[128];
+	int i;
+
+	for (i = 0; i < OPTIONS.count[T_STATE]; i++) {
+		snprintf(name, sizeof(name), "bench.state.host%06i.check%i", i, (int)(bench_rand(&rng) % 100));
+		state_t *s = find_state(db, name);
+		if (!s) continue;
+		free(s->summary);
+		s->summary   = string("synthetic state #%i, %lu", i, (unsigned long)bench_rand(&rng));
+		s->last_seen = now - bench_rand(&rng) % 3600;
+		s->status    = bench_rand(&rng) % 4;
+		s->stale     = bench_rand(&rng) % 2;
+		s->ignore    = bench_rand(&rng) % 2;
+		bytes += 64 + strlen(s->name) + strlen(s->summary);
+	}
+
+	for (i = 0; i < OPTIONS.count[T_COUNTER]; i++) {
+		snprintf(name, sizeof(name), "bench.counter.host%06i.metric%i", i, (int)(bench_rand(&rng) % 100));
+		counter_t *c = find_counter(db, name);
+		if (!c) continue;
+		c->last_seen = now - bench_rand(&rng) % 3600;
+		c->value     = bench_rand(&rng);
+		c->ignore    = bench_rand(&rng) % 2;
+		bytes += 64 + strlen(c->name);
+	}
+
+	for (i = 0; i < OPTIONS.count[T_SAMPLE]; i++) {
+		snprintf(name, sizeof(name), "bench.sample.host%06i.metric%i", i, (int)(bench_rand(&rng) % 100));
+		sample_t *s = find_sample(db, name);
+		if (!s) continue;
+		s->last_seen = now - bench_rand(&rng) % 3600;
+		s->n         = bench_rand(&rng) % 100000;
+		s->min       = rand_double(&rng);
+		s->max       = rand_double(&rng);
+		s->sum       = rand_double(&rng);
+		s->mean      = rand_double(&rng);
+		s->mean_     = rand_double(&rng);
+		s->var       = rand_double(&rng);
+		s->var_      = rand_double(&rng);
+		s->ignore    = bench_rand(&rng) % 2;
+		bytes += 128 + strlen(s->name);
+	}
+
+	for (i = 0; i < OPTIONS.count[T_RATE]; i++) {
+		snprintf(name, sizeof(name), "bench.rate.host%06i.metric%i", i, (int)(bench_rand(&rng) % 100));
+		rate_t *r = find_rate(db, name);
+		if (!r) continue;
+		r->first_seen = now - 60 - bench_rand(&rng) % 3600;
+		r->last_seen  = r->first_seen + bench_rand(&rng) % 60;
+		r->first      = bench_rand(&rng);
+		r->last       = bench_rand(&rng);
+		r->ignore     = bench_rand(&rng) % 2;
+		bytes += 64 + strlen(r->name);
+	}
+
+	for (i = 0; i < OPTIONS.count[T_EVENT]; i++) {
+		char *name  = string("bench.event.host%06i", i);
+		char *extra = string("synthetic event #%i, %lu", i, (unsigned long)bench_rand(&rng));
+		ring_push(&db->events, now - bench_rand(&rng) % 86400, name, extra);
+		bytes += 64 + strlen(name) + strlen(extra);
+		free(name);
+		free(extra);
+	}
+
+	return bytes;
+}
+/* }}} */
+static void churn(db_t *db, uint64_t *rng) /* {{{ */
+{
+	uint64_t cut = OPTIONS.churn / 100.0 * 1000000;
+	char *name;
+
+	state_t *s;
+	for_each_key_value(&db->states, name, s) {
+		if (bench_rand(rng) % 1000000 >= cut) continue;
+		free(s->summary);
+		/* some summaries grow, and have to move */
+		s->summary = string("changed state, %lu%s", (unsigned long)bench_rand(rng),
+			bench_rand(rng) % 4 ? "" : " (and then some, and then some more)");
+		s->last_seen++;
+		mark_dirty(s);
+	}
+
+	counter_t *c;
+	for_each_key_value(&db->counters, name, c) {
+		if (bench_rand(rng) % 1000000 >= cut) continue;
+		c->value++;
+		mark_dirty(c);
+	}
+
+	sample_t *a;
+	for_each_key_value(&db->samples, name, a) {
+		if (bench_rand(rng) % 1000000 >= cut) continue;
+		sample_data(a, rand_double(rng));
+	}
+
+	rate_t *r;
+	for_each_key_value(&db->rates, name, r) {
+		if (bench_rand(rng) % 1000000 >= cut) continue;
+		rate_data(r, bench_rand(rng));
+	}
+
+	/* new events push the oldest ones out */
+	size_t i, n = db->events.n * OPTIONS.churn / 100;
+	for (i = 0; i < n; i++) {
+		ring_entry_t *e = ring_get(&db->events, 0);
+		char *ev = strdup(ring_name(&db->events, e));
+		ring_shift(&db->events);
+		ring_push(&db->events, time_s(), ev, "churned");
+		free(ev);
+	}
+}
+/* }}} */
+
+#define differ(a,b,f) (memcmp(&(a)->f, &(b)->f, sizeof((a)->f)) != 0)
+static void verify(db_t *want, db_t *got, uint64_t *bad) /* {{{ */
+{
+	char *name;
+	int i;
+	for (i = 0; i < NTYPES; i++)
+		bad[i] = 0;
+
+	state_t *s1, *s2;
+	for_each_key_value(&want->states, name, s1) {
+		s2 = hash_get(&got->states, name);
+		if (!s2 || differ(s1, s2, last_seen) || differ(s1, s2, status)
+		 || differ(s1, s2, stale) || differ(s1, s2, ignore)
+		 || strcmp(s1->summary, s2->summary) != 0)
+			bad[T_STATE]++;
+	}
+
+	counter_t *c1, *c2;
+	for_each_key_value(&want->counters, name, c1) {
+		c2 = hash_get(&got->counters, name);
+		if (!c2 || differ(c1, c2, last_seen) || differ(c1, c2, value)
+		 || differ(c1, c2, ignore))
+			bad[T_COUNTER]++;
+	}
+
+	sample_t *a1, *a2;
+	for_each_key_value(&want->samples, name, a1) {
+		a2 = hash_get(&got->samples, name);
+		if (!a2 || differ(a1, a2, last_seen) || differ(a1, a2, n)
+		 || differ(a1, a2, min)  || differ(a1, a2, max)   || differ(a1, a2, sum)
+		 || differ(a1, a2, mean) || differ(a1, a2, mean_)
+		 || differ(a1, a2, var)  || differ(a1, a2, var_)
+		 || differ(a1, a2, ignore))
+			bad[T_SAMPLE]++;
+	}
+
+	rate_t *r1, *r2;
+	for_each_key_value(&want->rates, name, r1) {
+		r2 = hash_get(&got->rates, name);
+		if (!r2 || differ(r1, r2, first_seen) || differ(r1, r2, last_seen)
+		 || differ(r1, r2, first) || differ(r1, r2, last)
+		 || differ(r1, r2, ignore))
+			bad[T_RATE]++;
+	}
+
+	/* events come back in the order they were saved */
+	size_t j;
+	for (j = 0; j < want->events.n; j++) {
+		ring_entry_t *e1 = ring_get(&want->events, j);
+		ring_entry_t *e2 = ring_get(&got->events,  j);
+		if (!e2) {
+			bad[T_EVENT]++;
+			continue;
+		}
+		if (e1->timestamp != e2->timestamp
+		 || strcmp(ring_name(&want->events, e1),  ring_name(&got->events, e2))  != 0
+		 || strcmp(ring_extra(&want->events, e1), ring_extra(&got->events, e2)) != 0)
+			bad[T_EVENT]++;
+	}
+	if (got->events.n != want->events.n)
+		bad[T_EVENT]++;
+}
+/* }}} */
+#undef differ
+
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OPTIONS.count[T_STATE]   = 200000;
+	OPTIONS.count[T_COUNTER] = 300000;
+	OPTIONS.count[T_SAMPLE]  = 300000;
+	OPTIONS.count[T_RATE]    = 150000;
+	OPTIONS.count[T_EVENT]   = 50000;
+	OPTIONS.rounds   = 3;
+	OPTIONS.churn    = 1.0;
+	OPTIONS.versions = strdup("1,2,3");
+	OPTIONS.seed     = 1;
+	OPTIONS.workdir  = strdup("/tmp");
+
+	struct option long_opts[] = {
+		{ "help",           no_argument, NULL, 'h' },
+		{ "states",   required_argument, NULL, 'S' },
+		{ "counters", required_argument, NULL, 'C' },
+		{ "samples",  required_argument, NULL, 'A' },
+		{ "rates",    required_argument, NULL, 'R' },
+		{ "events",   required_argument, NULL, 'E' },
+		{ "rounds",   required_argument, NULL, 'n' },
+		{ "churn",    required_argument, NULL, 'c' },
+		{ "versions", required_argument, NULL, 'V' },
+		{ "seed",     required_argument, NULL, 's' },
+		{ "workdir",  required_argument, NULL, 'd' },
+		{ "debug",          no_argument, NULL, 'D' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?S:C:A:R:E:n:c:V:s:d:D", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'S': OPTIONS.count[T_STATE]   = atoi(optarg); break;
+		case 'C': OPTIONS.count[T_COUNTER] = atoi(optarg); break;
+		case 'A': OPTIONS.count[T_SAMPLE]  = atoi(optarg); break;
+		case 'R': OPTIONS.count[T_RATE]    = atoi(optarg); break;
+		case 'E': OPTIONS.count[T_EVENT]   = atoi(optarg); break;
+		case 'n': OPTIONS.rounds = atoi(optarg); break;
+		case 'c': OPTIONS.churn  = strtod(optarg, NULL); break;
+		case 'V': free(OPTIONS.versions); OPTIONS.versions = strdup(optarg); break;
+		case 's': OPTIONS.seed   = strtoull(optarg, NULL, 10); break;
+		case 'd': free(OPTIONS.workdir); OPTIONS.workdir = strdup(optarg); break;
+		case 'D': OPTIONS.verbose = 1; break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+
+	int i, nversions = 0, versions[8];
+	char *tok, *tmp = strdup(OPTIONS.versions);
+	for (tok = strtok(tmp, ","); tok && nversions < 8; tok = strtok(NULL, ","))
+		versions[nversions++] = atoi(tok);
+	free(tmp);
+
+	for (i = 0; i < NTYPES; i++)
+		if (OPTIONS.count[i] < 0)
+			break;
+	if (i != NTYPES || OPTIONS.rounds < 1 || nversions == 0
+	 || OPTIONS.churn < 0 || OPTIONS.churn > 100) {
+		fprintf(stderr, "invalid workload; see -h\n");
+		exit(1);
+	}
+
+	log_open("bench/savefile", "stderr");
+	log_level(OPTIONS.verbose ? LOG_DEBUG : LOG_ERR, NULL);
+
+	char *config   = write_config();
+	char *savefile = string("%s/bench-savefile.%i.save", OPTIONS.workdir, getpid());
+
+	fprintf(stderr, "populating state db...\n");
+	long rss_base = bench_rss_kb();
+	uint64_t t0 = bench_ns();
+	server_t *src = new_server(config);
+	size_t bytes = populate(&src->db, OPTIONS.seed);
+	uint64_t populate_ns = bench_ns() - t0;
+	long rss_db = bench_rss_kb();
+
+	/* save.size is in megabytes; leave some headroom over our
+	   (generous) estimate of what the records will need. */
+	int save_size = bytes / (1024 * 1024) + 2;
+
+	printf("---\n");
+	printf("# generated by bench/savefile\n");
+	printf("benchmark: savefile\n");
+	printf("workload:\n");
+	for (i = 0; i < NTYPES; i++)
+		printf("  %ss: %i\n", TYPES[i], OPTIONS.count[i]);
+	printf("  rounds: %i\n", OPTIONS.rounds);
+	printf("  churn_pct: %.2f\n", OPTIONS.churn);
+	printf("  seed: %lu\n", (unsigned long)OPTIONS.seed);
+	printf("  save_size_mb: %i\n", save_size);
+	printf("populate:\n");
+	printf("  seconds: %.6f\n", populate_ns / 1e9);
+	printf("  rss_kb: %li\n", rss_db - rss_base);
+	printf("versions:\n");
+
+	int rc = 0, v, round;
+	uint64_t rng = OPTIONS.seed + 1;
+	for (v = 0; v < nversions; v++) {
+		bench_lat_t lat[3];
+		uint64_t bad[NTYPES], a0, allocs = 0;
+		struct stat st;
+		int failed = 0;
+		memset(lat, 0, sizeof(lat));
+
+		fprintf(stderr, "v%i: %i round(s)...\n", versions[v], OPTIONS.rounds);
+		for (round = 0; round < OPTIONS.rounds; round++) {
+			server_t *dst = new_server(config);
+			if (round > 0)
+				churn(&src->db, &rng);
+
+			t0 = bench_ns();
+			if (binf_write_version(&src->db, savefile, save_size, versions[v]) != 0) {
+				failed = 1;
+				free_server(dst);
+				break;
+			}
+			bench_lat_add(&lat[0], bench_ns() - t0);
+
+			t0 = bench_ns();
+			if (binf_sync(savefile, save_size) != 0) {
+				failed = 1;
+				free_server(dst);
+				break;
+			}
+			bench_lat_add(&lat[1], bench_ns() - t0);
+
+			a0 = bench_allocs();
+			t0 = bench_ns();
+			if (binf_read(&dst->db, savefile, save_size) != 0) {
+				failed = 1;
+				free_server(dst);
+				break;
+			}
+			bench_lat_add(&lat[2], bench_ns() - t0);
+			allocs = bench_allocs() - a0;
+
+			verify(&src->db, &dst->db, bad);
+			free_server(dst);
+		}
+
+		printf("  v%i:\n", versions[v]);
+		if (failed) {
+			printf("    error: \"failed to save / load a v%i savefile\"\n", versions[v]);
+			rc = 1;
+			continue;
+		}
+
+		if (stat(savefile, &st) != 0)
+			st.st_size = 0;
+		printf("    file_bytes: %li\n", (long)st.st_size);
+		if (versions[v] >= 3)
+			printf("    last_write_bytes: %lu\n", (unsigned long)src->db.save.bytes);
+		bench_lat_yaml(stdout, "    ", "write", &lat[0]);
+		bench_lat_yaml(stdout, "    ", "sync",  &lat[1]);
+		bench_lat_yaml(stdout, "    ", "read",  &lat[2]);
+		printf("    read_allocs: %lu\n", (unsigned long)allocs);
+		printf("    mismatches:\n");
+		for (i = 0; i < NTYPES; i++) {
+			printf("      %s: %lu\n", TYPES[i], (unsigned long)bad[i]);
+			if (bad[i] && versions[v] != 1)
+				rc = 1;
+		}
+		for (i = 0; i < 3; i++)
+			bench_lat_free(&lat[i]);
+	}
+	printf("memory:\n");
+	printf("  rss_peak_kb: %li\n", bench_rss_peak_kb());
+
+	free_server(src);
+	unlink(savefile);
+	unlink(config);
+	free(savefile);
+	free(config);
+	free(OPTIONS.versions);
+	free(OPTIONS.workdir);
+	return rc;
+}
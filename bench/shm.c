@@ -0,0 +1,395 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/shm - the shared-memory ring, against the PULL listener
+
+   This links core.c, data.c and config.c directly (like bench/kernel),
+   and runs the same workload through each way a client on the same
+   host can get submissions to the kernel: a PUSH socket connected to
+   the listener over ipc://, and the shm.ring.  For each, it times:
+
+     1. throughput: -n COUNTER submissions back-to-back, followed by
+        a "fence" STATE update, until the fence comes out the other
+        side of the broadcast socket;
+
+     2. latency: -l fences on their own, spaced out enough that the
+        kernel (or the shm thread) has gone idle in between, so that
+        waking it up is part of the cost.
+ */
+
+#include "bench.h"
+#include "../src/bolo.h"
+#include <getopt.h>
+
+#define BENCH_CONTROLLER "inproc://bench/controller"
+#define BENCH_BROADCAST  "inproc://bench/broadcast"
+#define FENCE_NAME       "bench.fence"
+
+static struct {
+	uint64_t  messages;  /* -n */
+	uint64_t  latency;   /* -l */
+	int       names;     /* -c */
+	int       size;      /* -s, shm.size */
+	uint64_t  seed;      /* -S */
+	char     *workdir;   /* -d */
+	int       verbose;   /* -D */
+} OPTIONS = { 0 };
+
+/* one way of getting submissions to the kernel */
+typedef struct {
+	const char *name;
+	void       *push;   /* the PULL path */
+	bolo_shm_t  shm;    /* the shm.ring path */
+	uint64_t    full;   /* times we had to wait for room in the ring */
+} path_t;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/shm [options]\n\n");
+	printf("Options:\n");
+	printf("  -n, --messages N     messages to send, per path (default 200000)\n");
+	printf("  -l, --latency N      idle round trips to time, per path (default 2000)\n");
+	printf("  -c, --names N        distinct counter names (default 1000)\n");
+	printf("  -s, --size BYTES     shm.size, the size of the ring (default 4MiB)\n");
+	printf("  -S, --seed N         workload random seed (default 1)\n");
+	printf("  -d, --workdir PATH   scratch directory for the ring, sockets\n");
+	printf("                       and save/keys files (default /tmp)\n");
+	printf("  -D, --debug          turn on kernel debug logging (slow!)\n");
+}
+/* }}} */
+
+static char *scratch(const char *what) /* {{{ */
+{
+	return string("%s/bench-shm.%i.%s", OPTIONS.workdir, getpid(), what);
+}
+/* }}} */
+static char *write_config(void) /* {{{ */
+{
+	char *path = scratch("conf");
+	FILE *io = fopen(path, "w");
+	if (!io) {
+		fprintf(stderr, "failed to write %s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+
+	fprintf(io, "# generated by bench/shm\n");
+	fprintf(io, "listener   ipc://%s/bench-shm.%i.listener\n", OPTIONS.workdir, getpid());
+	fprintf(io, "controller %s\n", BENCH_CONTROLLER);
+	fprintf(io, "broadcast  %s\n", BENCH_BROADCAST);
+	fprintf(io, "savefile   %s/bench-shm.%i.save\n", OPTIONS.workdir, getpid());
+	fprintf(io, "keysfile   %s/bench-shm.%i.keys\n", OPTIONS.workdir, getpid());
+	fprintf(io, "save.interval 3600\n");
+	fprintf(io, "shm.ring   %s/bench-shm.%i.ring\n", OPTIONS.workdir, getpid());
+	fprintf(io, "shm.size   %i\n\n", OPTIONS.size);
+
+	fprintf(io, "type :bench {\n  freshness 3600\n  warning \"no data\"\n}\n");
+	fprintf(io, "state :bench \"%s\"\n", FENCE_NAME);
+	fprintf(io, "window @bench 60\n");
+	fprintf(io, "counter @bench m/^bench\\.shm\\./\n");
+
+	fclose(io);
+	return path;
+}
+/* }}} */
+static void cleanup_files(const char *config) /* {{{ */
+{
+	char *s;
+	unlink(config);
+	s = scratch("save"); unlink(s); free(s);
+	s = scratch("keys"); unlink(s); free(s);
+	s = scratch("listener"); unlink(s); free(s);
+}
+/* }}} */
+
+static void submit(path_t *path, pdu_t *p) /* {{{ */
+{
+	if (path->push) {
+		if (pdu_send(p, path->push) != 0) {
+			fprintf(stderr, "failed to send to the listener: %s\n", zmq_strerror(errno));
+			exit(3);
+		}
+		return;
+	}
+
+	while (bolo_shm_send(path->shm, p) != 0) {
+		if (errno != EAGAIN) {
+			fprintf(stderr, "failed to send to the shm ring: %s\n", strerror(errno));
+			exit(3);
+		}
+		path->full++;
+		sched_yield();
+	}
+}
+/* }}} */
+static pdu_t *make_fence(uint64_t seq) /* {{{ */
+{
+	pdu_t *p = pdu_make("STATE", 0);
+	pdu_extendf(p, "%i", time_s());
+	pdu_extendf(p, "%s", FENCE_NAME);
+	pdu_extendf(p, "%i", 0);
+	pdu_extendf(p, "%lu", (unsigned long)seq);
+	return p;
+}
+/* }}} */
+/* wait for the broadcast of fence #seq; returns non-zero on timeout (ms) */
+static int await_fence(void *sub, uint64_t seq, int timeout) /* {{{ */
+{
+	char want[32];
+	snprintf(want, sizeof(want), "%lu", (unsigned long)seq);
+
+	for (;;) {
+		zmq_pollitem_t poller[1] = { { sub, 0, ZMQ_POLLIN } };
+		if (zmq_poll(poller, 1, timeout) <= 0)
+			return -1;
+
+		pdu_t *p = pdu_recv(sub);
+		if (!p)
+			continue;
+
+		int found = 0;
+		if (pdu_size(p) == 6) {
+			char *name = pdu_string(p, 1);
+			char *msg  = pdu_string(p, 5);
+			found = strcmp(name, FENCE_NAME) == 0 && strcmp(msg, want) == 0;
+			free(name);
+			free(msg);
+		}
+		pdu_free(p);
+		if (found)
+			return 0;
+	}
+}
+/* }}} */
+static void fence(path_t *path, void *sub, uint64_t *seq) /* {{{ */
+{
+	pdu_t *p = make_fence(++*seq);
+	submit(path, p);
+	pdu_free(p);
+	if (await_fence(sub, *seq, 10 * 1000) != 0) {
+		fprintf(stderr, "timed out waiting for the kernel to process fence #%lu (via %s)\n",
+			(unsigned long)*seq, path->name);
+		exit(3);
+	}
+}
+/* }}} */
+
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OPTIONS.messages = 200000;
+	OPTIONS.latency  = 2000;
+	OPTIONS.names    = 1000;
+	OPTIONS.size     = DEFAULT_SHM_SIZE;
+	OPTIONS.seed     = 1;
+	OPTIONS.workdir  = strdup("/tmp");
+
+	struct option long_opts[] = {
+		{ "help",           no_argument, NULL, 'h' },
+		{ "messages", required_argument, NULL, 'n' },
+		{ "latency",  required_argument, NULL, 'l' },
+		{ "names",    required_argument, NULL, 'c' },
+		{ "size",     required_argument, NULL, 's' },
+		{ "seed",     required_argument, NULL, 'S' },
+		{ "workdir",  required_argument, NULL, 'd' },
+		{ "debug",          no_argument, NULL, 'D' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?n:l:c:s:S:d:D", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'n': OPTIONS.messages = strtoull(optarg, NULL, 10); break;
+		case 'l': OPTIONS.latency  = strtoull(optarg, NULL, 10); break;
+		case 'c': OPTIONS.names    = atoi(optarg); break;
+		case 's': OPTIONS.size     = atoi(optarg); break;
+		case 'S': OPTIONS.seed     = strtoull(optarg, NULL, 10); break;
+		case 'd': free(OPTIONS.workdir); OPTIONS.workdir = strdup(optarg); break;
+		case 'D': OPTIONS.verbose  = 1; break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+
+	if (OPTIONS.names < 1 || OPTIONS.size < 4096) {
+		fprintf(stderr, "invalid workload; see -h\n");
+		exit(1);
+	}
+
+	log_open("bench/shm", "stderr");
+	log_level(OPTIONS.verbose ? LOG_DEBUG : LOG_CRIT, NULL);
+
+	char *config = write_config();
+
+	server_t *svr = vmalloc(sizeof(server_t));
+	svr->config.grace_period = DEFAULT_GRACE_PERIOD;
+	svr->config.save_size    = DEFAULT_SAVE_SIZE;
+	svr->config.topk_size     = DEFAULT_TOPK_SIZE;
+	svr->config.topk_interval = DEFAULT_TOPK_INTERVAL;
+	svr->interval.tick       = 1000;
+	svr->interval.freshness  = 2;
+	svr->interval.savestate  = DEFAULT_SAVE_INTERVAL;
+	svr->interval.sweep      = DEFAULT_SWEEP;
+	if (configure(config, svr) != 0) {
+		fprintf(stderr, "failed to configure kernel from generated %s\n", config);
+		exit(2);
+	}
+	char *listener = strdup(svr->config.listener);
+	char *ring     = strdup(svr->config.shm_ring);
+
+	void *zmq = zmq_ctx_new();
+	if (!zmq) {
+		fprintf(stderr, "failed to initialize 0MQ\n");
+		exit(2);
+	}
+
+	/* we stand in for the supervisor, so that we can shut things down */
+	void *command = zmq_socket(zmq, ZMQ_PUB);
+	if (!command || zmq_bind(command, "inproc://bolo/v1/supervisor.command") != 0) {
+		fprintf(stderr, "failed to bind supervisor.command: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	if (core_kernel_thread(zmq, svr) != 0
+	 || core_scheduler_thread(zmq, 1000) != 0) {
+		fprintf(stderr, "failed to start kernel / scheduler threads: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	/* unlimited high-water marks, so nothing gets dropped on the way */
+	int hwm = 0;
+	void *sub  = zmq_socket(zmq, ZMQ_SUB);
+	void *push = zmq_socket(zmq, ZMQ_PUSH);
+	if (!sub || !push
+	 || zmq_setsockopt(sub,  ZMQ_RCVHWM, &hwm, sizeof(hwm)) != 0
+	 || zmq_setsockopt(push, ZMQ_SNDHWM, &hwm, sizeof(hwm)) != 0
+	 || zmq_setsockopt(sub,  ZMQ_SUBSCRIBE, "STATE", 5) != 0
+	 || zmq_connect(sub,  BENCH_BROADCAST) != 0
+	 || zmq_connect(push, listener) != 0) {
+		fprintf(stderr, "failed to connect to kernel: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	path_t paths[2];
+	memset(paths, 0, sizeof(paths));
+	paths[0].name = "pull";
+	paths[0].push = push;
+	paths[1].name = "shm";
+	paths[1].shm  = bolo_shm_open(ring);
+	if (!paths[1].shm) {
+		fprintf(stderr, "failed to open shm ring %s: %s\n", ring, strerror(errno));
+		exit(2);
+	}
+
+	/* make sure the kernel is up, and our subscription has made it to
+	   the broadcast socket, before we start timing anything */
+	uint64_t i, seq = 0;
+	for (i = 0; ; i++) {
+		pdu_t *p = make_fence(++seq);
+		submit(&paths[0], p);
+		pdu_free(p);
+		if (await_fence(sub, seq, 100) == 0)
+			break;
+		if (i == 100) {
+			fprintf(stderr, "kernel never came up\n");
+			exit(3);
+		}
+	}
+
+	/* build every message up front, so that only the sending is timed */
+	uint64_t rng = OPTIONS.seed ? OPTIONS.seed : 1;
+	int32_t ts = time_s();
+	pdu_t **msgs = vcalloc(OPTIONS.messages, sizeof(pdu_t *));
+	for (i = 0; i < OPTIONS.messages; i++) {
+		msgs[i] = pdu_make("COUNTER", 0);
+		pdu_extendf(msgs[i], "%i", ts);
+		pdu_extendf(msgs[i], "bench.shm.m%i", (int)(bench_rand(&rng) % OPTIONS.names));
+		pdu_extendf(msgs[i], "%i", 1);
+	}
+
+	double secs[2];
+	bench_lat_t lat[2];
+	memset(lat, 0, sizeof(lat));
+
+	int k;
+	for (k = 0; k < 2; k++) {
+		path_t *path = &paths[k];
+
+		fprintf(stderr, "%s: sending %lu messages...\n", path->name, (unsigned long)OPTIONS.messages);
+		uint64_t t0 = bench_ns();
+		for (i = 0; i < OPTIONS.messages; i++)
+			submit(path, msgs[i]);
+		fence(path, sub, &seq);
+		secs[k] = (bench_ns() - t0) / 1e9;
+
+		fprintf(stderr, "%s: timing %lu round trips...\n", path->name, (unsigned long)OPTIONS.latency);
+		for (i = 0; i < OPTIONS.latency; i++) {
+			usleep(200); /* long enough to go idle */
+			t0 = bench_ns();
+			fence(path, sub, &seq);
+			bench_lat_add(&lat[k], bench_ns() - t0);
+		}
+	}
+
+	printf("---\n");
+	printf("# generated by bench/shm\n");
+	printf("benchmark: shm\n");
+	printf("workload:\n");
+	printf("  messages: %lu\n", (unsigned long)OPTIONS.messages);
+	printf("  latency: %lu\n",  (unsigned long)OPTIONS.latency);
+	printf("  names: %i\n",     OPTIONS.names);
+	printf("  size: %i\n",      OPTIONS.size);
+	printf("  seed: %lu\n",     (unsigned long)OPTIONS.seed);
+	for (k = 0; k < 2; k++) {
+		printf("%s:\n", paths[k].name);
+		printf("  seconds: %.6f\n", secs[k]);
+		printf("  msgs_per_sec: %.1f\n", secs[k] > 0 ? OPTIONS.messages / secs[k] : 0);
+		if (paths[k].shm)
+			printf("  full: %lu\n", (unsigned long)paths[k].full);
+		bench_lat_yaml(stdout, "  ", "round_trip", &lat[k]);
+	}
+
+	pdu_send_and_free(pdu_make("TERMINATE", 0), command);
+	bolo_shm_close(paths[1].shm);
+	zmq_close(push);
+	zmq_close(sub);
+	zmq_close(command);
+	/* give the kernel a moment to tear itself down */
+	sleep(1);
+
+	for (i = 0; i < OPTIONS.messages; i++)
+		pdu_free(msgs[i]);
+	free(msgs);
+	for (k = 0; k < 2; k++)
+		bench_lat_free(&lat[k]);
+	cleanup_files(config);
+	free(config);
+	free(listener);
+	free(ring);
+	free(OPTIONS.workdir);
+	return 0;
+}
@@ -0,0 +1,326 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/submitter - what a call to the libbolo submitter costs
+
+   This has -t threads call bolo_submitter_counter() (or, for -s
+   percent of the calls, bolo_submitter_sample()) -n times each,
+   across -c names, and reports nanoseconds per call.  For comparison,
+   it then does -n calls the old way, one bolo_counter_pdu() sent
+   per call, on a single thread.
+
+   Nothing here needs an aggregator: a PULL socket in this process
+   stands in for one, and tallies what the submitter sent it.  The
+   totals have to come out exact (every increment, every sample), or
+   it exits non-zero.
+ */
+
+#include "bench.h"
+#include <bolo.h>
+#include <getopt.h>
+
+static struct {
+	uint64_t  calls;     /* -n, per thread */
+	int       threads;   /* -t */
+	int       names;     /* -c */
+	int       samples;   /* -s, percent */
+	int       interval;  /* -i, ms */
+	int       max;       /* -m */
+	uint64_t  seed;      /* -S */
+	char     *workdir;   /* -d */
+} OPTIONS = { 0 };
+
+static bolo_submitter_t SUBMITTER;
+static char **NAMES;
+
+typedef struct {
+	pthread_t tid;
+	int       id;
+	uint64_t  ns;
+	uint64_t  counted, sampled;
+	int       done;
+} worker_t;
+
+/* what the sink has been sent */
+static struct {
+	uint64_t pdus, counted, sampled;
+} SEEN;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/submitter [options]\n\n");
+	printf("Options:\n");
+	printf("  -n, --calls N        calls per thread (default 5000000)\n");
+	printf("  -t, --threads N      calling threads (default 4)\n");
+	printf("  -c, --names N        distinct metric names (default 1000)\n");
+	printf("  -s, --samples PCT    percentage of calls that are samples (default 20)\n");
+	printf("  -i, --interval MS    submitter flush interval (default 1000)\n");
+	printf("  -m, --max N          names per thread before an early flush (default 4096)\n");
+	printf("  -S, --seed N         workload random seed (default 1)\n");
+	printf("  -d, --workdir PATH   scratch directory for the sink socket (default /tmp)\n");
+}
+/* }}} */
+
+static void * _worker(void *_) /* {{{ */
+{
+	worker_t *w = (worker_t *)_;
+	uint64_t i, rng = OPTIONS.seed + w->id;
+	const char *name;
+
+	/* pick every name up front; we are timing the calls, not the rng */
+	uint32_t *pick = vcalloc(OPTIONS.calls, sizeof(uint32_t));
+	for (i = 0; i < OPTIONS.calls; i++)
+		pick[i] = bench_rand(&rng) % (OPTIONS.names * 100);
+
+	uint64_t t0 = bench_ns();
+	for (i = 0; i < OPTIONS.calls; i++) {
+		name = NAMES[pick[i] % OPTIONS.names];
+		if ((int)(pick[i] / OPTIONS.names) < OPTIONS.samples) {
+			bolo_submitter_sample(SUBMITTER, name, (double)(i % 100));
+			w->sampled++;
+		} else {
+			bolo_submitter_counter(SUBMITTER, name, 1);
+			w->counted++;
+		}
+	}
+	w->ns = bench_ns() - t0;
+	__atomic_store_n(&w->done, 1, __ATOMIC_SEQ_CST);
+
+	free(pick);
+	return NULL;
+}
+/* }}} */
+static void tally(pdu_t *p) /* {{{ */
+{
+	SEEN.pdus++;
+	if (strcmp(pdu_type(p), "COUNTER") == 0 && pdu_size(p) == 4) {
+		char *v = pdu_string(p, 3);
+		SEEN.counted += strtoull(v, NULL, 10);
+		free(v);
+
+	} else if (strcmp(pdu_type(p), "SAMPLE.AGG") == 0 && pdu_size(p) == 9) {
+		char *v = pdu_string(p, 3);
+		SEEN.sampled += strtoull(v, NULL, 10);
+		free(v);
+	}
+}
+/* }}} */
+static void drain(void *sink, uint64_t counted, uint64_t sampled) /* {{{ */
+{
+	while (SEEN.counted < counted || SEEN.sampled < sampled) {
+		zmq_pollitem_t poller[1] = { { sink, 0, ZMQ_POLLIN } };
+		if (zmq_poll(poller, 1, 5000) <= 0)
+			return;
+
+		pdu_t *p = pdu_recv(sink);
+		if (!p)
+			continue;
+		tally(p);
+		pdu_free(p);
+	}
+}
+/* }}} */
+
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OPTIONS.calls    = 5000000;
+	OPTIONS.threads  = 4;
+	OPTIONS.names    = 1000;
+	OPTIONS.samples  = 20;
+	OPTIONS.interval = 1000;
+	OPTIONS.max      = 4096;
+	OPTIONS.seed     = 1;
+	OPTIONS.workdir  = strdup("/tmp");
+
+	struct option long_opts[] = {
+		{ "help",           no_argument, NULL, 'h' },
+		{ "calls",    required_argument, NULL, 'n' },
+		{ "threads",  required_argument, NULL, 't' },
+		{ "names",    required_argument, NULL, 'c' },
+		{ "samples",  required_argument, NULL, 's' },
+		{ "interval", required_argument, NULL, 'i' },
+		{ "max",      required_argument, NULL, 'm' },
+		{ "seed",     required_argument, NULL, 'S' },
+		{ "workdir",  required_argument, NULL, 'd' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?n:t:c:s:i:m:S:d:", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'n': OPTIONS.calls    = strtoull(optarg, NULL, 10); break;
+		case 't': OPTIONS.threads  = atoi(optarg); break;
+		case 'c': OPTIONS.names    = atoi(optarg); break;
+		case 's': OPTIONS.samples  = atoi(optarg); break;
+		case 'i': OPTIONS.interval = atoi(optarg); break;
+		case 'm': OPTIONS.max      = atoi(optarg); break;
+		case 'S': OPTIONS.seed     = strtoull(optarg, NULL, 10); break;
+		case 'd': free(OPTIONS.workdir); OPTIONS.workdir = strdup(optarg); break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+
+	if (OPTIONS.calls < 1 || OPTIONS.threads < 1 || OPTIONS.names < 1
+	 || OPTIONS.samples < 0 || OPTIONS.samples > 100
+	 || OPTIONS.interval < 1 || OPTIONS.max < 1) {
+		fprintf(stderr, "invalid workload; see -h\n");
+		exit(1);
+	}
+
+	int i;
+	NAMES = vcalloc(OPTIONS.names, sizeof(char *));
+	for (i = 0; i < OPTIONS.names; i++)
+		NAMES[i] = string("bench.submitter.m%i", i);
+
+	void *zmq = zmq_ctx_new();
+	if (!zmq) {
+		fprintf(stderr, "failed to initialize 0MQ\n");
+		exit(2);
+	}
+
+	int hwm = 0;
+	char *endpoint = string("ipc://%s/bench-submitter.%i.sink", OPTIONS.workdir, getpid());
+	void *sink = zmq_socket(zmq, ZMQ_PULL);
+	if (!sink
+	 || zmq_setsockopt(sink, ZMQ_RCVHWM, &hwm, sizeof(hwm)) != 0
+	 || zmq_bind(sink, endpoint) != 0) {
+		fprintf(stderr, "failed to bind %s: %s\n", endpoint, zmq_strerror(errno));
+		exit(2);
+	}
+
+	/* phase 1: the submitter {{{ */
+	SUBMITTER = bolo_submitter_new(zmq, endpoint, OPTIONS.interval, OPTIONS.max);
+	if (!SUBMITTER) {
+		fprintf(stderr, "failed to create a submitter: %s\n", strerror(errno));
+		exit(2);
+	}
+
+	fprintf(stderr, "submitter: %i thread(s) x %lu calls...\n",
+		OPTIONS.threads, (unsigned long)OPTIONS.calls);
+	worker_t *workers = vcalloc(OPTIONS.threads, sizeof(worker_t));
+	uint64_t t0 = bench_ns();
+	for (i = 0; i < OPTIONS.threads; i++) {
+		workers[i].id = i;
+		if (pthread_create(&workers[i].tid, NULL, _worker, &workers[i]) != 0) {
+			fprintf(stderr, "failed to start worker thread: %s\n", strerror(errno));
+			exit(2);
+		}
+	}
+
+	/* keep the sink drained while they work */
+	uint64_t counted = 0, sampled = 0, busy = 0;
+	for (i = 0; i < OPTIONS.threads; ) {
+		zmq_pollitem_t poller[1] = { { sink, 0, ZMQ_POLLIN } };
+		if (zmq_poll(poller, 1, 10) > 0) {
+			pdu_t *p = pdu_recv(sink);
+			if (p) {
+				tally(p);
+				pdu_free(p);
+			}
+			continue;
+		}
+		if (__atomic_load_n(&workers[i].done, __ATOMIC_SEQ_CST))
+			i++;
+	}
+	uint64_t wall = bench_ns() - t0;
+	for (i = 0; i < OPTIONS.threads; i++) {
+		pthread_join(workers[i].tid, NULL);
+		counted += workers[i].counted;
+		sampled += workers[i].sampled;
+		busy    += workers[i].ns;
+	}
+
+	bolo_submitter_free(SUBMITTER);
+	drain(sink, counted, sampled);
+	uint64_t pdus = SEEN.pdus;
+	/* }}} */
+
+	/* phase 2: one pdu per call, the old way {{{ */
+	fprintf(stderr, "direct: %lu calls...\n", (unsigned long)OPTIONS.calls);
+	void *push = zmq_socket(zmq, ZMQ_PUSH);
+	if (!push
+	 || zmq_setsockopt(push, ZMQ_SNDHWM, &hwm, sizeof(hwm)) != 0
+	 || zmq_connect(push, endpoint) != 0) {
+		fprintf(stderr, "failed to connect to %s: %s\n", endpoint, zmq_strerror(errno));
+		exit(2);
+	}
+
+	uint64_t n, rng = OPTIONS.seed, direct = bench_ns();
+	for (n = 0; n < OPTIONS.calls; n++)
+		pdu_send_and_free(bolo_counter_pdu(NAMES[bench_rand(&rng) % OPTIONS.names], 1), push);
+	direct = bench_ns() - direct;
+
+	/* the direct pdus are tallied too; just make sure they're gone */
+	drain(sink, counted + OPTIONS.calls, sampled);
+	/* }}} */
+
+	uint64_t calls = OPTIONS.calls * OPTIONS.threads;
+	printf("---\n");
+	printf("# generated by bench/submitter\n");
+	printf("benchmark: submitter\n");
+	printf("workload:\n");
+	printf("  calls: %lu\n",     (unsigned long)OPTIONS.calls);
+	printf("  threads: %i\n",    OPTIONS.threads);
+	printf("  names: %i\n",      OPTIONS.names);
+	printf("  samples_pct: %i\n", OPTIONS.samples);
+	printf("  interval_ms: %i\n", OPTIONS.interval);
+	printf("  max: %i\n",        OPTIONS.max);
+	printf("  seed: %lu\n",      (unsigned long)OPTIONS.seed);
+	printf("submitter:\n");
+	printf("  seconds: %.6f\n",       wall / 1e9);
+	printf("  calls_per_sec: %.1f\n", wall ? calls / (wall / 1e9) : 0);
+	printf("  ns_per_call: %.1f\n",   (double)busy / calls);
+	printf("  pdus: %lu\n",           (unsigned long)pdus);
+	printf("  calls_per_pdu: %.1f\n", pdus ? (double)calls / pdus : 0);
+	printf("direct:\n");
+	printf("  seconds: %.6f\n",       direct / 1e9);
+	printf("  calls_per_sec: %.1f\n", direct ? OPTIONS.calls / (direct / 1e9) : 0);
+	printf("  ns_per_call: %.1f\n",   (double)direct / OPTIONS.calls);
+
+	int rc = 0;
+	if (SEEN.counted != counted + OPTIONS.calls || SEEN.sampled != sampled) {
+		fprintf(stderr, "LOST SUBMISSIONS: %lu/%lu increments, %lu/%lu samples made it\n",
+			(unsigned long)SEEN.counted, (unsigned long)(counted + OPTIONS.calls),
+			(unsigned long)SEEN.sampled, (unsigned long)sampled);
+		rc = 4;
+	}
+
+	zmq_close(push);
+	zmq_close(sink);
+	zmq_ctx_destroy(zmq);
+	unlink(endpoint + strlen("ipc://"));
+	free(endpoint);
+	for (i = 0; i < OPTIONS.names; i++)
+		free(NAMES[i]);
+	free(NAMES);
+	free(workers);
+	free(OPTIONS.workdir);
+	return rc;
+}
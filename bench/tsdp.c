@@ -0,0 +1,393 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/tsdp - what it costs to pack and unpack TSDP PDUs
+
+   This builds -c distinct SUBMIT SAMPLE PDUs, each a timestamp, a
+   metric name (-l octets long) and a value, plus -f extra string
+   frames, and then times -n rounds (cycling through them) of:
+
+     pack          tsdp_pack() into a buffer we already have;
+     unpack        tsdp_unpack(), then every frame looked at through
+                   tsdp_get_frame_view(), then tsdp_destroy();
+     unpack+copy   the same, but with tsdp_get_frame_value(), which
+                   hands back a copy of each frame (as a consumer that
+                   can't hang onto the packed buffer would need);
+     stream        tsdp_stream_pack() of the PDUs one after another into
+                   one buffer, and then tsdp_stream_next() over it, fed
+                   in -b octet chunks (as if it had come off a socket),
+                   with every frame looked at, as for unpack.
+
+   For each, it reports PDUs and megabytes per second, and how many
+   allocations each PDU took.  Every unpacked PDU is checked against
+   the one it was packed from; any mismatch is a non-zero exit.
+ */
+
+#include "bench.h"
+#include <tsdp.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+static struct {
+	uint64_t  rounds;    /* -n */
+	int       count;     /* -c */
+	int       length;    /* -l */
+	int       extra;     /* -f */
+	int       chunk;     /* -b */
+	uint64_t  seed;      /* -S */
+} OPTIONS = { 0 };
+
+typedef struct {
+	tsdp_t  *pdu;
+	uint8_t *packed;
+	int      len;
+} sample_t;
+
+typedef struct {
+	uint64_t ns;
+	uint64_t allocs;
+	uint64_t octets;
+} result_t;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/tsdp [options]\n\n");
+	printf("Options:\n");
+	printf("  -n, --rounds N       PDUs to pack / unpack, per test (default 5000000)\n");
+	printf("  -c, --count N        distinct PDUs to cycle through (default 1000)\n");
+	printf("  -l, --length N       octets in each metric name (default 32)\n");
+	printf("  -f, --frames N       extra string frames per PDU (default 0)\n");
+	printf("  -b, --chunk N        octets per read, for the stream test (default 1500)\n");
+	printf("  -S, --seed N         workload random seed (default 1)\n");
+}
+/* }}} */
+
+static sample_t* corpus(void) /* {{{ */
+{
+	sample_t *all = calloc(OPTIONS.count, sizeof(sample_t));
+	char *name = malloc(OPTIONS.length > 0 ? OPTIONS.length : 1);
+	uint64_t rng = OPTIONS.seed;
+	int i, j, k;
+
+	for (i = 0; i < OPTIONS.count; i++) {
+		tsdp_t *pdu;
+		if (tsdp_create(&pdu, TSDP_VERSION, TSDP_OP_SUBMIT) != 0) {
+			fprintf(stderr, "tsdp_create() failed: %s\n", strerror(errno));
+			exit(2);
+		}
+		tsdp_set_payloads(pdu, TSDP_PAYLOAD_SAMPLE);
+
+		uint64_t ts  = 1476000000 + i;
+		uint64_t val = bench_rand(&rng);
+		for (j = 0; j < OPTIONS.length; j++)
+			name[j] = 'a' + bench_rand(&rng) % 26;
+
+		tsdp_extend(pdu, TSDP_TYPE_TSTAMP, &ts,  sizeof(ts));
+		tsdp_extend(pdu, TSDP_TYPE_STRING, name, OPTIONS.length);
+		tsdp_extend(pdu, TSDP_TYPE_FLOAT,  &val, sizeof(val));
+		for (k = 0; k < OPTIONS.extra; k++)
+			tsdp_extend(pdu, TSDP_TYPE_STRING, name, OPTIONS.length);
+
+		all[i].pdu    = pdu;
+		all[i].len    = tsdp_packed_size(pdu);
+		all[i].packed = malloc(all[i].len);
+		if (tsdp_pack(all[i].packed, all[i].len, pdu) != all[i].len) {
+			fprintf(stderr, "tsdp_pack() failed: %s\n", tsdp_error_str(errno));
+			exit(2);
+		}
+	}
+
+	free(name);
+	return all;
+}
+/* }}} */
+static int check(sample_t *s, tsdp_t *got) /* {{{ */
+{
+	int i, n = tsdp_get_size(s->pdu);
+	if (tsdp_get_size(got) != n
+	 || tsdp_get_opcode(got)   != tsdp_get_opcode(s->pdu)
+	 || tsdp_get_payloads(got) != tsdp_get_payloads(s->pdu))
+		return 1;
+
+	for (i = 0; i < n; i++) {
+		const void *a, *b;
+		int alen, blen, type = tsdp_get_frame_type(s->pdu, i);
+		if (tsdp_get_frame_view(s->pdu, i, type, &a, &alen) != 0
+		 || tsdp_get_frame_view(got,    i, type, &b, &blen) != 0
+		 || alen != blen || memcmp(a, b, alen) != 0)
+			return 1;
+	}
+	return 0;
+}
+/* }}} */
+
+static result_t bench_pack(sample_t *all) /* {{{ */
+{
+	result_t r = { 0 };
+	uint8_t buf[65536];
+	uint64_t i;
+
+	uint64_t a0 = bench_thread_allocs();
+	uint64_t t0 = bench_ns();
+	for (i = 0; i < OPTIONS.rounds; i++) {
+		sample_t *s = &all[i % OPTIONS.count];
+		int n = tsdp_pack(buf, sizeof(buf), s->pdu);
+		if (n < 0) {
+			fprintf(stderr, "tsdp_pack() failed: %s\n", tsdp_error_str(-n));
+			exit(2);
+		}
+		r.octets += n;
+	}
+	r.ns     = bench_ns() - t0;
+	r.allocs = bench_thread_allocs() - a0;
+	return r;
+}
+/* }}} */
+static result_t bench_unpack(sample_t *all, int copy, int *bad) /* {{{ */
+{
+	result_t r = { 0 };
+	uint64_t i, sum = 0;
+
+	uint64_t a0 = bench_thread_allocs();
+	uint64_t t0 = bench_ns();
+	for (i = 0; i < OPTIONS.rounds; i++) {
+		sample_t *s = &all[i % OPTIONS.count];
+		tsdp_t *pdu;
+		int rc = tsdp_unpack(&pdu, s->packed, s->len);
+		if (rc != 0) {
+			fprintf(stderr, "tsdp_unpack() failed: %s\n", tsdp_error_str(-rc));
+			exit(2);
+		}
+
+		/* look at every frame, the way a consumer would */
+		int f, n = tsdp_get_size(pdu);
+		for (f = 0; f < n; f++) {
+			int len, type = tsdp_get_frame_type(pdu, f);
+			if (copy) {
+				void *v;
+				tsdp_get_frame_value(pdu, f, type, &v, &len);
+				sum += len ? ((uint8_t *)v)[0] : 0;
+				free(v);
+			} else {
+				const void *v;
+				tsdp_get_frame_view(pdu, f, type, &v, &len);
+				sum += len ? ((const uint8_t *)v)[0] : 0;
+			}
+		}
+
+		/* only check the first time through the corpus,
+		   so that we mostly time the codec, not memcmp */
+		if (i < (uint64_t)OPTIONS.count && check(s, pdu) != 0)
+			(*bad)++;
+
+		tsdp_destroy(pdu);
+		r.octets += s->len;
+	}
+	r.ns     = bench_ns() - t0;
+	r.allocs = bench_thread_allocs() - a0;
+
+	if (sum == 42) /* keep the frame reads from being optimized away */
+		fprintf(stderr, "\n");
+	return r;
+}
+/* }}} */
+static result_t bench_stream_pack(sample_t *all, uint8_t *buf, size_t cap, size_t *len) /* {{{ */
+{
+	result_t r = { 0 };
+	uint64_t i;
+
+	uint64_t a0 = bench_thread_allocs();
+	uint64_t t0 = bench_ns();
+	for (i = 0; i < OPTIONS.rounds; i++) {
+		/* start the buffer over, every time through the corpus */
+		if (i % OPTIONS.count == 0)
+			*len = 0;
+
+		int n = tsdp_stream_pack(buf + *len, cap - *len, all[i % OPTIONS.count].pdu);
+		if (n < 0) {
+			fprintf(stderr, "tsdp_stream_pack() failed: %s\n", tsdp_error_str(-n));
+			exit(2);
+		}
+		*len     += n;
+		r.octets += n;
+	}
+	r.ns     = bench_ns() - t0;
+	r.allocs = bench_thread_allocs() - a0;
+
+	/* leave the whole corpus in buf, for bench_stream() */
+	for (*len = 0, i = 0; i < (uint64_t)OPTIONS.count; i++)
+		*len += tsdp_stream_pack(buf + *len, cap - *len, all[i].pdu);
+	return r;
+}
+/* }}} */
+static result_t bench_stream(sample_t *all, const uint8_t *buf, size_t len, int *bad) /* {{{ */
+{
+	result_t r = { 0 };
+	uint64_t i = 0, sum = 0;
+	tsdp_stream_t *stream;
+	const tsdp_t *pdu;
+
+	if (tsdp_stream_new(&stream, 0) != 0) {
+		fprintf(stderr, "tsdp_stream_new() failed: %s\n", strerror(errno));
+		exit(2);
+	}
+
+	uint64_t a0 = bench_thread_allocs();
+	uint64_t t0 = bench_ns();
+	while (i < OPTIONS.rounds) {
+		size_t at;
+		for (at = 0; at < len && i < OPTIONS.rounds; at += OPTIONS.chunk) {
+			tsdp_stream_feed(stream, buf + at, len - at < (size_t)OPTIONS.chunk ? len - at : (size_t)OPTIONS.chunk);
+
+			int rc;
+			while ((rc = tsdp_stream_next(stream, &pdu)) == 1) {
+				int f, n = tsdp_get_size(pdu);
+				for (f = 0; f < n; f++) {
+					const void *v;
+					int len;
+					tsdp_get_frame_view(pdu, f, tsdp_get_frame_type(pdu, f), &v, &len);
+					sum += len ? ((const uint8_t *)v)[0] : 0;
+				}
+				if (i < (uint64_t)OPTIONS.count && check(&all[i], (tsdp_t *)pdu) != 0)
+					(*bad)++;
+				r.octets += tsdp_stream_packed_size(pdu);
+				i++;
+			}
+			if (rc != 0) {
+				fprintf(stderr, "tsdp_stream_next() failed: %s\n", tsdp_error_str(-rc));
+				exit(2);
+			}
+		}
+	}
+	r.ns     = bench_ns() - t0;
+	r.allocs = bench_thread_allocs() - a0;
+	tsdp_stream_destroy(stream);
+
+	if (sum == 42)
+		fprintf(stderr, "\n");
+	return r;
+}
+/* }}} */
+
+static void report(const char *key, result_t *r) /* {{{ */
+{
+	double secs = r->ns / 1e9;
+	printf("%s:\n", key);
+	printf("  seconds: %.6f\n",         secs);
+	printf("  pdus_per_sec: %.1f\n",    secs ? OPTIONS.rounds / secs : 0);
+	printf("  mb_per_sec: %.1f\n",      secs ? r->octets / secs / 1048576.0 : 0);
+	printf("  ns_per_pdu: %.1f\n",      (double)r->ns / OPTIONS.rounds);
+	printf("  allocs_per_pdu: %.2f\n",  (double)r->allocs / OPTIONS.rounds);
+}
+/* }}} */
+
+int main(int argc, char **argv)
+{
+	OPTIONS.rounds = 5000000;
+	OPTIONS.count  = 1000;
+	OPTIONS.length = 32;
+	OPTIONS.extra  = 0;
+	OPTIONS.chunk  = 1500;
+	OPTIONS.seed   = 1;
+
+	struct option long_opts[] = {
+		{ "help",         no_argument, NULL, 'h' },
+		{ "rounds", required_argument, NULL, 'n' },
+		{ "count",  required_argument, NULL, 'c' },
+		{ "length", required_argument, NULL, 'l' },
+		{ "frames", required_argument, NULL, 'f' },
+		{ "chunk",  required_argument, NULL, 'b' },
+		{ "seed",   required_argument, NULL, 'S' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?n:c:l:f:b:S:", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'n': OPTIONS.rounds = strtoull(optarg, NULL, 10); break;
+		case 'c': OPTIONS.count  = atoi(optarg); break;
+		case 'l': OPTIONS.length = atoi(optarg); break;
+		case 'f': OPTIONS.extra  = atoi(optarg); break;
+		case 'b': OPTIONS.chunk  = atoi(optarg); break;
+		case 'S': OPTIONS.seed   = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+	if (OPTIONS.rounds < 1 || OPTIONS.count < 1
+	 || OPTIONS.length < 0 || OPTIONS.length > TSDP_MAX_FRAME
+	 || OPTIONS.extra < 0  || OPTIONS.extra > 8 || OPTIONS.chunk < 1) {
+		fprintf(stderr, "bad options; see --help\n");
+		return 1;
+	}
+
+	fprintf(stderr, "building %i PDUs...\n", OPTIONS.count);
+	sample_t *all = corpus();
+	int bad = 0;
+
+	fprintf(stderr, "packing %lu PDUs...\n", (unsigned long)OPTIONS.rounds);
+	result_t pack = bench_pack(all);
+	fprintf(stderr, "unpacking %lu PDUs...\n", (unsigned long)OPTIONS.rounds);
+	result_t view = bench_unpack(all, 0, &bad);
+	fprintf(stderr, "unpacking (and copying) %lu PDUs...\n", (unsigned long)OPTIONS.rounds);
+	result_t copy = bench_unpack(all, 1, &bad);
+
+	size_t len = 0, cap = (size_t)OPTIONS.count * (4 + 2 * (4 + OPTIONS.extra) + 16 + OPTIONS.length * (1 + OPTIONS.extra));
+	uint8_t *buf = malloc(cap);
+	fprintf(stderr, "stream-packing %lu PDUs...\n", (unsigned long)OPTIONS.rounds);
+	result_t spack = bench_stream_pack(all, buf, cap, &len);
+	fprintf(stderr, "stream-unpacking %lu PDUs, %i octets at a time...\n", (unsigned long)OPTIONS.rounds, OPTIONS.chunk);
+	result_t stream = bench_stream(all, buf, len, &bad);
+	free(buf);
+
+	printf("---\n");
+	printf("# generated by bench/tsdp\n");
+	printf("benchmark: tsdp\n");
+	printf("workload:\n");
+	printf("  rounds: %lu\n",     (unsigned long)OPTIONS.rounds);
+	printf("  count: %i\n",       OPTIONS.count);
+	printf("  length: %i\n",      OPTIONS.length);
+	printf("  frames: %i\n",      3 + OPTIONS.extra);
+	printf("  chunk: %i\n",       OPTIONS.chunk);
+	printf("  octets_per_pdu: %i\n", all[0].len);
+	printf("  seed: %lu\n",       (unsigned long)OPTIONS.seed);
+	report("pack",        &pack);
+	report("unpack",      &view);
+	report("unpack_copy", &copy);
+	report("stream_pack", &spack);
+	report("stream",      &stream);
+	printf("mismatches: %i\n", bad);
+
+	int i;
+	for (i = 0; i < OPTIONS.count; i++) {
+		tsdp_destroy(all[i].pdu);
+		free(all[i].packed);
+	}
+	free(all);
+	return bad ? 1 : 0;
+}
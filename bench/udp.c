@@ -0,0 +1,368 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   bench/udp - blast datagrams at the kernel's udp listener, on localhost
+
+   This links core.c, data.c and config.c directly (like bench/kernel),
+   turns on udp.port, and sends -n datagrams of COUNTER lines as fast
+   as sendmmsg(2) will let it.  Then it watches the kernel's own udp
+   counters (from a STATS request) until they stop moving, and reports
+   how many datagrams per second made it in, and how many the OS had
+   to drop on the way.
+ */
+
+#define _GNU_SOURCE /* for sendmmsg(2) */
+#include "bench.h"
+#include "../src/bolo.h"
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BENCH_CONTROLLER "inproc://bench/controller"
+#define BENCH_BROADCAST  "inproc://bench/broadcast"
+#define SEND_BATCH       64
+
+static struct {
+	uint64_t  datagrams; /* -n */
+	int       lines;     /* -L, per datagram */
+	int       names;     /* -c */
+	int       port;      /* -p */
+	int       buffer;    /* -b, udp.buffer */
+	uint64_t  seed;      /* -s */
+	char     *workdir;   /* -d */
+	int       verbose;   /* -D */
+} OPTIONS = { 0 };
+
+typedef struct {
+	uint64_t datagrams, batches, submissions;
+	uint64_t malformed, truncated, overflowed;
+} udp_stats_t;
+
+/*************************************************************************/
+
+static void usage(void) /* {{{ */
+{
+	printf("Usage: bench/udp [options]\n\n");
+	printf("Options:\n");
+	printf("  -n, --datagrams N    datagrams to send (default 200000)\n");
+	printf("  -L, --lines N        COUNTER lines per datagram (default 1)\n");
+	printf("  -c, --names N        distinct counter names (default 1000)\n");
+	printf("  -p, --port N         udp port to listen on (default 29990)\n");
+	printf("  -b, --buffer BYTES   udp.buffer, the socket receive buffer\n");
+	printf("                       (default 0, up to the OS)\n");
+	printf("  -s, --seed N         workload random seed (default 1)\n");
+	printf("  -d, --workdir PATH   scratch directory for save/keys files (default /tmp)\n");
+	printf("  -D, --debug          turn on kernel debug logging (slow!)\n");
+}
+/* }}} */
+
+static char *write_config(void) /* {{{ */
+{
+	char *path = string("%s/bench-udp.%i.conf", OPTIONS.workdir, getpid());
+	FILE *io = fopen(path, "w");
+	if (!io) {
+		fprintf(stderr, "failed to write %s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+
+	fprintf(io, "# generated by bench/udp\n");
+	fprintf(io, "controller %s\n", BENCH_CONTROLLER);
+	fprintf(io, "broadcast  %s\n", BENCH_BROADCAST);
+	fprintf(io, "savefile   %s/bench-udp.%i.save\n", OPTIONS.workdir, getpid());
+	fprintf(io, "keysfile   %s/bench-udp.%i.keys\n", OPTIONS.workdir, getpid());
+	fprintf(io, "save.interval 3600\n");
+	fprintf(io, "udp.port   %i\n", OPTIONS.port);
+	fprintf(io, "udp.buffer %i\n\n", OPTIONS.buffer);
+
+	fprintf(io, "window @bench 60\n");
+	fprintf(io, "counter @bench m/^bench\\.udp\\./\n");
+
+	fclose(io);
+	return path;
+}
+/* }}} */
+static void cleanup_files(const char *config) /* {{{ */
+{
+	char *s;
+	unlink(config);
+	s = string("%s/bench-udp.%i.save", OPTIONS.workdir, getpid()); unlink(s); free(s);
+	s = string("%s/bench-udp.%i.keys", OPTIONS.workdir, getpid()); unlink(s); free(s);
+}
+/* }}} */
+
+static uint64_t stat_field(const char *yaml, const char *field) /* {{{ */
+{
+	const char *s = strstr(yaml, "\nudp:\n");
+	if (!s || !(s = strstr(s, field)))
+		return 0;
+	return strtoull(s + strlen(field), NULL, 10);
+}
+/* }}} */
+static int get_stats(void *controller, udp_stats_t *st) /* {{{ */
+{
+	pdu_send_and_free(pdu_make("STATS", 0), controller);
+	pdu_t *p = pdu_recv(controller);
+	if (!p)
+		return -1;
+
+	char *yaml = pdu_size(p) == 2 ? pdu_string(p, 1) : NULL;
+	pdu_free(p);
+	if (!yaml)
+		return -1;
+
+	st->datagrams   = stat_field(yaml, "datagrams:");
+	st->batches     = stat_field(yaml, "batches:");
+	st->submissions = stat_field(yaml, "submissions:");
+	st->malformed   = stat_field(yaml, "malformed:");
+	st->truncated   = stat_field(yaml, "truncated:");
+	st->overflowed  = stat_field(yaml, "overflowed:");
+	free(yaml);
+	return 0;
+}
+/* }}} */
+
+/*************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OPTIONS.datagrams = 200000;
+	OPTIONS.lines     = 1;
+	OPTIONS.names     = 1000;
+	OPTIONS.port      = 29990;
+	OPTIONS.buffer    = 0;
+	OPTIONS.seed      = 1;
+	OPTIONS.workdir   = strdup("/tmp");
+
+	struct option long_opts[] = {
+		{ "help",            no_argument, NULL, 'h' },
+		{ "datagrams", required_argument, NULL, 'n' },
+		{ "lines",     required_argument, NULL, 'L' },
+		{ "names",     required_argument, NULL, 'c' },
+		{ "port",      required_argument, NULL, 'p' },
+		{ "buffer",    required_argument, NULL, 'b' },
+		{ "seed",      required_argument, NULL, 's' },
+		{ "workdir",   required_argument, NULL, 'd' },
+		{ "debug",           no_argument, NULL, 'D' },
+		{ 0, 0, 0, 0 },
+	};
+	for (;;) {
+		int idx = 1;
+		int c = getopt_long(argc, argv, "h?n:L:c:p:b:s:d:D", long_opts, &idx);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+		case '?': usage(); exit(0);
+		case 'n': OPTIONS.datagrams = strtoull(optarg, NULL, 10); break;
+		case 'L': OPTIONS.lines     = atoi(optarg); break;
+		case 'c': OPTIONS.names     = atoi(optarg); break;
+		case 'p': OPTIONS.port      = atoi(optarg); break;
+		case 'b': OPTIONS.buffer    = atoi(optarg); break;
+		case 's': OPTIONS.seed      = strtoull(optarg, NULL, 10); break;
+		case 'd': free(OPTIONS.workdir); OPTIONS.workdir = strdup(optarg); break;
+		case 'D': OPTIONS.verbose   = 1; break;
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+
+	if (OPTIONS.lines < 1 || OPTIONS.names < 1
+	 || OPTIONS.port < 1 || OPTIONS.port > 65535 || OPTIONS.buffer < 0) {
+		fprintf(stderr, "invalid workload; see -h\n");
+		exit(1);
+	}
+
+	log_open("bench/udp", "stderr");
+	log_level(OPTIONS.verbose ? LOG_DEBUG : LOG_CRIT, NULL);
+
+	char *config = write_config();
+
+	server_t *svr = vmalloc(sizeof(server_t));
+	svr->config.grace_period = DEFAULT_GRACE_PERIOD;
+	svr->config.save_size    = DEFAULT_SAVE_SIZE;
+	svr->config.topk_size     = DEFAULT_TOPK_SIZE;
+	svr->config.topk_interval = DEFAULT_TOPK_INTERVAL;
+	svr->interval.tick       = 1000;
+	svr->interval.freshness  = 2;
+	svr->interval.savestate  = DEFAULT_SAVE_INTERVAL;
+	svr->interval.sweep      = DEFAULT_SWEEP;
+	if (configure(config, svr) != 0) {
+		fprintf(stderr, "failed to configure kernel from generated %s\n", config);
+		exit(2);
+	}
+
+	void *zmq = zmq_ctx_new();
+	if (!zmq) {
+		fprintf(stderr, "failed to initialize 0MQ\n");
+		exit(2);
+	}
+
+	/* we stand in for the supervisor, so that we can shut things down */
+	void *command = zmq_socket(zmq, ZMQ_PUB);
+	if (!command || zmq_bind(command, "inproc://bolo/v1/supervisor.command") != 0) {
+		fprintf(stderr, "failed to bind supervisor.command: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	if (core_kernel_thread(zmq, svr) != 0
+	 || core_scheduler_thread(zmq, 1000) != 0) {
+		fprintf(stderr, "failed to start kernel / scheduler threads: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	void *controller = zmq_socket(zmq, ZMQ_DEALER);
+	if (!controller || zmq_connect(controller, BENCH_CONTROLLER) != 0) {
+		fprintf(stderr, "failed to connect to kernel: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(OPTIONS.port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		fprintf(stderr, "failed to set up the udp sender: %s\n", strerror(errno));
+		exit(2);
+	}
+
+	/* build every datagram up front, so that we only time the sending */
+	fprintf(stderr, "building %lu datagrams...\n", (unsigned long)OPTIONS.datagrams);
+	uint64_t i, rng = OPTIONS.seed ? OPTIONS.seed : 1, bytes = 0;
+	int32_t ts = time_s();
+	char **dgrams = vcalloc(OPTIONS.datagrams, sizeof(char *));
+	size_t *lens  = vcalloc(OPTIONS.datagrams, sizeof(size_t));
+	for (i = 0; i < OPTIONS.datagrams; i++) {
+		strings_t *l = strings_new(NULL);
+		int j;
+		for (j = 0; j < OPTIONS.lines; j++) {
+			char *line = string("COUNTER %i bench.udp.m%i 1",
+				ts, (int)(bench_rand(&rng) % OPTIONS.names));
+			strings_add(l, line);
+			free(line);
+		}
+		dgrams[i] = strings_join(l, "\n");
+		lens[i]   = strlen(dgrams[i]);
+		bytes    += lens[i];
+		strings_free(l);
+	}
+
+	/* make sure the kernel is up before we start timing anything */
+	udp_stats_t before, now;
+	if (get_stats(controller, &before) != 0) {
+		fprintf(stderr, "kernel never came up\n");
+		exit(3);
+	}
+
+	fprintf(stderr, "sending...\n");
+	struct mmsghdr msgs[SEND_BATCH];
+	struct iovec   iov[SEND_BATCH];
+	uint64_t failed = 0, t0 = bench_ns(), t1, t2;
+	for (i = 0; i < OPTIONS.datagrams; ) {
+		int j, n = OPTIONS.datagrams - i < SEND_BATCH ? OPTIONS.datagrams - i : SEND_BATCH;
+		memset(msgs, 0, sizeof(msgs));
+		for (j = 0; j < n; j++) {
+			iov[j].iov_base = dgrams[i + j];
+			iov[j].iov_len  = lens[i + j];
+			msgs[j].msg_hdr.msg_iov    = &iov[j];
+			msgs[j].msg_hdr.msg_iovlen = 1;
+		}
+		int rc = sendmmsg(fd, msgs, n, 0);
+		if (rc <= 0) {
+			/* ECONNREFUSED and the like; count it, and move on */
+			failed++;
+			i++;
+			continue;
+		}
+		i += rc;
+	}
+	t1 = bench_ns();
+
+	/* wait for the kernel's counters to settle */
+	fprintf(stderr, "waiting for the listener to catch up...\n");
+	uint64_t seen = 0;
+	t2 = t1; /* when the counters last moved */
+	for (;;) {
+		if (get_stats(controller, &now) != 0) {
+			fprintf(stderr, "failed to get stats from the kernel\n");
+			exit(3);
+		}
+		uint64_t total = now.datagrams + now.overflowed
+		               - before.datagrams - before.overflowed;
+		if (total != seen) {
+			seen = total;
+			t2 = bench_ns();
+		}
+		if (total >= OPTIONS.datagrams - failed
+		 || bench_ns() - t2 > 500 * 1000 * 1000)
+			break;
+		usleep(5 * 1000);
+	}
+
+	uint64_t received  = now.datagrams   - before.datagrams;
+	uint64_t submitted = now.submissions - before.submissions;
+	uint64_t batches   = now.batches     - before.batches;
+	uint64_t dropped   = now.overflowed  - before.overflowed;
+	double send_s = (t1 - t0) / 1e9;
+	double recv_s = (t2 - t0) / 1e9;
+
+	printf("---\n");
+	printf("# generated by bench/udp\n");
+	printf("benchmark: udp\n");
+	printf("workload:\n");
+	printf("  datagrams: %lu\n", (unsigned long)OPTIONS.datagrams);
+	printf("  lines_per_datagram: %i\n", OPTIONS.lines);
+	printf("  bytes_per_datagram: %.1f\n", OPTIONS.datagrams ? (double)bytes / OPTIONS.datagrams : 0);
+	printf("  names: %i\n", OPTIONS.names);
+	printf("  buffer: %i\n", OPTIONS.buffer);
+	printf("  seed: %lu\n", (unsigned long)OPTIONS.seed);
+	printf("send:\n");
+	printf("  seconds: %.6f\n", send_s);
+	printf("  datagrams_per_sec: %.1f\n", send_s > 0 ? OPTIONS.datagrams / send_s : 0);
+	printf("  failed: %lu\n", (unsigned long)failed);
+	printf("receive:\n");
+	printf("  seconds: %.6f\n", recv_s);
+	printf("  datagrams: %lu\n", (unsigned long)received);
+	printf("  datagrams_per_sec: %.1f\n", recv_s > 0 ? received / recv_s : 0);
+	printf("  submissions_per_sec: %.1f\n", recv_s > 0 ? submitted / recv_s : 0);
+	printf("  per_batch: %.2f\n", batches ? (double)received / batches : 0);
+	printf("  overflowed: %lu\n", (unsigned long)dropped);
+	printf("  truncated: %lu\n", (unsigned long)(now.truncated - before.truncated));
+	printf("  loss_pct: %.3f\n", OPTIONS.datagrams ? 100.0 * (OPTIONS.datagrams - received) / OPTIONS.datagrams : 0);
+
+	pdu_send_and_free(pdu_make("TERMINATE", 0), command);
+	zmq_close(controller);
+	zmq_close(command);
+	close(fd);
+	/* give the kernel a moment to tear itself down */
+	sleep(1);
+
+	for (i = 0; i < OPTIONS.datagrams; i++)
+		free(dgrams[i]);
+	free(dgrams);
+	free(lens);
+	cleanup_files(config);
+	free(config);
+	free(OPTIONS.workdir);
+	return 0;
+}
@@ -24,6 +24,7 @@
 #include <stdint.h>
 
 typedef struct __tsdp_pdu tsdp_t;
+typedef struct __tsdp_stream tsdp_stream_t;
 typedef long long         tsdp_tstamp_t;
 
 #define  TSDP_VERSION  1
@@ -51,8 +52,12 @@ typedef long long         tsdp_tstamp_t;
 #define  TSDP_TYPE_FLOAT     0x02
 #define  TSDP_TYPE_STRING    0x03
 #define  TSDP_TYPE_TSTAMP    0x04
+#define  TSDP_BIGGEST_TYPE   TSDP_TYPE_TSTAMP
 #define  TSDP_RESERVED_TYPE  0xfb
 
+/* frame sizes are 12 bits on the wire */
+#define  TSDP_MAX_FRAME      0xfff
+
 #define  TSDP_F_ROLLOVER            0x80
 #define  TSDP_F_UNSUBSCRIBE         0x80
 #define  TSDP_F_STATE_OK            0
@@ -77,14 +82,32 @@ typedef long long         tsdp_tstamp_t;
 #define  TSDP_EEARLYFF 2
 #define  TSDP_ENOFF    3
 #define  TSDP_EBADTYPE 4
-#define  TSDP_BIGGEST_ERROR  TSDP_EBADTYPE
+#define  TSDP_E2BIG    5
+#define  TSDP_BIGGEST_ERROR  TSDP_E2BIG
 
 const char* tsdp_error_str(int error);
-const char* tsdp__opcode_str(int opcode);
+const char* tsdp_opcode_str(int opcode);
+
+/* how many octets tsdp_pack() will need for this pdu */
+int tsdp_packed_size(const tsdp_t *pdu);
 
-int tsdp_pack(uint8_t **buf, size_t *len, const tsdp_t *pdu);
+/* pack pdu into the first tsdp_packed_size(pdu) octets of
+   buf, and return that many, or -TSDP_E2SMALL if len is not
+   enough.  nothing is allocated. */
+int tsdp_pack(uint8_t *buf, size_t len, const tsdp_t *pdu);
+
+/* unpack exactly one pdu from the len octets at buf.  the
+   frames of the new pdu point into buf, rather than copies
+   of it, so buf has to outlive the pdu (tsdp_extend() is
+   still fine; those frames are the pdu's own). */
 int tsdp_unpack(tsdp_t **pdu, const uint8_t *buf, size_t len);
 
+/* find the first STRING frame (the name, for a SUBMIT, or first
+   key, for a FACT) of the packed pdu at buf, without unpacking it,
+   and return it, with its size in *n.  if there isn't one, that is
+   the whole of buf, so that it still makes a key to go by. */
+const uint8_t* tsdp_packed_key(const uint8_t *buf, size_t len, size_t *n);
+
 int tsdp_create(tsdp_t **pdu, int version, int opcode);
 int tsdp_destroy(tsdp_t *pdu);
 
@@ -97,12 +120,61 @@ int tsdp_get_size     (const tsdp_t *pdu);
 int tsdp_get_frame_type  (const tsdp_t *pdu, int frame);
 int tsdp_get_frame_size  (const tsdp_t *pdu, int frame);
 int tsdp_get_frame_value (const tsdp_t *pdu, int frame, int type, void **data, int *len);
+int tsdp_get_frame_view  (const tsdp_t *pdu, int frame, int type, const void **data, int *len);
 
 int tsdp_set_version  (tsdp_t *pdu, int version);
 int tsdp_set_opcode   (tsdp_t *pdu, int opcode);
 int tsdp_set_flags    (tsdp_t *pdu, int flags);
 int tsdp_set_payloads (tsdp_t *pdu, int payloads);
 
-int tsdp_extend(tsdp_t *pdu, int type, void *data, int len);
+int tsdp_extend(tsdp_t *pdu, int type, const void *data, int len);
+
+/* typed frames, in network byte order (see tsdp/values.c) */
+int tsdp_extend_uint   (tsdp_t *pdu, uint64_t v);
+int tsdp_extend_float  (tsdp_t *pdu, double v);
+int tsdp_extend_tstamp (tsdp_t *pdu, tsdp_tstamp_t ms);
+int tsdp_extend_string (tsdp_t *pdu, const char *s);
+
+int tsdp_get_uint   (const tsdp_t *pdu, int frame, uint64_t *v);
+int tsdp_get_float  (const tsdp_t *pdu, int frame, double *v);
+int tsdp_get_tstamp (const tsdp_t *pdu, int frame, tsdp_tstamp_t *ms);
+
+/* TSDP over a byte stream (TCP, or several PDUs batched up in
+   one datagram) is just one packed PDU after another; each one
+   ends with its final frame.  A PDU with no frames at all (a
+   HEARTBEAT, say) has no final frame to end on, so on a stream
+   it gets one empty NIL frame, which the decoder drops again
+   (so a PDU of just one empty NIL frame can't be streamed). */
+
+/* how many octets tsdp_stream_pack() will need for this pdu */
+int tsdp_stream_packed_size(const tsdp_t *pdu);
+
+/* like tsdp_pack(), but for a stream; to batch PDUs, pack
+   each one where the last one left off. */
+int tsdp_stream_pack(uint8_t *buf, size_t len, const tsdp_t *pdu);
+
+/* an incremental decoder, for PDUs of up to max octets each
+   (or TSDP_STREAM_MAX, if max is 0) */
+#define TSDP_STREAM_MAX 65536
+int tsdp_stream_new(tsdp_stream_t **stream, size_t max);
+int tsdp_stream_destroy(tsdp_stream_t *stream);
+
+/* start the decoder over, as if it were new (errors and all), but
+   without giving back what it has allocated; for a decoder that is
+   used once per datagram, say. */
+int tsdp_stream_reset(tsdp_stream_t *stream);
+
+/* hand the decoder the next len octets of the stream.  buf is
+   not copied, so it has to stay put until tsdp_stream_next()
+   returns 0 (or an error); only then can more be fed in. */
+int tsdp_stream_feed(tsdp_stream_t *stream, const uint8_t *buf, size_t len);
+
+/* get the next complete pdu from the stream, returning 1 if
+   there was one, or 0 if it needs to be fed more first.  the
+   pdu belongs to the decoder, and is only good until the next
+   call; nothing gets allocated per pdu.  errors are for good:
+   there is no way to find the start of the next pdu after a
+   bad one, so the stream has to be dropped. */
+int tsdp_stream_next(tsdp_stream_t *stream, const tsdp_t **pdu);
 
 #endif
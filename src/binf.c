@@ -21,11 +21,31 @@
 #include <sys/mman.h>
 
 #define RECORD_TYPE_MASK  0x000f
+#define RECORD_TYPE_FREE     0x0
 #define RECORD_TYPE_STATE    0x1
 #define RECORD_TYPE_COUNTER  0x2
 #define RECORD_TYPE_SAMPLE   0x3
 #define RECORD_TYPE_EVENT    0x4
 #define RECORD_TYPE_RATE     0x5
+#define RECORD_TYPE_EVENTS   0x6
+
+/* v1 savefiles mangled floating point sample data (it was
+   run through htonl, truncating it to a 32-bit integer);
+   v2 stores doubles as IEEE-754 bit patterns, big-endian.
+   Otherwise, the formats are identical.
+
+   v3 lays records out in slots, so that a record can stay put
+   from one save to the next: a record's len may include padding
+   after its strings (room to grow), and free slots are written
+   as RECORD_TYPE_FREE records, which readers skip.  The header
+   count covers free slots too.  Records are otherwise as in v2.
+
+   v3 also saves events in batches, one RECORD_TYPE_EVENTS record
+   per batch: the sequence number of the first event and the count,
+   then the timestamp, name and extra data of each event in turn.
+   A batch is closed off after every save, so it is only written
+   again when its oldest events are dropped (and it only shrinks). */
+#define BINF_VERSION 3
 
 typedef struct PACKED {
 	uint32_t  magic;
@@ -56,13 +76,13 @@ typedef struct PACKED {
 typedef struct PACKED {
 	uint32_t  last_seen;
 	uint64_t  n;
-	double    min;
-	double    max;
-	double    sum;
-	double    mean;
-	double    mean_;
-	double    var;
-	double    var_;
+	uint64_t  min;
+	uint64_t  max;
+	uint64_t  sum;
+	uint64_t  mean;
+	uint64_t  mean_;
+	uint64_t  var;
+	uint64_t  var_;
 	 uint8_t  ignore;
 } binf_sample_t;
 
@@ -78,6 +98,11 @@ typedef struct PACKED {
 	uint32_t  timestamp;
 } binf_event_t;
 
+typedef struct PACKED {
+	uint64_t  first;
+	uint32_t  count;
+} binf_events_t;
+
 #define binf_record_type(b) ((b)->flags & RECORD_TYPE_MASK)
 
 #ifndef htonll
@@ -110,16 +135,34 @@ static uint64_t ntohll(uint64_t x)
 }
 #endif
 
-static int s_write_record(void *addr, size_t *len, uint8_t type, void *_)
+static uint64_t s_pack_double(double d, int version)
+{
+	uint64_t raw;
+	if (version == 1) {
+		double v1 = htonl((uint32_t)d);
+		memcpy(&raw, &v1, sizeof(raw));
+		return raw;
+	}
+
+	memcpy(&raw, &d, sizeof(raw));
+	return htonll(raw);
+}
+
+static double s_unpack_double(uint64_t raw, int version)
+{
+	double d;
+	if (version == 1) {
+		memcpy(&d, &raw, sizeof(d));
+		return ntohl((uint32_t)d);
+	}
+
+	raw = ntohll(raw);
+	memcpy(&d, &raw, sizeof(d));
+	return d;
+}
+
+static size_t s_record_len(uint8_t type, void *_)
 {
-	binf_record_t record;
-	union {
-		binf_state_t   state;
-		binf_counter_t counter;
-		binf_sample_t  sample;
-		binf_event_t   event;
-		binf_rate_t    rate;
-	} body;
 	union {
 		void      *unknown;
 		state_t   *state;
@@ -128,49 +171,74 @@ static int s_write_record(void *addr, size_t *len, uint8_t type, void *_)
 		event_t   *event;
 		rate_t    *rate;
 	} payload;
-	const char *s;
 
 	payload.unknown = _;
-
-	record.len   = sizeof(record);
-	record.flags = type;
 	switch (type) {
 	case RECORD_TYPE_STATE:
-		record.len += sizeof(body.state);
-		record.len += strlen(payload.state->name)    + 1;
-		record.len += strlen(payload.state->summary) + 1;
-		break;
+		return sizeof(binf_record_t) + sizeof(binf_state_t)
+		     + strlen(payload.state->name) + 1
+		     + strlen(payload.state->summary) + 1;
 
 	case RECORD_TYPE_COUNTER:
-		record.len += sizeof(body.counter);
-		record.len += strlen(payload.counter->name) + 1;
-		break;
+		return sizeof(binf_record_t) + sizeof(binf_counter_t)
+		     + strlen(payload.counter->name) + 1;
 
 	case RECORD_TYPE_SAMPLE:
-		record.len += sizeof(body.sample);
-		record.len += strlen(payload.sample->name) + 1;
-		break;
+		return sizeof(binf_record_t) + sizeof(binf_sample_t)
+		     + strlen(payload.sample->name) + 1;
 
 	case RECORD_TYPE_EVENT:
-		record.len += sizeof(body.event);
-		record.len += strlen(payload.event->name)  + 1;
-		record.len += strlen(payload.event->extra) + 1;
-		break;
+		return sizeof(binf_record_t) + sizeof(binf_event_t)
+		     + strlen(payload.event->name) + 1
+		     + strlen(payload.event->extra) + 1;
 
 	case RECORD_TYPE_RATE:
-		record.len += sizeof(body.rate);
-		record.len += strlen(payload.rate->name) + 1;
-		break;
+		return sizeof(binf_record_t) + sizeof(binf_rate_t)
+		     + strlen(payload.rate->name) + 1;
+
+	case RECORD_TYPE_EVENTS:
+		return sizeof(binf_record_t) + sizeof(binf_events_t)
+		     + ((ring_batch_t*)_)->bytes;
 
 	default:
-		return -1;
+		return 0;
 	}
+}
+
+static int s_write_record(void *addr, size_t *len, uint8_t type, void *_, int version, size_t room)
+{
+	binf_record_t record;
+	union {
+		binf_state_t   state;
+		binf_counter_t counter;
+		binf_sample_t  sample;
+		binf_event_t   event;
+		binf_rate_t    rate;
+	} body;
+	union {
+		void      *unknown;
+		state_t   *state;
+		counter_t *counter;
+		sample_t  *sample;
+		event_t   *event;
+		rate_t    *rate;
+	} payload;
+	const char *s;
+
+	payload.unknown = _;
+
+	/* room is the size of the slot; 0 for just what the record needs */
+	size_t n = s_record_len(type, _);
+	if (room == 0)
+		room = n;
+	if (n == 0 || n > 0xffff || n > room)
+		return -1;
 
 	#define _cpybin(addr,obj,idx,size) \
 		memcpy(addr + idx, obj, size); \
 		idx += size;
 
-	record.len   = htons(record.len);
+	record.len   = htons(room);
 	record.flags = htons(type);
 
 	memcpy(addr + *len, &record, sizeof(record));
@@ -208,13 +276,13 @@ static int s_write_record(void *addr, size_t *len, uint8_t type, void *_)
 	case RECORD_TYPE_SAMPLE:
 		body.sample.last_seen = htonl(payload.sample->last_seen);
 		body.sample.n         = htonll(payload.sample->n);
-		body.sample.min       = htonl(payload.sample->min);
-		body.sample.max       = htonl(payload.sample->max);
-		body.sample.sum       = htonl(payload.sample->sum);
-		body.sample.mean      = htonl(payload.sample->mean);
-		body.sample.mean_     = htonl(payload.sample->mean_);
-		body.sample.var       = htonl(payload.sample->var);
-		body.sample.var_      = htonl(payload.sample->var_);
+		body.sample.min       = s_pack_double(payload.sample->min,   version);
+		body.sample.max       = s_pack_double(payload.sample->max,   version);
+		body.sample.sum       = s_pack_double(payload.sample->sum,   version);
+		body.sample.mean      = s_pack_double(payload.sample->mean,  version);
+		body.sample.mean_     = s_pack_double(payload.sample->mean_, version);
+		body.sample.var       = s_pack_double(payload.sample->var,   version);
+		body.sample.var_      = s_pack_double(payload.sample->var_,  version);
 		body.sample.ignore    = payload.sample->ignore;
 
 		_cpybin(addr, &body.sample, *len, sizeof(body.sample))
@@ -256,10 +324,12 @@ static int s_write_record(void *addr, size_t *len, uint8_t type, void *_)
 	}
 
 	#undef _cpybin
+	memset(addr + *len, 0, room - n);
+	*len += room - n;
 	return 0;
 }
 
-static int s_read_record(void *addr, size_t *len, uint8_t *type, void **r)
+static int s_read_record(void *addr, size_t *len, size_t max, uint8_t *type, void **r, int version)
 {
 	binf_record_t record;
 	union {
@@ -280,15 +350,31 @@ static int s_read_record(void *addr, size_t *len, uint8_t *type, void **r)
 	ssize_t want;
 	char *buf, *p;
 
+	if (*len + sizeof(record) > max)
+		return 1;
 	memcpy(&record, addr + *len, sizeof(record));
-	*len += sizeof(record);
 
 	record.len   = ntohs(record.len);
 	record.flags = ntohs(record.flags);
 	if (type)
 		*type = binf_record_type(&record);
 
+	/* every record type has a fixed-size body and at least one
+	   NULL-terminated string after it; the smallest is an event. */
+	if (record.len < sizeof(record) + sizeof(binf_event_t) + 1
+	 || *len + record.len > max)
+		return 1;
+	*len += sizeof(record);
+
 	switch (binf_record_type(&record)) {
+	case RECORD_TYPE_FREE:
+		if (version < 3)
+			return 1;
+
+		*len += record.len - sizeof(record);
+		*r = NULL;
+		return 0;
+
 	case RECORD_TYPE_STATE:
 		payload.state = calloc(1, sizeof(state_t));
 		if (!payload.state)
@@ -352,13 +438,13 @@ static int s_read_record(void *addr, size_t *len, uint8_t *type, void **r)
 
 		payload.sample->last_seen = ntohl(body.sample.last_seen);
 		payload.sample->n         = ntohll(body.sample.n);
-		payload.sample->min       = ntohl(body.sample.min);
-		payload.sample->max       = ntohl(body.sample.max);
-		payload.sample->sum       = ntohl(body.sample.sum);
-		payload.sample->mean      = ntohl(body.sample.mean);
-		payload.sample->mean_     = ntohl(body.sample.mean_);
-		payload.sample->var       = ntohl(body.sample.var);
-		payload.sample->var_      = ntohl(body.sample.var_);
+		payload.sample->min       = s_unpack_double(body.sample.min,   version);
+		payload.sample->max       = s_unpack_double(body.sample.max,   version);
+		payload.sample->sum       = s_unpack_double(body.sample.sum,   version);
+		payload.sample->mean      = s_unpack_double(body.sample.mean,  version);
+		payload.sample->mean_     = s_unpack_double(body.sample.mean_, version);
+		payload.sample->var       = s_unpack_double(body.sample.var,   version);
+		payload.sample->var_      = s_unpack_double(body.sample.var_,  version);
 		payload.sample->ignore    = body.sample.ignore;
 
 		want = record.len - sizeof(record) - sizeof(body.sample);
@@ -433,6 +519,48 @@ static int s_read_record(void *addr, size_t *len, uint8_t *type, void **r)
 		*r = payload.rate;
 		return 0;
 
+	case RECORD_TYPE_EVENTS: {
+		binf_events_t batch;
+		binf_event_t event;
+		ring_t *ring;
+		char *name, *extra, *end;
+		uint32_t n;
+
+		if (version < 3 || record.len < sizeof(record) + sizeof(batch))
+			return 1;
+
+		memcpy(&batch, addr + *len, sizeof(batch));
+		p   = addr + *len + sizeof(batch);
+		end = addr + *len + record.len - sizeof(record);
+
+		ring = vmalloc(sizeof(ring_t));
+		ring_init(ring);
+		for (n = ntohl(batch.count); n > 0; n--) {
+			if (p + sizeof(event) > end)
+				break;
+			memcpy(&event, p, sizeof(event));
+			name = p + sizeof(event);
+			if (!(extra = memchr(name, '\0', end - name)))
+				break;
+			extra++;
+			if (!(p = memchr(extra, '\0', end - extra)))
+				break;
+			p++;
+			ring_push(ring, ntohl(event.timestamp), name, extra);
+		}
+		if (n > 0) {
+			ring_done(ring);
+			free(ring);
+			return 1;
+		}
+		/* (ring_push numbered the events from 0) */
+		ring->seq = ntohll(batch.first);
+
+		*len += record.len - sizeof(record);
+		*r = ring;
+		return 0;
+	}
+
 	default:
 		return 1;
 	}
@@ -440,20 +568,344 @@ static int s_read_record(void *addr, size_t *len, uint8_t *type, void **r)
 	return 1;
 }
 
+/* slotted (v3) savefiles {{{ */
+typedef struct {
+	db_t     *db;
+	void     *addr;
+	size_t    max;
+	uint64_t  bytes;
+} s_save_t;
+
+static int s_write_batch(void *addr, size_t *len, ring_t *ring, ring_batch_t *b, size_t room)
+{
+	binf_record_t record;
+	binf_events_t batch;
+	binf_event_t event;
+	ring_entry_t *e;
+	uint64_t seq;
+
+	size_t n = s_record_len(RECORD_TYPE_EVENTS, b);
+	if (room == 0)
+		room = n;
+	if (n > 0xffff || n > room)
+		return -1;
+
+	record.len   = htons(room);
+	record.flags = htons(RECORD_TYPE_EVENTS);
+	memcpy(addr + *len, &record, sizeof(record));
+	*len += sizeof(record);
+
+	batch.first = htonll(b->first);
+	batch.count = htonl(b->last - b->first);
+	memcpy(addr + *len, &batch, sizeof(batch));
+	*len += sizeof(batch);
+
+	for (seq = b->first; seq < b->last; seq++) {
+		e = ring_get(ring, seq - ring->seq);
+		event.timestamp = htonl(e->timestamp);
+		memcpy(addr + *len, &event, sizeof(event));
+		*len += sizeof(event);
+		memcpy(addr + *len, ring->arena + e->off, e->len);
+		*len += e->len;
+	}
+
+	memset(addr + *len, 0, room - n);
+	*len += room - n;
+	return 0;
+}
+
+static size_t s_slot_len(uint8_t type, size_t need)
+{
+	/* leave state summaries some room to grow in */
+	if (type == RECORD_TYPE_STATE)
+		need += need / 4;
+	need = (need + 7) & ~7;
+	return need > 0xffff ? 0xffff : need;
+}
+
+static void s_slot_free(s_save_t *save, uint32_t i)
+{
+	binf_slot_t *slot = &save->db->save.slots[i];
+	binf_record_t record;
+
+	record.len   = htons(slot->len);
+	record.flags = htons(RECORD_TYPE_FREE);
+	memcpy(save->addr + slot->offset, &record, sizeof(record));
+	save->bytes += sizeof(record);
+
+	slot->owner = NULL;
+	save->db->save.free += slot->len;
+}
+
+static int s_slot_push(db_t *db, size_t offset, size_t len, void *owner)
+{
+	if (db->save.n == db->save.cap) {
+		db->save.cap = db->save.cap ? db->save.cap * 2 : 1024;
+		db->save.slots = realloc(db->save.slots, db->save.cap * sizeof(binf_slot_t));
+	}
+
+	binf_slot_t *slot = &db->save.slots[db->save.n];
+	slot->offset = offset;
+	slot->len    = len;
+	slot->gen    = db->save.gen;
+	slot->owner  = owner;
+	if (!owner)
+		db->save.free += len;
+
+	return db->save.n++;
+}
+
+static int s_slot_new(s_save_t *save, size_t len, void *owner)
+{
+	db_t *db = save->db;
+	if (db->save.end + len + 2 > save->max)
+		return -1;
+
+	db->save.end += len;
+	return s_slot_push(db, db->save.end - len, len, owner);
+}
+
+/* returns -1 if the savefile is out of room */
+static int s_save_record(s_save_t *save, uint8_t type, void *x, uint32_t *slot, uint8_t *dirty)
+{
+	db_t *db = save->db;
+	int i = -1;
+
+	if (*slot > 0 && *slot <= db->save.n && db->save.slots[*slot - 1].owner == x)
+		i = *slot - 1;
+
+	if (i >= 0 && !*dirty) {
+		db->save.slots[i].gen = db->save.gen;
+		return 0;
+	}
+
+	size_t need = s_record_len(type, x);
+	if (need == 0 || need > 0xffff) {
+		logger(LOG_ERR, "unable to save a %lu-byte record; skipping", need);
+		return 0;
+	}
+
+	/* records that outgrow their slot move to the end */
+	if (i >= 0 && need > db->save.slots[i].len) {
+		s_slot_free(save, i);
+		i = -1;
+	}
+	if (i < 0) {
+		i = s_slot_new(save, s_slot_len(type, need), x);
+		if (i < 0)
+			return -1;
+		*slot = i + 1;
+	}
+
+	size_t off = db->save.slots[i].offset;
+	db->save.slots[i].gen = db->save.gen;
+	if (type == RECORD_TYPE_EVENTS)
+		s_write_batch(save->addr, &off, &db->events, x, db->save.slots[i].len);
+	else
+		s_write_record(save->addr, &off, type, x, BINF_VERSION, db->save.slots[i].len);
+	save->bytes += db->save.slots[i].len;
+	*dirty = 0;
+	return 0;
+}
+
+static int s_write_slots(db_t *db, const char *file, int db_size, int rewrite)
+{
+	binf_header_t header;
+
+	state_t   *state;
+	counter_t *counter;
+	sample_t  *sample;
+	ring_batch_t *batch;
+	rate_t    *rate;
+
+	char *name;
+	uint32_t i;
+	s_save_t save = { db, NULL, (size_t)db_size * 1024 * 1024, 0 };
+	struct stat st;
+	int fd = -1;
+
+	/* start from scratch if we don't know what's in the file, or
+	   if free slots have taken up half of it */
+	if (!db->save.file || strcmp(db->save.file, file) != 0
+	 || db->save.free > db->save.end / 2)
+		rewrite = 1;
+
+	if (!rewrite) {
+		fd = open(file, O_RDWR);
+		if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size != save.max) {
+			if (fd >= 0)
+				close(fd);
+			rewrite = 1;
+		}
+	}
+
+	if (rewrite) {
+		/* size up the savefile before we truncate the old one;
+		   a partial save is worse than no save at all. */
+		size_t need = sizeof(header) + 2;
+		for_each_key_value(&db->states,   name, state)   need += s_slot_len(RECORD_TYPE_STATE,   s_record_len(RECORD_TYPE_STATE,   state));
+		for_each_key_value(&db->counters, name, counter) need += s_slot_len(RECORD_TYPE_COUNTER, s_record_len(RECORD_TYPE_COUNTER, counter));
+		for_each_key_value(&db->samples,  name, sample)  need += s_slot_len(RECORD_TYPE_SAMPLE,  s_record_len(RECORD_TYPE_SAMPLE,  sample));
+		for_each_object(batch, &db->events.batches, l)   need += s_slot_len(RECORD_TYPE_EVENTS,  s_record_len(RECORD_TYPE_EVENTS,  batch));
+		for_each_key_value(&db->rates,    name, rate)    need += s_slot_len(RECORD_TYPE_RATE,    s_record_len(RECORD_TYPE_RATE,    rate));
+		if (need > save.max) {
+			logger(LOG_ERR, "state db needs %lu bytes, which exceeds the save.size of %iM; not saving to %s",
+					need, db_size, file);
+			return -1;
+		}
+
+		fd = open(file, O_RDWR|O_CREAT|O_TRUNC, 0640);
+		if (fd < 0) {
+			logger(LOG_ERR, "kernel failed to open save file %s for writing: %s",
+					file, strerror(errno));
+			return -1;
+		}
+		if (ftruncate(fd, save.max) == -1) {
+			logger(LOG_ERR, "failed to write to save file %s end: %s", file, strerror(errno));
+			close(fd);
+			return -1;
+		}
+
+		binf_forget(db);
+		db->save.file = strdup(file);
+		db->save.end  = sizeof(header);
+		db->save.rewrites++;
+	}
+
+	save.addr = mmap(NULL, save.max, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (save.addr == MAP_FAILED) {
+		logger(LOG_ERR, "failed to allocate mmap %s, for writing: %s", file, strerror(errno));
+		close(fd);
+		binf_forget(db);
+		return -1;
+	}
+
+	logger(LOG_NOTICE, "saving state db to %s%s", file, rewrite ? " (from scratch)" : "");
+	db->save.gen++;
+
+	int rc = 0;
+	for_each_key_value(&db->states, name, state)
+		if (rc == 0) rc = s_save_record(&save, RECORD_TYPE_STATE, state, &state->slot, &state->dirty);
+	for_each_key_value(&db->counters, name, counter)
+		if (rc == 0) rc = s_save_record(&save, RECORD_TYPE_COUNTER, counter, &counter->slot, &counter->dirty);
+	for_each_key_value(&db->samples, name, sample)
+		if (rc == 0) rc = s_save_record(&save, RECORD_TYPE_SAMPLE, sample, &sample->slot, &sample->dirty);
+	for_each_object(batch, &db->events.batches, l)
+		if (rc == 0) rc = s_save_record(&save, RECORD_TYPE_EVENTS, batch, &batch->slot, &batch->dirty);
+	for_each_key_value(&db->rates, name, rate)
+		if (rc == 0) rc = s_save_record(&save, RECORD_TYPE_RATE, rate, &rate->slot, &rate->dirty);
+
+	if (rc != 0) {
+		munmap(save.addr, save.max);
+		close(fd);
+		if (rewrite) {
+			logger(LOG_ERR, "ran out of room in save file %s", file);
+			binf_forget(db);
+			return -1;
+		}
+		logger(LOG_INFO, "ran out of room for new records in save file %s; rewriting it", file);
+		return s_write_slots(db, file, db_size, 1);
+	}
+
+	/* whatever we didn't come across has gone away */
+	for (i = 0; i < db->save.n; i++)
+		if (db->save.slots[i].owner && db->save.slots[i].gen != db->save.gen)
+			s_slot_free(&save, i);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(&header.magic, "BOLO", 4);
+	header.version   = htons(BINF_VERSION);
+	header.flags     = 0;
+	header.timestamp = htonl((uint32_t)time_s());
+	header.count     = htonl(db->save.n);
+	memcpy(save.addr, &header, sizeof(header));
+	memcpy(save.addr + db->save.end, "\0\0", 2);
+	save.bytes += sizeof(header) + 2;
+
+	/* new events go in a new batch, so this one never has to move */
+	ring_seal(&db->events);
+
+	db->save.saves++;
+	db->save.bytes  = save.bytes;
+	db->save.total += save.bytes;
+	logger(LOG_INFO, "done writing savefile %s (%lu bytes in %u slots, %lu bytes written)",
+			file, db->save.end, db->save.n, save.bytes);
+
+	munmap(save.addr, save.max);
+	close(fd);
+	return 0;
+}
+/* }}} */
+
+typedef struct {
+	ring_t   *ring;
+	uint32_t  slot;
+} s_batch_t;
+
+static int s_batch_cmp(const void *a, const void *b)
+{
+	uint64_t x = ((const s_batch_t*)a)->ring->seq,
+	         y = ((const s_batch_t*)b)->ring->seq;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+void binf_forget(db_t *db)
+{
+	free(db->save.file);
+	free(db->save.slots);
+	db->save.file  = NULL;
+	db->save.slots = NULL;
+	db->save.n     = db->save.cap = 0;
+	db->save.end   = db->save.free = 0;
+}
+
 int binf_write(db_t *db, const char *file, int db_size)
+{
+	return binf_write_version(db, file, db_size, BINF_VERSION);
+}
+
+int binf_write_version(db_t *db, const char *file, int db_size, int version)
 {
 	binf_header_t header;
 
 	state_t   *state;
 	counter_t *counter;
 	sample_t  *sample;
-	event_t   *event;
+	event_t    event;
 	rate_t   *rate;
 
 	char *name;
 	void *addr;
 	int i;
-	size_t so_far = 0;
+	size_t j, so_far = 0, need, max;
+
+	if (version == 3)
+		return s_write_slots(db, file, db_size, 0);
+	if (version != 1 && version != 2) {
+		logger(LOG_ERR, "unable to write a v%i savefile; only v1, v2 and v3 are supported", version);
+		return -1;
+	}
+
+	/* older formats are always written from scratch */
+	binf_forget(db);
+
+	/* size up the savefile before we truncate the old one;
+	   a partial save is worse than no save at all. */
+	max  = (size_t)db_size * 1024 * 1024;
+	need = sizeof(header) + 2;
+	for_each_key_value(&db->states,   name, state)   need += s_record_len(RECORD_TYPE_STATE,   state);
+	for_each_key_value(&db->counters, name, counter) need += s_record_len(RECORD_TYPE_COUNTER, counter);
+	for_each_key_value(&db->samples,  name, sample)  need += s_record_len(RECORD_TYPE_SAMPLE,  sample);
+	for (j = 0; j < db->events.n; j++) {
+		ring_entry_t *e = ring_get(&db->events, j);
+		need += sizeof(binf_record_t) + sizeof(binf_event_t) + e->len;
+	}
+	for_each_key_value(&db->rates,    name, rate)    need += s_record_len(RECORD_TYPE_RATE,    rate);
+	if (need > max) {
+		logger(LOG_ERR, "state db needs %lu bytes, which exceeds the save.size of %iM; not saving to %s",
+				need, db_size, file);
+		return -1;
+	}
 
 	int fd = open(file, O_RDWR|O_CREAT|O_TRUNC, 0640);
 	if (fd < 0) {
@@ -466,7 +918,7 @@ int binf_write(db_t *db, const char *file, int db_size)
 
 	memset(&header, 0, sizeof(header));
 	memcpy(&header.magic, "BOLO", 4);
-	header.version   = htons(1);
+	header.version   = htons(version);
 	header.flags     = 0;
 	header.timestamp = htonl((uint32_t)time_s());
 
@@ -474,23 +926,24 @@ int binf_write(db_t *db, const char *file, int db_size)
 	for_each_key_value(&db->states,   name, state)   header.count++;
 	for_each_key_value(&db->counters, name, counter) header.count++;
 	for_each_key_value(&db->samples,  name, sample)  header.count++;
-	for_each_object(event, &db->events, l)           header.count++;
+	header.count += db->events.n;
 	for_each_key_value(&db->rates,    name, rate)    header.count++;
 	header.count = htonl(header.count);
 
-	if((lseek(fd, db_size * 1024 * 1024, SEEK_SET)) == -1) {
+	if((lseek(fd, max, SEEK_SET)) == -1) {
 		logger(LOG_ERR, "failed to seek to the end of the savedb: %s, error: %s", file, strerror(errno));
 		close(fd);
 		return -1;
 	}
-	if((ftruncate(fd, db_size * 1024 * 1024)) == -1) {
+	if((ftruncate(fd, max)) == -1) {
 		logger(LOG_ERR, "failed to write to save file %s end: %s", file, strerror(errno));
 		close(fd);
 		return -1;
 	}
-	addr = mmap(NULL, db_size * 1024 * 1024, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	addr = mmap(NULL, max, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
 	if (addr == MAP_FAILED) {
 		logger(LOG_ERR, "failed to allocate mmap %s, for writing: %s", file, strerror(errno));
+		close(fd);
 		return -1;
 	}
 
@@ -500,34 +953,38 @@ int binf_write(db_t *db, const char *file, int db_size)
 
 	i = 1;
 	for_each_key_value(&db->states, name, state) {
-		s_write_record(addr, &so_far, RECORD_TYPE_STATE, state);
+		s_write_record(addr, &so_far, RECORD_TYPE_STATE, state, version, 0);
 		logger(LOG_INFO, "wrote bytes for state record #%i (%s), index = %i", i, name, so_far);
 		i++;
 	}
 	for_each_key_value(&db->counters, name, counter) {
-		s_write_record(addr, &so_far, RECORD_TYPE_COUNTER, counter);
+		s_write_record(addr, &so_far, RECORD_TYPE_COUNTER, counter, version, 0);
 		logger(LOG_INFO, "wrote bytes for counter record #%i (%s), index = %i", i, name, so_far);
 		i++;
 	}
 	for_each_key_value(&db->samples, name, sample) {
-		s_write_record(addr, &so_far, RECORD_TYPE_SAMPLE, sample);
+		s_write_record(addr, &so_far, RECORD_TYPE_SAMPLE, sample, version, 0);
 		logger(LOG_INFO, "wrote bytes for sample record #%i (%s), index = %i", i, name, so_far);
 		i++;
 	}
-	event_t *ev;
-	for_each_object(ev, &db->events, l) {
-		s_write_record(addr, &so_far, RECORD_TYPE_EVENT, ev);
-		logger(LOG_INFO, "wrote bytes for event record #%i (%s), index = %i", i, name, so_far);
+	for (j = 0; j < db->events.n; j++) {
+		ring_entry_t *e = ring_get(&db->events, j);
+		event.timestamp = e->timestamp;
+		event.name      = ring_name(&db->events, e);
+		event.extra     = ring_extra(&db->events, e);
+		s_write_record(addr, &so_far, RECORD_TYPE_EVENT, &event, version, 0);
+		logger(LOG_INFO, "wrote bytes for event record #%i (%s), index = %i", i, event.name, so_far);
 		i++;
 	}
 	for_each_key_value(&db->rates, name, rate) {
-		s_write_record(addr, &so_far, RECORD_TYPE_RATE, rate);
+		s_write_record(addr, &so_far, RECORD_TYPE_RATE, rate, version, 0);
 		logger(LOG_INFO, "wrote bytes for rate record #%i (%s), index = %i", i, name, so_far);
 		i++;
 	}
 	memcpy(addr + so_far, "\0\0", 2);
 
 	logger(LOG_INFO, "done writing savefile %s", file);
+	munmap(addr, max);
 	close(fd);
 	return 0;
 }
@@ -542,11 +999,23 @@ int binf_read(db_t *db, const char *file, int db_size)
 		sample_t  *sample;
 		event_t   *event;
 		rate_t    *rate;
+		ring_t    *batch;
 	} payload, found;
 	unsigned int i;
 	uint8_t type;
 	void *addr;
-	size_t so_far = 0;
+	size_t so_far = 0, at, max;
+	struct stat st;
+	int rc = -1;
+
+	/* for v3 savefiles, where each record was found */
+	void     *owner;
+	uint32_t *slot;
+	uint8_t  *dirty;
+
+	/* event batches, and the slots they were found in */
+	s_batch_t *batches = NULL;
+	size_t     nbatches = 0, cap = 0, j;
 
 	int fd = open(file, O_RDONLY);
 	if (fd < 0) {
@@ -554,11 +1023,27 @@ int binf_read(db_t *db, const char *file, int db_size)
 			file, strerror(errno));
 		return -1;
 	}
-	addr = mmap(NULL,
-		    db_size * 1024 * 1024,
-		    PROT_READ, MAP_SHARED, fd, 0);
+
+	/* never map (and touch) more than the file actually holds;
+	   a savefile written with a smaller save.size would SIGBUS */
+	max = (size_t)db_size * 1024 * 1024;
+	if (fstat(fd, &st) != 0) {
+		logger(LOG_ERR, "failed to stat %s: %s", file, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < max)
+		max = st.st_size;
+	if (max < sizeof(header) + 2) {
+		logger(LOG_ERR, "%s is too small to be a bolo savefile", file);
+		close(fd);
+		return -1;
+	}
+
+	addr = mmap(NULL, max, PROT_READ, MAP_SHARED, fd, 0);
 	if (addr == MAP_FAILED) {
 		logger(LOG_ERR, "failed to allocate mmap %s, for reading: %s", file, strerror(errno));
+		close(fd);
 		return -1;
 	}
 
@@ -568,8 +1053,7 @@ int binf_read(db_t *db, const char *file, int db_size)
 
 	if (memcmp(&header.magic, "BOLO", 4) != 0) {
 		logger(LOG_ERR, "%s does not seem to be a bolo savefile", file);
-		close(fd);
-		return -1;
+		goto done;
 	}
 
 	header.version   = ntohs(header.version);
@@ -580,25 +1064,34 @@ int binf_read(db_t *db, const char *file, int db_size)
 	logger(LOG_NOTICE, "%s is a v%i database, dated %lu, and contains %u records",
 			file, header.version, header.timestamp, header.count);
 
-	if (header.version != 1) {
-		logger(LOG_ERR, "%s is a v%u savefile; this version of bolo only supports v1 files",
+	if (header.version < 1 || header.version > 3) {
+		logger(LOG_ERR, "%s is a v%u savefile; this version of bolo only supports v1, v2 and v3 files",
 			file, header.version);
-		close(fd);
-		return -1;
+		goto done;
 	}
+	if (header.version == 1)
+		logger(LOG_WARNING, "%s is a v1 savefile; sample values will be truncated to integers",
+			file);
+
+	binf_forget(db);
 
 	for (i = 1; i <= header.count; i++) {
 		logger(LOG_INFO, "reading record #%i from savefile", i);
 
-		if (s_read_record(addr, &so_far, &type, &payload.unknown) != 0) {
+		at = so_far;
+		owner = NULL; slot = NULL; dirty = NULL;
+		if (s_read_record(addr, &so_far, max - 2, &type, &payload.unknown, header.version) != 0) {
 			logger(LOG_ERR, "%s: failed to read all of record #%i", file, i);
-			close(fd);
-			return -1;
+			goto done;
 		}
 
 		switch (type) {
+		case RECORD_TYPE_FREE:
+			break;
+
 		case RECORD_TYPE_STATE:
 			if ((found.state = find_state(db, payload.state->name)) != NULL) {
+				owner = found.state; slot = &found.state->slot; dirty = &found.state->dirty;
 				free(found.state->summary);
 				found.state->summary   = payload.state->summary;
 				found.state->last_seen = payload.state->last_seen;
@@ -618,6 +1111,7 @@ int binf_read(db_t *db, const char *file, int db_size)
 
 		case RECORD_TYPE_COUNTER:
 			if ((found.counter = find_counter(db, payload.counter->name)) != NULL) {
+				owner = found.counter; slot = &found.counter->slot; dirty = &found.counter->dirty;
 				found.counter->last_seen = payload.counter->last_seen;
 				found.counter->value     = payload.counter->value;
 				found.counter->ignore    = payload.counter->ignore;
@@ -633,6 +1127,7 @@ int binf_read(db_t *db, const char *file, int db_size)
 
 		case RECORD_TYPE_SAMPLE:
 			if ((found.sample = find_sample(db, payload.sample->name)) != NULL) {
+				owner = found.sample; slot = &found.sample->slot; dirty = &found.sample->dirty;
 				found.sample->last_seen = payload.sample->last_seen;
 				found.sample->n         = payload.sample->n;
 				found.sample->min       = payload.sample->min;
@@ -654,11 +1149,30 @@ int binf_read(db_t *db, const char *file, int db_size)
 			break;
 
 		case RECORD_TYPE_EVENT:
-			list_push(&db->events, &payload.event->l);
+			/* (v3 files from before event batches get these
+			   moved into batches on the next save) */
+			ring_push(&db->events, payload.event->timestamp, payload.event->name, payload.event->extra);
+			free(payload.event->name);
+			free(payload.event->extra);
+			free(payload.event);
+			payload.event = NULL;
+			break;
+
+		case RECORD_TYPE_EVENTS:
+			if (nbatches == cap) {
+				cap = cap ? cap * 2 : 64;
+				batches = realloc(batches, cap * sizeof(s_batch_t));
+			}
+			batches[nbatches].ring = payload.batch;
+			batches[nbatches].slot = db->save.n;
+			nbatches++;
+			/* (the batch takes this slot over below) */
+			owner = payload.batch;
 			break;
 
 		case RECORD_TYPE_RATE:
 			if ((found.rate = find_rate(db, payload.rate->name)) != NULL) {
+				owner = found.rate; slot = &found.rate->slot; dirty = &found.rate->dirty;
 				found.rate->first_seen = payload.rate->first_seen;
 				found.rate->last_seen  = payload.rate->last_seen;
 				found.rate->first      = payload.rate->first;
@@ -674,21 +1188,70 @@ int binf_read(db_t *db, const char *file, int db_size)
 
 		default:
 			logger(LOG_ERR, "unknown record type %02x found!", type);
-			close(fd);
-			return 1;
+			rc = 1;
+			goto done;
+		}
+
+		/* remember the layout, so the next save
+		   only has to rewrite what changes */
+		if (header.version >= 3) {
+			int n = s_slot_push(db, at, so_far - at, owner);
+			if (slot) {
+				*slot  = n + 1;
+				*dirty = 0;
+			}
 		}
 	}
 	char trailer[2] = { 1 };
 	memcpy(trailer, addr + so_far, 2);
 	if (trailer[0] || trailer[1]) {
 		logger(LOG_ERR, "no savefile trailer found!");
-		close(fd);
-		return 1;
+		rc = 1;
+		goto done;
+	}
+
+	/* put the event batches back in order, each one in a batch
+	   of its own, still living in the slot it was read from */
+	qsort(batches, nbatches, sizeof(s_batch_t), s_batch_cmp);
+	for (j = 0; j < nbatches; j++) {
+		ring_t *ring = batches[j].ring;
+		if (ring->n == 0) {
+			db->save.slots[batches[j].slot].owner = NULL;
+			db->save.free += db->save.slots[batches[j].slot].len;
+			continue;
+		}
+
+		ring_seal(&db->events);
+		for (i = 0; i < ring->n; i++) {
+			ring_entry_t *e = ring_get(ring, i);
+			ring_push(&db->events, e->timestamp, ring_name(ring, e), ring_extra(ring, e));
+		}
+
+		ring_batch_t *b = list_tail(&db->events.batches, ring_batch_t, l);
+		db->save.slots[batches[j].slot].owner = b;
+		b->slot  = batches[j].slot + 1;
+		b->dirty = 0;
 	}
+	ring_seal(&db->events);
 
 	logger(LOG_INFO, "done reading savefile %s", file);
+	if (header.version >= 3) {
+		db->save.file = strdup(file);
+		db->save.end  = so_far;
+	}
+	rc = 0;
+
+done:
+	for (j = 0; j < nbatches; j++) {
+		ring_done(batches[j].ring);
+		free(batches[j].ring);
+	}
+	free(batches);
+	if (rc != 0)
+		binf_forget(db);
+	munmap(addr, max);
 	close(fd);
-	return 0;
+	return rc;
 }
 
 int binf_sync(const char *file, int db_size)
@@ -703,13 +1266,17 @@ int binf_sync(const char *file, int db_size)
 	void *addr = mmap(NULL, db_size * 1024 * 1024, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
 	if (addr == MAP_FAILED) {
 		logger(LOG_ERR, "failed to allocate mmap %s for syncing: %s", file, strerror(errno));
+		close(fd);
 		return -1;
 	}
-	if((msync(addr, db_size * 1024 * 1024, MS_ASYNC)) == -1) {
+	if((msync(addr, db_size * 1024 * 1024, MS_SYNC)) == -1) {
 		logger(LOG_ERR, "failed to sync mmap %s: %s", file, strerror(errno));
+		munmap(addr, db_size * 1024 * 1024);
+		close(fd);
 		return -1;
 	}
 	logger(LOG_NOTICE, "successfully synced state %s to disk", file);
+	munmap(addr, db_size * 1024 * 1024);
 	close(fd);
 	return 0;
 }
@@ -75,9 +75,17 @@
 #define DEFAULT_SWEEP        60
 #define DEFAULT_SAVE_SIZE     4
 #define DEFAULT_SAVE_INTERVAL 15
+#define DEFAULT_TOPK_SIZE     10
+#define DEFAULT_TOPK_INTERVAL 60
+#define DEFAULT_SHM_SIZE      (4 * 1024 * 1024)
+#define DEFAULT_SHM_MODE      0600
 
 #define KERNEL_ENDPOINT "inproc://kernel"
 
+#define OVERFLOW_NAME  "__overflow__"
+#define LIMIT_REJECT   0
+#define LIMIT_FOLD     1
+
 typedef struct {
 	char     *name;
 	uint16_t  freshness;
@@ -92,6 +100,8 @@ typedef struct {
 	list_t   anon;
 } window_t;
 
+/* auto-created records remember the rule that made them
+   (NULL for explicitly configured ones), for limit.* and evict.idle */
 typedef struct {
 	type_t   *type;
 	char     *name;
@@ -101,14 +111,19 @@ typedef struct {
 	char     *summary;
 	uint8_t   stale;
 	uint8_t   ignore;
+	struct re_state *rule;
+
+	uint32_t  slot;    /* savefile slot + 1; 0 if never saved */
+	uint8_t   dirty;   /* changed since it was last saved */
 } state_t;
 
-typedef struct {
+typedef struct re_state {
 	list_t      l;
 	type_t     *type;
 
 	pcre       *re;
 	pcre_extra *re_extra;
+	int         limit, count;
 } re_state_t;
 
 typedef struct {
@@ -117,14 +132,23 @@ typedef struct {
 	int32_t   last_seen;
 	uint64_t  value;
 	uint8_t   ignore;
+	int32_t   traced;  /* ts of a sampled submission, for trace.rate */
+
+	list_t    l;       /* db->auto_counters */
+	int32_t   active;  /* when we last looked it up (server time) */
+	struct re_counter *rule;
+
+	uint32_t  slot;    /* savefile slot + 1; 0 if never saved */
+	uint8_t   dirty;   /* changed since it was last saved */
 } counter_t;
 
-typedef struct {
+typedef struct re_counter {
 	list_t      l;
 	window_t   *window;
 
 	pcre       *re;
 	pcre_extra *re_extra;
+	int         limit, count;
 } re_counter_t;
 
 typedef struct {
@@ -139,14 +163,23 @@ typedef struct {
 	double    mean, mean_;
 	double    var,  var_;
 	uint8_t   ignore;
+	int32_t   traced;  /* ts of a sampled submission, for trace.rate */
+
+	list_t    l;       /* db->auto_samples */
+	int32_t   active;  /* when we last looked it up (server time) */
+	struct re_sample *rule;
+
+	uint32_t  slot;    /* savefile slot + 1; 0 if never saved */
+	uint8_t   dirty;   /* changed since it was last saved */
 } sample_t;
 
-typedef struct {
+typedef struct re_sample {
 	list_t      l;
 	window_t   *window;
 
 	pcre       *re;
 	pcre_extra *re_extra;
+	int         limit, count;
 } re_sample_t;
 
 typedef struct {
@@ -158,31 +191,141 @@ typedef struct {
 	uint64_t    first;
 	uint64_t    last;
 	uint8_t     ignore;
+	int32_t     traced;  /* ts of a sampled submission, for trace.rate */
+
+	list_t      l;       /* db->auto_rates */
+	int32_t     active;  /* when we last looked it up (server time) */
+	struct re_rate *rule;
+
+	uint32_t    slot;    /* savefile slot + 1; 0 if never saved */
+	uint8_t     dirty;   /* changed since it was last saved */
 } rate_t;
 
-typedef struct {
+typedef struct re_rate {
 	list_t      l;
 	window_t   *window;
 
 	pcre       *re;
 	pcre_extra *re_extra;
+	int         limit, count;
 } re_rate_t;
 
 typedef struct {
-	list_t     l;
 	int32_t    timestamp;
 	char      *name;
 	char      *extra;
 } event_t;
 
+/* the event buffer; a ring of entries over a ring of bytes (see ring.c) */
+typedef struct {
+	int32_t    timestamp;
+	int32_t    latest;  /* highest timestamp up to here, for ring_since() */
+	uint32_t   off;     /* of name\0extra\0 in the arena */
+	uint32_t   len;
+} ring_entry_t;
+
+typedef struct {
+	list_t     l;
+	uint64_t   first, last;  /* sequence numbers, [first, last) */
+	size_t     bytes;        /* saved size, roughly */
+
+	uint32_t   slot;   /* savefile slot + 1; 0 if never saved */
+	uint8_t    dirty;
+} ring_batch_t;
+
+typedef struct {
+	ring_entry_t *entries;
+	size_t        cap, n, head;
+	uint64_t      seq;    /* sequence number of the oldest event */
+
+	char         *arena;
+	size_t        size, start, end;
+
+	list_t        batches;  /* oldest first */
+	int           sealed;   /* start a new batch on the next push */
+} ring_t;
+
+/* the shared-memory submission ring (see shm.ring), written by
+   clients on the same host (via libbolo's bolo_shm_* functions)
+   and drained by the aggregator.
+
+   The segment is one page of header, followed by `size` bytes
+   (a power of two) of records.  Clients reserve space by moving
+   `tail` forward with a compare-and-swap; the aggregator is the
+   only one that moves `head`.  A record is complete once its
+   `size` has been set, which the writer does last.  Records never
+   wrap; a writer that would run off the end of the data area pads
+   it out with a record of no frames, and starts over at the top.
+
+   When the aggregator runs out of records, it sets `sleeping` and
+   waits on an eventfd; whoever clears `sleeping` has to write to
+   it.  Clients get that eventfd over the unix socket at
+   <shm.ring>.sock (as SCM_RIGHTS ancillary data).
+
+   The aggregator drains records in order, so a writer that dies
+   between reserving its space and setting `size` stops the ring
+   there: nothing after it is ever read, and once the ring fills up,
+   every client gets EAGAIN.  There is no telling how big the dead
+   record was, so there is no skipping it either; only a restart of
+   the aggregator (which re-creates the ring) clears it. */
+#define SHM_MAGIC   "BOLOSHM1"
+#define SHM_VERSION 1
+#define SHM_HEADER  4096
+#define SHM_ALIGN   8
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t closed;     /* set when the aggregator goes away */
+	uint64_t size;       /* of the data area */
+	uint64_t full;       /* times a client found no room for its submission */
+
+	uint64_t tail     __attribute__((aligned(64)));
+	uint64_t head     __attribute__((aligned(64)));
+	uint32_t sleeping __attribute__((aligned(64)));
+} shm_header_t;
+
+/* followed by `frames` frames, each a uint32_t length and then that
+   many bytes, padded out so the next record starts on SHM_ALIGN */
+typedef struct {
+	uint32_t size;       /* of the whole record; 0 until written */
+	uint32_t frames;     /* 0 for padding */
+} shm_record_t;
+
+#define shm_data(h)    ((uint8_t *)(h) + SHM_HEADER)
+#define shm_record(h,x) ((shm_record_t *)(shm_data(h) + ((x) & ((h)->size - 1))))
+
+#define ring_name(r,e)  ((r)->arena + (e)->off)
+#define ring_extra(r,e) ((r)->arena + (e)->off + strlen(ring_name(r,e)) + 1)
+
+/* every record type tracks whether it needs saving again */
+#define mark_dirty(x) ((x)->dirty = 1)
+
+/* where a saved record lives in the savefile (see binf.c) */
+typedef struct {
+	uint32_t  offset;  /* of the record header */
+	uint16_t  len;     /* room in the slot, header and all */
+	uint32_t  gen;     /* last save that found its record */
+	void     *owner;   /* NULL if the slot is free */
+} binf_slot_t;
+
+/* radix trie; an ordered index of names (see trie.c) */
+typedef struct trie {
+	char         *edge;
+	size_t        len;
+	uint16_t      bits;  /* PAYLOAD_* types this name is a key for */
+	int           n;
+	struct trie **kids;
+} trie_t;
+
 typedef struct {
 	hash_t  states;
 	hash_t  counters;
 	hash_t  samples;
 	hash_t  rates;
+	trie_t  names;   /* all of the above, by PAYLOAD_* type */
 
-	list_t  events;
-	int     events_count;
+	ring_t  events;
 
 	list_t  state_matches;
 	list_t  counter_matches;
@@ -192,6 +335,38 @@ typedef struct {
 	hash_t  types;
 	hash_t  windows;
 	list_t  anon_windows;
+
+	/* auto-created counters, samples and rates, oldest first */
+	list_t  auto_counters;
+	list_t  auto_samples;
+	list_t  auto_rates;
+
+	struct {
+		int      metrics;  /* global cap on auto-created records; 0 = none */
+		int      overflow; /* LIMIT_REJECT or LIMIT_FOLD */
+		int      count;
+
+		uint64_t created;
+		uint64_t evicted;
+		uint64_t rejected;
+		uint64_t folded;
+	} limit;
+
+	/* the savefile layout, as of the last save (or read),
+	   so that binf_write only has to rewrite what changed */
+	struct {
+		char        *file;
+		binf_slot_t *slots;
+		uint32_t     n, cap;
+		uint32_t     gen;
+		size_t       end;      /* offset of the trailer */
+		size_t       free;     /* bytes in free slots */
+
+		uint64_t     saves;
+		uint64_t     rewrites; /* saves that had to start from scratch */
+		uint64_t     bytes;    /* written by the last save */
+		uint64_t     total;    /* written by all saves */
+	} save;
 } db_t;
 
 #define EVENTS_KEEP_NUMBER 0
@@ -200,13 +375,23 @@ typedef struct {
 typedef struct {
 	db_t    db;
 	hash_t  keys;
+	trie_t  keynames;
 
 	struct {
 		char     *listener;
 		char     *controller;
 		char     *broadcast;
+		char     *broadcast_tsdp;
 		char     *beacon;
+		char     *upstream;
+		char     *replication;
+		char     *standby_for;
 		uint16_t  nsca_port;
+		uint16_t  udp_port;
+		int       udp_buffer; /* bytes; 0 leaves it up to the OS */
+		char     *shm_ring;
+		int       shm_size;   /* bytes; rounded up to a power of two */
+		int       shm_mode;   /* of the ring and its socket; 0 for DEFAULT_SHM_MODE */
 
 		char     *log_level;
 		char     *log_facility;
@@ -224,6 +409,14 @@ typedef struct {
 		int       events_keep;
 
 		int       grace_period;
+		double    trace_rate;
+
+		int       topk_size;
+		int       topk_interval;
+
+		int       evict_idle; /* windows */
+		int       query_threads;
+		int       listener_threads;
 	} config;
 
 	struct {
@@ -234,24 +427,107 @@ typedef struct {
 	} interval;
 } server_t;
 
+/* from libbolo (see include/bolo.h), for the aggregator's udp listener */
+pdu_t *bolo_stream_pdu(const char *line);
+
+/* from libbolo (see include/bolo.h and the shm_header_t commentary) */
+typedef struct __bolo_shm* bolo_shm_t;
+bolo_shm_t bolo_shm_open(const char *path);
+int        bolo_shm_send(bolo_shm_t, pdu_t *pdu);
+void       bolo_shm_close(bolo_shm_t);
+
+/* from libbolo (see include/bolo.h and bolo_num.c) */
+#define BOLO_NUM_MAX 32
+int      bolo_utoa(char *buf, uint64_t v);
+int      bolo_itoa(char *buf, int64_t v);
+int      bolo_etoa(char *buf, double v);
+int      bolo_dtoa(char *buf, double v);
+uint64_t bolo_strtou(const char *s, char **end);
+int64_t  bolo_strtoi(const char *s, char **end);
+double   bolo_strtod(const char *s, char **end);
+int bolo_extend_uint  (pdu_t *pdu, uint64_t v);
+int bolo_extend_int   (pdu_t *pdu, int64_t v);
+int bolo_extend_e     (pdu_t *pdu, double v);
+int bolo_extend_double(pdu_t *pdu, double v);
+
 #define probable(f) (rand() * 1.0 / RAND_MAX <= (f))
 
 /* write to the mmap memory space */
 int binf_write(db_t *db, const char *file, int db_size);
+/* write an older (or newer) savefile format; mainly for testing */
+int binf_write_version(db_t *db, const char *file, int db_size, int version);
 int binf_read(db_t *db, const char *file, int db_size);
+/* forget the savefile layout; the next save will rewrite it all */
+void binf_forget(db_t *db);
 /* force a flush to disk of the mmap save file */
 int binf_sync(const char *file, int db_size);
 
 int configure(const char *path, server_t *s);
 int deconfigure(server_t *s);
 
+/* space-saving top-k heavy hitters */
+typedef struct {
+	char     *name;
+	uint32_t  hash;
+	uint64_t  count;
+	uint64_t  error; /* count may be over by at most this much */
+} topk_entry_t;
+
+typedef struct {
+	int           k, n;
+	topk_entry_t *entries;
+	int32_t      *slots;
+	uint32_t      mask;
+	uint64_t      total;
+} topk_t;
+
+int topk_init(topk_t *t, int k);
+void topk_reset(topk_t *t);
+void topk_done(topk_t *t);
+void topk_add(topk_t *t, const char *name);
+/* for names that were already hashed (by topk_hash), elsewhere */
+uint32_t topk_hash(const char *name);
+void topk_add_hashed(topk_t *t, const char *name, uint32_t hash);
+/* fills *list with pointers to entries, most frequent first;
+   returns how many there are.  free(*list) when done. */
+int topk_sorted(topk_t *t, topk_entry_t ***list);
+
+/* walk callbacks return non-zero to stop the walk */
+typedef int (*trie_fn)(const char *key, uint16_t bits, void *udata);
+void trie_init(trie_t *t);
+void trie_done(trie_t *t);
+void trie_insert(trie_t *t, const char *key, uint16_t bits);
+void trie_remove(trie_t *t, const char *key, uint16_t bits);
+/* visits every key starting with prefix that has any of bits, in order */
+int trie_walk(trie_t *t, const char *prefix, uint16_t bits, trie_fn fn, void *udata);
+size_t re_prefix(const char *re, char *buf, size_t len);
+
+void ring_init(ring_t *r);
+void ring_done(ring_t *r);
+void ring_reserve(ring_t *r, size_t n);
+void ring_push(ring_t *r, int32_t ts, const char *name, const char *extra);
+void ring_shift(ring_t *r);
+/* close off the current batch; the next push starts a new one */
+void ring_seal(ring_t *r);
+ring_entry_t* ring_get(ring_t *r, size_t i);
+/* index of the first event at or after ts (as far as ordering allows) */
+size_t ring_since(ring_t *r, int32_t ts);
+/* a compacted copy, without batches, for snapshots */
+void ring_copy(ring_t *dst, ring_t *src);
+
 void sample_reset(sample_t *sample);
 int sample_data(sample_t *s, double v);
+/* folds a whole (pre-aggregated) window of n values into s */
+int sample_merge(sample_t *s, uint64_t n, double min, double max, double sum, double mean, double var);
 
 void counter_reset(counter_t *counter);
 
 void rate_reset(rate_t *r);
 int rate_data(rate_t *r, uint64_t v);
+/* how far the counter behind r went, over the whole window */
+uint64_t rate_diff(rate_t *r);
+/* folds in diff, as seen (by someone else) between first and last */
+int rate_merge(rate_t *r, int32_t first, int32_t last, uint64_t diff);
 double rate_calc(rate_t *r, int32_t span);
 
 state_t*   find_state(  db_t*, const char *name);
@@ -259,6 +535,12 @@ counter_t* find_counter(db_t*, const char *name);
 sample_t*  find_sample( db_t*, const char *name);
 rate_t*    find_rate(   db_t*, const char *name);
 
+/* remove a record from the db (and its rule's limit), and free it */
+void release_state(  db_t*, state_t*);
+void release_counter(db_t*, counter_t*);
+void release_sample( db_t*, sample_t*);
+void release_rate(   db_t*, rate_t*);
+
 pdu_t *parse_state_pdu  (int argc, char **argv, const char *ts);
 pdu_t *parse_counter_pdu(int argc, char **argv, const char *ts);
 pdu_t *parse_sample_pdu (int argc, char **argv, const char *ts);
@@ -118,6 +118,8 @@ int cmd_aggregator(int off, int argc, char **argv)
 	svr->interval.sweep      = DEFAULT_SWEEP;
 
 	svr->config.save_size    = DEFAULT_SAVE_SIZE;
+	svr->config.topk_size     = DEFAULT_TOPK_SIZE;
+	svr->config.topk_interval = DEFAULT_TOPK_INTERVAL;
 
 	if (OPTIONS.foreground) {
 		log_open("bolo", "stderr");
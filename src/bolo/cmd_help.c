@@ -38,6 +38,7 @@ int cmd_help(int off, int argc, char **argv)
 	                "  cache     Subscriber store-n-forward cache.\n"
 	                "  forget    Instruct a remote aggregator to forget data.\n"
 	                "  query     Query a Bolo Aggregator for information.\n"
+	                "  route     Spread submissions across several aggregators.\n"
 	                "  send      Submit data to a Bolo Aggregator.\n");
 	return 0;
 }
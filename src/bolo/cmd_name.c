@@ -21,6 +21,14 @@
 #include <stdio.h>
 #include <string.h>
 
+static int s_found(bolo_name_t name, void *data, void *arg)
+{
+	char *s = bolo_name_string(name);
+	fprintf(stdout, "%s\n", s);
+	free(s);
+	return 0;
+}
+
 int cmd_name(int off, int argc, char **argv)
 {
 	/*
@@ -30,6 +38,7 @@ int cmd_name(int off, int argc, char **argv)
 	    bolo name concat a,b x,y
 	    bolo name add a,b x=y z=z
 	    bolo name rm a,b,x=y,z=z x z
+	    bolo name search x=*,* x=y,a=b a=b,c=d
 	 */
 
 	if (argc - off < 2) {
@@ -162,6 +171,30 @@ int cmd_name(int off, int argc, char **argv)
 		fprintf(stdout, "%s\n", s);
 		free(s);
 
+	} else if (strcmp(argv[off + 1], "search") == 0) {
+		if (argc - off < 4) {
+			fprintf(stderr, "USAGE: bolo name search <pattern> <name> [<name> ...]\n");
+			exit(1);
+		}
+		bolo_name_t pattern = bolo_name_parse(argv[off + 2]);
+		if (pattern == NULL) {
+			fprintf(stderr, "%s: not a valid qualified name\n", argv[off + 2]);
+			exit(1);
+		}
+		bolo_name_index_t idx = bolo_name_index_new();
+		int i;
+		for (i = off + 3; i < argc; i++) {
+			bolo_name_t name = bolo_name_parse(argv[i]);
+			if (name == NULL) {
+				fprintf(stderr, "%s: not a valid qualified name\n", argv[i]);
+				continue;
+			}
+			bolo_name_index_add(idx, name, NULL);
+			bolo_name_free(name);
+		}
+		if (bolo_name_index_search(idx, pattern, s_found, NULL) == 0)
+			exit(2);
+
 	} else {
 		fprintf(stderr, "Unrecognized command '%s'\n", argv[off + 1]);
 		exit(1);
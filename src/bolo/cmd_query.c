@@ -41,6 +41,7 @@ int cmd_query(int off, int argc, char **argv)
 		case 'e':
 			free(endpoint);
 			endpoint = strdup(optarg);
+			break;
 		default:
 			fprintf(stderr, "unhandled option flag %#02x\n", c);
 			return 1;
@@ -137,7 +138,7 @@ int cmd_query(int off, int argc, char **argv)
 				*a = '\0';
 
 				n++;
-				pdu_extendf(p, "%s", a);
+				pdu_extendf(p, "%s", c);
 				c = b;
 			}
 
@@ -179,7 +180,7 @@ int cmd_query(int off, int argc, char **argv)
 				b = a; while (*b &&  isspace(*b)) b++;
 				*a = '\0';
 
-				pdu_extendf(p, "%s", a);
+				pdu_extendf(p, "%s", c);
 				c = b;
 			}
 
@@ -225,7 +226,7 @@ int cmd_query(int off, int argc, char **argv)
 				b = a; while (*b &&  isspace(*b)) b++;
 				*a = '\0';
 
-				pdu_extendf(p, "%s", a);
+				pdu_extendf(p, "%s", c);
 				c = b;
 			}
 
@@ -246,6 +247,26 @@ int cmd_query(int off, int argc, char **argv)
 			}
 			pdu_free(p);
 
+		} else if (strcasecmp(a, "sync.keys") == 0) {
+			if (*c) fprintf(stderr, "ignoring useless arguments to `sync.keys' command\n");
+
+			if (pdu_send_and_free(pdu_make("SYNC.KEYS", 0), z) != 0) {
+				fprintf(stderr, "failed to send [SYNC.KEYS] PDU to %s; command aborted\n", endpoint);
+				return 3;
+			}
+			p = pdu_recv(z);
+			if (!p) {
+				fprintf(stderr, "no response received from %s\n", endpoint);
+				return 3;
+			}
+
+			if (strcmp(pdu_type(p), "ERROR") == 0) {
+				fprintf(stderr, "error: %s\n", s = pdu_string(p, 1)); free(s);
+				pdu_free(p);
+				continue;
+			}
+			pdu_free(p);
+
 		} else if (strcasecmp(a, "search.keys") == 0) {
 			while (*c && isspace(*c)) c++;
 			if (!*c) {
@@ -290,10 +311,22 @@ int cmd_query(int off, int argc, char **argv)
 			if (*c) {
 				ts = c;
 				while (*c && isdigit(*c)) c++;
-				*c = '\0';
+				if (*c && !isspace(*c)) {
+					fprintf(stderr, "invalid timestamp argument to `get.events' call\n");
+					fprintf(stderr, "usage: get.events [<since> [<pattern>]]\n");
+					continue;
+				}
+				if (*c) *c++ = '\0';
+				while (*c && isspace(*c)) c++;
 			}
 
-			if (pdu_send_and_free(pdu_make("GET.EVENTS", 1, ts), z) != 0) {
+			pdu_t *q = pdu_make("GET.EVENTS", 1, ts);
+			if (*c) {
+				a = c; while (*a && !isspace(*a)) a++;
+				*a = '\0';
+				pdu_extendf(q, "%s", c);
+			}
+			if (pdu_send_and_free(q, z) != 0) {
 				fprintf(stderr, "failed to send [GET.EVENTS] PDU to %s; command aborted\n", endpoint);
 				return 3;
 			}
@@ -336,6 +369,52 @@ int cmd_query(int off, int argc, char **argv)
 			fprintf(stdout, "%s", s = pdu_string(p, 1)); free(s);
 			pdu_free(p);
 
+		} else if (strcasecmp(a, "stats") == 0) {
+			if (*c) fprintf(stderr, "ignoring useless arguments to `stats' command\n");
+
+			if (pdu_send_and_free(pdu_make("STATS", 0), z) != 0) {
+				fprintf(stderr, "failed to send [STATS] PDU to %s; command aborted\n", endpoint);
+				return 3;
+			}
+			p = pdu_recv(z);
+			if (!p) {
+				fprintf(stderr, "no response received from %s\n", endpoint);
+				return 3;
+			}
+			if (strcmp(pdu_type(p), "ERROR") == 0) {
+				fprintf(stderr, "error: %s\n", s = pdu_string(p, 1)); free(s);
+				continue;
+			}
+			if (strcmp(pdu_type(p), "STATS") != 0) {
+				fprintf(stderr, "unknown response [%s] from %s\n", pdu_type(p), endpoint);
+				return 4;
+			}
+			fprintf(stdout, "%s", s = pdu_string(p, 1)); free(s);
+			pdu_free(p);
+
+		} else if (strcasecmp(a, "topk") == 0) {
+			if (*c) fprintf(stderr, "ignoring useless arguments to `topk' command\n");
+
+			if (pdu_send_and_free(pdu_make("TOPK", 0), z) != 0) {
+				fprintf(stderr, "failed to send [TOPK] PDU to %s; command aborted\n", endpoint);
+				return 3;
+			}
+			p = pdu_recv(z);
+			if (!p) {
+				fprintf(stderr, "no response received from %s\n", endpoint);
+				return 3;
+			}
+			if (strcmp(pdu_type(p), "ERROR") == 0) {
+				fprintf(stderr, "error: %s\n", s = pdu_string(p, 1)); free(s);
+				continue;
+			}
+			if (strcmp(pdu_type(p), "TOPK") != 0) {
+				fprintf(stderr, "unknown response [%s] from %s\n", pdu_type(p), endpoint);
+				return 4;
+			}
+			fprintf(stdout, "%s", s = pdu_string(p, 1)); free(s);
+			pdu_free(p);
+
 		} else {
 			fprintf(stderr, "unrecognized command '%s'\n", a);
 			continue;
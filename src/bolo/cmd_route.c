@@ -0,0 +1,798 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <getopt.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <vigor.h>
+#include <bolo.h>
+#include <tsdp.h>
+
+/*
+   The submission router.
+
+   Every backend aggregator gets a number of points (virtual nodes) on
+   a hash ring, and each submission goes to the backend that owns the
+   first point at or after the hash of its metric name.  Backends that
+   fail their health checks are skipped over (so their share goes to
+   whoever owns the next points along) but stay on the ring, so that
+   when they come back they get exactly the same names as before, and
+   nobody else's names move.
+
+   The frontend thread reads submissions off of the listener, and hands
+   them to one of the worker threads, picked by name, so that updates
+   to the same metric stay in order.  The workers pick a backend and
+   pass the frames along.  Nobody ever parses a PDU; frames are moved,
+   untouched, from one socket to the next.
+ */
+
+#define DEFAULT_VNODES   128
+#define DEFAULT_WORKERS  2
+#define DEFAULT_INTERVAL 5
+#define DRAIN_MAX        1024  /* submissions read per wakeup */
+
+typedef struct {
+	char *listener;   /* where submissions go */
+	char *controller; /* where health checks go (optional) */
+	int   up;         /* set by the checker, read by the workers */
+} backend_t;
+
+typedef struct {
+	uint32_t hash;
+	int      backend;
+} vnode_t;
+
+typedef struct {
+	int        nbackends;
+	backend_t *backends;
+	int        up;        /* how many backends are up */
+
+	size_t     nvnodes;
+	vnode_t   *vnodes;    /* sorted by hash */
+} router_t;
+
+typedef struct {
+	zmq_msg_t *frames;
+	size_t     n, cap;
+} frames_t;
+
+typedef struct {
+	router_t *router;
+
+	void *control;    /* SUB:  hooked up to supervisor.command; receives control messages */
+	void *listener;   /* PULL: where clients submit (external) */
+	void **workers;   /* PUSH: one per worker, to worker.input */
+	int   nworkers;
+
+	frames_t in;
+} frontend_t;
+
+typedef struct {
+	router_t *router;
+	int id;
+
+	void *control;    /* SUB:  hooked up to supervisor.command; receives control messages */
+	void *input;      /* PULL: connected to one of frontend.workers */
+	void **backends;  /* PUSH: one per backend aggregator (external) */
+
+	frames_t in;
+	uint64_t routed, dropped;
+} worker_t;
+
+typedef struct {
+	router_t *router;
+	void *zmq;
+	int   interval;
+
+	void *control;    /* SUB:    hooked up to supervisor.command; receives control messages */
+	void **probes;    /* DEALER: one per backend with a controller (external) */
+} checker_t;
+
+/**************************/
+
+static uint32_t s_hash(const void *buf, size_t len) /* {{{ */
+{
+	/* FNV-1a, then murmur3's finalizer, since FNV on its own
+	   doesn't spread short, similar keys very well */
+	const uint8_t *p = buf;
+	uint32_t h = 2166136261u;
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+	h ^= h >> 16; h *= 0x85ebca6bu;
+	h ^= h >> 13; h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+/* }}} */
+static int s_vnode_cmp(const void *a, const void *b) /* {{{ */
+{
+	const vnode_t *x = a, *y = b;
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	return x->backend - y->backend;
+}
+/* }}} */
+static void router_build(router_t *r, int vnodes) /* {{{ */
+{
+	int i, j;
+	r->nvnodes = r->nbackends * vnodes;
+	r->vnodes  = vmalloc(r->nvnodes * sizeof(vnode_t));
+	r->up      = r->nbackends;
+
+	for (i = 0; i < r->nbackends; i++) {
+		r->backends[i].up = 1;
+		for (j = 0; j < vnodes; j++) {
+			char *key = string("%s#%i", r->backends[i].listener, j);
+			r->vnodes[i * vnodes + j].hash    = s_hash(key, strlen(key));
+			r->vnodes[i * vnodes + j].backend = i;
+			free(key);
+		}
+	}
+	qsort(r->vnodes, r->nvnodes, sizeof(vnode_t), s_vnode_cmp);
+}
+/* }}} */
+static int router_lookup(router_t *r, uint32_t hash) /* {{{ */
+{
+	if (__atomic_load_n(&r->up, __ATOMIC_RELAXED) == 0)
+		return -1;
+
+	size_t lo = 0, hi = r->nvnodes, i;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (r->vnodes[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* walk clockwise to the first backend that is up */
+	for (i = 0; i < r->nvnodes; i++) {
+		vnode_t *v = &r->vnodes[(lo + i) % r->nvnodes];
+		if (__atomic_load_n(&r->backends[v->backend].up, __ATOMIC_RELAXED))
+			return v->backend;
+	}
+	return -1;
+}
+/* }}} */
+static void router_mark(router_t *r, int i, int up) /* {{{ */
+{
+	backend_t *b = &r->backends[i];
+	if (__atomic_load_n(&b->up, __ATOMIC_RELAXED) == up)
+		return;
+
+	__atomic_store_n(&b->up, up, __ATOMIC_RELAXED);
+	if (up) {
+		__atomic_add_fetch(&r->up, 1, __ATOMIC_RELAXED);
+		logger(LOG_NOTICE, "backend %s is back; routing its share to it again", b->listener);
+	} else {
+		__atomic_sub_fetch(&r->up, 1, __ATOMIC_RELAXED);
+		logger(LOG_WARNING, "backend %s failed its health check; routing around it", b->listener);
+	}
+}
+/* }}} */
+
+/* receive all the frames of one message, without copying them anywhere;
+   returns the number of frames, 0 if there was nothing to read, or -1 */
+static int frames_recv(frames_t *f, void *socket, int flags) /* {{{ */
+{
+	int more;
+	size_t len = sizeof(more);
+
+	f->n = 0;
+	do {
+		if (f->n == f->cap) {
+			f->cap = f->cap ? f->cap * 2 : 8;
+			f->frames = realloc(f->frames, f->cap * sizeof(zmq_msg_t));
+			if (!f->frames)
+				return -1;
+		}
+
+		zmq_msg_init(&f->frames[f->n]);
+		if (zmq_msg_recv(&f->frames[f->n], socket, f->n ? 0 : flags) < 0) {
+			zmq_msg_close(&f->frames[f->n]);
+			while (f->n > 0)
+				zmq_msg_close(&f->frames[--f->n]);
+			return errno == EAGAIN ? 0 : -1;
+		}
+		f->n++;
+
+		zmq_getsockopt(socket, ZMQ_RCVMORE, &more, &len);
+	} while (more);
+
+	return f->n;
+}
+/* }}} */
+/* hand the frames off to another socket; they are gone either way */
+static int frames_send(frames_t *f, void *socket, int flags) /* {{{ */
+{
+	size_t i;
+	for (i = 0; i < f->n; i++) {
+		if (zmq_msg_send(&f->frames[i], socket, flags | (i + 1 < f->n ? ZMQ_SNDMORE : 0)) < 0) {
+			for (; i < f->n; i++)
+				zmq_msg_close(&f->frames[i]);
+			f->n = 0;
+			return -1;
+		}
+	}
+	f->n = 0;
+	return 0;
+}
+/* }}} */
+static uint32_t frames_key(frames_t *f) /* {{{ */
+{
+	/* [ TYPE | ts | name | ... ], except for
+	   [ SET.KEYS | key | value | ... ], which goes by its first key */
+	size_t i = 2;
+	if (zmq_msg_size(&f->frames[0]) == 8
+	 && memcmp(zmq_msg_data(&f->frames[0]), "SET.KEYS", 8) == 0)
+		i = 1;
+	if (i >= f->n)
+		i = f->n - 1;
+
+	/* binary TSDP comes in one frame, and goes by its name,
+	   so that it lands on the same backend as the text would */
+	const uint8_t *b = zmq_msg_data(&f->frames[i]);
+	size_t len = zmq_msg_size(&f->frames[i]);
+	if (f->n == 1 && len >= 4 && (b[0] >> 4) == TSDP_VERSION)
+		b = tsdp_packed_key(b, len, &len);
+
+	return s_hash(b, len);
+}
+/* }}} */
+
+/**************************/
+
+static void * _frontend_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	frontend_t *frontend = (frontend_t*)_;
+	zmq_pollitem_t poll[2] = {
+		{ frontend->control,  0, ZMQ_POLLIN, 0 },
+		{ frontend->listener, 0, ZMQ_POLLIN, 0 },
+	};
+	int i, n;
+
+	for (;;) {
+		if (zmq_poll(poll, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != ETERM) /* shutting down */
+				logger(LOG_ERR, "frontend: poll failed: %s", strerror(errno));
+			break;
+		}
+		if (poll[0].revents & ZMQ_POLLIN)
+			break;
+
+		for (i = 0; i < DRAIN_MAX; i++) {
+			n = frames_recv(&frontend->in, frontend->listener, ZMQ_DONTWAIT);
+			if (n <= 0)
+				break;
+
+			int w = frames_key(&frontend->in) % frontend->nworkers;
+			if (frames_send(&frontend->in, frontend->workers[w], 0) != 0)
+				logger(LOG_WARNING, "frontend: failed to hand a submission to worker %i: %s", w, strerror(errno));
+		}
+	}
+
+	logger(LOG_DEBUG, "frontend: shutting down");
+
+	for (i = 0; i < frontend->nworkers; i++)
+		zmq_close(frontend->workers[i]);
+	zmq_close(frontend->listener);
+	zmq_close(frontend->control);
+
+	free(frontend->workers);
+	free(frontend->in.frames);
+	free(frontend);
+
+	logger(LOG_DEBUG, "frontend: terminated");
+	return NULL;
+}
+/* }}} */
+static void * _worker_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	worker_t *worker = (worker_t*)_;
+	router_t *router = worker->router;
+	zmq_pollitem_t poll[2] = {
+		{ worker->control, 0, ZMQ_POLLIN, 0 },
+		{ worker->input,   0, ZMQ_POLLIN, 0 },
+	};
+	int i, n;
+
+	for (;;) {
+		if (zmq_poll(poll, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != ETERM) /* shutting down */
+				logger(LOG_ERR, "worker %i: poll failed: %s", worker->id, strerror(errno));
+			break;
+		}
+		if (poll[0].revents & ZMQ_POLLIN)
+			break;
+
+		for (i = 0; i < DRAIN_MAX; i++) {
+			n = frames_recv(&worker->in, worker->input, ZMQ_DONTWAIT);
+			if (n <= 0)
+				break;
+
+			int b = router_lookup(router, frames_key(&worker->in));
+			if (b < 0) {
+				logger(LOG_DEBUG, "worker %i: no backends are up; dropping a submission", worker->id);
+				while (worker->in.n > 0)
+					zmq_msg_close(&worker->in.frames[--worker->in.n]);
+				worker->dropped++;
+
+			} else if (frames_send(&worker->in, worker->backends[b], ZMQ_DONTWAIT) != 0) {
+				logger(LOG_DEBUG, "worker %i: failed to route a submission to %s: %s",
+					worker->id, router->backends[b].listener, strerror(errno));
+				worker->dropped++;
+
+			} else {
+				worker->routed++;
+			}
+		}
+	}
+
+	logger(LOG_DEBUG, "worker %i: shutting down", worker->id);
+	logger(LOG_INFO, "worker %i: routed %lu submissions, dropped %lu",
+		worker->id, worker->routed, worker->dropped);
+
+	for (i = 0; i < router->nbackends; i++)
+		zmq_close(worker->backends[i]);
+	zmq_close(worker->input);
+	zmq_close(worker->control);
+
+	free(worker->backends);
+	free(worker->in.frames);
+	free(worker);
+
+	logger(LOG_DEBUG, "worker: terminated");
+	return NULL;
+}
+/* }}} */
+static int s_probe(void *zmq, void **z, const char *endpoint) /* {{{ */
+{
+	/* unanswered checks must not hold up shutdown */
+	int linger = 0;
+	*z = zmq_socket(zmq, ZMQ_DEALER);
+	if (!*z)
+		return -1;
+	if (zmq_setsockopt(*z, ZMQ_LINGER, &linger, sizeof(linger)) != 0)
+		return -1;
+	return vzmq_connect(*z, endpoint);
+}
+/* }}} */
+static void * _checker_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	checker_t *checker = (checker_t*)_;
+	router_t  *router  = checker->router;
+	int n = router->nbackends;
+	int i, halt = 0;
+
+	zmq_pollitem_t *poll = vcalloc(n + 1, sizeof(zmq_pollitem_t));
+	int *who   = vcalloc(n + 1, sizeof(int));
+	int *alive = vcalloc(n, sizeof(int));
+
+	while (!halt) {
+		for (i = 0; i < n; i++) {
+			alive[i] = 0;
+			if (checker->probes[i])
+				pdu_send_and_free(pdu_make("STATS", 0), checker->probes[i]);
+		}
+
+		/* give everyone until the next round to answer */
+		uint64_t deadline = time_ms() + checker->interval * 1000;
+		uint64_t now;
+		while (!halt && (now = time_ms()) < deadline) {
+			int np = 0;
+			poll[np].socket = checker->control;
+			poll[np].events = ZMQ_POLLIN;
+			np++;
+			for (i = 0; i < n; i++) {
+				if (!checker->probes[i] || alive[i])
+					continue;
+				poll[np].socket = checker->probes[i];
+				poll[np].events = ZMQ_POLLIN;
+				who[np] = i;
+				np++;
+			}
+
+			if (zmq_poll(poll, np, deadline - now) < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno != ETERM) /* shutting down */
+					logger(LOG_ERR, "checker: poll failed: %s", strerror(errno));
+				halt = 1;
+				break;
+			}
+			if (poll[0].revents & ZMQ_POLLIN) {
+				halt = 1;
+				break;
+			}
+
+			int j;
+			for (j = 1; j < np; j++) {
+				if (!(poll[j].revents & ZMQ_POLLIN))
+					continue;
+				/* any answer at all will do */
+				pdu_free(pdu_recv(poll[j].socket));
+				alive[who[j]] = 1;
+				router_mark(router, who[j], 1);
+			}
+		}
+		if (halt)
+			break;
+
+		for (i = 0; i < n; i++) {
+			if (!checker->probes[i] || alive[i])
+				continue;
+			router_mark(router, i, 0);
+
+			/* start over with a fresh socket, so that a late answer
+			   to this check doesn't count for the next one */
+			zmq_close(checker->probes[i]);
+			if (s_probe(checker->zmq, &checker->probes[i], router->backends[i].controller) != 0)
+				logger(LOG_ERR, "checker: failed to reconnect to %s", router->backends[i].controller);
+		}
+	}
+
+	logger(LOG_DEBUG, "checker: shutting down");
+
+	for (i = 0; i < n; i++)
+		if (checker->probes[i])
+			zmq_close(checker->probes[i]);
+	zmq_close(checker->control);
+
+	free(poll);
+	free(who);
+	free(alive);
+	free(checker->probes);
+	free(checker);
+
+	logger(LOG_DEBUG, "checker: terminated");
+	return NULL;
+}
+/* }}} */
+
+static int s_push(void *zmq, void **z, int linger, int immediate) /* {{{ */
+{
+	*z = zmq_socket(zmq, ZMQ_PUSH);
+	if (!*z)
+		return -1;
+	if (zmq_setsockopt(*z, ZMQ_LINGER, &linger, sizeof(linger)) != 0)
+		return -1;
+	if (immediate && zmq_setsockopt(*z, ZMQ_IMMEDIATE, &immediate, sizeof(immediate)) != 0)
+		return -1;
+	return 0;
+}
+/* }}} */
+static int router_threads(void *zmq, router_t *router, const char *listen, int nworkers, int interval) /* {{{ */
+{
+	assert(zmq != NULL);
+	assert(router != NULL);
+	assert(listen != NULL);
+
+	int rc, i, j;
+	pthread_t tid;
+
+	logger(LOG_INFO, "initializing frontend thread");
+	frontend_t *frontend = vmalloc(sizeof(frontend_t));
+	frontend->router   = router;
+	frontend->nworkers = nworkers;
+	frontend->workers  = vcalloc(nworkers, sizeof(void*));
+
+	logger(LOG_DEBUG, "connecting frontend.control -> supervisor");
+	rc = bolo_subscriber_connect_supervisor(zmq, &frontend->control);
+	if (rc != 0)
+		return rc;
+
+	logger(LOG_DEBUG, "binding PULL socket frontend.listener to %s", listen);
+	frontend->listener = zmq_socket(zmq, ZMQ_PULL);
+	if (!frontend->listener)
+		return -1;
+	rc = zmq_bind(frontend->listener, listen);
+	if (rc != 0)
+		return rc;
+
+	for (i = 0; i < nworkers; i++) {
+		logger(LOG_INFO, "initializing worker thread %i", i);
+		worker_t *worker = vmalloc(sizeof(worker_t));
+		worker->router   = router;
+		worker->id       = i;
+		worker->backends = vcalloc(router->nbackends, sizeof(void*));
+
+		char *inproc = string("inproc://bolo.route/v1/worker.%i", i);
+		logger(LOG_DEBUG, "binding PUSH socket frontend.workers[%i] to %s", i, inproc);
+		rc = s_push(zmq, &frontend->workers[i], 0, 0);
+		if (rc == 0) {
+			/* block while the worker catches up, but not forever */
+			int timeout = 1000;
+			rc = zmq_setsockopt(frontend->workers[i], ZMQ_SNDTIMEO, &timeout, sizeof(timeout));
+		}
+		if (rc == 0)
+			rc = zmq_bind(frontend->workers[i], inproc);
+		if (rc != 0) {
+			free(inproc);
+			return rc;
+		}
+
+		logger(LOG_DEBUG, "connecting worker[%i].control -> supervisor", i);
+		rc = bolo_subscriber_connect_supervisor(zmq, &worker->control);
+		if (rc != 0) {
+			free(inproc);
+			return rc;
+		}
+
+		logger(LOG_DEBUG, "connecting worker[%i].input -> %s", i, inproc);
+		worker->input = zmq_socket(zmq, ZMQ_PULL);
+		rc = worker->input ? zmq_connect(worker->input, inproc) : -1;
+		free(inproc);
+		if (rc != 0)
+			return rc;
+
+		for (j = 0; j < router->nbackends; j++) {
+			/* don't queue up submissions for backends we can't reach;
+			   fail the send, so they get counted as dropped */
+			logger(LOG_DEBUG, "connecting worker[%i].backends[%i] -> %s", i, j, router->backends[j].listener);
+			rc = s_push(zmq, &worker->backends[j], 1000, 1);
+			if (rc == 0)
+				rc = vzmq_connect_af(worker->backends[j], router->backends[j].listener, AF_UNSPEC);
+			if (rc != 0)
+				return rc;
+		}
+
+		logger(LOG_DEBUG, "worker %i: spinning up thread", i);
+		rc = pthread_create(&tid, NULL, _worker_thread, worker);
+		if (rc != 0)
+			return rc;
+	}
+
+	logger(LOG_DEBUG, "frontend: spinning up thread");
+	rc = pthread_create(&tid, NULL, _frontend_thread, frontend);
+	if (rc != 0)
+		return rc;
+
+	logger(LOG_INFO, "initializing health checker thread");
+	checker_t *checker = vmalloc(sizeof(checker_t));
+	checker->router   = router;
+	checker->zmq      = zmq;
+	checker->interval = interval;
+	checker->probes   = vcalloc(router->nbackends, sizeof(void*));
+
+	logger(LOG_DEBUG, "connecting checker.control -> supervisor");
+	rc = bolo_subscriber_connect_supervisor(zmq, &checker->control);
+	if (rc != 0)
+		return rc;
+
+	for (i = 0; i < router->nbackends; i++) {
+		if (!router->backends[i].controller)
+			continue;
+
+		logger(LOG_DEBUG, "connecting checker.probes[%i] -> %s", i, router->backends[i].controller);
+		rc = s_probe(zmq, &checker->probes[i], router->backends[i].controller);
+		if (rc != 0)
+			return rc;
+	}
+
+	logger(LOG_DEBUG, "checker: spinning up thread");
+	rc = pthread_create(&tid, NULL, _checker_thread, checker);
+	if (rc != 0)
+		return rc;
+
+	return 0;
+}
+/* }}} */
+
+/**************************/
+
+int cmd_route(int off, int argc, char **argv) /* {{{ */
+{
+	struct {
+		char *listen;
+		strings_t *backends;
+
+		int   vnodes;
+		int   workers;
+		int   interval;
+
+		int   verbose;
+		int   daemonize;
+
+		char *pidfile;
+		char *user;
+		char *group;
+
+	} OPTIONS = {
+		.verbose   = 0,
+		.listen    = strdup("tcp://*:2999"),
+		.backends  = strings_new(NULL),
+		.vnodes    = DEFAULT_VNODES,
+		.workers   = DEFAULT_WORKERS,
+		.interval  = DEFAULT_INTERVAL,
+		.daemonize = 1,
+		.pidfile   = strdup("/var/run/bolo/route.pid"),
+		.user      = strdup("root"),
+		.group     = strdup("root"),
+	};
+
+	struct option long_opts[] = {
+		{ "verbose",          no_argument, NULL, 'v' },
+		{ "listen",     required_argument, NULL, 'l' },
+		{ "backend",    required_argument, NULL, 'b' },
+		{ "vnodes",     required_argument, NULL, 'n' },
+		{ "workers",    required_argument, NULL, 'w' },
+		{ "interval",   required_argument, NULL, 'i' },
+		{ "foreground",       no_argument, NULL, 'F' },
+		{ "pidfile",    required_argument, NULL, 'p' },
+		{ "user",       required_argument, NULL, 'u' },
+		{ "group",      required_argument, NULL, 'g' },
+		{ 0, 0, 0, 0 },
+	};
+
+	optind = ++off;
+	for (;;) {
+		int c = getopt_long(argc, argv, "v+l:b:n:w:i:Fp:u:g:", long_opts, &off);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'v':
+			OPTIONS.verbose++;
+			break;
+
+		case 'l':
+			free(OPTIONS.listen);
+			OPTIONS.listen = strdup(optarg);
+			break;
+
+		case 'b':
+			strings_add(OPTIONS.backends, optarg);
+			break;
+
+		case 'n':
+			OPTIONS.vnodes = strtol(optarg, NULL, 10);
+			break;
+
+		case 'w':
+			OPTIONS.workers = strtol(optarg, NULL, 10);
+			break;
+
+		case 'i':
+			OPTIONS.interval = strtol(optarg, NULL, 10);
+			break;
+
+		case 'F':
+			OPTIONS.daemonize = 0;
+			break;
+
+		case 'p':
+			free(OPTIONS.pidfile);
+			OPTIONS.pidfile = strdup(optarg);
+			break;
+
+		case 'u':
+			free(OPTIONS.user);
+			OPTIONS.user = strdup(optarg);
+			break;
+
+		case 'g':
+			free(OPTIONS.group);
+			OPTIONS.group = strdup(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "unhandled option flag %#02x\n", c);
+			exit(1);
+		}
+	}
+
+	if (OPTIONS.backends->num == 0) {
+		fprintf(stderr, "USAGE: %s route [options] -b tcp://aggr1:2999[,tcp://aggr1:2998] -b ...\n", argv[0]);
+		exit(1);
+	}
+	if (OPTIONS.vnodes < 1 || OPTIONS.workers < 1 || OPTIONS.interval < 1) {
+		fprintf(stderr, "--vnodes, --workers and --interval must all be at least 1\n");
+		exit(1);
+	}
+
+	router_t router;
+	memset(&router, 0, sizeof(router));
+	router.nbackends = OPTIONS.backends->num;
+	router.backends  = vcalloc(router.nbackends, sizeof(backend_t));
+
+	int i;
+	for (i = 0; i < router.nbackends; i++) {
+		/* LISTENER[,CONTROLLER] */
+		char *comma = strchr(OPTIONS.backends->strings[i], ',');
+		if (comma) {
+			router.backends[i].listener   = strndup(OPTIONS.backends->strings[i], comma - OPTIONS.backends->strings[i]);
+			router.backends[i].controller = strdup(comma + 1);
+		} else {
+			router.backends[i].listener   = strdup(OPTIONS.backends->strings[i]);
+		}
+	}
+	router_build(&router, OPTIONS.vnodes);
+
+	if (OPTIONS.daemonize) {
+		log_open("bolo-route", "daemon");
+		log_level(LOG_ERR + OPTIONS.verbose, NULL);
+
+		mode_t um = umask(0);
+		if (daemonize(OPTIONS.pidfile, OPTIONS.user, OPTIONS.group) != 0) {
+			fprintf(stderr, "daemonization failed: (%i) %s\n", errno, strerror(errno));
+			exit(3);
+		}
+		umask(um);
+	} else {
+		log_open("bolo-route", "console");
+		log_level(LOG_INFO + OPTIONS.verbose, NULL);
+	}
+	logger(LOG_NOTICE, "starting up");
+
+
+	void *zmq = zmq_ctx_new();
+	if (!zmq) {
+		logger(LOG_ERR, "failed to initialize 0MQ context");
+		exit(1);
+	}
+
+	int rc;
+	rc = bolo_subscriber_init();
+	if (rc != 0) {
+		logger(LOG_ERR, "failed to initialize subscriber architecture");
+		exit(2);
+	}
+
+	rc = router_threads(zmq, &router, OPTIONS.listen, OPTIONS.workers, OPTIONS.interval);
+	if (rc != 0) {
+		logger(LOG_ERR, "failed to initialize router: %s", strerror(errno));
+		exit(2);
+	}
+
+	bolo_subscriber_supervisor(zmq);
+	logger(LOG_INFO, "shutting down");
+
+	for (i = 0; i < router.nbackends; i++) {
+		free(router.backends[i].listener);
+		free(router.backends[i].controller);
+	}
+	free(router.backends);
+	free(router.vnodes);
+
+	free(OPTIONS.listen);
+	strings_free(OPTIONS.backends);
+
+	free(OPTIONS.pidfile);
+	free(OPTIONS.user);
+	free(OPTIONS.group);
+
+	return 0;
+}
+/* }}} */
@@ -20,7 +20,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
+#include <errno.h>
 #include <bolo.h>
+#include <tsdp.h>
 #include <vigor.h>
 
 #define DEFAULT_ENDPOINT "tcp://127.0.0.1:2999"
@@ -31,12 +33,85 @@
 #define TYPE_KEY     4
 #define TYPE_EVENT   5
 #define TYPE_RATE    6
+#define TYPE_SAMPLE_AGG 7
 
 static char *endpoint = NULL;
+static char *ring = NULL;
+static bolo_shm_t shm = NULL;
 static int type = TYPE_STREAM;
+static int binary = 0;
+
+static pdu_t* tsdp_pdu(pdu_t *pdu)
+{
+	/* re-encode a submission as a single-frame TSDP SUBMIT PDU,
+	   with its numbers in binary; SAMPLE.AGG has no TSDP payload
+	   type, so it (and anything that doesn't fit) goes as is. */
+	int payloads;
+	const char *what = pdu_type(pdu);
+	if      (strcmp(what, "STATE")    == 0) payloads = TSDP_PAYLOAD_STATE;
+	else if (strcmp(what, "COUNTER")  == 0) payloads = TSDP_PAYLOAD_TALLY;
+	else if (strcmp(what, "SAMPLE")   == 0) payloads = TSDP_PAYLOAD_SAMPLE;
+	else if (strcmp(what, "RATE")     == 0) payloads = TSDP_PAYLOAD_DELTA;
+	else if (strcmp(what, "EVENT")    == 0) payloads = TSDP_PAYLOAD_EVENT;
+	else if (strcmp(what, "SET.KEYS") == 0) payloads = TSDP_PAYLOAD_FACT;
+	else return pdu;
+
+	tsdp_t *t;
+	if (tsdp_create(&t, TSDP_VERSION, TSDP_OP_SUBMIT) != 0)
+		return pdu;
+	tsdp_set_payloads(t, payloads);
+
+	size_t i;
+	int rc = 0;
+	for (i = 1; rc == 0 && i < pdu_size(pdu); i++) {
+		char *v = pdu_string(pdu, i);
+		if (payloads == TSDP_PAYLOAD_FACT || i == 2)
+			rc = tsdp_extend_string(t, v);
+		else if (i == 1)
+			rc = tsdp_extend_tstamp(t, strtoll(v, NULL, 10) * 1000);
+		else if (payloads == TSDP_PAYLOAD_STATE && i == 3)
+			rc = tsdp_set_flags(t, atoi(v) & 0x3);
+		else if (payloads == TSDP_PAYLOAD_TALLY || payloads == TSDP_PAYLOAD_DELTA)
+			rc = tsdp_extend_uint(t, strtoull(v, NULL, 10));
+		else if (payloads == TSDP_PAYLOAD_SAMPLE)
+			rc = tsdp_extend_float(t, strtod(v, NULL));
+		else
+			rc = tsdp_extend_string(t, v);
+		free(v);
+	}
+
+	if (rc == 0) {
+		int n = tsdp_packed_size(t);
+		uint8_t *buf = malloc(n);
+		if (buf && tsdp_pack(buf, n, t) == n) {
+			pdu_free(pdu);
+			pdu = pdu_new();
+			pdu_extend(pdu, buf, n);
+		}
+		free(buf);
+	}
+	tsdp_destroy(t);
+	return pdu;
+}
 
 static int send_pdu(void *z, pdu_t *pdu)
 {
+	if (binary)
+		pdu = tsdp_pdu(pdu);
+
+	if (shm) {
+		/* give the aggregator a second or so to make room */
+		int rc, tries = 1000;
+		while ((rc = bolo_shm_send(shm, pdu)) != 0 && errno == EAGAIN && --tries > 0)
+			usleep(1000);
+		pdu_free(pdu);
+		if (rc != 0) {
+			fprintf(stderr, "failed to send results to %s: %s\n", ring, strerror(errno));
+			return 3;
+		}
+		return 0;
+	}
+
 	if (pdu_send_and_free(pdu, z) != 0) {
 		fprintf(stderr, "failed to send results to %s\n", endpoint);
 		return 3;
@@ -48,16 +123,19 @@ int cmd_send(int off, int argc, char **argv)
 {
 	endpoint = strdup(DEFAULT_ENDPOINT);
 	type = TYPE_STREAM;
+	binary = 0;
 
 	struct option long_opts[] = {
 		{ "endpoint", required_argument, NULL, 'e' },
 		{ "type",     required_argument, NULL, 't' },
+		{ "shm",      required_argument, NULL, 's' },
+		{ "tsdp",     no_argument,       NULL, 'T' },
 		{ 0, 0, 0, 0 },
 	};
 
 	optind = ++off;
 	for (;;) {
-		int c = getopt_long(argc, argv, "e:t:", long_opts, &off);
+		int c = getopt_long(argc, argv, "e:t:s:T", long_opts, &off);
 		if (c == -1) break;
 
 		switch (c) {
@@ -66,6 +144,15 @@ int cmd_send(int off, int argc, char **argv)
 			endpoint = strdup(optarg);
 			break;
 
+		case 's':
+			free(ring);
+			ring = strdup(optarg);
+			break;
+
+		case 'T':
+			binary = 1;
+			break;
+
 		case 't':
 			if (strcasecmp(optarg, "state") == 0) {
 				type = TYPE_STATE;
@@ -76,6 +163,9 @@ int cmd_send(int off, int argc, char **argv)
 			} else if (strcasecmp(optarg, "sample") == 0) {
 				type = TYPE_SAMPLE;
 
+			} else if (strcasecmp(optarg, "sample.agg") == 0) {
+				type = TYPE_SAMPLE_AGG;
+
 			} else if (strcasecmp(optarg, "stream") == 0) {
 				type = TYPE_STREAM;
 
@@ -123,6 +213,13 @@ int cmd_send(int off, int argc, char **argv)
 			return 1;
 		}
 
+	} else if (type == TYPE_SAMPLE_AGG) {
+		pdu = bolo_parse_sample_agg_pdu(argc - optind, argv + optind, NULL);
+		if (!pdu) {
+			fprintf(stderr, "USAGE: %s -t sample.agg name n min max sum mean variance\n", argv[0]);
+			return 1;
+		}
+
 	} else if (type == TYPE_RATE) {
 		pdu = bolo_parse_rate_pdu(argc - optind, argv + optind, NULL);
 		if (!pdu) {
@@ -151,26 +248,37 @@ int cmd_send(int off, int argc, char **argv)
 		}
 
 	} else {
-		fprintf(stderr, "USAGE: %s -t (sample|counter|state|key|event) args\n", argv[0]);
+		fprintf(stderr, "USAGE: %s -t (sample|sample.agg|counter|rate|state|key|event|stream) args\n", argv[0]);
 		return 1;
 	}
 
-	void *zmq = zmq_ctx_new();
-	if (!zmq) {
-		fprintf(stderr, "failed to initialize 0MQ context; aborting (results NOT submitted)\n");
-		return 3;
-	}
-	void *z = zmq_socket(zmq, ZMQ_PUSH);
-	if (!z) {
-		fprintf(stderr, "failed to create a PUSH socket; aborting (results NOT submitted)\n");
-		return 3;
-	}
-	if (vzmq_connect(z, endpoint) != 0) {
-		fprintf(stderr, "failed to connect to %s; aborting (results NOT submitted)\n", endpoint);
-		return 3;
+	void *zmq = NULL, *z = NULL;
+	if (ring) {
+		shm = bolo_shm_open(ring);
+		if (!shm) {
+			fprintf(stderr, "failed to open shm ring %s: %s; aborting (results NOT submitted)\n",
+				ring, strerror(errno));
+			return 3;
+		}
+
+	} else {
+		zmq = zmq_ctx_new();
+		if (!zmq) {
+			fprintf(stderr, "failed to initialize 0MQ context; aborting (results NOT submitted)\n");
+			return 3;
+		}
+		z = zmq_socket(zmq, ZMQ_PUSH);
+		if (!z) {
+			fprintf(stderr, "failed to create a PUSH socket; aborting (results NOT submitted)\n");
+			return 3;
+		}
+		if (vzmq_connect(z, endpoint) != 0) {
+			fprintf(stderr, "failed to connect to %s; aborting (results NOT submitted)\n", endpoint);
+			return 3;
+		}
 	}
 
-	int rc;
+	int rc = 0;
 	if (pdu) {
 		rc = send_pdu(z, pdu);
 
@@ -195,8 +303,12 @@ int cmd_send(int off, int argc, char **argv)
 		}
 	}
 
-	zmq_close(z);
-	zmq_ctx_destroy(zmq);
+	if (shm) {
+		bolo_shm_close(shm);
+	} else {
+		zmq_close(z);
+		zmq_ctx_destroy(zmq);
+	}
 
 	return rc;
 }
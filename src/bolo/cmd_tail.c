@@ -48,28 +48,53 @@ static struct {
 	pcre_extra  *re_extra;
 } OPTIONS = { 0 };
 
-static void s_print(pdu_t *p)
+static int s_mask(bolo_broadcast_t *b)
 {
-	char *filter;
-	if (strcmp(pdu_type(p), "TRANSITION") == 0
-	 || strcmp(pdu_type(p), "STATE") == 0)
-		filter = pdu_string(p, 1);
-	else
-		filter = pdu_string(p, 2);
-
-	logger(LOG_INFO, "checking '%s' against /%s/", filter, OPTIONS.match);
-	if (pcre_exec(OPTIONS.re, OPTIONS.re_extra, filter, strlen(filter), 0, 0, NULL, 0) == 0) {
-		fprintf(stdout, "%s", pdu_type(p));
-		int i;
-		char *s;
-		for (i = 1; i < pdu_size(p); i++) {
-			fprintf(stdout, " %s", s = pdu_string(p, i));
-			free(s);
-		}
-		fprintf(stdout, "\n");
+	switch (b->type) {
+	case PAYLOAD_STATE:   return b->transition ? MASK_TRANSITION : MASK_STATE;
+	case PAYLOAD_EVENT:   return MASK_EVENT;
+	case PAYLOAD_RATE:    return MASK_RATE;
+	case PAYLOAD_COUNTER: return MASK_COUNTER;
+	case PAYLOAD_SAMPLE:  return MASK_SAMPLE;
+	default:              return 0;
 	}
+}
 
-	free(filter);
+static void s_print(bolo_broadcast_t *b)
+{
+	static const char *status[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+
+	/* printed the way the aggregator formats textual broadcasts,
+	   whichever kind we are subscribed to */
+	logger(LOG_INFO, "checking '%s' against /%s/", b->name, OPTIONS.match);
+	if (pcre_exec(OPTIONS.re, OPTIONS.re_extra, b->name, strlen(b->name), 0, 0, NULL, 0) != 0)
+		return;
+
+	switch (b->type) {
+	case PAYLOAD_STATE:
+		fprintf(stdout, "%s %s %i %s %s %s\n", b->transition ? "TRANSITION" : "STATE",
+			b->name, b->ts, b->stale ? "stale" : "fresh",
+			status[b->status > 3 ? 3 : b->status], b->message);
+		break;
+
+	case PAYLOAD_EVENT:
+		fprintf(stdout, "EVENT %i %s %s\n", b->ts, b->name, b->message);
+		break;
+
+	case PAYLOAD_RATE:
+		fprintf(stdout, "RATE %i %s %i %e\n", b->ts, b->name, b->window, b->rate);
+		break;
+
+	case PAYLOAD_COUNTER:
+		fprintf(stdout, "COUNTER %i %s %lu\n", b->ts, b->name, (unsigned long)b->value);
+		break;
+
+	case PAYLOAD_SAMPLE:
+		fprintf(stdout, "SAMPLE %i %s %lu %e %e %e %e %e\n", b->ts, b->name,
+			(unsigned long)b->n, b->min, b->max, b->sum, b->mean, b->var);
+		break;
+	}
+	fflush(stdout);
 }
 
 int cmd_tail(int off, int argc, char **argv)
@@ -200,17 +225,14 @@ int cmd_tail(int off, int argc, char **argv)
 	signal_handlers();
 	while (!signalled()) {
 		while ((p = pdu_recv(z))) {
-			logger(LOG_INFO, "received a [%s] PDU of %i frames", pdu_type(p), pdu_size(p));
+			logger(LOG_INFO, "received a PDU of %i frames", pdu_size(p));
 
-			#define MATCH(x) (OPTIONS.mask & MASK_ ## x && strcmp(pdu_type(p), #x) == 0)
-			if (MATCH(STATE)
-			 || MATCH(TRANSITION)
-			 || MATCH(EVENT)
-			 || MATCH(RATE)
-			 || MATCH(COUNTER)
-			 || MATCH(SAMPLE))
-				s_print(p);
+			/* text, or binary TSDP from a broadcast.tsdp endpoint */
+			bolo_broadcast_t *b = bolo_broadcast_decode(p);
+			if (b && (OPTIONS.mask & s_mask(b)))
+				s_print(b);
 
+			free(b);
 			pdu_free(p);
 
 			logger(LOG_INFO, "waiting for a PDU from %s", OPTIONS.endpoint);
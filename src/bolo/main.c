@@ -27,6 +27,7 @@ int cmd_forget(int i, int argc, char **argv);
 int cmd_help(int i, int argc, char **argv);
 int cmd_name(int i, int argc, char **argv);
 int cmd_query(int i, int argc, char **argv);
+int cmd_route(int i, int argc, char **argv);
 int cmd_send(int i, int argc, char **argv);
 int cmd_spy(int i, int argc, char **argv);
 int cmd_tail(int i, int argc, char **argv);
@@ -95,6 +96,9 @@ int main(int argc, char **argv)
 	if (strcmp(argv[i], "query") == 0)
 		return cmd_query(i, argc, argv);
 
+	if (strcmp(argv[i], "route") == 0)
+		return cmd_route(i, argc, argv);
+
 	if (strcmp(argv[i], "send") == 0)
 		return cmd_send(i, argc, argv);
 
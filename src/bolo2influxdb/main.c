@@ -74,25 +74,25 @@ static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 		uint64_t spent = 0;
 
 		STOPWATCH(&watch, spent) {
-			char *name, *ts;
+			char *name;
 			char *type, *item, *metric;
 			char *p, pkt[65536];
 			size_t len;
 
-			if ((strcmp(pdu_type(pdu), "COUNTER") == 0 && pdu_size(pdu) == 4)
-			 || (strcmp(pdu_type(pdu), "SAMPLE")  == 0 && pdu_size(pdu) == 9)
-			 || (strcmp(pdu_type(pdu), "RATE")    == 0 && pdu_size(pdu) == 5)) {
-				//logger(LOG_INFO, "received a [%s] PDU", pdu_type(pdu));
-				ts   = pdu_string(pdu, 1);
-				name = pdu_string(pdu, 2);
-
-			} else {
+			/* decodes textual and binary (TSDP) broadcasts alike */
+			bolo_broadcast_t *b = bolo_broadcast_decode(pdu);
+			if (!b || !(b->type == PAYLOAD_COUNTER
+			         || b->type == PAYLOAD_SAMPLE
+			         || b->type == PAYLOAD_RATE)) {
+				free(b);
 				return VIGOR_REACTOR_CONTINUE;
 			}
+			name = b->name;
 
 			p = strchr(name, ':');
 			if (!p) {
 				fprintf(stderr, "unrecognized pattern `%s'\n", name);
+				free(b);
 				return VIGOR_REACTOR_CONTINUE;
 			}
 
@@ -102,6 +102,7 @@ static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 			p = strchr(type, ':');
 			if (!p) {
 				fprintf(stderr, "unrecognized pattern `%s:%s'\n", name, type);
+				free(b);
 				return VIGOR_REACTOR_CONTINUE;
 			}
 
@@ -114,69 +115,53 @@ static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 			}
 			metric = p;
 
-			if (strcmp(pdu_type(pdu), "SAMPLE") == 0) {
-				char *n, *min, *max, *sum, *mean, *var;
-				n    = pdu_string(pdu, 3);
-				min  = pdu_string(pdu, 4);
-				max  = pdu_string(pdu, 5);
-				sum  = pdu_string(pdu, 6);
-				mean = pdu_string(pdu, 7);
-				var  = pdu_string(pdu, 8);
-
+			/* format numbers without the locale-bound printf machinery */
+			char ts[BOLO_NUM_MAX], v[6][BOLO_NUM_MAX];
+			bolo_itoa(ts, b->ts);
+
+			if (b->type == PAYLOAD_SAMPLE) {
+				bolo_utoa(v[0], b->n);
+				bolo_etoa(v[1], b->min);
+				bolo_etoa(v[2], b->max);
+				bolo_etoa(v[3], b->sum);
+				bolo_etoa(v[4], b->mean);
+				bolo_etoa(v[5], b->var);
 				if (item) {
 					len = snprintf(pkt, 65536,
 						"%s,host=%s,type=%s,item=%s n=%s,min=%s,max=%s,sum=%s,mean=%s,var=%s %s000000000\n",
-						metric, name, type, item, n, min, max, sum, mean, var, ts);
+						metric, name, type, item, v[0], v[1], v[2], v[3], v[4], v[5], ts);
 				} else {
 					len = snprintf(pkt, 65536,
 						"%s,host=%s,type=%s n=%s,min=%s,max=%s,sum=%s,mean=%s,var=%s %s000000000\n",
-						metric, name, type,       n, min, max, sum, mean, var, ts);
+						metric, name, type,       v[0], v[1], v[2], v[3], v[4], v[5], ts);
 				}
 
-				free(n);
-				free(min);
-				free(max);
-				free(sum);
-				free(mean);
-				free(var);
-
-			} else if (strcmp(pdu_type(pdu), "COUNTER") == 0) {
-				char *value;
-				value = pdu_string(pdu, 3);
-
+			} else if (b->type == PAYLOAD_COUNTER) {
+				bolo_utoa(v[0], b->value);
 				if (item) {
 					len = snprintf(pkt, 65536,
 						"%s,host=%s,type=%s,item=%s value=%s %s000000000\n",
-						metric, name, type, item, value, ts);
+						metric, name, type, item, v[0], ts);
 				} else {
 					len = snprintf(pkt, 65536,
 						"%s,host=%s,type=%s value=%s %s000000000\n",
-						metric, name, type,       value, ts);
+						metric, name, type,       v[0], ts);
 				}
 
-				free(value);
-
-			} else if (strcmp(pdu_type(pdu), "RATE") == 0) {
-				char *win, *value;
-				win   = pdu_string(pdu, 3);
-				value = pdu_string(pdu, 4);
-
+			} else {
+				bolo_itoa(v[0], b->window);
+				bolo_etoa(v[1], b->rate);
 				if (item) {
 					len = snprintf(pkt, 65536,
 						"%s,host=%s,type=%s,item=%s window=%s,value=%s %s000000000\n",
-						metric, name, type, item, win, value, ts);
+						metric, name, type, item, v[0], v[1], ts);
 				} else {
 					len = snprintf(pkt, 65536,
 						"%s,host=%s,type=%s window=%s,value=%s %s000000000\n",
-						metric, name, type,       win, value, ts);
+						metric, name, type,       v[0], v[1], ts);
 				}
-
-				free(win);
-				free(value);
-
-			} else {
-				return VIGOR_REACTOR_CONTINUE;
 			}
+			free(b);
 
 			ssize_t n = send(dispatcher->udp, pkt, len, 0);
 			if (n >= 0 && n != len) {
@@ -185,7 +170,7 @@ static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 		}
 
 		pdu_t *perf = pdu_make("SAMPLE", 1, "dispatch.time.s");
-		pdu_extendf(perf, "%lf", spent / 1000.);
+		bolo_extend_double(perf, spent / 1000.);
 		pdu_send_and_free(perf, dispatcher->monitor);
 
 		return VIGOR_REACTOR_CONTINUE;
@@ -104,6 +104,13 @@ static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 				metric = "bogon.setkeys";
 			}
 
+		} else if (strcmp(pdu_type(pdu), "DEL.KEYS") == 0) {
+			if (pdu_size(pdu) >= 2) {
+				metric = "delkeys";
+			} else {
+				metric = "bogon.delkeys";
+			}
+
 		} else {
 			metric = "bogon.unknown";
 		}
@@ -362,6 +369,8 @@ int main(int argc, char **argv) /* {{{ */
 		"COUNT",  "state",      "COUNT",  "bogon.state",
 		"COUNT",  "transition", "COUNT",  "bogon.transition",
 		"COUNT",  "event",      "COUNT",  "bogon.event",
+		"COUNT",  "setkeys",    "COUNT",  "bogon.setkeys",
+		"COUNT",  "delkeys",    "COUNT",  "bogon.delkeys",
 		"COUNT",  "bogon.unknown", NULL);
 	if (rc != 0) {
 		logger(LOG_WARNING, "failed to provision metrics");
@@ -139,7 +139,7 @@ static int _inserter_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 
 			if (rc == 0) {
 				pdu_t *perf = pdu_make("SAMPLE", 1, "state:insert.time.s");
-				pdu_extendf(perf, "%lf", spent / 1000.);
+				bolo_extend_double(perf, spent / 1000.);
 				pdu_send_and_free(perf, inserter->monitor);
 
 				pdu_send_and_free(pdu_make("COUNT", 1, "state:insert.ops"), inserter->monitor);
@@ -186,7 +186,7 @@ static int _inserter_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 
 			if (rc == 0) {
 				pdu_t *perf = pdu_make("SAMPLE", 1, "event:insert.time.s");
-				pdu_extendf(perf, "%lf", spent / 1000.);
+				bolo_extend_double(perf, spent / 1000.);
 				pdu_send_and_free(perf, inserter->monitor);
 
 				pdu_send_and_free(pdu_make("COUNT", 1, "event:insert.ops"), inserter->monitor);
@@ -365,7 +365,7 @@ static int _reconciler_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 
 		if (rc == 0) {
 			pdu_t *perf = pdu_make("SAMPLE", 1, "reconcile.time.s");
-			pdu_extendf(perf, "%lf", spent / 1000.);
+			bolo_extend_double(perf, spent / 1000.);
 			pdu_send_and_free(perf, reconciler->monitor);
 
 			pdu_send_and_free(pdu_make("COUNT", 1, "reconcile.ops"), reconciler->monitor);
@@ -466,6 +466,29 @@ int reconciler_thread(void *zmq, const char *dsn) /* {{{ */
 /***********************************************************/
 
 #define SEEN (char**)0x42
+static pdu_t* _insert_pdu(bolo_broadcast_t *b) /* {{{ */
+{
+	/* the inserters take [ STATE | name | ts | stale | code | summary ]
+	   and [ EVENT | ts | name | extra ], as the textual broadcast has them */
+	static const char *codes[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+	pdu_t *p;
+
+	if (b->type == PAYLOAD_STATE) {
+		p = pdu_make("STATE", 1, b->name);
+		bolo_extend_int(p, b->ts);
+		pdu_extendf(p, "%s", b->stale ? "stale" : "fresh");
+		pdu_extendf(p, "%s", codes[b->status < 0 || b->status > 3 ? 3 : b->status]);
+		pdu_extendf(p, "%s", b->message);
+
+	} else {
+		p = pdu_make("EVENT", 0);
+		bolo_extend_int(p, b->ts);
+		pdu_extendf(p, "%s", b->name);
+		pdu_extendf(p, "%s", b->message);
+	}
+	return p;
+}
+/* }}} */
 static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 {
 	assert(socket != NULL);
@@ -488,39 +511,34 @@ static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 		uint64_t spent = 0;
 
 		STOPWATCH(&watch, spent) {
-			if (strcmp(pdu_type(pdu), "STATE") == 0 && pdu_size(pdu) == 6) {
-				char *state = pdu_string(pdu, 1);
-				char *code  = pdu_string(pdu, 4);
-				if (strcmp(code, "OK") != 0 || !hash_get(&dispatcher->seen, state)) {
-					hash_set(&dispatcher->seen, state, SEEN);
-					pdu_send_and_free(pdu_dup(pdu, NULL), dispatcher->inserts);
+			/* decodes textual and binary (TSDP) broadcasts alike */
+			bolo_broadcast_t *b = bolo_broadcast_decode(pdu);
+			if (b && b->type == PAYLOAD_STATE) {
+				/* TRANSITIONs always go in; STATEs do if they aren't OK,
+				   or if we haven't seen the state since we started */
+				if (b->transition || b->status != OK || !hash_get(&dispatcher->seen, b->name)) {
+					hash_set(&dispatcher->seen, b->name, SEEN);
+					pdu_send_and_free(_insert_pdu(b), dispatcher->inserts);
 				} else {
 					pdu_send_and_free(pdu_make("COUNT", 1, "dispatch.skips"), dispatcher->monitor);
 				}
-				free(state);
-				free(code);
-
-			} else if (strcmp(pdu_type(pdu), "TRANSITION") == 0 && pdu_size(pdu) == 6) {
-				char *state = pdu_string(pdu, 1);
-				hash_set(&dispatcher->seen, state, SEEN);
-				free(state);
-
-				pdu_send_and_free(pdu_dup(pdu, "STATE"), dispatcher->inserts);
 
-			} else if (strcmp(pdu_type(pdu), "EVENT") == 0 && pdu_size(pdu) == 4) {
-				pdu_send_and_free(pdu_dup(pdu, "EVENT"), dispatcher->inserts);
+			} else if (b && b->type == PAYLOAD_EVENT) {
+				pdu_send_and_free(_insert_pdu(b), dispatcher->inserts);
 
 			} else {
 #ifdef BOLO2PG_DEBUG
 				logger(LOG_DEBUG, "dispatcher: skipping broadcast [%s] PDU (%i frames)",
 						pdu_type(pdu), pdu_size(pdu));
 #endif
+				free(b);
 				return VIGOR_REACTOR_CONTINUE;
 			}
+			free(b);
 		}
 
 		pdu_t *perf = pdu_make("SAMPLE", 1, "dispatch.time.s");
-		pdu_extendf(perf, "%lf", spent / 1000.);
+		bolo_extend_double(perf, spent / 1000.);
 		pdu_send_and_free(perf, dispatcher->monitor);
 
 		return VIGOR_REACTOR_CONTINUE;
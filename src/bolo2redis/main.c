@@ -212,6 +212,21 @@ int main(int argc, char **argv)
 					free(k);
 					free(v);
 				}
+
+			} else if (strcmp(pdu_type(p), "DEL.KEYS") == 0) {
+				int i;
+				for (i = 1; i < pdu_size(p); i++) {
+					char *k = pdu_string(p, i);
+					logger(LOG_DEBUG, "deleting key `%s'", k);
+
+					redisReply *reply = redisCommand(redis, "DEL %s", k);
+					if (reply->type == REDIS_REPLY_ERROR) {
+						logger(LOG_ERR, "received error from redis: %s", reply->str);
+					}
+					freeReplyObject(reply);
+
+					free(k);
+				}
 			}
 
 			pdu_free(p);
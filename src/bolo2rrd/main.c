@@ -274,53 +274,69 @@ static int _dispatcher_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 		uint64_t spent = 0;
 
 		STOPWATCH(&watch, spent) {
-			char *name = NULL;
-			if ((strcmp(pdu_type(pdu), "COUNTER") == 0 && pdu_size(pdu) == 4)
-			 || (strcmp(pdu_type(pdu), "SAMPLE")  == 0 && pdu_size(pdu) == 9)
-			 || (strcmp(pdu_type(pdu), "RATE")    == 0 && pdu_size(pdu) == 5)) {
-				//logger(LOG_INFO, "received a [%s] PDU", pdu_type(pdu));
-				name = pdu_string(pdu, 2);
-
-			} else {
+			/* decodes textual and binary (TSDP) broadcasts alike */
+			bolo_broadcast_t *b = bolo_broadcast_decode(pdu);
+			const char *type;
+			if      (b && b->type == PAYLOAD_COUNTER) type = "COUNTER";
+			else if (b && b->type == PAYLOAD_SAMPLE)  type = "SAMPLE";
+			else if (b && b->type == PAYLOAD_RATE)    type = "RATE";
+			else {
+				free(b);
 				return VIGOR_REACTOR_CONTINUE;
 			}
 
-			rrdfile_t *file = hash_get(&dispatcher->map->hash, name);
+			rrdfile_t *file = hash_get(&dispatcher->map->hash, b->name);
 			if (!file) {
-				file = rrd_filename(dispatcher->root, name, pdu_type(pdu));
-				hash_set(&dispatcher->map->hash, name, file);
-			} else if (strcmp(file->type, "UNDEFINED") == 0)
-				file->type = pdu_type(pdu);
-
-			free(name);
+				file = rrd_filename(dispatcher->root, b->name, type);
+				hash_set(&dispatcher->map->hash, b->name, file);
+			} else if (strcmp(file->type, "UNDEFINED") == 0) {
+				free(file->type);
+				file->type = strdup(type);
+			}
 
 			struct stat st;
 			pdu_t *relay;
 			if (stat(file->abspath, &st) != 0 || (CACHED && rrdc_is_connected(CACHED) && rrdc_info(file->abspath) == NULL)) {
 				relay = pdu_make("CREATE", 4,
-					file->parents[0], file->parents[1], file->abspath, pdu_type(pdu));
+					file->parents[0], file->parents[1], file->abspath, type);
 
 				pdu_send_and_free(relay, dispatcher->creates);
 
 
 			} else {
-				char *s; s = pdu_string(pdu, 1);
-				relay = pdu_make("UPDATE", 3, file->abspath, s, pdu_type(pdu));
-				free(s);
-
-				int i;
-				for (i = 3; i < pdu_size(pdu); i++) {
-					char *s = pdu_string(pdu, i);
-					pdu_extendf(relay, "%s", s);
-					free(s);
+				/* the values go to rrdupdate as text, formatted
+				   as the textual broadcast would have them */
+				relay = pdu_make("UPDATE", 1, file->abspath);
+				bolo_extend_int(relay, b->ts);
+				pdu_extendf(relay, "%s", type);
+
+				switch (b->type) {
+				case PAYLOAD_COUNTER:
+					bolo_extend_uint(relay, b->value);
+					break;
+
+				case PAYLOAD_SAMPLE:
+					bolo_extend_uint(relay, b->n);
+					bolo_extend_e(relay, b->min);
+					bolo_extend_e(relay, b->max);
+					bolo_extend_e(relay, b->sum);
+					bolo_extend_e(relay, b->mean);
+					bolo_extend_e(relay, b->var);
+					break;
+
+				case PAYLOAD_RATE:
+					bolo_extend_int(relay, b->window);
+					bolo_extend_e(relay, b->rate);
+					break;
 				}
 
 				pdu_send_and_free(relay, dispatcher->updates);
 			}
+			free(b);
 		}
 
 		pdu_t *perf = pdu_make("SAMPLE", 1, "dispatch.time.s");
-		pdu_extendf(perf, "%lf", spent / 1000.);
+		bolo_extend_double(perf, spent / 1000.);
 		pdu_send_and_free(perf, dispatcher->monitor);
 
 		return VIGOR_REACTOR_CONTINUE;
@@ -552,7 +568,7 @@ static int _creator_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 
 		if (rc == 0) {
 			pdu_t *perf = pdu_make("SAMPLE", 1, "create.time.s");
-			pdu_extendf(perf, "%lf", spent / 1000.);
+			bolo_extend_double(perf, spent / 1000.);
 			pdu_send_and_free(perf, creator->monitor);
 
 			pdu_send_and_free(pdu_make("COUNT", 1, "create.ops"), creator->monitor);
@@ -779,7 +795,7 @@ static int _updater_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 
 		if (rc == 0) {
 			pdu_t *perf = pdu_make("SAMPLE", 1, "update.time.s");
-			pdu_extendf(perf, "%lf", spent / 1000.);
+			bolo_extend_double(perf, spent / 1000.);
 			pdu_send_and_free(perf, updater->monitor);
 
 			pdu_send_and_free(pdu_make("COUNT", 1, "update.ops"), updater->monitor);
@@ -0,0 +1,275 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bolo.h>
+#include <tsdp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <vigor.h>
+
+/* strings (and, for FACTs, the keys / values arrays) are
+   copied in after the bolo_broadcast_t, as NUL-terminated
+   strings, so that the whole thing is one free() */
+
+static bolo_broadcast_t* _alloc(int nkeys, size_t len) /* {{{ */
+{
+	bolo_broadcast_t *b = calloc(1, sizeof(bolo_broadcast_t)
+		+ 2 * nkeys * sizeof(char *) + len);
+	if (!b)
+		return NULL;
+
+	b->nkeys  = nkeys;
+	b->keys   = (char **)(b + 1);
+	b->values = b->keys + nkeys;
+	return b;
+}
+/* }}} */
+static void * _invalid(bolo_broadcast_t *b) /* {{{ */
+{
+	free(b);
+	errno = EINVAL;
+	return NULL;
+}
+/* }}} */
+
+static int _status(const char *s) /* {{{ */
+{
+	if (strcmp(s, "OK")       == 0) return OK;
+	if (strcmp(s, "WARNING")  == 0) return WARNING;
+	if (strcmp(s, "CRITICAL") == 0) return CRITICAL;
+	return UNKNOWN;
+}
+/* }}} */
+static bolo_broadcast_t* _text(pdu_t *pdu) /* {{{ */
+{
+	const char *type = pdu_type(pdu);
+	int i, n = pdu_size(pdu), want = -1, nkeys = 0, what = 0;
+	if      (strcmp(type, "STATE")      == 0) { want = 6; what = PAYLOAD_STATE;   }
+	else if (strcmp(type, "TRANSITION") == 0) { want = 6; what = PAYLOAD_STATE;   }
+	else if (strcmp(type, "COUNTER")    == 0) { want = 4; what = PAYLOAD_COUNTER; }
+	else if (strcmp(type, "SAMPLE")     == 0) { want = 9; what = PAYLOAD_SAMPLE;  }
+	else if (strcmp(type, "RATE")       == 0) { want = 5; what = PAYLOAD_RATE;    }
+	else if (strcmp(type, "EVENT")      == 0) { want = 4; what = PAYLOAD_EVENT;   }
+	else if (strcmp(type, "SET.KEYS")   == 0 && n % 2 == 1) { want = n; nkeys = (n - 1) / 2; what = PAYLOAD_FACT; }
+	else if (strcmp(type, "DEL.KEYS")   == 0) { want = n; nkeys = n - 1; what = PAYLOAD_FACT; }
+	if (n != want || n < 2)
+		return _invalid(NULL);
+
+	size_t len = 0;
+	for (i = 1; i < n; i++)
+		len += pdu_segment_size(pdu, i) + 1;
+
+	bolo_broadcast_t *b = _alloc(nkeys, len);
+	if (!b)
+		return NULL;
+	b->type = what;
+
+	char *f[9] = { NULL }, *s = (char *)(b->values + nkeys);
+	for (i = 1; i < n; i++) {
+		size_t l = pdu_segment_size(pdu, i);
+		memcpy(s, pdu_segment(pdu, i), l);
+		s[l] = '\0';
+		if (i < 9)
+			f[i] = s;
+
+		if (strcmp(type, "SET.KEYS") == 0)
+			(i % 2 ? b->keys : b->values)[(i - 1) / 2] = s;
+		else if (strcmp(type, "DEL.KEYS") == 0)
+			b->keys[i - 1] = s;
+		s += l + 1;
+	}
+
+	switch (what) {
+	/* [ STATE | name | ts | stale | status | summary ] */
+	case PAYLOAD_STATE:
+		b->name       = f[1];
+		b->ts         = bolo_strtoi(f[2], NULL);
+		b->stale      = strcmp(f[3], "stale") == 0;
+		b->status     = _status(f[4]);
+		b->message    = f[5];
+		b->transition = *type == 'T';
+		break;
+
+	/* [ COUNTER | ts | name | value ] */
+	case PAYLOAD_COUNTER:
+		b->ts    = bolo_strtoi(f[1], NULL);
+		b->name  = f[2];
+		b->value = bolo_strtou(f[3], NULL);
+		break;
+
+	/* [ SAMPLE | ts | name | n | min | max | sum | mean | var ] */
+	case PAYLOAD_SAMPLE:
+		b->ts   = bolo_strtoi(f[1], NULL);
+		b->name = f[2];
+		b->n    = bolo_strtou(f[3], NULL);
+		b->min  = bolo_strtod(f[4], NULL);
+		b->max  = bolo_strtod(f[5], NULL);
+		b->sum  = bolo_strtod(f[6], NULL);
+		b->mean = bolo_strtod(f[7], NULL);
+		b->var  = bolo_strtod(f[8], NULL);
+		break;
+
+	/* [ RATE | ts | name | window | value ] */
+	case PAYLOAD_RATE:
+		b->ts     = bolo_strtoi(f[1], NULL);
+		b->name   = f[2];
+		b->window = bolo_strtoi(f[3], NULL);
+		b->rate   = bolo_strtod(f[4], NULL);
+		break;
+
+	/* [ EVENT | ts | name | extra ] */
+	case PAYLOAD_EVENT:
+		b->ts      = bolo_strtoi(f[1], NULL);
+		b->name    = f[2];
+		b->message = f[3];
+		break;
+
+	/* [ SET.KEYS | (key | value)+ ], or [ DEL.KEYS | key+ ] */
+	case PAYLOAD_FACT:
+		b->name = b->keys[0];
+		break;
+	}
+	return b;
+}
+/* }}} */
+
+static char* _string(const tsdp_t *t, int i, char **s) /* {{{ */
+{
+	const void *v;
+	int len;
+	if (tsdp_get_frame_view(t, i, TSDP_TYPE_STRING, &v, &len) != 0)
+		return NULL;
+
+	char *str = *s;
+	memcpy(str, v, len);
+	str[len] = '\0';
+	*s += len + 1;
+	return str;
+}
+/* }}} */
+static bolo_broadcast_t* _tsdp(const tsdp_t *t) /* {{{ */
+{
+	int i, n = tsdp_get_size(t), want = -1, nkeys = 0, what = 0;
+	if (tsdp_get_opcode(t) != TSDP_OP_BROADCAST)
+		return _invalid(NULL);
+
+	switch (tsdp_get_payloads(t)) {
+	case TSDP_PAYLOAD_STATE:  want = 3; what = PAYLOAD_STATE;   break;
+	case TSDP_PAYLOAD_TALLY:  want = 3; what = PAYLOAD_COUNTER; break;
+	case TSDP_PAYLOAD_SAMPLE: want = 8; what = PAYLOAD_SAMPLE;  break;
+	case TSDP_PAYLOAD_DELTA:  want = 4; what = PAYLOAD_RATE;    break;
+	case TSDP_PAYLOAD_EVENT:  want = 3; what = PAYLOAD_EVENT;   break;
+	case TSDP_PAYLOAD_FACT:
+		if (n % 2 == 0) { want = n; nkeys = n / 2; what = PAYLOAD_FACT; }
+		break;
+	}
+	if (n != want || n < 2)
+		return _invalid(NULL);
+
+	size_t len = 0;
+	for (i = 0; i < n; i++)
+		if (tsdp_get_frame_type(t, i) == TSDP_TYPE_STRING)
+			len += tsdp_get_frame_size(t, i) + 1;
+
+	bolo_broadcast_t *b = _alloc(nkeys, len);
+	if (!b)
+		return NULL;
+	b->type = what;
+
+	char *s = (char *)(b->values + nkeys);
+	tsdp_tstamp_t ms = 0;
+	uint64_t u = 0;
+	int flags = tsdp_get_flags(t), ok = 1;
+
+	if (what == PAYLOAD_FACT) {
+		/* ( STRING key | STRING value, or NIL if deleted )+ */
+		for (i = 0; ok && i < nkeys; i++) {
+			ok = (b->keys[i] = _string(t, 2 * i, &s)) != NULL;
+			if (ok && tsdp_get_frame_type(t, 2 * i + 1) != TSDP_TYPE_NIL)
+				ok = (b->values[i] = _string(t, 2 * i + 1, &s)) != NULL;
+		}
+		b->name = b->keys[0];
+		return ok ? b : _invalid(b);
+	}
+
+	/* [ TSTAMP | STRING name | ... ] */
+	ok = tsdp_get_tstamp(t, 0, &ms) == 0
+	  && (b->name = _string(t, 1, &s)) != NULL;
+	b->ts = ms / 1000;
+
+	switch (what) {
+	/* [ ... | STRING summary ], with the status in the flags */
+	case PAYLOAD_STATE:
+		b->status     = flags & 0x3;
+		b->stale      = !(flags & TSDP_F_STATE_FRESH);
+		b->transition = !!(flags & TSDP_F_STATE_TRANSITION);
+		ok = ok && (b->message = _string(t, 2, &s)) != NULL;
+		break;
+
+	/* [ ... | UINT value ] */
+	case PAYLOAD_COUNTER:
+		ok = ok && tsdp_get_uint(t, 2, &b->value) == 0;
+		break;
+
+	/* [ ... | UINT n | FLOAT min | max | sum | mean | var ] */
+	case PAYLOAD_SAMPLE:
+		ok = ok && tsdp_get_uint (t, 2, &b->n)    == 0
+		        && tsdp_get_float(t, 3, &b->min)  == 0
+		        && tsdp_get_float(t, 4, &b->max)  == 0
+		        && tsdp_get_float(t, 5, &b->sum)  == 0
+		        && tsdp_get_float(t, 6, &b->mean) == 0
+		        && tsdp_get_float(t, 7, &b->var)  == 0;
+		break;
+
+	/* [ ... | UINT window (seconds) | FLOAT rate ] */
+	case PAYLOAD_RATE:
+		ok = ok && tsdp_get_uint (t, 2, &u)       == 0
+		        && tsdp_get_float(t, 3, &b->rate) == 0;
+		b->window = u;
+		break;
+
+	/* [ ... | STRING extra ] */
+	case PAYLOAD_EVENT:
+		ok = ok && (b->message = _string(t, 2, &s)) != NULL;
+		break;
+	}
+	return ok ? b : _invalid(b);
+}
+/* }}} */
+
+bolo_broadcast_t* bolo_broadcast_decode(pdu_t *pdu)
+{
+	if (!pdu || pdu_size(pdu) < 1)
+		return _invalid(NULL);
+
+	/* a TSDP broadcast is one frame, starting with the version
+	   (and opcode); no textual PDU type starts like that. */
+	if (pdu_size(pdu) == 1 && pdu_segment_size(pdu, 0) >= 4
+	 && (pdu_segment(pdu, 0)[0] >> 4) == TSDP_VERSION) {
+		tsdp_t *t;
+		if (tsdp_unpack(&t, pdu_segment(pdu, 0), pdu_segment_size(pdu, 0)) != 0)
+			return _invalid(NULL);
+		bolo_broadcast_t *b = _tsdp(t);
+		tsdp_destroy(t);
+		return b;
+	}
+	return _text(pdu);
+}
@@ -20,26 +20,250 @@
 #include <bolo.h>
 #include <vigor.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <pthread.h>
+
+/* every key and value is interned, once, in a process-wide symbol
+   table, and kept for the life of the process.  two parts are the
+   same if their pointers are, and each one carries its hash along
+   with it (just in front of the string, see SYM()).  there are only
+   so many distinct keys and values in a deployment, so none of them
+   are ever given back. */
+typedef struct {
+	uint64_t  hash;
+	size_t    len;
+	char      str[];
+} sym_t;
+
+#define SYM(s) ((sym_t *)((char *)(s) - offsetof(sym_t, str)))
+
+static struct {
+	pthread_rwlock_t lock;
+	sym_t          **slots;   /* open addressing, linear probing */
+	size_t           cap;     /* always a power of two */
+	size_t           used;
+} SYMBOLS = { PTHREAD_RWLOCK_INITIALIZER, NULL, 0, 0 };
+
+/* whole names, and what they parsed to, so that parsing one again is
+   a hash probe and a copy.  there can be far more whole names than
+   keys or values (every host times every metric), so this is bounded:
+   names go in sets of NAME_WAYS slots, picked by hash, and a name whose
+   set is full evicts (and frees) one of the others. */
+#define NAME_CACHE 65536 /* slots; a power of two */
+#define NAME_WAYS  4     /* slots per set */
+
+typedef struct {
+	uint64_t            hash;
+	char               *name;
+	struct __bolo_name *parsed;
+} parsed_t;
+
+static struct {
+	pthread_rwlock_t lock;
+	parsed_t        *slots;   /* NAME_CACHE of them, once allocated */
+} PARSED = { PTHREAD_RWLOCK_INITIALIZER, NULL };
 
 struct __bolo_name_part {
-	char *name;
-	char *value;
-	int   wildcard;
+	const char *name;  /* interned */
+	const char *value; /* interned */
+	int         wildcard;
 };
 struct __bolo_name {
 	int size;
 	int wildcard;
+	int wilds;     /* how many parts are name=* */
+	uint64_t hash; /* of the parts, in any order; see s_rehash() */
 	struct __bolo_name_part* parts;
 };
 
 /***************************************************************/
 
+static uint64_t s_hash(const char *s, size_t len)
+{
+	/* FNV-1a; the strings are short, and mostly ASCII */
+	uint64_t h = 0xcbf29ce484222325ULL;
+	while (len--) {
+		h ^= (uint8_t)*s++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static uint64_t s_mix(uint64_t x)
+{
+	/* the splitmix64 finalizer */
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/* with SYMBOLS.lock held, for reading at least */
+static sym_t* s_find(const char *s, size_t len, uint64_t h)
+{
+	size_t i, mask = SYMBOLS.cap - 1;
+	if (!SYMBOLS.cap)
+		return NULL;
+
+	for (i = h & mask; SYMBOLS.slots[i]; i = (i + 1) & mask) {
+		sym_t *y = SYMBOLS.slots[i];
+		if (y->hash == h && y->len == len && memcmp(y->str, s, len) == 0)
+			return y;
+	}
+	return NULL;
+}
+
+/* with SYMBOLS.lock held for writing */
+static sym_t* s_intern(const char *s, size_t len)
+{
+	uint64_t h = s_hash(s, len);
+	sym_t *y = s_find(s, len, h);
+	size_t i, mask;
+
+	if (y)
+		return y;
+
+	if ((SYMBOLS.used + 1) * 2 > SYMBOLS.cap) {
+		size_t cap = SYMBOLS.cap ? SYMBOLS.cap * 2 : 1024;
+		sym_t **slots = vcalloc(cap, sizeof(sym_t *));
+
+		for (i = 0; i < SYMBOLS.cap; i++) {
+			if (!SYMBOLS.slots[i])
+				continue;
+			size_t j = SYMBOLS.slots[i]->hash & (cap - 1);
+			while (slots[j])
+				j = (j + 1) & (cap - 1);
+			slots[j] = SYMBOLS.slots[i];
+		}
+		free(SYMBOLS.slots);
+		SYMBOLS.slots = slots;
+		SYMBOLS.cap   = cap;
+	}
+
+	y = vmalloc(sizeof(sym_t) + len + 1);
+	y->hash = h;
+	y->len  = len;
+	memcpy(y->str, s, len);
+	y->str[len] = '\0';
+
+	mask = SYMBOLS.cap - 1;
+	for (i = h & mask; SYMBOLS.slots[i]; i = (i + 1) & mask)
+		;
+	SYMBOLS.slots[i] = y;
+	SYMBOLS.used++;
+	return y;
+}
+
+static const char* s_str(const char *s)
+{
+	size_t len = strlen(s);
+
+	/* most keys and values are already interned */
+	pthread_rwlock_rdlock(&SYMBOLS.lock);
+	sym_t *y = s_find(s, len, s_hash(s, len));
+	pthread_rwlock_unlock(&SYMBOLS.lock);
+	if (y)
+		return y->str;
+
+	pthread_rwlock_wrlock(&SYMBOLS.lock);
+	y = s_intern(s, len);
+	pthread_rwlock_unlock(&SYMBOLS.lock);
+	return y->str;
+}
+
+static bolo_name_t s_parsed(const char *name, uint64_t h)
+{
+	bolo_name_t qn = NULL;
+
+	int i;
+
+	pthread_rwlock_rdlock(&PARSED.lock);
+	if (PARSED.slots) {
+		parsed_t *set = &PARSED.slots[h & (NAME_CACHE - NAME_WAYS)];
+		for (i = 0; i < NAME_WAYS; i++) {
+			if (set[i].name && set[i].hash == h && strcmp(set[i].name, name) == 0) {
+				qn = bolo_name_copy(set[i].parsed);
+				break;
+			}
+		}
+	}
+	pthread_rwlock_unlock(&PARSED.lock);
+	return qn;
+}
+
+static void s_remember(const char *name, uint64_t h, bolo_name_t qn)
+{
+	char *s = strdup(name);
+	bolo_name_t copy = bolo_name_copy(qn);
+	char *old_name = NULL;
+	bolo_name_t old = NULL;
+	int i;
+
+	if (!s) {
+		bolo_name_free(copy);
+		return;
+	}
+
+	pthread_rwlock_wrlock(&PARSED.lock);
+	if (!PARSED.slots)
+		PARSED.slots = vcalloc(NAME_CACHE, sizeof(parsed_t));
+
+	/* an empty slot if there is one (or this name, if another thread
+	   beat us to it), otherwise one of them, by the high bits of h */
+	parsed_t *set = &PARSED.slots[h & (NAME_CACHE - NAME_WAYS)];
+	parsed_t *p = &set[(h >> 32) % NAME_WAYS];
+	for (i = 0; i < NAME_WAYS; i++) {
+		if (!set[i].name || (set[i].hash == h && strcmp(set[i].name, name) == 0)) {
+			p = &set[i];
+			break;
+		}
+	}
+	old_name  = p->name;
+	old       = p->parsed;
+	p->hash   = h;
+	p->name   = s;
+	p->parsed = copy;
+	pthread_rwlock_unlock(&PARSED.lock);
+
+	free(old_name);
+	bolo_name_free(old);
+}
+
 static int s_sort(const void *a_, const void *b_)
 {
 	struct __bolo_name_part *a = (struct __bolo_name_part*)a_;
 	struct __bolo_name_part *b = (struct __bolo_name_part*)b_;
-	return a->name && b->name ? strcmp(a->name, b->name) : 0;
+	int rc = strcmp(a->name, b->name);
+	return rc ? rc : strcmp(a->value, b->value);
+}
+
+static void s_rehash(bolo_name_t name)
+{
+	/* a sum, so that the order of the parts doesn't matter */
+	uint64_t h = 0;
+	int i;
+
+	name->wilds = 0;
+	for (i = 0; i < name->size; i++) {
+		h += s_mix(SYM(name->parts[i].name)->hash ^ s_mix(SYM(name->parts[i].value)->hash));
+		if (name->parts[i].wildcard)
+			name->wilds++;
+	}
+	name->hash = s_mix(h);
+}
+
+static int s_same(bolo_name_t a, bolo_name_t b)
+{
+	/* both are sorted, and the parts are interned */
+	int i;
+	if (a->hash != b->hash || a->size != b->size)
+		return 0;
+	for (i = 0; i < a->size; i++)
+		if (a->parts[i].name  != b->parts[i].name
+		 || a->parts[i].value != b->parts[i].value)
+			return 0;
+	return 1;
 }
 
 /***************************************************************/
@@ -48,20 +272,32 @@ bolo_name_t bolo_name_parse(const char *name)
 {
 	bolo_name_t qn;
 	const char *a, *b;
+	size_t len = strlen(name);
+	uint64_t h = s_hash(name, len);
 	int i;
 
+	/* have we taken this one apart before? */
+	if ((qn = s_parsed(name, h)) != NULL)
+		return qn;
+
 	qn = vmalloc(sizeof(struct __bolo_name));
 
 	/* degenerate case */
-	if (!*name)
+	if (!*name) {
+		s_rehash(qn);
 		return qn;
+	}
 
 	int n = 1;
 	for (a = name; *a; a++)
 		if (*a == ',')
 			n++;
 
-	qn->parts = vcalloc(n, sizeof(struct __bolo_name_part));
+	struct {
+		const char *name, *value;
+		size_t      nlen,  vlen;
+	} *span = vcalloc(n, sizeof(*span));
+
 	for (i = 0, a = name; i < n;) {
 		for (b = a; *b && *b != '=' && *b != ','; b++)
 			;
@@ -75,14 +311,17 @@ bolo_name_t bolo_name_parse(const char *name)
 				a = b + 1;
 				continue;
 			}
+			free(span);
+			free(qn);
 			return NULL;
 		}
 
-		qn->parts[i].name = strndup(a, b - a);
+		span[i].name = a;
+		span[i].nlen = b - a;
 		for (a = ++b; *b && *b != ','; b++)
 			;
-		qn->parts[i].wildcard = strncmp(a, "*", b - a) == 0 ? 1 : 0;
-		qn->parts[i].value = strndup(a, b - a);
+		span[i].value = a;
+		span[i].vlen  = b - a;
 		i++;
 
 		if (!*b)
@@ -90,36 +329,68 @@ bolo_name_t bolo_name_parse(const char *name)
 		a = b + 1;
 	}
 
-	qsort(qn->parts, n, sizeof(struct __bolo_name_part), s_sort);
-	qn->size = i;
+	qn->size  = i;
+	qn->parts = vcalloc(n, sizeof(struct __bolo_name_part));
+
+	pthread_rwlock_wrlock(&SYMBOLS.lock);
+	for (i = 0; i < qn->size; i++) {
+		qn->parts[i].name     = s_intern(span[i].name,  span[i].nlen)->str;
+		qn->parts[i].value    = s_intern(span[i].value, span[i].vlen)->str;
+		qn->parts[i].wildcard = strncmp(span[i].value, "*", span[i].vlen) == 0 ? 1 : 0;
+	}
+	qsort(qn->parts, qn->size, sizeof(struct __bolo_name_part), s_sort);
+	s_rehash(qn);
+	pthread_rwlock_unlock(&SYMBOLS.lock);
+
+	/* remember it, for next time */
+	s_remember(name, h, qn);
+
+	free(span);
 	return qn;
 }
 
 bolo_name_t bolo_name_copy(bolo_name_t name)
 {
 	bolo_name_t copy = vmalloc(sizeof(struct __bolo_name));
-	copy->size     = name->size;
-	copy->wildcard = name->wildcard;
-	copy->parts    = vcalloc(name->size, sizeof(struct __bolo_name_part));
+	memcpy(copy, name, sizeof(struct __bolo_name));
+	copy->parts = NULL;
 
-	int i;
-	for (i = 0; i < name->size; i++) {
-		copy->parts[i].name     = name->parts[i].name;
-		copy->parts[i].value    = name->parts[i].value;
-		copy->parts[i].wildcard = name->parts[i].wildcard;
+	/* the parts themselves are interned, so this is all there is */
+	if (name->size) {
+		copy->parts = vcalloc(name->size, sizeof(struct __bolo_name_part));
+		memcpy(copy->parts, name->parts, name->size * sizeof(struct __bolo_name_part));
 	}
 
 	return copy;
 }
 
+void bolo_name_free(bolo_name_t name)
+{
+	if (!name)
+		return;
+
+	free(name->parts);
+	free(name);
+}
+
+uint64_t bolo_name_hash(bolo_name_t name)
+{
+	return name->wildcard ? s_mix(name->hash + 1) : name->hash;
+}
+
+int bolo_name_equal(bolo_name_t a, bolo_name_t b)
+{
+	return a->wildcard == b->wildcard && s_same(a, b);
+}
+
 char* bolo_name_string(bolo_name_t name)
 {
 	size_t len = 0;
 	int i;
 
 	for (i = 0; i < name->size; i++) {
-		len += strlen(name->parts[i].name)  + 1 /* = */
-		     + strlen(name->parts[i].value) + 1 /* , */;
+		len += SYM(name->parts[i].name)->len  + 1 /* = */
+		     + SYM(name->parts[i].value)->len + 1 /* , */;
 	}
 	if (name->wildcard) {
 		len += 2; /* for "*," */
@@ -130,14 +401,14 @@ char* bolo_name_string(bolo_name_t name)
 	/* omit the trailing comma, add a null-terminator.
 	   it's a wash, really; len stays the same */
 
-	char *p, *q, *s;
+	char *p, *s;
 	p = s = vcalloc(len, sizeof(char));
 	for (i = 0; i < name->size; i++) {
-		for (q = name->parts[i].name; *q; *p++ = *q++)
-			;
+		memcpy(p, name->parts[i].name, SYM(name->parts[i].name)->len);
+		p += SYM(name->parts[i].name)->len;
 		*p++ = '=';
-		for (q = name->parts[i].value; *q; *p++ = *q++)
-			;
+		memcpy(p, name->parts[i].value, SYM(name->parts[i].value)->len);
+		p += SYM(name->parts[i].value)->len;
 		*p++ = ',';
 	}
 	if (name->wildcard) {
@@ -155,16 +426,21 @@ int bolo_name_match(bolo_name_t a, bolo_name_t b)
 	if (b->size == 0 && b->wildcard)
 		return 0;
 
+	/* without any wildcards in (b), the parts have to be the same,
+	   and if the hashes differ, they aren't */
+	if (!b->wildcard && !b->wilds)
+		return s_same(a, b) ? 0 : 1;
+
 	int i = 0, j = 0;
 	for (;;) {
 		/* do we still have components to compare? */
 		if (i < a->size && j < b->size) {
 			/* do the names match? */
-			if (strcmp(a->parts[i].name, b->parts[j].name) == 0) {
+			if (a->parts[i].name == b->parts[j].name) {
 				/* do the value match?
 				   or, alternatively, is the b component a name=* wildcard? */
 				if (!b->parts[j].wildcard
-				 && strcmp(a->parts[i].value, b->parts[j].value) != 0) {
+				 && a->parts[i].value != b->parts[j].value) {
 					return 1;
 				}
 				i++; j++;
@@ -192,11 +468,16 @@ int bolo_name_match(bolo_name_t a, bolo_name_t b)
 int bolo_name_set(bolo_name_t name, const char *key, const char *value)
 {
 	int wild = (!value || strcmp(value, "*") == 0) ? 1 : 0;
+	const char *k = s_str(key);
+	const char *v = s_str(wild ? "*" : value);
 	int i;
+
 	for (i = 0; i < name->size; i++) {
-		if (strcmp(name->parts[i].name, key) == 0) {
-			free(name->parts[i].value);
-			name->parts[i].value = wild ? NULL : strdup(value);
+		if (name->parts[i].name == k) {
+			name->parts[i].value    = v;
+			name->parts[i].wildcard = wild;
+			qsort(name->parts, name->size, sizeof(struct __bolo_name_part), s_sort);
+			s_rehash(name);
 			return 0;
 		}
 	}
@@ -207,30 +488,33 @@ int bolo_name_set(bolo_name_t name, const char *key, const char *value)
 		return -1;
 	}
 	name->parts = new;
-	name->parts[name->size].name     = strdup(key);
-	name->parts[name->size].value    = wild ? NULL : strdup(value);
+	name->parts[name->size].name     = k;
+	name->parts[name->size].value    = v;
 	name->parts[name->size].wildcard = wild;
 	name->size++;
 	qsort(name->parts, name->size, sizeof(struct __bolo_name_part), s_sort);
+	s_rehash(name);
 	return 0;
 }
 
 int bolo_name_unset(bolo_name_t name, const char *key)
 {
+	size_t len = strlen(key);
 	int i;
+
+	/* if it was never interned, no name has it */
+	pthread_rwlock_rdlock(&SYMBOLS.lock);
+	sym_t *k = s_find(key, len, s_hash(key, len));
+	pthread_rwlock_unlock(&SYMBOLS.lock);
+	if (!k)
+		return 0;
+
 	for (i = 0; i < name->size; i++) {
-		if (strcmp(name->parts[i].name, key) == 0) {
-			free(name->parts[i].name);
-			free(name->parts[i].value);
-			for (; i < name->size - 1; i++) {
-				name->parts[i].name     = name->parts[i+1].name;
-				name->parts[i].value    = name->parts[i+1].value;
-				name->parts[i].wildcard = name->parts[i+1].wildcard;
-			}
-			name->parts[name->size - 1].name     = NULL;
-			name->parts[name->size - 1].value    = NULL;
-			name->parts[name->size - 1].wildcard = 0;
+		if (name->parts[i].name == k->str) {
+			memmove(&name->parts[i], &name->parts[i + 1],
+				(name->size - i - 1) * sizeof(struct __bolo_name_part));
 			name->size--;
+			s_rehash(name);
 			return 0;
 		}
 	}
@@ -247,3 +531,292 @@ int bolo_name_concat(bolo_name_t a, bolo_name_t b)
 	}
 	return 0;
 }
+
+/***************************************************************/
+
+/* an index of names, by their parts: for every name=value (and
+   every name, whatever the value), the slots of the names that
+   have it.  looking up a pattern starts from the shortest of the
+   lists its parts pick out, and bolo_name_match()es each one. */
+typedef struct {
+	const char *key;    /* interned */
+	const char *value;  /* interned, or NULL for any value */
+	int         n, cap;
+	int        *slots;
+} posting_t;
+
+struct __bolo_name_index {
+	int          n, cap;    /* slots in use (or freed), and allocated */
+	bolo_name_t *names;     /* by slot, NULL if removed */
+	void       **data;
+	int          live;
+
+	int         *spare;     /* freed slots, to reuse */
+	int          nspare;
+
+	int         *byhash;    /* slots, by bolo_name_hash(); -1 is empty.  */
+	size_t       hcap;      /* slots that have since been removed are   */
+	size_t       hused;     /* just skipped, until the next rebuild     */
+
+	posting_t  **postings;  /* by (key, value) */
+	size_t       pcap;
+	size_t       pused;
+};
+
+static uint64_t s_posting_hash(const char *key, const char *value)
+{
+	return s_mix(SYM(key)->hash ^ s_mix(value ? SYM(value)->hash : 0));
+}
+
+static posting_t* s_posting(bolo_name_index_t idx, const char *key, const char *value, int create)
+{
+	uint64_t h = s_posting_hash(key, value);
+	size_t i, mask = idx->pcap - 1;
+
+	if (idx->pcap) {
+		for (i = h & mask; idx->postings[i]; i = (i + 1) & mask)
+			if (idx->postings[i]->key == key && idx->postings[i]->value == value)
+				return idx->postings[i];
+	}
+	if (!create)
+		return NULL;
+
+	if ((idx->pused + 1) * 2 > idx->pcap) {
+		size_t cap = idx->pcap ? idx->pcap * 2 : 64;
+		posting_t **postings = vcalloc(cap, sizeof(posting_t *));
+
+		for (i = 0; i < idx->pcap; i++) {
+			posting_t *p = idx->postings[i];
+			if (!p)
+				continue;
+			size_t j = s_posting_hash(p->key, p->value) & (cap - 1);
+			while (postings[j])
+				j = (j + 1) & (cap - 1);
+			postings[j] = p;
+		}
+		free(idx->postings);
+		idx->postings = postings;
+		idx->pcap     = cap;
+	}
+
+	posting_t *p = vmalloc(sizeof(posting_t));
+	p->key   = key;
+	p->value = value;
+
+	mask = idx->pcap - 1;
+	for (i = h & mask; idx->postings[i]; i = (i + 1) & mask)
+		;
+	idx->postings[i] = p;
+	idx->pused++;
+	return p;
+}
+
+static int s_post(posting_t *p, int slot)
+{
+	if (p->n == p->cap) {
+		int cap = p->cap ? p->cap * 2 : 8;
+		int *slots = realloc(p->slots, cap * sizeof(int));
+		if (!slots)
+			return -1;
+		p->slots = slots;
+		p->cap   = cap;
+	}
+	p->slots[p->n++] = slot;
+	return 0;
+}
+
+static void s_unpost(posting_t *p, int slot)
+{
+	int i;
+	for (i = 0; p && i < p->n; i++) {
+		if (p->slots[i] == slot) {
+			p->slots[i] = p->slots[--p->n];
+			return;
+		}
+	}
+}
+
+static int s_find_slot(bolo_name_index_t idx, bolo_name_t name)
+{
+	size_t i, mask = idx->hcap - 1;
+	if (!idx->hcap)
+		return -1;
+
+	for (i = bolo_name_hash(name) & mask; idx->byhash[i] >= 0; i = (i + 1) & mask) {
+		int s = idx->byhash[i];
+		if (idx->names[s] && bolo_name_equal(idx->names[s], name))
+			return s;
+	}
+	return -1;
+}
+
+static void s_hash_slot(bolo_name_index_t idx, int slot)
+{
+	size_t i, mask;
+
+	if ((idx->hused + 1) * 2 > idx->hcap) {
+		/* rebuild, leaving out the slots that have been removed */
+		size_t cap = 64;
+		while (cap < (size_t)(idx->live + 1) * 4)
+			cap *= 2;
+
+		free(idx->byhash);
+		idx->byhash = vcalloc(cap, sizeof(int));
+		memset(idx->byhash, 0xff, cap * sizeof(int));
+		idx->hcap  = cap;
+		idx->hused = 0;
+
+		int s;
+		for (s = 0; s < idx->n; s++)
+			if (idx->names[s] && s != slot)
+				s_hash_slot(idx, s);
+	}
+
+	mask = idx->hcap - 1;
+	for (i = bolo_name_hash(idx->names[slot]) & mask; idx->byhash[i] >= 0; i = (i + 1) & mask)
+		;
+	idx->byhash[i] = slot;
+	idx->hused++;
+}
+
+bolo_name_index_t bolo_name_index_new(void)
+{
+	return vmalloc(sizeof(struct __bolo_name_index));
+}
+
+void bolo_name_index_free(bolo_name_index_t idx)
+{
+	size_t i;
+	int s;
+
+	if (!idx)
+		return;
+
+	for (s = 0; s < idx->n; s++)
+		bolo_name_free(idx->names[s]);
+	for (i = 0; i < idx->pcap; i++) {
+		if (idx->postings[i]) {
+			free(idx->postings[i]->slots);
+			free(idx->postings[i]);
+		}
+	}
+	free(idx->names);
+	free(idx->data);
+	free(idx->spare);
+	free(idx->byhash);
+	free(idx->postings);
+	free(idx);
+}
+
+int bolo_name_index_add(bolo_name_index_t idx, bolo_name_t name, void *data)
+{
+	int s = s_find_slot(idx, name);
+	if (s >= 0) {
+		idx->data[s] = data;
+		return 0;
+	}
+
+	if (idx->nspare) {
+		s = idx->spare[--idx->nspare];
+
+	} else {
+		if (idx->n == idx->cap) {
+			int cap = idx->cap ? idx->cap * 2 : 64;
+			bolo_name_t *names = realloc(idx->names, cap * sizeof(bolo_name_t));
+			if (!names)
+				return -1;
+			idx->names = names;
+
+			void **all = realloc(idx->data, cap * sizeof(void *));
+			if (!all)
+				return -1;
+			idx->data = all;
+
+			int *spare = realloc(idx->spare, cap * sizeof(int));
+			if (!spare)
+				return -1;
+			idx->spare = spare;
+			idx->cap   = cap;
+		}
+		s = idx->n++;
+	}
+
+	idx->names[s] = bolo_name_copy(name);
+	idx->data[s]  = data;
+	idx->live++;
+	s_hash_slot(idx, s);
+
+	/* parts are sorted, so repeats are next to each other */
+	int i;
+	struct __bolo_name_part *p = name->parts;
+	for (i = 0; i < name->size; i++) {
+		if (i == 0 || p[i].name != p[i - 1].name) {
+			if (s_post(s_posting(idx, p[i].name, NULL, 1), s) != 0)
+				return -1;
+		}
+		if (i == 0 || p[i].name != p[i - 1].name || p[i].value != p[i - 1].value) {
+			if (s_post(s_posting(idx, p[i].name, p[i].value, 1), s) != 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+void* bolo_name_index_get(bolo_name_index_t idx, bolo_name_t name)
+{
+	int s = s_find_slot(idx, name);
+	return s < 0 ? NULL : idx->data[s];
+}
+
+void* bolo_name_index_remove(bolo_name_index_t idx, bolo_name_t name)
+{
+	int s = s_find_slot(idx, name);
+	if (s < 0)
+		return NULL;
+
+	int i;
+	struct __bolo_name_part *p = idx->names[s]->parts;
+	for (i = 0; i < idx->names[s]->size; i++) {
+		if (i == 0 || p[i].name != p[i - 1].name)
+			s_unpost(s_posting(idx, p[i].name, NULL, 0), s);
+		if (i == 0 || p[i].name != p[i - 1].name || p[i].value != p[i - 1].value)
+			s_unpost(s_posting(idx, p[i].name, p[i].value, 0), s);
+	}
+
+	void *data = idx->data[s];
+	bolo_name_free(idx->names[s]);
+	idx->names[s] = NULL;
+	idx->data[s]  = NULL;
+	idx->spare[idx->nspare++] = s;
+	idx->live--;
+	return data;
+}
+
+int bolo_name_index_search(bolo_name_index_t idx, bolo_name_t pattern,
+                           int (*fn)(bolo_name_t, void*, void*), void *arg)
+{
+	posting_t *best = NULL;
+	int i, n, found = 0;
+
+	for (i = 0; i < pattern->size; i++) {
+		posting_t *p = s_posting(idx, pattern->parts[i].name,
+			pattern->parts[i].wildcard ? NULL : pattern->parts[i].value, 0);
+		if (!p || p->n == 0)
+			return 0; /* nothing has that part */
+		if (!best || p->n < best->n)
+			best = p;
+	}
+
+	/* no parts ("*"), so no choice but to look at everything */
+	n = best ? best->n : idx->n;
+	for (i = 0; i < n; i++) {
+		int s = best ? best->slots[i] : i;
+		if (!idx->names[s] || bolo_name_match(idx->names[s], pattern) != 0)
+			continue;
+
+		found++;
+		if (fn && fn(idx->names[s], idx->data[s], arg) != 0)
+			break;
+	}
+	return found;
+}
@@ -0,0 +1,576 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* for strtod_l(3) */
+#include <bolo.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <locale.h>
+#include <pthread.h>
+
+/*
+   Numbers, to and from the strings that go out in PDU frames.
+
+   Every PDU field that holds a number gets formatted on the way out
+   (timestamps, counters, the five sample statistics...) and parsed
+   again on the way in, at every hop.  printf() and strtod() do both
+   correctly, but they are slow about it, and they look at the locale
+   while they are at it.  These don't, for the inputs that we actually
+   see: plain decimal integers, decimals with a '.', and numbers in
+   the "%e" form that broadcasts use.
+
+   Anything else (hex, whitespace, "inf", more digits than fit in a
+   machine word, and the rare double that is too close to a rounding
+   boundary for the quick way to be sure of) is handed to libc, so the
+   answers are always the same as libc's, only usually quicker.  That
+   is libc in the "C" locale, whatever setlocale() the program linking
+   us has called: a ',' for a '.' would make PDUs unreadable.
+ */
+
+/* for when we do go to libc; created the first time we need it */
+static locale_t C_LOCALE = (locale_t)0;
+static pthread_once_t C_LOCALE_ONCE = PTHREAD_ONCE_INIT;
+
+static void _c_locale_init(void) /* {{{ */
+{
+	C_LOCALE = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+/* }}} */
+static locale_t _c_locale(void) /* {{{ */
+{
+	/* (if newlocale fails, we get 0, and libc's own locale) */
+	pthread_once(&C_LOCALE_ONCE, _c_locale_init);
+	return C_LOCALE;
+}
+/* }}} */
+static int _printf(char *buf, size_t len, const char *fmt, ...) /* {{{ */
+{
+	locale_t c = _c_locale(), was = c ? uselocale(c) : (locale_t)0;
+
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(buf, len, fmt, ap);
+	va_end(ap);
+
+	if (c) uselocale(was);
+	return n;
+}
+/* }}} */
+static double _strtod(const char *s, char **end) /* {{{ */
+{
+	locale_t c = _c_locale();
+	return c ? strtod_l(s, end, c) : strtod(s, end);
+}
+/* }}} */
+
+static const char DIGITS[] =
+	"00010203040506070809" "10111213141516171819"
+	"20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859"
+	"60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+/* 10^0 .. 10^22 are exact as doubles (for parsing) */
+static const double P10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* formatting works in long double, where it has at least 64 bits
+   of mantissa: 10^0 .. 10^27 are exact, and scaling a double by
+   10^k (for |k| <= 54) rounds at most twice.  elsewhere (i.e. where
+   long double is just a double) everything goes through libc. */
+#if LDBL_MANT_DIG >= 64
+#define FAST_FORMAT 1
+
+static const long double L10[] = {
+	1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,  1e8L,  1e9L,
+	1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+	1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L,
+};
+#define MAX_SCALE 54
+
+static long double _scale(long double x, int k) /* {{{ */
+{
+	if (k >= 0) {
+		if (k > 27) { x *= L10[27]; k -= 27; }
+		return x * L10[k];
+	}
+	k = -k;
+	if (k > 27) { x /= L10[27]; k -= 27; }
+	return x / L10[k];
+}
+/* }}} */
+static int _exp10(double v) /* {{{ */
+{
+	/* floor(log10(v)), give or take one; callers check */
+	union { double d; uint64_t u; } b = { v };
+	int e2 = (int)((b.u >> 52) & 0x7ff) - 1023;
+	if (e2 == -1023) /* subnormal */
+		e2 = -1074 + 63 - __builtin_clzll(b.u & 0xfffffffffffffULL);
+	return (e2 * 78913) >> 18;
+}
+/* }}} */
+#endif
+
+/*************************************************************************/
+
+static char* _utoa(char *end, uint64_t v) /* {{{ */
+{
+	/* writes backwards, from end; returns where it stopped */
+	while (v >= 100) {
+		unsigned r = (unsigned)(v % 100);
+		v /= 100;
+		*--end = DIGITS[2 * r + 1];
+		*--end = DIGITS[2 * r];
+	}
+	if (v >= 10) {
+		*--end = DIGITS[2 * v + 1];
+		*--end = DIGITS[2 * v];
+	} else {
+		*--end = '0' + v;
+	}
+	return end;
+}
+/* }}} */
+int bolo_utoa(char *buf, uint64_t v) /* {{{ */
+{
+	char tmp[20], *p = _utoa(tmp + sizeof(tmp), v);
+	int n = tmp + sizeof(tmp) - p;
+	memcpy(buf, p, n);
+	buf[n] = '\0';
+	return n;
+}
+/* }}} */
+int bolo_itoa(char *buf, int64_t v) /* {{{ */
+{
+	if (v >= 0)
+		return bolo_utoa(buf, v);
+	*buf = '-';
+	return 1 + bolo_utoa(buf + 1, 0 - (uint64_t)v);
+}
+/* }}} */
+
+static int _exponent(char *p, int x) /* {{{ */
+{
+	/* e+05, e-12, e+308; at least two digits, like printf */
+	char *s = p;
+	*p++ = 'e';
+	*p++ = x < 0 ? '-' : '+';
+	if (x < 0) x = -x;
+	if (x >= 100) { *p++ = '0' + x / 100; x %= 100; }
+	*p++ = DIGITS[2 * x];
+	*p++ = DIGITS[2 * x + 1];
+	*p = '\0';
+	return p - s;
+}
+/* }}} */
+int bolo_etoa(char *buf, double v) /* {{{ */
+{
+#ifdef FAST_FORMAT
+	char *p = buf;
+	double a = v;
+	if (signbit(a)) { *p++ = '-'; a = -a; }
+
+	if (isinf(a)) {
+		memcpy(p, "inf", 4);
+		return p - buf + 3;
+	}
+	if (a == 0.0) {
+		memcpy(p, "0.000000e+00", 13);
+		return p - buf + 12;
+	}
+	if (isnan(a))
+		goto slow;
+
+	/* a * 10^k, as an integer of seven digits */
+	int x = _exp10(a), k = 6 - x;
+	if (k > MAX_SCALE || k < -MAX_SCALE)
+		goto slow;
+	long double s = _scale(a, k);
+	if (s >= 1e7L) {
+		x++; k--;
+		if (k < -MAX_SCALE) goto slow;
+		s = _scale(a, k);
+	} else if (s < 1e6L) {
+		x--; k++;
+		if (k > MAX_SCALE) goto slow;
+		s = _scale(a, k);
+	}
+
+	/* printf rounds the exact value, half to even; we can only
+	   tell which way to go if we aren't too near the half-way
+	   point to be sure (s is under 2^24, and off by no more
+	   than two roundings, of 2^-64 each, so well under 2^-32) */
+	uint64_t m = (uint64_t)s;
+	long double frac = s - m;
+	if (frac - 0.5L < 0x1p-32L && 0.5L - frac < 0x1p-32L)
+		goto slow;
+	if (frac > 0.5L)
+		m++;
+	if (m == 10000000) {
+		m = 1000000;
+		x++;
+	}
+
+	char tmp[7];
+	_utoa(tmp + 7, m);
+	*p++ = tmp[0];
+	*p++ = '.';
+	memcpy(p, tmp + 1, 6);
+	p += 6;
+	return p - buf + _exponent(p, x);
+
+slow:
+#endif
+	return _printf(buf, BOLO_NUM_MAX, "%e", v);
+}
+/* }}} */
+
+static int _format(char *buf, int neg, uint64_t d, int n, int x) /* {{{ */
+{
+	/* n significant digits d, the first of which is at 10^x; laid
+	   out the way "%.17g" would lay them out (minus the padding) */
+	char ds[20], *p = buf;
+	_utoa(ds + n, d);
+	if (neg)
+		*p++ = '-';
+
+	if (x >= 17 || x < -4) {
+		*p++ = ds[0];
+		if (n > 1) {
+			*p++ = '.';
+			memcpy(p, ds + 1, n - 1);
+			p += n - 1;
+		}
+		return p - buf + _exponent(p, x);
+	}
+
+	if (x < 0) {
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -x - 1);
+		p += -x - 1;
+		memcpy(p, ds, n);
+		p += n;
+
+	} else if (n <= x + 1) {
+		memcpy(p, ds, n);
+		p += n;
+		memset(p, '0', x + 1 - n);
+		p += x + 1 - n;
+
+	} else {
+		memcpy(p, ds, x + 1);
+		p += x + 1;
+		*p++ = '.';
+		memcpy(p, ds + x + 1, n - x - 1);
+		p += n - x - 1;
+	}
+	*p = '\0';
+	return p - buf;
+}
+/* }}} */
+static int _dtoa_slow(char *buf, double v, int prec) /* {{{ */
+{
+	/* the fewest digits (prec + 1, at least) that printf can
+	   round v to, and still have strtod give back exactly v */
+	char tmp[BOLO_NUM_MAX];
+	for (; prec < 16; prec++) {
+		_printf(tmp, sizeof(tmp), "%.*e", prec, v);
+		if (_strtod(tmp, NULL) == v)
+			break;
+	}
+	if (prec >= 16)
+		_printf(tmp, sizeof(tmp), "%.*e", 16, v);
+
+	/* -d.ddde-x */
+	char *p = tmp;
+	int neg = *p == '-';
+	if (neg) p++;
+
+	uint64_t d = 0;
+	int n = 0;
+	for (; *p != 'e'; p++) {
+		if (*p < '0' || *p > '9') continue; /* the decimal point */
+		d = d * 10 + (*p - '0');
+		n++;
+	}
+	while (n > 1 && d % 10 == 0) {
+		d /= 10;
+		n--;
+	}
+	return _format(buf, neg, d, n, atoi(p + 1));
+}
+/* }}} */
+int bolo_dtoa(char *buf, double v) /* {{{ */
+{
+	if (isnan(v))
+		return _printf(buf, BOLO_NUM_MAX, "%.17g", v);
+	if (isinf(v)) {
+		strcpy(buf, v < 0 ? "-inf" : "inf");
+		return v < 0 ? 4 : 3;
+	}
+	if (v == 0.0) {
+		strcpy(buf, signbit(v) ? "-0" : "0");
+		return signbit(v) ? 2 : 1;
+	}
+
+#ifdef FAST_FORMAT
+	int neg = v < 0;
+	double a = neg ? -v : v;
+
+	/* a is the only double in (a - lo, a + hi); any decimal in
+	   there reads back as a.  (at a power of two, the gap below
+	   is half the size of the gap above.) */
+	union { double d; uint64_t u; } b = { a }, below, above;
+	below.u = b.u - 1;
+	above.u = b.u + 1;
+	long double lo = ((long double)a - below.d) / 2;
+	long double hi = isinf(above.d) ? lo : ((long double)above.d - a) / 2;
+
+	/* a * 10^k, as an integer of seventeen digits, more or less */
+	int x = _exp10(a), k = 16 - x;
+	if (k > MAX_SCALE || k < -MAX_SCALE)
+		return _dtoa_slow(buf, v, 0);
+	long double s = _scale(a, k);
+	if (s >= 1e17L || s < 1e16L) {
+		int by = s >= 1e17L ? 1 : -1;
+		x += by; k -= by;
+		if (k > MAX_SCALE || k < -MAX_SCALE)
+			return _dtoa_slow(buf, v, 0);
+		s = _scale(a, k);
+	}
+
+	/* s is off by two roundings (of 2^-64 each, relatively), and
+	   min and max by one more; err covers that.  the interval is
+	   over 2^7 times wider, so we only miss out on the ones that
+	   land right on an edge (those go the slow way) */
+	long double err = s * 0x1p-62L;
+	long double min = s - _scale(lo, k);
+	long double max = s + _scale(hi, k);
+
+	/* no decimal of fewer than n digits is anywhere near the
+	   interval (let alone in it), so there's no sense trying
+	   those; a multiple of 10^j is in (l, h] if h / 10^j and
+	   l / 10^j (rounded down) differ. */
+	uint64_t l = (uint64_t)(min - err) - 1, h = (uint64_t)(max + err);
+	int n = 17;
+	while (n > 1 && h / 10 > l / 10) {
+		h /= 10;
+		l /= 10;
+		n--;
+	}
+
+	/* try s rounded to n significant digits, then n+1... */
+	uint64_t step = 1;
+	int i;
+	for (i = n; i < 17; i++)
+		step *= 10;
+	for (; n <= 17; n++, step /= 10) {
+		uint64_t q = (uint64_t)(s / step);
+		long double rem = s - (long double)q * step;
+		if (rem < 0)     { q--; rem += step; }
+		if (rem >= step) { q++; rem -= step; }
+
+		/* the n-digit decimals either side of s */
+		long double half = step / 2.0L, below = s - rem, above = below + step;
+		if (rem - half < err && half - rem < err) {
+			/* too close to call which is nearer; that only
+			   matters if either of them would read back */
+			if (below > min - err || above < max + err)
+				break;
+			continue;
+		}
+		if (rem > half)
+			q++;
+
+		long double c = rem > half ? above : below;
+		if ((c - min < err && min - c < err)
+		 || (c - max < err && max - c < err))
+			break; /* too close to call whether it reads back */
+
+		if (c > min && c < max) {
+			int at = x;
+			if (q == L10[n]) { /* 9.99... rounded up to 10 */
+				q /= 10;
+				at++;
+			}
+			while (n > 1 && q % 10 == 0) {
+				q /= 10;
+				n--;
+			}
+			return _format(buf, neg, q, n, at);
+		}
+	}
+	/* fewer than n digits won't do; libc can say how many will */
+	return _dtoa_slow(buf, v, n - 1);
+#else
+	return _dtoa_slow(buf, v, 0);
+#endif
+}
+/* }}} */
+
+/*************************************************************************/
+
+uint64_t bolo_strtou(const char *s, char **end) /* {{{ */
+{
+	const char *p = s;
+	uint64_t v = 0;
+	int n;
+
+	if (*p == '+') p++;
+	for (n = 0; n < 19 && *p >= '0' && *p <= '9'; n++, p++)
+		v = v * 10 + (*p - '0');
+	if (n == 0 || (*p >= '0' && *p <= '9'))
+		return strtoull(s, end, 10);
+
+	if (end) *end = (char *)p;
+	return v;
+}
+/* }}} */
+int64_t bolo_strtoi(const char *s, char **end) /* {{{ */
+{
+	const char *p = s;
+	uint64_t v = 0;
+	int n, neg = 0;
+
+	if (*p == '-' || *p == '+')
+		neg = *p++ == '-';
+	for (n = 0; n < 18 && *p >= '0' && *p <= '9'; n++, p++)
+		v = v * 10 + (*p - '0');
+	if (n == 0 || (*p >= '0' && *p <= '9'))
+		return strtoll(s, end, 10);
+
+	if (end) *end = (char *)p;
+	return neg ? -(int64_t)v : (int64_t)v;
+}
+/* }}} */
+double bolo_strtod(const char *s, char **end) /* {{{ */
+{
+#if FLT_EVAL_METHOD == 0
+	/* up to 19 significant digits, and an exponent; if the digits
+	   fit in a double's mantissa, and 10^exponent is exact, one
+	   multiply (or divide) is correctly rounded, as strtod is */
+	const char *p = s;
+	uint64_t m = 0;
+	int nd = 0, any = 0, scale = 0, neg = 0;
+
+	if (*p == '-' || *p == '+')
+		neg = *p++ == '-';
+	if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		goto slow;
+
+	for (; *p >= '0' && *p <= '9'; p++, any = 1) {
+		if (nd == 19) goto slow;
+		m = m * 10 + (*p - '0');
+		if (m) nd++;
+	}
+	if (*p == '.') {
+		for (p++; *p >= '0' && *p <= '9'; p++, any = 1) {
+			if (nd == 19) goto slow;
+			m = m * 10 + (*p - '0');
+			if (m) nd++;
+			scale--;
+		}
+	}
+	if (!any)
+		goto slow;
+
+	if (*p == 'e' || *p == 'E') {
+		const char *q = p + 1;
+		int e = 0, eneg = 0;
+		if (*q == '-' || *q == '+')
+			eneg = *q++ == '-';
+		if (*q >= '0' && *q <= '9') {
+			for (; *q >= '0' && *q <= '9'; q++)
+				if (e < 10000) e = e * 10 + (*q - '0');
+			scale += eneg ? -e : e;
+			p = q;
+		}
+	}
+	double v;
+	if (m <= (1ULL << 53) && scale >= -22 && scale <= 22) {
+		v = (double)m;
+		v = scale < 0 ? v / P10[-scale] : v * P10[scale];
+
+	} else {
+#ifdef FAST_FORMAT
+		/* too many digits (as "%.17g" gives us) for that; but m
+		   is exact in a long double, and so is 10^scale, so r is
+		   only off by one rounding.  narrowing it to a double is
+		   a second rounding, which is only safe if r is not too
+		   near the half-way point between two doubles. */
+		if (m == 0 || scale < -27 || scale > 27)
+			goto slow;
+		long double r = scale < 0 ? m / L10[-scale] : m * L10[scale];
+		if (r > DBL_MAX || r < DBL_MIN)
+			goto slow;
+
+		v = (double)r;
+		union { double d; uint64_t u; } b = { v }, next;
+		next.u = b.u + (r < v ? -1 : 1);
+		long double off  = r < v ? v - r : r - v;
+		long double half = (r < v ? v - (long double)next.d : (long double)next.d - v) / 2;
+		if (off - half < r * 0x1p-62L && half - off < r * 0x1p-62L)
+			goto slow;
+#else
+		goto slow;
+#endif
+	}
+	if (end) *end = (char *)p;
+	return neg ? -v : v;
+
+slow:
+#endif
+	return _strtod(s, end);
+}
+/* }}} */
+
+/*************************************************************************/
+
+int bolo_extend_uint(pdu_t *pdu, uint64_t v) /* {{{ */
+{
+	char buf[BOLO_NUM_MAX];
+	return pdu_extend(pdu, buf, bolo_utoa(buf, v));
+}
+/* }}} */
+int bolo_extend_int(pdu_t *pdu, int64_t v) /* {{{ */
+{
+	char buf[BOLO_NUM_MAX];
+	return pdu_extend(pdu, buf, bolo_itoa(buf, v));
+}
+/* }}} */
+int bolo_extend_e(pdu_t *pdu, double v) /* {{{ */
+{
+	char buf[BOLO_NUM_MAX];
+	return pdu_extend(pdu, buf, bolo_etoa(buf, v));
+}
+/* }}} */
+int bolo_extend_double(pdu_t *pdu, double v) /* {{{ */
+{
+	char buf[BOLO_NUM_MAX];
+	return pdu_extend(pdu, buf, bolo_dtoa(buf, v));
+}
+/* }}} */
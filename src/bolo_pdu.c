@@ -18,6 +18,7 @@
  */
 
 #include "bolo.h"
+#include <math.h>
 
 pdu_t *bolo_parse_state_pdu(int argc, char **argv, const char *ts)
 {
@@ -52,9 +53,9 @@ pdu_t *bolo_parse_state_pdu(int argc, char **argv, const char *ts)
 
 	pdu_t *pdu = pdu_make("STATE", 0);
 	if (ts) pdu_extendf(pdu, "%s", ts);
-	else    pdu_extendf(pdu, "%i", time_s());
+	else    bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", argv[0]);
-	pdu_extendf(pdu, "%u", status);
+	bolo_extend_uint(pdu, status);
 	pdu_extendf(pdu, "%s", msg);
 	free(msg);
 
@@ -72,9 +73,9 @@ pdu_t *bolo_parse_counter_pdu(int argc, char **argv, const char *ts)
 
 	pdu_t *pdu = pdu_make("COUNTER", 0);
 	if (ts) pdu_extendf(pdu, "%s", ts);
-	else    pdu_extendf(pdu, "%i", time_s());
+	else    bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", argv[0]);
-	pdu_extendf(pdu, "%u", incr);
+	bolo_extend_uint(pdu, (unsigned int)incr);
 
 	return pdu;
 }
@@ -86,7 +87,7 @@ pdu_t *bolo_parse_sample_pdu(int argc, char **argv, const char *ts)
 
 	pdu_t *pdu = pdu_make("SAMPLE", 0);
 	if (ts) pdu_extendf(pdu, "%s", ts);
-	else    pdu_extendf(pdu, "%i", time_s());
+	else    bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", argv[0]);
 
 	int i;
@@ -96,6 +97,31 @@ pdu_t *bolo_parse_sample_pdu(int argc, char **argv, const char *ts)
 	return pdu;
 }
 
+pdu_t *bolo_parse_sample_agg_pdu(int argc, char **argv, const char *ts)
+{
+	if (argc != 7)
+		return NULL;
+
+	/* n must be a whole number, the rest just numbers */
+	char *end;
+	int i;
+	bolo_strtou(argv[1], &end);
+	if (!*argv[1] || *end)
+		return NULL;
+	for (i = 2; i < 7; i++) {
+		if (!*argv[i] || !isfinite(bolo_strtod(argv[i], &end)) || *end)
+			return NULL;
+	}
+
+	pdu_t *pdu = pdu_make("SAMPLE.AGG", 0);
+	if (ts) pdu_extendf(pdu, "%s", ts);
+	else    bolo_extend_int(pdu, time_s());
+	for (i = 0; i < 7; i++)
+		pdu_extendf(pdu, "%s", argv[i]);
+
+	return pdu;
+}
+
 pdu_t *bolo_parse_rate_pdu(int argc, char **argv, const char *ts)
 {
 	if (argc < 2)
@@ -103,7 +129,7 @@ pdu_t *bolo_parse_rate_pdu(int argc, char **argv, const char *ts)
 
 	pdu_t *pdu = pdu_make("RATE", 0);
 	if (ts) pdu_extendf(pdu, "%s", ts);
-	else    pdu_extendf(pdu, "%i", time_s());
+	else    bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", argv[0]);
 	pdu_extendf(pdu, "%s", argv[1]);
 
@@ -139,7 +165,7 @@ pdu_t *bolo_parse_event_pdu(int argc, char **argv, const char *ts)
 
 	pdu_t *pdu = pdu_make("EVENT", 0);
 	if (ts) pdu_extendf(pdu, "%s", ts);
-	else    pdu_extendf(pdu, "%i", time_s());
+	else    bolo_extend_int(pdu, time_s());
 
 	pdu_extendf(pdu, "%s", argv[0]);
 	char *extra = "";
@@ -171,6 +197,9 @@ pdu_t *bolo_stream_pdu(const char *line)
 	} else if (strcasecmp(l->strings[0], "SAMPLE") == 0) {
 		pdu = bolo_parse_sample_pdu(l->num - 2, l->strings + 2, l->strings[1]);
 
+	} else if (strcasecmp(l->strings[0], "SAMPLE.AGG") == 0) {
+		pdu = bolo_parse_sample_agg_pdu(l->num - 2, l->strings + 2, l->strings[1]);
+
 	} else if (strcasecmp(l->strings[0], "RATE") == 0) {
 		pdu = bolo_parse_rate_pdu(l->num - 2, l->strings + 2, l->strings[1]);
 
@@ -188,9 +217,9 @@ pdu_t *bolo_stream_pdu(const char *line)
 pdu_t *bolo_forget_pdu(uint16_t payload, const char *regex, uint8_t ignore)
 {
 	pdu_t *pdu = pdu_make("FORGET", 0);
-	pdu_extendf(pdu, "%u", payload);
+	bolo_extend_uint(pdu, payload);
 	pdu_extendf(pdu, "%s", regex);
-	pdu_extendf(pdu, "%u", ignore); /* flags */
+	bolo_extend_uint(pdu, ignore); /* flags */
 
 	return pdu;
 }
@@ -198,9 +227,9 @@ pdu_t *bolo_forget_pdu(uint16_t payload, const char *regex, uint8_t ignore)
 pdu_t *bolo_state_pdu(const char *name, int status, const char *msg)
 {
 	pdu_t *pdu = pdu_make("STATE", 0);
-	pdu_extendf(pdu, "%i", time_s());
+	bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", name);
-	pdu_extendf(pdu, "%u", status);
+	bolo_extend_uint(pdu, status);
 	pdu_extendf(pdu, "%s", msg);
 	return pdu;
 }
@@ -208,21 +237,21 @@ pdu_t *bolo_state_pdu(const char *name, int status, const char *msg)
 pdu_t *bolo_counter_pdu(const char *name, unsigned int value)
 {
 	pdu_t *pdu = pdu_make("COUNTER", 0);
-	pdu_extendf(pdu, "%i", time_s());
+	bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", name);
-	pdu_extendf(pdu, "%u", value);
+	bolo_extend_uint(pdu, value);
 	return pdu;
 }
 
 static pdu_t *_vsample_pdu(const char *name, int n, va_list ap)
 {
 	pdu_t *pdu = pdu_make("SAMPLE", 0);
-	pdu_extendf(pdu, "%i", time_s());
+	bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", name);
 
 	int i;
 	for (i = 0; i < n; i++)
-		pdu_extendf(pdu, "%lf", va_arg(ap, double));
+		bolo_extend_double(pdu, va_arg(ap, double));
 	return pdu;
 }
 
@@ -236,12 +265,26 @@ pdu_t *bolo_sample_pdu(const char *name, int n, ...)
 	return pdu;
 }
 
+pdu_t *bolo_sample_agg_pdu(const char *name, unsigned long n, double min, double max, double sum, double mean, double var)
+{
+	pdu_t *pdu = pdu_make("SAMPLE.AGG", 0);
+	bolo_extend_int(pdu, time_s());
+	pdu_extendf(pdu, "%s", name);
+	bolo_extend_uint(pdu, n);
+	bolo_extend_double(pdu, min);
+	bolo_extend_double(pdu, max);
+	bolo_extend_double(pdu, sum);
+	bolo_extend_double(pdu, mean);
+	bolo_extend_double(pdu, var);
+	return pdu;
+}
+
 pdu_t *bolo_rate_pdu(const char *name, unsigned long value)
 {
 	pdu_t *pdu = pdu_make("RATE", 0);
-	pdu_extendf(pdu, "%i", time_s());
+	bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", name);
-	pdu_extendf(pdu, "%lu", value);
+	bolo_extend_uint(pdu, value);
 	return pdu;
 }
 
@@ -277,7 +320,7 @@ pdu_t *bolo_setkeys_pdu(int n, ...)
 pdu_t *bolo_event_pdu(const char *name, const char *extra)
 {
 	pdu_t *pdu = pdu_make("EVENT", 0);
-	pdu_extendf(pdu, "%i", time_s());
+	bolo_extend_int(pdu, time_s());
 	pdu_extendf(pdu, "%s", name);
 	pdu_extendf(pdu, "%s", extra ? extra : "");
 	return pdu;
@@ -0,0 +1,191 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bolo.h"
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* the client side of the shared-memory submission ring
+   (see the shm_header_t commentary in src/bolo.h) */
+
+struct __bolo_shm {
+	shm_header_t *ring;
+	size_t        len;    /* of the whole mapping */
+	int           wake;   /* the aggregator's eventfd */
+};
+
+static int _shm_wake_fd(const char *path) /* {{{ */
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s.sock", path) >= (int)sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0)
+		return -1;
+	if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(s);
+		return -1;
+	}
+
+	char byte;
+	struct iovec iov = { &byte, 1 };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	int fd = -1;
+	if (recvmsg(s, &msg, 0) == 1) {
+		struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+		if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+			memcpy(&fd, CMSG_DATA(c), sizeof(fd));
+	}
+	close(s);
+
+	if (fd < 0)
+		errno = EPROTO;
+	return fd;
+}
+/* }}} */
+
+bolo_shm_t bolo_shm_open(const char *path)
+{
+	int fd = open(path, O_RDWR);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < SHM_HEADER) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	shm_header_t *ring = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED)
+		return NULL;
+
+	if (memcmp(ring->magic, SHM_MAGIC, 8) != 0
+	 || ring->version != SHM_VERSION
+	 || ring->size + SHM_HEADER != (uint64_t)st.st_size) {
+		munmap(ring, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	int wake = _shm_wake_fd(path);
+	if (wake < 0) {
+		munmap(ring, st.st_size);
+		return NULL;
+	}
+
+	bolo_shm_t shm = vmalloc(sizeof(struct __bolo_shm));
+	shm->ring = ring;
+	shm->len  = st.st_size;
+	shm->wake = wake;
+	return shm;
+}
+
+int bolo_shm_send(bolo_shm_t shm, pdu_t *pdu)
+{
+	shm_header_t *ring = shm->ring;
+	if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+		errno = EPIPE;
+		return -1;
+	}
+
+	size_t i, n = pdu_size(pdu);
+	uint64_t need = sizeof(shm_record_t);
+	for (i = 0; i < n; i++)
+		need += sizeof(uint32_t) + pdu_segment_size(pdu, i);
+	need = (need + SHM_ALIGN - 1) & ~(uint64_t)(SHM_ALIGN - 1);
+	if (need > ring->size / 4) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	/* reserve our space (and any padding at the end) */
+	uint64_t tail, head, pad;
+	for (;;) {
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		pad = (tail & (ring->size - 1)) + need > ring->size
+		    ? ring->size - (tail & (ring->size - 1)) : 0;
+		if (tail + pad + need - head > ring->size) {
+			__atomic_add_fetch(&ring->full, 1, __ATOMIC_RELAXED);
+			errno = EAGAIN;
+			return -1;
+		}
+		if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + pad + need,
+				0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			break;
+	}
+
+	if (pad) {
+		shm_record(ring, tail)->frames = 0;
+		__atomic_store_n(&shm_record(ring, tail)->size, pad, __ATOMIC_RELEASE);
+		tail += pad;
+	}
+
+	shm_record_t *r = shm_record(ring, tail);
+	uint8_t *p = (uint8_t *)(r + 1);
+	for (i = 0; i < n; i++) {
+		uint32_t len = pdu_segment_size(pdu, i);
+		memcpy(p, &len, sizeof(len));
+		memcpy(p + sizeof(len), pdu_segment(pdu, i), len);
+		p += sizeof(len) + len;
+	}
+	r->frames = n;
+	__atomic_store_n(&r->size, need, __ATOMIC_SEQ_CST);
+
+	/* if the aggregator went to sleep, we get to wake it up */
+	uint32_t sleeping = 1;
+	if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST)
+	 && __atomic_compare_exchange_n(&ring->sleeping, &sleeping, 0,
+			0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		/* the submission is in, either way; if this fails, the
+		   aggregator will find it the next time it wakes up */
+		uint64_t one = 1;
+		ssize_t rc = write(shm->wake, &one, sizeof(one));
+		(void)rc;
+	}
+	return 0;
+}
+
+void bolo_shm_close(bolo_shm_t shm)
+{
+	if (!shm)
+		return;
+
+	munmap(shm->ring, shm->len);
+	close(shm->wake);
+	free(shm);
+}
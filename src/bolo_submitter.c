@@ -0,0 +1,401 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bolo.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <vigor.h>
+
+/* the submitter coalesces COUNTER increments and SAMPLE values
+   per name, in a buffer per calling thread, and a background
+   thread sends what has piled up every so often as one COUNTER
+   (or SAMPLE.AGG) per name, instead of one per call. */
+
+#define SUBMIT_COUNTER 1
+#define SUBMIT_SAMPLE  2
+
+#define SUBMITTER_INITIAL_SLOTS 64
+
+typedef struct {
+	char     *name;      /* NULL if the slot is free */
+	uint32_t  hash;
+	uint8_t   type;
+	uint8_t   dirty;     /* has something to send */
+
+	uint64_t  n;         /* COUNTER: total increment; SAMPLE: values */
+	double    min, max, sum;
+	double    mean, m2;  /* running, as per Welford */
+} slot_t;
+
+typedef struct {
+	list_t          l;
+	pthread_mutex_t lock;   /* the owning thread, and the flusher */
+	int             orphan; /* the owning thread has exited */
+	int             refs;   /* the owning thread, and the submitter;
+	                           whoever lets go last frees it */
+
+	slot_t  *slots;         /* open addressing, linear probing */
+	size_t   cap, used, dirty;
+} buffer_t;
+
+struct __bolo_submitter {
+	pthread_mutex_t lock;     /* everything from here on down */
+	pthread_cond_t  wake;     /* for the flusher */
+	pthread_cond_t  done;     /* for bolo_submitter_flush() */
+	list_t          buffers;
+	uint64_t        requested, flushed;
+	int             stop;
+
+	pthread_key_t   mine;     /* this thread's buffer_t */
+	pthread_t       tid;
+	void           *push;     /* PUSH: connected to endpoint; the flusher's alone */
+	int             interval; /* ms */
+	size_t          max;      /* names per buffer, before flushing early */
+
+	uint64_t        sent;     /* PDUs, by the flusher */
+};
+
+static uint32_t _hash(int type, const char *name) /* {{{ */
+{
+	uint32_t h = 2166136261u ^ type;
+	while (*name) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+/* }}} */
+static slot_t * _slot(buffer_t *b, int type, const char *name, uint32_t h) /* {{{ */
+{
+	size_t i, mask = b->cap - 1;
+	for (i = h & mask; b->slots[i].name; i = (i + 1) & mask)
+		if (b->slots[i].hash == h && b->slots[i].type == type
+		 && strcmp(b->slots[i].name, name) == 0)
+			return &b->slots[i];
+	return &b->slots[i];
+}
+/* }}} */
+static void _grow(buffer_t *b) /* {{{ */
+{
+	slot_t *old = b->slots;
+	size_t i, n = b->cap;
+
+	b->cap = n ? n * 2 : SUBMITTER_INITIAL_SLOTS;
+	b->slots = vcalloc(b->cap, sizeof(slot_t));
+	for (i = 0; i < n; i++)
+		if (old[i].name)
+			*_slot(b, old[i].type, old[i].name, old[i].hash) = old[i];
+	free(old);
+}
+/* }}} */
+
+static void _release(buffer_t *b) /* {{{ */
+{
+	if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	size_t i;
+	for (i = 0; i < b->cap; i++)
+		free(b->slots[i].name);
+	free(b->slots);
+	pthread_mutex_destroy(&b->lock);
+	free(b);
+}
+/* }}} */
+static void _orphan(void *_) /* {{{ */
+{
+	/* the owning thread's reference keeps b around while we're
+	   here, even if the submitter is being freed out from under us */
+	buffer_t *b = (buffer_t *)_;
+	pthread_mutex_lock(&b->lock);
+	b->orphan = 1;
+	pthread_mutex_unlock(&b->lock);
+	_release(b);
+}
+/* }}} */
+static buffer_t * _buffer(bolo_submitter_t s) /* {{{ */
+{
+	buffer_t *b = pthread_getspecific(s->mine);
+	if (b)
+		return b;
+
+	b = vmalloc(sizeof(buffer_t));
+	b->refs = 2;
+	pthread_mutex_init(&b->lock, NULL);
+	_grow(b);
+
+	pthread_mutex_lock(&s->lock);
+	list_push(&s->buffers, &b->l);
+	pthread_mutex_unlock(&s->lock);
+	pthread_setspecific(s->mine, b);
+	return b;
+}
+/* }}} */
+static slot_t * _lookup(bolo_submitter_t s, buffer_t *b, int type, const char *name) /* {{{ */
+{
+	/* the caller holds b->lock */
+	uint32_t h = _hash(type, name);
+	slot_t *x = _slot(b, type, name, h);
+	if (x->name)
+		return x;
+
+	if ((b->used + 1) * 4 > b->cap * 3) {
+		_grow(b);
+		x = _slot(b, type, name, h);
+	}
+	x->name = strdup(name);
+	x->hash = h;
+	x->type = type;
+	b->used++;
+	return x;
+}
+/* }}} */
+static void _touched(bolo_submitter_t s, buffer_t *b, slot_t *x) /* {{{ */
+{
+	/* the caller holds b->lock */
+	if (x->dirty)
+		return;
+
+	x->dirty = 1;
+	if (++b->dirty == s->max) {
+		pthread_mutex_lock(&s->lock);
+		pthread_cond_signal(&s->wake);
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+/* }}} */
+
+static int _flush_buffer(bolo_submitter_t s, buffer_t *b, int32_t ts) /* {{{ */
+{
+	/* take what is there, under the lock, so that the owning
+	   thread can get back to it before we start sending.  if its
+	   thread had already exited by then, this is the last of it;
+	   if not, anything it adds later waits for the next flush */
+	pthread_mutex_lock(&b->lock);
+	int orphan = b->orphan;
+	size_t i, n = 0;
+	slot_t *out = b->dirty ? vcalloc(b->dirty, sizeof(slot_t)) : NULL;
+	for (i = 0; i < b->cap && n < b->dirty; i++) {
+		slot_t *x = &b->slots[i];
+		if (!x->name || !x->dirty)
+			continue;
+
+		out[n] = *x;
+		out[n++].name = strdup(x->name);
+		x->dirty = 0;
+		x->n = 0;
+		x->sum = x->mean = x->m2 = 0;
+	}
+	b->dirty = 0;
+	pthread_mutex_unlock(&b->lock);
+
+	for (i = 0; i < n; i++) {
+		pdu_t *p;
+		if (out[i].type == SUBMIT_COUNTER) {
+			p = pdu_make("COUNTER", 0);
+			bolo_extend_int(p, ts);
+			pdu_extendf(p, "%s", out[i].name);
+			bolo_extend_uint(p, out[i].n);
+		} else {
+			p = bolo_sample_agg_pdu(out[i].name, out[i].n,
+				out[i].min, out[i].max, out[i].sum, out[i].mean,
+				out[i].m2 / out[i].n);
+		}
+		if (pdu_send_and_free(p, s->push) == 0)
+			s->sent++;
+		free(out[i].name);
+	}
+	free(out);
+	return orphan;
+}
+/* }}} */
+static void _flush(bolo_submitter_t s) /* {{{ */
+{
+	/* the caller holds s->lock; buffers only ever get added
+	   to the end of the list, and only we take them off */
+	buffer_t *b, *tmp;
+	int32_t ts = time_s();
+	for_each_object_safe(b, tmp, &s->buffers, l) {
+		pthread_mutex_unlock(&s->lock);
+		int orphan = _flush_buffer(s, b, ts);
+		pthread_mutex_lock(&s->lock);
+		if (!orphan)
+			continue;
+
+		/* its thread is gone, and we just sent the last of it */
+		list_delete(&b->l);
+		_release(b);
+	}
+}
+/* }}} */
+static void * _flusher(void *_) /* {{{ */
+{
+	bolo_submitter_t s = (bolo_submitter_t)_;
+
+	pthread_mutex_lock(&s->lock);
+	while (!s->stop) {
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec  += s->interval / 1000;
+		until.tv_nsec += (s->interval % 1000) * 1000000L;
+		if (until.tv_nsec >= 1000000000L) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000L;
+		}
+
+		if (s->requested == s->flushed)
+			pthread_cond_timedwait(&s->wake, &s->lock, &until);
+
+		uint64_t requested = s->requested;
+		_flush(s);
+		s->flushed = requested;
+		pthread_cond_broadcast(&s->done);
+	}
+
+	/* one last time, on the way out */
+	_flush(s);
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+/* }}} */
+
+bolo_submitter_t bolo_submitter_new(void *zmq, const char *endpoint, int interval, int max)
+{
+	if (!zmq || !endpoint || interval <= 0 || max <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	bolo_submitter_t s = vmalloc(sizeof(struct __bolo_submitter));
+	list_init(&s->buffers);
+	s->interval = interval;
+	s->max      = max;
+
+	s->push = zmq_socket(zmq, ZMQ_PUSH);
+	if (!s->push)
+		goto fail;
+	if (vzmq_connect(s->push, endpoint) != 0)
+		goto fail;
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->wake, NULL);
+	pthread_cond_init(&s->done, NULL);
+	if (pthread_key_create(&s->mine, _orphan) != 0)
+		goto fail;
+	if (pthread_create(&s->tid, NULL, _flusher, s) != 0) {
+		pthread_key_delete(s->mine);
+		goto fail;
+	}
+	return s;
+
+fail:
+	if (s->push)
+		zmq_close(s->push);
+	free(s);
+	return NULL;
+}
+
+int bolo_submitter_counter(bolo_submitter_t s, const char *name, unsigned int incr)
+{
+	buffer_t *b = _buffer(s);
+	pthread_mutex_lock(&b->lock);
+	slot_t *x = _lookup(s, b, SUBMIT_COUNTER, name);
+	x->n += incr;
+	_touched(s, b, x);
+	pthread_mutex_unlock(&b->lock);
+	return 0;
+}
+
+int bolo_submitter_sample(bolo_submitter_t s, const char *name, double value)
+{
+	buffer_t *b = _buffer(s);
+	pthread_mutex_lock(&b->lock);
+	slot_t *x = _lookup(s, b, SUBMIT_SAMPLE, name);
+	if (x->n == 0 || value < x->min) x->min = value;
+	if (x->n == 0 || value > x->max) x->max = value;
+	x->n++;
+	x->sum += value;
+
+	double delta = value - x->mean;
+	x->mean += delta / x->n;
+	x->m2   += delta * (value - x->mean);
+	_touched(s, b, x);
+	pthread_mutex_unlock(&b->lock);
+	return 0;
+}
+
+int bolo_submitter_flush(bolo_submitter_t s)
+{
+	pthread_mutex_lock(&s->lock);
+	uint64_t want = ++s->requested;
+	pthread_cond_signal(&s->wake);
+	while (s->flushed < want && !s->stop)
+		pthread_cond_wait(&s->done, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+	return 0;
+}
+
+void bolo_submitter_free(bolo_submitter_t s)
+{
+	if (!s)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_signal(&s->wake);
+	pthread_cond_broadcast(&s->done);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->tid, NULL);
+
+	/* no more _orphan() calls from threads that exit from here on
+	   (our own buffer, we let go of ourselves); ones that are already
+	   running hold a reference, so whichever of us is last frees it */
+	buffer_t *b, *tmp;
+	if ((b = pthread_getspecific(s->mine)) != NULL) {
+		pthread_setspecific(s->mine, NULL);
+		_orphan(b);
+	}
+	pthread_key_delete(s->mine);
+
+	/* threads that are still around keep their buffer_t pointers
+	   (and with it, a small struct that is never freed), but must
+	   not call us anymore */
+	for_each_object_safe(b, tmp, &s->buffers, l) {
+		size_t i;
+		list_delete(&b->l);
+		pthread_mutex_lock(&b->lock);
+		for (i = 0; i < b->cap; i++)
+			free(b->slots[i].name);
+		free(b->slots);
+		b->slots = NULL;
+		b->cap   = 0;
+		pthread_mutex_unlock(&b->lock);
+		_release(b);
+	}
+
+	zmq_close(s->push);
+	pthread_cond_destroy(&s->wake);
+	pthread_cond_destroy(&s->done);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
@@ -206,7 +206,7 @@ static int _monitor_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 			char *_value = pdu_string(pdu, 2);
 			char *error;
 
-			double value = strtod(_value, &error);
+			double value = bolo_strtod(_value, &error);
 			if (!*error) {
 				metric_t *metric = _metric(monitor, name, METRIC_TYPE_SAMPLE);
 				if (metric) {
@@ -232,7 +232,7 @@ static int _monitor_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 
 			uint64_t value;
 			if (_value) {
-				value = strtoull(_value, &error, 10);
+				value = bolo_strtou(_value, &error);
 			} else {
 				value = 1;
 				error = "";
@@ -46,6 +46,24 @@
 #define T_KEYWORD_SWEEP         0x17
 #define T_KEYWORD_SAVE_SIZE     0x18
 #define T_KEYWORD_SAVE_INTERVAL 0x19
+#define T_KEYWORD_TRACE_RATE    0x1a
+#define T_KEYWORD_TOPK_SIZE     0x1b
+#define T_KEYWORD_TOPK_INTERVAL 0x1c
+#define T_KEYWORD_LIMIT_METRICS  0x1d
+#define T_KEYWORD_LIMIT_RULE     0x1e
+#define T_KEYWORD_LIMIT_OVERFLOW 0x1f
+#define T_KEYWORD_EVICT_IDLE     0x20
+#define T_KEYWORD_QUERY_THREADS  0x21
+#define T_KEYWORD_UPSTREAM       0x22
+#define T_KEYWORD_REPLICATION    0x23
+#define T_KEYWORD_STANDBY_FOR    0x24
+#define T_KEYWORD_LISTENER_THREADS 0x25
+#define T_KEYWORD_UDP_PORT       0x26
+#define T_KEYWORD_UDP_BUFFER     0x27
+#define T_KEYWORD_SHM_RING       0x28
+#define T_KEYWORD_SHM_SIZE       0x29
+#define T_KEYWORD_BROADCAST_TSDP 0x2a
+#define T_KEYWORD_SHM_MODE       0x2b
 
 #define T_OPEN_BRACE           0x80
 #define T_CLOSE_BRACE          0x81
@@ -121,6 +139,7 @@ getline:
 		while (*b && isdigit(*b)) b++;
 		if (!*b || isspace(*b)) {
 			memcpy(p->value, p->buffer, b-p->buffer);
+			p->value[b-p->buffer] = '\0';
 			p->token = T_NUMBER;
 
 			while (*b && isspace(*b)) b++;
@@ -181,6 +200,7 @@ getline:
 			KEYWORD("listener",   LISTENER);
 			KEYWORD("controller", CONTROLLER);
 			KEYWORD("broadcast",  BROADCAST);
+			KEYWORD("broadcast.tsdp", BROADCAST_TSDP);
 			KEYWORD("nsca.port",  NSCAPORT);
 			KEYWORD("user",       USER);
 			KEYWORD("group",      GROUP);
@@ -189,6 +209,9 @@ getline:
 			KEYWORD("savefile",   SAVEFILE);
 			KEYWORD("keysfile",   KEYSFILE);
 			KEYWORD("beacon",     BEACON);
+			KEYWORD("upstream",   UPSTREAM);
+			KEYWORD("replication", REPLICATION);
+			KEYWORD("standby.for", STANDBY_FOR);
 			KEYWORD("sweep",      SWEEP);
 			KEYWORD("dumpfiles",  DUMPFILES);
 			KEYWORD("type",       TYPE);
@@ -203,6 +226,20 @@ getline:
 			KEYWORD("grace.period", GRACE_PERIOD);
 			KEYWORD("save.size",      SAVE_SIZE);
 			KEYWORD("save.interval",  SAVE_INTERVAL);
+			KEYWORD("trace.rate",     TRACE_RATE);
+			KEYWORD("topk.size",      TOPK_SIZE);
+			KEYWORD("topk.interval",  TOPK_INTERVAL);
+			KEYWORD("limit.metrics",  LIMIT_METRICS);
+			KEYWORD("limit.rule",     LIMIT_RULE);
+			KEYWORD("limit.overflow", LIMIT_OVERFLOW);
+			KEYWORD("evict.idle",     EVICT_IDLE);
+			KEYWORD("query.threads",  QUERY_THREADS);
+			KEYWORD("listener.threads", LISTENER_THREADS);
+			KEYWORD("udp.port",       UDP_PORT);
+			KEYWORD("udp.buffer",     UDP_BUFFER);
+			KEYWORD("shm.ring",       SHM_RING);
+			KEYWORD("shm.size",       SHM_SIZE);
+			KEYWORD("shm.mode",       SHM_MODE);
 
 			if (!p->token) {
 				memcpy(p->value, p->buffer, b-p->buffer);
@@ -278,14 +315,19 @@ int configure(const char *path, server_t *s)
 	list_init(&s->db.counter_matches);
 	list_init(&s->db.sample_matches);
 	list_init(&s->db.rate_matches);
-	list_init(&s->db.events);
+	ring_init(&s->db.events);
 	list_init(&s->db.anon_windows);
+	list_init(&s->db.auto_counters);
+	list_init(&s->db.auto_samples);
+	list_init(&s->db.auto_rates);
+	memset(&s->db.limit, 0, sizeof(s->db.limit));
 	memset(&s->db.states,   0, sizeof(hash_t));
 	memset(&s->db.counters, 0, sizeof(hash_t));
 	memset(&s->db.samples,  0, sizeof(hash_t));
 	memset(&s->db.rates,    0, sizeof(hash_t));
 	memset(&s->db.types,    0, sizeof(hash_t));
 	memset(&s->db.windows,  0, sizeof(hash_t));
+	trie_init(&s->db.names);
 
 	parser_t p;
 	memset(&p, 0, sizeof(p));
@@ -317,6 +359,8 @@ int configure(const char *path, server_t *s)
 	rate_t       *rate       = NULL;
 	re_rate_t    *re_rate    = NULL;
 
+	int           rule_limit = 0;
+
 	const char *re_err;
 	int re_off;
 
@@ -327,12 +371,17 @@ int configure(const char *path, server_t *s)
 		case T_KEYWORD_LISTENER:    SERVER_STRING(s->config.listener);    break;
 		case T_KEYWORD_CONTROLLER:  SERVER_STRING(s->config.controller);  break;
 		case T_KEYWORD_BROADCAST:   SERVER_STRING(s->config.broadcast);   break;
+		case T_KEYWORD_BROADCAST_TSDP: SERVER_STRING(s->config.broadcast_tsdp); break;
 		case T_KEYWORD_USER:        SERVER_STRING(s->config.runas_user);  break;
 		case T_KEYWORD_GROUP:       SERVER_STRING(s->config.runas_group); break;
 		case T_KEYWORD_PIDFILE:     SERVER_STRING(s->config.pidfile);     break;
 		case T_KEYWORD_SAVEFILE:    SERVER_STRING(s->config.savefile);    break;
 		case T_KEYWORD_KEYSFILE:    SERVER_STRING(s->config.keysfile);    break;
 		case T_KEYWORD_BEACON:      SERVER_STRING(s->config.beacon);      break;
+		case T_KEYWORD_UPSTREAM:    SERVER_STRING(s->config.upstream);    break;
+		case T_KEYWORD_REPLICATION: SERVER_STRING(s->config.replication); break;
+		case T_KEYWORD_STANDBY_FOR: SERVER_STRING(s->config.standby_for); break;
+		case T_KEYWORD_SHM_RING:    SERVER_STRING(s->config.shm_ring);    break;
 
 		case T_KEYWORD_DUMPFILES: /* noop */ break;
 
@@ -367,6 +416,88 @@ int configure(const char *path, server_t *s)
 			s->interval.savestate = atoi(p.value);
 			break;
 
+		case T_KEYWORD_TRACE_RATE:
+			NEXT;
+			if (p.token != T_NUMBER && p.token != T_STRING) { ERROR("Expected numeric trace rate value"); }
+			s->config.trace_rate = strtod(p.value, NULL);
+			if (s->config.trace_rate < 0 || s->config.trace_rate > 1) { ERROR("trace.rate must be between 0 and 1"); }
+			break;
+
+		case T_KEYWORD_TOPK_SIZE:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric top-k size value"); }
+			s->config.topk_size = atoi(p.value);
+			break;
+
+		case T_KEYWORD_TOPK_INTERVAL:
+			NEXT;
+			if (p.token != T_NUMBER && p.token != T_TIME) { ERROR("Expected numeric top-k interval value"); }
+			s->config.topk_interval = atoi(p.value);
+			if (s->config.topk_interval < 1) { ERROR("topk.interval must be at least 1 second"); }
+			break;
+
+		case T_KEYWORD_LIMIT_METRICS:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric metrics limit value"); }
+			s->db.limit.metrics = atoi(p.value);
+			break;
+
+		case T_KEYWORD_LIMIT_RULE:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric rule limit value"); }
+			rule_limit = atoi(p.value);
+			break;
+
+		case T_KEYWORD_LIMIT_OVERFLOW:
+			NEXT;
+			if      (p.token == T_STRING && strcmp(p.value, "reject") == 0) s->db.limit.overflow = LIMIT_REJECT;
+			else if (p.token == T_STRING && strcmp(p.value, "fold")   == 0) s->db.limit.overflow = LIMIT_FOLD;
+			else { ERROR("Expected 'reject' or 'fold' for limit.overflow"); }
+			break;
+
+		case T_KEYWORD_EVICT_IDLE:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric evict.idle value"); }
+			s->config.evict_idle = atoi(p.value);
+			break;
+
+		case T_KEYWORD_QUERY_THREADS:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric query.threads value"); }
+			s->config.query_threads = atoi(p.value);
+			break;
+
+		case T_KEYWORD_LISTENER_THREADS:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric listener.threads value"); }
+			s->config.listener_threads = atoi(p.value);
+			break;
+
+		case T_KEYWORD_UDP_PORT:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric udp.port value"); }
+			s->config.udp_port = atoi(p.value) & 0xffff;
+			break;
+
+		case T_KEYWORD_UDP_BUFFER:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric udp.buffer value"); }
+			s->config.udp_buffer = atoi(p.value);
+			break;
+
+		case T_KEYWORD_SHM_SIZE:
+			NEXT;
+			if (p.token != T_NUMBER) { ERROR("Expected numeric shm.size value"); }
+			s->config.shm_size = atoi(p.value);
+			break;
+
+		case T_KEYWORD_SHM_MODE:
+			NEXT;
+			if (p.token != T_NUMBER || strspn(p.value, "01234567") != strlen(p.value)
+			 || strtol(p.value, NULL, 8) & ~0777) { ERROR("Expected octal shm.mode value"); }
+			s->config.shm_mode = strtol(p.value, NULL, 8);
+			break;
+
 		case T_KEYWORD_NSCAPORT:
 			NEXT;
 			if (p.token != T_NUMBER) { ERROR("Expected numeric port value"); }
@@ -469,6 +600,7 @@ int configure(const char *path, server_t *s)
 
 				state = calloc(1, sizeof(state_t));
 				hash_set(&s->db.states, p.value, state);
+				trie_insert(&s->db.names, p.value, PAYLOAD_STATE);
 				state->name    = strdup(p.value);
 				state->type    = type;
 				state->status  = PENDING;
@@ -490,6 +622,7 @@ int configure(const char *path, server_t *s)
 				}
 
 				re_state->re_extra = pcre_study(re_state->re, 0, &re_err);
+				re_state->limit    = rule_limit;
 				list_push(&s->db.state_matches, &re_state->l);
 
 			} else {
@@ -525,6 +658,7 @@ int configure(const char *path, server_t *s)
 
 				counter = calloc(1, sizeof(counter_t));
 				hash_set(&s->db.counters, p.value, counter);
+				trie_insert(&s->db.names, p.value, PAYLOAD_COUNTER);
 				counter->name   = strdup(p.value);
 				counter->window = win;
 				counter->value  = 0;
@@ -545,6 +679,7 @@ int configure(const char *path, server_t *s)
 				}
 
 				re_counter->re_extra = pcre_study(re_counter->re, 0, &re_err);
+				re_counter->limit    = rule_limit;
 				list_push(&s->db.counter_matches, &re_counter->l);
 
 			} else {
@@ -580,6 +715,7 @@ int configure(const char *path, server_t *s)
 
 				sample = calloc(1, sizeof(sample_t));
 				hash_set(&s->db.samples, p.value, sample);
+				trie_insert(&s->db.names, p.value, PAYLOAD_SAMPLE);
 				sample->name   = strdup(p.value);
 				sample->window = win;
 				sample->n = 0;
@@ -600,6 +736,7 @@ int configure(const char *path, server_t *s)
 				}
 
 				re_sample->re_extra = pcre_study(re_sample->re, 0, &re_err);
+				re_sample->limit    = rule_limit;
 				list_push(&s->db.sample_matches, &re_sample->l);
 
 			} else {
@@ -635,6 +772,7 @@ int configure(const char *path, server_t *s)
 
 				rate = calloc(1, sizeof(rate_t));
 				hash_set(&s->db.rates, p.value, rate);
+				trie_insert(&s->db.names, p.value, PAYLOAD_RATE);
 				rate->name   = strdup(p.value);
 				rate->window = win;
 
@@ -654,6 +792,7 @@ int configure(const char *path, server_t *s)
 				}
 
 				re_rate->re_extra = pcre_study(re_rate->re, 0, &re_err);
+				re_rate->limit    = rule_limit;
 				list_push(&s->db.rate_matches, &re_rate->l);
 
 			} else {
@@ -764,16 +903,25 @@ int deconfigure(server_t *s)
 	}
 
 	hash_done(&s->keys, 1);
+	trie_done(&s->keynames);
+	trie_done(&s->db.names);
+	ring_done(&s->db.events);
+	binf_forget(&s->db);
 
 	free(s->config.listener);     s->config.listener     = NULL;
 	free(s->config.controller);   s->config.controller   = NULL;
 	free(s->config.broadcast);    s->config.broadcast   = NULL;
+	free(s->config.broadcast_tsdp); s->config.broadcast_tsdp = NULL;
 	free(s->config.pidfile);      s->config.pidfile      = NULL;
 	free(s->config.runas_user);   s->config.runas_user   = NULL;
 	free(s->config.runas_group);  s->config.runas_group  = NULL;
 	free(s->config.savefile);     s->config.savefile     = NULL;
 	free(s->config.keysfile);     s->config.keysfile     = NULL;
 	free(s->config.beacon);       s->config.beacon       = NULL;
+	free(s->config.upstream);     s->config.upstream     = NULL;
+	free(s->config.replication);  s->config.replication  = NULL;
+	free(s->config.standby_for);  s->config.standby_for  = NULL;
+	free(s->config.shm_ring);     s->config.shm_ring     = NULL;
 	free(s->config.log_level);    s->config.log_level    = NULL;
 	free(s->config.log_facility); s->config.log_facility = NULL;
 
@@ -17,29 +17,234 @@
   with Bolo.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE /* for recvmmsg(2) */
 #include "bolo.h"
+#include <tsdp.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
 #include <signal.h>
 #include <assert.h>
 
+#define TOPK_STATE     0
+#define TOPK_COUNTER   1
+#define TOPK_SAMPLE    2
+#define TOPK_RATE      3
+#define TOPK_EVENT     4
+#define TOPK_UNMATCHED 5
+#define TOPK_LISTS     6
+
+/* an immutable copy of what the read-only management
+   requests need, published by the kernel for reader threads */
+typedef struct {
+	char     *name;
+	char     *summary;
+	int32_t   last_seen;
+	uint8_t   status;
+	uint8_t   stale;
+} snap_state_t;
+
+typedef struct {
+	char *key;
+	char *value;
+} snap_key_t;
+
+typedef struct snapshot {
+	struct snapshot *next;    /* on the retired list */
+	uint64_t         retired; /* epoch in which it was replaced */
+
+	size_t        nstates, nkeys;
+	snap_state_t *states;     /* sorted by name */
+	snap_key_t   *keys;       /* sorted by key */
+	ring_t        events;     /* oldest first */
+} snapshot_t;
+
+/* epoch-based reclamation: readers note the global epoch in their
+   slot of active[] before looking at current, and clear it when done.
+   A replaced snapshot is freed once no reader is still in an epoch
+   at or before the one it was retired in.
+
+   Snapshots are taken lazily: the kernel only marks current as stale
+   (once a tick, if anything changed, and after a FORGET or DEL.KEYS),
+   and takes a new one when a reader finds it stale and asks. */
+typedef struct {
+	snapshot_t *current;
+	uint64_t    epoch;
+	uint64_t   *active;
+	int         readers;
+	int         stale;        /* the db has changed since current was taken */
+
+	snapshot_t *retired;      /* kernel thread only */
+	int         refs;         /* threads still using this */
+} snapshots_t;
+
+typedef struct {
+	int          id;
+	snapshots_t *snapshots;
+
+	void *control;    /* SUB:    hooked up to supervisor.command; receives control messages */
+	void *queries;    /* DEALER: connected to the management proxy */
+	void *kernel;     /* DEALER: connected to kernel.management, for everything else */
+} reader_t;
+
+typedef struct {
+	int      refs;        /* the kernel, the dispatcher, and each decoder */
+	int      threads;     /* listener.threads */
+
+	uint64_t failed;      /* submissions we couldn't hand on, to a decoder
+	                         (by the dispatcher) or to the kernel (by one) */
+} listener_stats_t;
+
+/* datagrams are read this many at a time (see recvmmsg(2));
+   anything longer than UDP_DATAGRAM_MAX is dropped, as truncated */
+#define UDP_BATCH        64
+#define UDP_DATAGRAM_MAX 8192
+
+typedef struct {
+	int      refs;        /* the kernel, and the udp thread */
+	uint16_t port;
+
+	uint64_t datagrams;   /* received */
+	uint64_t batches;     /* recvmmsg() calls that came back with any */
+	uint64_t submissions; /* handed to the kernel */
+	uint64_t malformed;   /* lines (or TSDP PDUs) we couldn't make sense of */
+	uint64_t truncated;   /* datagrams longer than UDP_DATAGRAM_MAX */
+	uint64_t overflowed;  /* dropped by the OS, for lack of buffer space */
+	uint64_t failed;      /* datagrams we couldn't hand (all of) to the kernel */
+} udp_stats_t;
+
+/* records are drained from the shm.ring this many at a time,
+   and handed to the kernel in one go */
+#define SHM_BATCH 64
+
+typedef struct {
+	int      refs;        /* the kernel, and the shm thread */
+
+	uint64_t submissions; /* handed to the kernel */
+	uint64_t batches;     /* handed over */
+	uint64_t wakeups;     /* times a client had to wake us up */
+	uint64_t malformed;   /* records we couldn't make sense of */
+	uint64_t full;        /* times a client found the ring full */
+} shm_stats_t;
+
 typedef struct {
 	void *control;    /* SUB:    hooked up to supervisor.command; receives control messages */
 	void *tock;       /* SUB:    hooked up to scheduler.tick, for timing interrupts */
 
 	void *listener;   /* PULL:   bound to external interface for metric / state submission */
 	void *broadcast;  /* PUB:    bound to external interface for broadcasting updates */
-	void *management; /* ROUTER: bound to external interface for management purposes */
+	void *tsdp;       /* PUB:    bound to broadcast.tsdp, for broadcasting them as binary TSDP */
+	void *management; /* ROUTER: bound to external interface for management purposes
+	                             (or to kernel.management, behind the readers) */
 	void *beacon;     /* PUB:    bound to external interface for beacon hearbeats */
+	void *upstream;   /* PUSH:   connected to another aggregator's listener, for closed windows */
+	void *replicas;   /* PUB:    bound to external interface, for hot-standby followers */
+	void *primary;    /* SUB:    connected to the replicas socket of the aggregator we stand by for */
+	void *updates;    /* PULL:   bound to kernel.updates, for submissions that were already
+	                             decoded, by listener.threads, udp.port or shm.ring
+	                             (see update_t) */
 
 	reactor_t *reactor;
 	server_t  *server;
 
+	listener_stats_t *decoders; /* see listener.threads; NULL if we decode */
+	udp_stats_t      *udp;      /* see udp.port; NULL if there's no udp thread */
+	shm_stats_t      *shm;      /* see shm.ring; NULL if there's no shm thread */
+
 	struct {
 		int32_t last;     /* s */
 		int16_t interval; /* s */
 	} freshness, savestate, tick, sweep;
+
+	/* sampled latency tracing (see trace.rate) */
+	struct {
+		hash_t   lags;    /* "TYPE rule" -> trace_t */
+		uint64_t sampled;
+		int32_t  ts;      /* client ts of the submission being traced */
+		char     rule[128];
+	} trace;
+
+	/* heavy hitters (see topk.size); two generations, so that
+	   there is always a complete interval to look at */
+	struct {
+		topk_t   lists[2][TOPK_LISTS];
+		int32_t  since[2];
+		int      cur;
+	} topk;
+
+	/* idle auto-created metrics (see evict.idle); each list is
+	   swept a little at a time, clock-style, on every tick */
+	struct {
+		list_t  *counters, *samples, *rates;
+	} evict;
+
+	/* closed windows sent to the upstream aggregator (see upstream) */
+	struct {
+		uint64_t forwarded;
+		uint64_t dropped;   /* upstream wasn't taking them */
+	} forward;
+
+	/* TSDP broadcasts left out (see broadcast.tsdp and tsdp_fits()) */
+	uint64_t tsdp_skipped;
+
+	/* hot-standby replication (see replication and standby.for);
+	   submissions are passed along to followers in batches, at least
+	   once a tick, and applied by them exactly as we applied them */
+	struct {
+		pdu_t   *batch;     /* [ REPLICATE | seq | n | frames ... | n | ... ] */
+		int      pending;   /* submissions in batch */
+		uint64_t seq;       /* last batch sent */
+		uint64_t sent;      /* submissions */
+		uint64_t last;      /* last batch applied */
+		uint64_t applied;   /* submissions */
+		uint64_t missed;    /* batches we never saw */
+		int32_t  heard;     /* when the primary last sent a batch */
+		int      standby;   /* following; don't broadcast anything */
+		int      replaying; /* applying a batch from the primary */
+	} replica;
+
+	/* for query.threads; NULL if the kernel answers everything itself */
+	snapshots_t *snapshots;
+	int          dirty;
+	int          mutated;  /* the last management request changed the db */
+
+	/* keys set or deleted since the last save.interval; only these
+	   are broadcast, and appended to the keys log (see flush_keys) */
+	struct {
+		hash_t        dirty;
+		int           n;
+		unsigned long count;  /* keys in the store */
+		unsigned long logged; /* entries in the log since it was compacted */
+	} keys;
 } kernel_t;
 
+/* the keys log is folded back into the keysfile once it holds
+   more entries than there are keys, but never before this many */
+#define KEYS_LOG_MIN 1024
+
+static const char *TOPK_NAMES[TOPK_LISTS] = {
+	"STATE", "COUNTER", "SAMPLE", "RATE", "EVENT", "unmatched",
+};
+
+/* lag histograms are bucketed by powers of two, in milliseconds;
+   the last bucket catches everything over ~16s */
+#define TRACE_BUCKETS 16
+typedef struct {
+	uint64_t n, sum, max;
+	uint64_t skewed;  /* client ts was in the future */
+	uint64_t bucket[TRACE_BUCKETS];
+} trace_lag_t;
+
+typedef struct {
+	trace_lag_t received;  /* listener receipt, vs. client ts */
+	trace_lag_t broadcast; /* broadcast of the result, vs. client ts */
+} trace_t;
+
+#define TRACE_RECEIVED  0
+#define TRACE_BROADCAST 1
+
 typedef struct {
 	void *control;    /* SUB:  hooked up to supervisor.command; receives control messages */
 
@@ -47,6 +252,88 @@ typedef struct {
 	int   interval;
 } scheduler_t;
 
+/* a submission, decoded and ready to apply.  Every string and value
+   lives in the same allocation, so one free() gets rid of all of it.
+   With listener.threads, decoder threads build these, and hand the
+   kernel a pointer to each, in an [ UPDATE | update_t* ] PDU. */
+#define UPDATE_NONE       0  /* malformed, or not a submission */
+#define UPDATE_STATE      1
+#define UPDATE_COUNTER    2
+#define UPDATE_SAMPLE     3
+#define UPDATE_RATE       4
+#define UPDATE_SAMPLE_AGG 5
+#define UPDATE_RATE_AGG   6
+#define UPDATE_EVENT      7
+#define UPDATE_SET_KEYS   8
+
+typedef struct {
+	pdu_t    *raw;      /* the submission itself, for replication (decoders only) */
+	uint64_t  traced;   /* when it was received (ms), if sampled for tracing */
+	uint32_t  hash;     /* of name; see topk_hash() */
+	int32_t   ts;
+	uint8_t   type;     /* UPDATE_* */
+	uint8_t   code;     /* STATE */
+
+	int64_t   i[3];     /* COUNTER increment; RATE value; SAMPLE.AGG n;
+	                       RATE.AGG first-seen, last-seen, diff */
+	double    d[5];     /* SAMPLE.AGG min, max, sum, mean, var */
+
+	int       n;        /* SAMPLE values; SET.KEYS pairs */
+	double   *values;   /* SAMPLE */
+	char     *name;     /* (the first key, for SET.KEYS) */
+	char     *extra;    /* STATE message; EVENT description */
+} update_t;
+
+typedef struct {
+	void *control;    /* SUB:  hooked up to supervisor.command; receives control messages */
+	void *listener;   /* PULL: bound to external interface for metric / state submission */
+	void **decoders;  /* PUSH: one per decoder, bound to listener.decoder.N */
+	int   n;
+
+	listener_stats_t *stats; /* shared with the kernel, which reports them */
+} dispatcher_t;
+
+typedef struct {
+	int    id;
+	double trace_rate;
+	int    keep;      /* hold on to the raw submission, for replication */
+
+	void *control;    /* SUB:  hooked up to supervisor.command; receives control messages */
+	void *queue;      /* PULL: connected to listener.decoder.N, fed by the dispatcher */
+	void *kernel;     /* PUSH: connected to kernel.updates */
+
+	listener_stats_t *stats; /* shared with the kernel, which reports them */
+} decoder_t;
+
+typedef struct {
+	int            fd;      /* bound to udp.port */
+	tsdp_stream_t *stream;  /* for TSDP datagrams; reset for each one */
+	double         trace_rate;
+	int            keep;    /* hold on to the raw submission, for replication */
+	udp_stats_t   *stats;   /* shared with the kernel, which reports them */
+
+	void *control;    /* SUB:  hooked up to supervisor.command; receives control messages */
+	void *kernel;     /* PUSH: connected to kernel.updates */
+} udp_t;
+
+typedef struct {
+	shm_header_t *ring;
+	size_t        len;    /* of the whole mapping */
+	uint64_t      size;   /* of the data area, and     */
+	uint64_t      head;   /* where we are in it; ours, */
+	                      /* since clients can write the header */
+	char         *path;   /* shm.ring */
+	char         *door;   /* <shm.ring>.sock, where clients get `wake` */
+	int           wake;   /* eventfd, for when we are sleeping */
+	int           fd;     /* AF_UNIX, listening on `door` */
+	double        trace_rate;
+	int           keep;   /* hold on to the raw submission, for replication */
+	shm_stats_t  *stats;  /* shared with the kernel, which reports them */
+
+	void *control;    /* SUB:  hooked up to supervisor.command; receives control messages */
+	void *kernel;     /* PUSH: connected to kernel.updates */
+} shm_t;
+
 #define winstart(x, t) ((t) - ((t) % (x)->window->time))
 #define winend(x, t)   (winstart((x), (t)) + (x)->window->time)
 #define max(a,b) ((a) > (b) ? (a) : (b))
@@ -55,20 +342,63 @@ typedef struct {
 
 
 static void broadcast_state(kernel_t*, state_t*);
-static void broadcast_setkeys(kernel_t*);
+static void broadcast_setkeys(kernel_t*, int all);
 static void broadcast_transition(kernel_t*, state_t*);
 static void broadcast_event(kernel_t*, event_t*);
 static void broadcast_counter(kernel_t *kernel, counter_t *counter);
 static void broadcast_sample(kernel_t *kernel, sample_t *sample);
 static void broadcast_rate(kernel_t *kernel, rate_t *rate);
+static void forward_window(kernel_t *kernel, pdu_t *p);
+static void broadcast(kernel_t *kernel, pdu_t *p);
+static void broadcast_tsdp(kernel_t *kernel, tsdp_t *t);
+static tsdp_t* tsdp_broadcast(int payloads, int flags, int32_t ts);
+static int  tsdp_fits(kernel_t *kernel, const char *type, const char *name, const char *s);
+static void tsdp_text(tsdp_t *t, const char *s);
+
+static void replicate(kernel_t *kernel, pdu_t *pdu);
+static void replicate_flush(kernel_t *kernel);
+static void replicate_apply(kernel_t *kernel, pdu_t *batch);
+static int forget(kernel_t *kernel, pdu_t *pdu, const char **err);
+static void del_keys(kernel_t *kernel, pdu_t *pdu);
+static void promote(kernel_t *kernel, const char *why);
+static int _kernel_reactor(void *socket, pdu_t *pdu, void *_);
+static int _pdu_is_tsdp(pdu_t *pdu);
+static int _pdu_is(pdu_t *pdu, const char *type, int min, int max);
+
+static update_t* update_decode(pdu_t *pdu, uint64_t traced);
+static update_t* update_tsdp(const tsdp_t *t, uint64_t traced);
+static void update_apply(kernel_t *kernel, update_t *u);
+static void submit(kernel_t *kernel, pdu_t *raw, update_t *u);
+static void submit_pdu(kernel_t *kernel, pdu_t *pdu);
 
 static int save_keys(hash_t *keys, const char *file);
-static int read_keys(hash_t *keys, const char *file);
+static int read_keys(hash_t *keys, trie_t *names, const char *file);
+static void set_key(kernel_t *kernel, char *key, char *value);
+static void del_key(kernel_t *kernel, const char *key);
+static void flush_keys(kernel_t *kernel);
+static void compact_keys(kernel_t *kernel);
+
+static strings_t* matching(trie_t *names, uint16_t bits, const char *pattern, pcre *re, pcre_extra *re_extra);
 
 static void check_freshness(kernel_t *kernel);
 
-static void event_free(event_t *ev);
 static void buffer_event(db_t *db, event_t *ev, int max, int keep);
+static void events_dump(ring_t *events, int32_t since, pcre *re, pcre_extra *re_extra, FILE *io);
+
+static const char * trace_rule(kernel_t *kernel, const char *pdu, type_t *type, window_t *window);
+static void trace_lag(kernel_t *kernel, const char *rule, int which, int32_t ts, uint64_t now);
+static void trace_dump(kernel_t *kernel, FILE *io);
+
+static void topk_hit(kernel_t *kernel, int list, const char *name, uint32_t hash);
+static void topk_rotate(kernel_t *kernel, int32_t now);
+static void topk_dump(kernel_t *kernel, FILE *io);
+
+static void evict_reset(kernel_t *kernel);
+static void evict_idle(kernel_t *kernel, int32_t now);
+static void metrics_dump(kernel_t *kernel, FILE *io);
+
+static void snapshot_publish(kernel_t *kernel);
+static void snapshots_release(snapshots_t *snapshots);
 
 static inline const char *statstr(uint8_t s)
 {
@@ -78,6 +408,18 @@ static inline const char *statstr(uint8_t s)
 
 /*************************************************************************/
 
+static tsdp_t* tsdp_state(state_t *state, int transition) /* {{{ */
+{
+	/* [ TSTAMP | name | summary ], with the status in the flags */
+	tsdp_t *t = tsdp_broadcast(TSDP_PAYLOAD_STATE,
+		(state->status > 3 ? 3 : state->status) | transition
+		| (state->stale ? TSDP_F_STATE_STALE : TSDP_F_STATE_FRESH),
+		state->last_seen);
+	tsdp_text(t, state->name);
+	tsdp_text(t, state->summary);
+	return t;
+}
+/* }}} */
 static void broadcast_state(kernel_t *kernel, state_t *state) /* {{{ */
 {
 	logger(LOG_INFO, "broadcasting [STATE] data for %s: "
@@ -86,34 +428,79 @@ static void broadcast_state(kernel_t *kernel, state_t *state) /* {{{ */
 		state->status, state->summary);
 
 	pdu_t *p = pdu_make("STATE", 1, state->name);
-	pdu_extendf(p, "%li", state->last_seen);
+	bolo_extend_int(p, state->last_seen);
 	pdu_extendf(p, "%s",  state->stale ? "stale" : "fresh");
 	pdu_extendf(p, "%s",  statstr(state->status));
 	pdu_extendf(p, "%s",  state->summary);
-	pdu_send_and_free(p, kernel->broadcast);
+	broadcast(kernel, p);
+	if (kernel->tsdp && tsdp_fits(kernel, "STATE", state->name, state->summary))
+		broadcast_tsdp(kernel, tsdp_state(state, TSDP_F_STATE_STEADY));
+
+	if (kernel->trace.ts)
+		trace_lag(kernel, kernel->trace.rule, TRACE_BROADCAST, kernel->trace.ts, time_ms());
 }
 /* }}} */
-static void broadcast_setkeys(kernel_t *kernel) /* {{{ */
+static void broadcast_setkeys(kernel_t *kernel, int all) /* {{{ */
 {
-	pdu_t *pdu = pdu_make("SET.KEYS", 0);
-	int n = 0;
-	char *key, *value;
-	for_each_key_value(&kernel->server->keys, key, value) {
-		if (!value) continue;
-		pdu_extendf(pdu, "%s", key);
-		pdu_extendf(pdu, "%s", value);
-		n++;
-		if (n == 30) {
+	pdu_t *set = pdu_make("SET.KEYS", 0);
+	pdu_t *del = pdu_make("DEL.KEYS", 0);
+	int nset = 0, ndel = 0, nfact = 0;
+	char *key, *value, *x;
+
+	/* in TSDP, a deleted key is one with a NIL value */
+	tsdp_t *fact = kernel->tsdp ? tsdp_broadcast(TSDP_PAYLOAD_FACT, 0, 0) : NULL;
+
+	/* unless asked for everything, only send
+	   what changed since the last broadcast */
+	for_each_key_value(all ? &kernel->server->keys : &kernel->keys.dirty, key, x) {
+		if (!x) continue;
+		value = hash_get(&kernel->server->keys, key);
+
+		if (fact && tsdp_fits(kernel, "FACT", key, value)) {
+			tsdp_text(fact, key);
+			if (value)
+				tsdp_text(fact, value);
+			else
+				tsdp_extend(fact, TSDP_TYPE_NIL, NULL, 0);
+			if (++nfact == 30) {
+				broadcast_tsdp(kernel, fact);
+				fact = tsdp_broadcast(TSDP_PAYLOAD_FACT, 0, 0);
+				nfact = 0;
+			}
+		}
+
+		if (!value) {
+			pdu_extendf(del, "%s", key);
+			if (++ndel == 30) {
+				logger(LOG_INFO, "broadcasting [DEL.KEYS] data");
+				broadcast(kernel, del);
+				del = pdu_make("DEL.KEYS", 0);
+				ndel = 0;
+			}
+			continue;
+		}
+
+		pdu_extendf(set, "%s", key);
+		pdu_extendf(set, "%s", value);
+		if (++nset == 30) {
 			logger(LOG_INFO, "broadcasting [SET.KEYS] data");
-			pdu_send_and_free(pdu, kernel->broadcast);
-			pdu = pdu_make("SET.KEYS", 0);
-			n = 0;
+			broadcast(kernel, set);
+			set = pdu_make("SET.KEYS", 0);
+			nset = 0;
 		}
 	}
-	if (n > 0)
-		pdu_send_and_free(pdu, kernel->broadcast);
+	if (nset > 0)
+		broadcast(kernel, set);
 	else
-		pdu_free(pdu);
+		pdu_free(set);
+	if (ndel > 0)
+		broadcast(kernel, del);
+	else
+		pdu_free(del);
+	if (nfact > 0)
+		broadcast_tsdp(kernel, fact);
+	else if (fact)
+		tsdp_destroy(fact);
 }
 /* }}} */
 static void broadcast_transition(kernel_t *kernel, state_t *state) /* {{{ */
@@ -124,11 +511,13 @@ static void broadcast_transition(kernel_t *kernel, state_t *state) /* {{{ */
 		state->status, state->summary);
 
 	pdu_t *p = pdu_make("TRANSITION", 1, state->name);
-	pdu_extendf(p, "%li", state->last_seen);
+	bolo_extend_int(p, state->last_seen);
 	pdu_extendf(p, "%s",  state->stale ? "stale" : "fresh");
 	pdu_extendf(p, "%s",  statstr(state->status));
 	pdu_extendf(p, "%s",  state->summary);
-	pdu_send_and_free(p, kernel->broadcast);
+	broadcast(kernel, p);
+	if (kernel->tsdp && tsdp_fits(kernel, "TRANSITION", state->name, state->summary))
+		broadcast_tsdp(kernel, tsdp_state(state, TSDP_F_STATE_TRANSITION));
 }
 /* }}} */
 static void broadcast_event(kernel_t *kernel, event_t *ev) /* {{{ */
@@ -137,10 +526,19 @@ static void broadcast_event(kernel_t *kernel, event_t *ev) /* {{{ */
 		ev->name, ev->timestamp, ev->extra);
 
 	pdu_t *p = pdu_make("EVENT", 0);
-	pdu_extendf(p, "%i", ev->timestamp);
+	bolo_extend_int(p, ev->timestamp);
 	pdu_extendf(p, "%s", ev->name);
 	pdu_extendf(p, "%s", ev->extra);
-	pdu_send_and_free(p, kernel->broadcast);
+	broadcast(kernel, p);
+	if (kernel->tsdp && tsdp_fits(kernel, "EVENT", ev->name, ev->extra)) {
+		tsdp_t *t = tsdp_broadcast(TSDP_PAYLOAD_EVENT, 0, ev->timestamp);
+		tsdp_text(t, ev->name);
+		tsdp_text(t, ev->extra);
+		broadcast_tsdp(kernel, t);
+	}
+
+	if (kernel->trace.ts)
+		trace_lag(kernel, kernel->trace.rule, TRACE_BROADCAST, kernel->trace.ts, time_ms());
 }
 /* }}} */
 static void broadcast_counter(kernel_t *kernel, counter_t *counter) /* {{{ */
@@ -152,10 +550,23 @@ static void broadcast_counter(kernel_t *kernel, counter_t *counter) /* {{{ */
 		counter->name, ts, counter->value);
 
 	pdu_t *p = pdu_make("COUNTER", 0);
-	pdu_extendf(p, "%u",  ts);
+	bolo_extend_int(p, ts);
 	pdu_extendf(p, "%s",  counter->name);
-	pdu_extendf(p, "%lu", counter->value);
-	pdu_send_and_free(p, kernel->broadcast);
+	bolo_extend_uint(p, counter->value);
+	if (kernel->upstream)
+		forward_window(kernel, pdu_dup(p, NULL));
+	broadcast(kernel, p);
+	if (kernel->tsdp && tsdp_fits(kernel, "COUNTER", counter->name, NULL)) {
+		tsdp_t *t = tsdp_broadcast(TSDP_PAYLOAD_TALLY, 0, ts);
+		tsdp_text(t, counter->name);
+		tsdp_extend_uint(t, counter->value);
+		broadcast_tsdp(kernel, t);
+	}
+
+	if (counter->traced) {
+		trace_lag(kernel, trace_rule(kernel, "COUNTER", NULL, counter->window), TRACE_BROADCAST, counter->traced, time_ms());
+		counter->traced = 0;
+	}
 }
 /* }}} */
 static void broadcast_sample(kernel_t *kernel, sample_t *sample) /* {{{ */
@@ -168,15 +579,46 @@ static void broadcast_sample(kernel_t *kernel, sample_t *sample) /* {{{ */
 		sample->max, sample->sum, sample->mean, sample->var);
 
 	pdu_t *p = pdu_make("SAMPLE", 0);
-	pdu_extendf(p, "%u", ts);
+	bolo_extend_int(p, ts);
 	pdu_extendf(p, "%s", sample->name);
-	pdu_extendf(p, "%u", sample->n);
-	pdu_extendf(p, "%e", sample->min);
-	pdu_extendf(p, "%e", sample->max);
-	pdu_extendf(p, "%e", sample->sum);
-	pdu_extendf(p, "%e", sample->mean);
-	pdu_extendf(p, "%e", sample->var);
-	pdu_send_and_free(p, kernel->broadcast);
+	bolo_extend_uint(p, sample->n);
+	bolo_extend_e(p, sample->min);
+	bolo_extend_e(p, sample->max);
+	bolo_extend_e(p, sample->sum);
+	bolo_extend_e(p, sample->mean);
+	bolo_extend_e(p, sample->var);
+	broadcast(kernel, p);
+	if (kernel->tsdp && tsdp_fits(kernel, "SAMPLE", sample->name, NULL)) {
+		/* at full precision, since there is no printf() to lose it */
+		tsdp_t *t = tsdp_broadcast(TSDP_PAYLOAD_SAMPLE, 0, ts);
+		tsdp_text(t, sample->name);
+		tsdp_extend_uint (t, sample->n);
+		tsdp_extend_float(t, sample->min);
+		tsdp_extend_float(t, sample->max);
+		tsdp_extend_float(t, sample->sum);
+		tsdp_extend_float(t, sample->mean);
+		tsdp_extend_float(t, sample->var);
+		broadcast_tsdp(kernel, t);
+	}
+
+	if (kernel->upstream) {
+		/* the same, at full precision, for another aggregator to merge */
+		p = pdu_make("SAMPLE.AGG", 0);
+		bolo_extend_int(p, ts);
+		pdu_extendf(p, "%s",    sample->name);
+		bolo_extend_uint(p, sample->n);
+		bolo_extend_double(p, sample->min);
+		bolo_extend_double(p, sample->max);
+		bolo_extend_double(p, sample->sum);
+		bolo_extend_double(p, sample->mean);
+		bolo_extend_double(p, sample->var);
+		forward_window(kernel, p);
+	}
+
+	if (sample->traced) {
+		trace_lag(kernel, trace_rule(kernel, "SAMPLE", NULL, sample->window), TRACE_BROADCAST, sample->traced, time_ms());
+		sample->traced = 0;
+	}
 }
 /* }}} */
 static void broadcast_rate(kernel_t *kernel, rate_t *rate) /* {{{ */
@@ -189,31 +631,266 @@ static void broadcast_rate(kernel_t *kernel, rate_t *rate) /* {{{ */
 		rate->name, ts, rate->first, rate->last, rate->window->time, value);
 
 	pdu_t *p = pdu_make("RATE", 0);
-	pdu_extendf(p, "%u", ts);
+	bolo_extend_int(p, ts);
 	pdu_extendf(p, "%s", rate->name);
-	pdu_extendf(p, "%i", rate->window->time);
-	pdu_extendf(p, "%e", value);
+	bolo_extend_int(p, rate->window->time);
+	bolo_extend_e(p, value);
+	broadcast(kernel, p);
+	if (kernel->tsdp && tsdp_fits(kernel, "RATE", rate->name, NULL)) {
+		tsdp_t *t = tsdp_broadcast(TSDP_PAYLOAD_DELTA, TSDP_F_DELTA_UNIT_SECOND, ts);
+		tsdp_text(t, rate->name);
+		tsdp_extend_uint (t, rate->window->time);
+		tsdp_extend_float(t, value);
+		broadcast_tsdp(kernel, t);
+	}
+
+	if (kernel->upstream) {
+		/* the rate itself can't be added up; what the
+		   counter did, and over how long, can be */
+		p = pdu_make("RATE.AGG", 0);
+		bolo_extend_int(p, ts);
+		pdu_extendf(p, "%s",  rate->name);
+		bolo_extend_int(p, rate->first_seen);
+		bolo_extend_int(p, rate->last_seen);
+		bolo_extend_uint(p, rate_diff(rate));
+		forward_window(kernel, p);
+	}
+
+	if (rate->traced) {
+		trace_lag(kernel, trace_rule(kernel, "RATE", NULL, rate->window), TRACE_BROADCAST, rate->traced, time_ms());
+		rate->traced = 0;
+	}
+}
+/* }}} */
+
+static void broadcast(kernel_t *kernel, pdu_t *p) /* {{{ */
+{
+	/* followers keep quiet until they take over */
+	if (kernel->replica.standby) {
+		pdu_free(p);
+		return;
+	}
 	pdu_send_and_free(p, kernel->broadcast);
 }
 /* }}} */
+static tsdp_t* tsdp_broadcast(int payloads, int flags, int32_t ts) /* {{{ */
+{
+	/* a TSDP BROADCAST, starting with its TSTAMP (if it has one) */
+	tsdp_t *t;
+	if (tsdp_create(&t, TSDP_VERSION, TSDP_OP_BROADCAST) != 0) {
+		logger(LOG_CRIT, "failed to create a TSDP [BROADCAST] PDU: %s", strerror(errno));
+		abort();
+	}
+	tsdp_set_payloads(t, payloads);
+	tsdp_set_flags(t, flags);
+	if (payloads != TSDP_PAYLOAD_FACT)
+		tsdp_extend_tstamp(t, ts * 1000LL);
+	return t;
+}
+/* }}} */
+static int tsdp_fits(kernel_t *kernel, const char *type, const char *name, const char *s) /* {{{ */
+{
+	/* frames top out at TSDP_MAX_FRAME octets.  rather than cut
+	   a longer string short (and broadcast a metric under some
+	   other name), leave the TSDP side of it out altogether;
+	   the textual broadcast still has it */
+	if ((!name || strlen(name) <= TSDP_MAX_FRAME)
+	 && (!s    || strlen(s)    <= TSDP_MAX_FRAME))
+		return 1;
+
+	logger(LOG_WARNING, "not broadcasting [%s] data for %.64s%s over TSDP: "
+		"longer than the %i octets a frame can hold",
+		type, name, strlen(name) > 64 ? "..." : "", TSDP_MAX_FRAME);
+	kernel->tsdp_skipped++;
+	return 0;
+}
+/* }}} */
+static void tsdp_text(tsdp_t *t, const char *s) /* {{{ */
+{
+	/* see tsdp_fits(), which callers check first */
+	tsdp_extend(t, TSDP_TYPE_STRING, s, s ? strlen(s) : 0);
+}
+/* }}} */
+/* }}} */
+static void broadcast_tsdp(kernel_t *kernel, tsdp_t *t) /* {{{ */
+{
+	/* one 0MQ frame per PDU; subscribers tell the payload
+	   types apart themselves (see bolo_broadcast_decode()) */
+	uint8_t buf[4096], *p = buf;
+	int n = tsdp_packed_size(t);
+	if (n > (int)sizeof(buf))
+		p = vmalloc(n);
+
+	if (!kernel->replica.standby && tsdp_pack(p, n, t) == n)
+		zmq_send(kernel->tsdp, p, n, 0);
+
+	if (p != buf)
+		free(p);
+	tsdp_destroy(t);
+}
+/* }}} */
+static void forward_window(kernel_t *kernel, pdu_t *p) /* {{{ */
+{
+	if (kernel->replica.standby) {
+		pdu_free(p);
+		return;
+	}
+
+	/* the upstream socket doesn't block; if the upstream
+	   aggregator can't keep up (or isn't there), drop it */
+	if (pdu_send_and_free(p, kernel->upstream) != 0) {
+		kernel->forward.dropped++;
+		logger(LOG_WARNING, "unable to forward closed window upstream to %s: %s",
+			kernel->server->config.upstream, strerror(errno));
+		return;
+	}
+	kernel->forward.forwarded++;
+}
+/* }}} */
 
 static void beacon_sweep(kernel_t *kernel, uint16_t interval) /* {{{ */
 {
 	logger(LOG_DEBUG, "sending beacon sweep");
 
 	pdu_t *p = pdu_make("BEACON", 0);
-	pdu_extendf(p, "%lu", time_ms());
-	pdu_extendf(p, "%lu", interval * 1000);
+	bolo_extend_uint(p, time_ms());
+	bolo_extend_uint(p, interval * 1000);
 	pdu_send_and_free(p, kernel->beacon);
 }
 /* }}} */
 
+/* submissions go out in batches of at most this many,
+   or whatever has built up by the next tick */
+#define REPLICA_BATCH 512
+
+static void replicate(kernel_t *kernel, pdu_t *pdu) /* {{{ */
+{
+	size_t i;
+	if (!kernel->replica.batch)
+		kernel->replica.batch = pdu_make("REPLICATE", 0);
+
+	bolo_extend_uint(kernel->replica.batch, pdu_size(pdu));
+	if (_pdu_is_tsdp(pdu))
+		pdu_extend(kernel->replica.batch, pdu_segment(pdu, 0), pdu_segment_size(pdu, 0));
+	else
+		pdu_extendf(kernel->replica.batch, "%s", pdu_type(pdu));
+	for (i = 1; i < pdu_size(pdu); i++)
+		pdu_extend(kernel->replica.batch, pdu_segment(pdu, i), pdu_segment_size(pdu, i));
+
+	if (++kernel->replica.pending >= REPLICA_BATCH)
+		replicate_flush(kernel);
+}
+/* }}} */
+static void replicate_flush(kernel_t *kernel) /* {{{ */
+{
+	/* empty batches go out too, every tick, so that
+	   followers know we are still here */
+	pdu_t *p = pdu_make("REPLICATE", 0);
+	bolo_extend_uint(p, ++kernel->replica.seq);
+	if (kernel->replica.batch) {
+		size_t i;
+		for (i = 1; i < pdu_size(kernel->replica.batch); i++)
+			pdu_extend(p, pdu_segment(kernel->replica.batch, i), pdu_segment_size(kernel->replica.batch, i));
+		pdu_free(kernel->replica.batch);
+		kernel->replica.batch = NULL;
+	}
+
+	logger(LOG_DEBUG, "replicating batch %lu (%i submissions)", kernel->replica.seq, kernel->replica.pending);
+	kernel->replica.sent += kernel->replica.pending;
+	kernel->replica.pending = 0;
+	pdu_send_and_free(p, kernel->replicas);
+}
+/* }}} */
+static void replicate_apply(kernel_t *kernel, pdu_t *batch) /* {{{ */
+{
+	char *s;
+	size_t i, j, n;
+
+	if (!kernel->replica.standby) {
+		logger(LOG_DEBUG, "ignoring [REPLICATE] batch from %s; we have taken over",
+			kernel->server->config.standby_for);
+		return;
+	}
+	if (pdu_size(batch) < 2) {
+		logger(LOG_WARNING, "received malformed [REPLICATE] PDU (no sequence number)");
+		return;
+	}
+
+	s = pdu_string(batch, 1); uint64_t seq = bolo_strtou(s, NULL); free(s);
+	if (kernel->replica.last && seq > kernel->replica.last + 1) {
+		logger(LOG_WARNING, "missed %lu [REPLICATE] batches from %s (got %lu, expected %lu)",
+			seq - kernel->replica.last - 1, kernel->server->config.standby_for, seq, kernel->replica.last + 1);
+		kernel->replica.missed += seq - kernel->replica.last - 1;
+	}
+	kernel->replica.last  = seq;
+	kernel->replica.heard = time_s();
+
+	/* run each submission through the listener, as if it came from
+	   the same agent that sent it to the primary */
+	kernel->replica.replaying = 1;
+	for (i = 2; i < pdu_size(batch); i += n) {
+		s = pdu_string(batch, i++); n = bolo_strtou(s, NULL); free(s);
+		if (n < 1 || i + n > pdu_size(batch)) {
+			logger(LOG_WARNING, "received malformed [REPLICATE] PDU (batch %lu is short)", seq);
+			break;
+		}
+
+		pdu_t *p;
+		if (pdu_segment_size(batch, i) >= 4 && (pdu_segment(batch, i)[0] >> 4) == TSDP_VERSION) {
+			/* binary TSDP goes back in as-is */
+			p = pdu_new();
+			pdu_extend(p, pdu_segment(batch, i), pdu_segment_size(batch, i));
+		} else {
+			s = pdu_string(batch, i);
+			p = pdu_make(s, 0);
+			free(s);
+		}
+		for (j = 1; j < n; j++)
+			pdu_extend(p, pdu_segment(batch, i + j), pdu_segment_size(batch, i + j));
+
+		/* FORGET and DEL.KEYS came in on the primary's management
+		   port, and are applied the way it applied them */
+		if (_pdu_is(p, "FORGET", 4, 4)) {
+			const char *err;
+			if (forget(kernel, p, &err) != 0)
+				logger(LOG_WARNING, "failed to replay [FORGET] from %s: %s",
+					kernel->server->config.standby_for, err);
+			else if (kernel->replicas)
+				replicate(kernel, p);
+
+		} else if (_pdu_is(p, "DEL.KEYS", 2, 0)) {
+			del_keys(kernel, p);
+			if (kernel->replicas)
+				replicate(kernel, p);
+
+		} else {
+			submit_pdu(kernel, p);
+		}
+		pdu_free(p);
+		kernel->replica.applied++;
+	}
+	kernel->replica.replaying = 0;
+}
+/* }}} */
+static void promote(kernel_t *kernel, const char *why) /* {{{ */
+{
+	logger(LOG_NOTICE, "taking over from %s (%s); last heard from it %is ago, at batch %lu",
+		kernel->server->config.standby_for, why,
+		time_s() - kernel->replica.heard, kernel->replica.last);
+	kernel->replica.standby = 0;
+}
+/* }}} */
+
 static int save_keys(hash_t *keys, const char *file) /* {{{ */
 {
-	FILE *io = fopen(file, "w");
+	/* write the new keysfile alongside the old one, and swap it in
+	   whole, so that a crash never leaves us with half of one */
+	char *tmp = string("%s.tmp", file);
+	FILE *io = fopen(tmp, "w");
 	if (!io) {
 		logger(LOG_ERR, "kernel failed to open keys file %s for writing: %s",
-				file, strerror(errno));
+				tmp, strerror(errno));
+		free(tmp);
 		return -1;
 	}
 
@@ -228,11 +905,18 @@ static int save_keys(hash_t *keys, const char *file) /* {{{ */
 		n++;
 	}
 	fprintf(io, "# %lu keys\n", n);
-	fclose(io);
+	if (fclose(io) != 0 || rename(tmp, file) != 0) {
+		logger(LOG_ERR, "kernel failed to save keys file %s: %s",
+				file, strerror(errno));
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
 	return 0;
 }
 /* }}} */
-static int read_keys(hash_t *keys, const char *file) /* {{{ */
+static int read_keys(hash_t *keys, trie_t *names, const char *file) /* {{{ */
 {
 	FILE *io = fopen(file, "r");
 	if (!io) {
@@ -255,6 +939,18 @@ static int read_keys(hash_t *keys, const char *file) /* {{{ */
 		while (*value && !isspace(*value)) value++;
 		*value++ = '\0';
 		while (*value && isspace(*value)) value++;
+
+		/* "- key" lines in the keys log are deletions */
+		if (strcmp(key, "-") == 0 && *value && *value != '=') {
+			key = value;
+			while (*value && !isspace(*value)) value++;
+			*value = '\0';
+
+			free(hash_set(keys, key, NULL));
+			trie_remove(names, key, 1);
+			continue;
+		}
+
 		if (*value++ != '=') continue;
 		while (*value && isspace(*value)) value++;
 
@@ -266,12 +962,154 @@ static int read_keys(hash_t *keys, const char *file) /* {{{ */
 		char *existing = hash_set(keys, key, value);
 		if (existing != value)
 			free(existing);
+		trie_insert(names, key, 1);
 	}
 
 	fclose(io);
 	return 0;
 }
 /* }}} */
+static void set_key(kernel_t *kernel, char *key, char *value) /* {{{ */
+{
+	char *existing = hash_set(&kernel->server->keys, key, value);
+	if (!existing)
+		kernel->keys.count++;
+	else if (existing != value)
+		free(existing);
+	trie_insert(&kernel->server->keynames, key, 1);
+
+	if (!hash_get(&kernel->keys.dirty, key)) {
+		hash_set(&kernel->keys.dirty, key, "");
+		kernel->keys.n++;
+	}
+}
+/* }}} */
+static void del_key(kernel_t *kernel, const char *key) /* {{{ */
+{
+	char *existing = hash_set(&kernel->server->keys, key, NULL);
+	if (!existing)
+		return;
+
+	free(existing);
+	kernel->keys.count--;
+	trie_remove(&kernel->server->keynames, key, 1);
+
+	if (!hash_get(&kernel->keys.dirty, key)) {
+		hash_set(&kernel->keys.dirty, key, "");
+		kernel->keys.n++;
+	}
+}
+/* }}} */
+static void flush_keys(kernel_t *kernel) /* {{{ */
+{
+	const char *file = kernel->server->config.keysfile;
+	if (kernel->keys.n == 0)
+		return;
+
+	broadcast_setkeys(kernel, 0);
+	if (kernel->keys.logged + kernel->keys.n > max(KEYS_LOG_MIN, kernel->keys.count)) {
+		compact_keys(kernel);
+		goto done;
+	}
+
+	char *log = string("%s.log", file);
+	FILE *io = fopen(log, "a");
+	if (!io) {
+		logger(LOG_ERR, "kernel failed to open keys log %s for writing: %s",
+				log, strerror(errno));
+		free(log);
+		compact_keys(kernel);
+		goto done;
+	}
+
+	logger(LOG_INFO, "logging %i changed keys to %s", kernel->keys.n, log);
+	char *key, *value, *x;
+	for_each_key_value(&kernel->keys.dirty, key, x) {
+		if (!x) continue;
+		value = hash_get(&kernel->server->keys, key);
+		if (value)
+			fprintf(io, "%s = %s\n", key, value);
+		else
+			fprintf(io, "- %s\n", key);
+	}
+	if (fclose(io) != 0) {
+		/* we can't trust the log any more; replace it */
+		logger(LOG_ERR, "kernel failed to write keys log %s: %s",
+				log, strerror(errno));
+		free(log);
+		compact_keys(kernel);
+		goto done;
+	}
+	free(log);
+	kernel->keys.logged += kernel->keys.n;
+
+done:
+	hash_done(&kernel->keys.dirty, 0);
+	memset(&kernel->keys.dirty, 0, sizeof(hash_t));
+	kernel->keys.n = 0;
+}
+/* }}} */
+static void compact_keys(kernel_t *kernel) /* {{{ */
+{
+	const char *file = kernel->server->config.keysfile;
+	if (save_keys(&kernel->server->keys, file) != 0)
+		return; /* keep logging until we can */
+
+	char *log = string("%s.log", file);
+	if (unlink(log) != 0 && errno != ENOENT)
+		logger(LOG_WARNING, "kernel failed to remove keys log %s: %s",
+				log, strerror(errno));
+	free(log);
+
+	kernel->keys.logged = 0;
+}
+/* }}} */
+typedef struct {
+	pcre       *re;
+	pcre_extra *re_extra;
+	strings_t  *names;
+} matching_t;
+
+static int _matching(const char *name, uint16_t bits, void *udata)
+{
+	matching_t *m = (matching_t*)udata;
+	if (pcre_exec(m->re, m->re_extra, name, strlen(name), 0, 0, NULL, 0) == 0)
+		strings_add(m->names, (char*)name);
+	return 0;
+}
+
+typedef struct {
+	db_t *db;
+	FILE *io;
+} dump_t;
+
+static int _dump_state(const char *name, uint16_t bits, void *udata)
+{
+	dump_t  *d     = (dump_t*)udata;
+	state_t *state = hash_get(&d->db->states, name);
+	if (!state)
+		return 0;
+
+	fprintf(d->io, "%s:\n", name);
+	fprintf(d->io, "  status:    %s\n", statstr(state->status));
+	fprintf(d->io, "  message:   %s\n", state->summary);
+	fprintf(d->io, "  last_seen: %i\n", state->last_seen);
+	fprintf(d->io, "  fresh:     %s\n", state->stale ? "no" : "yes");
+	return 0;
+}
+
+static strings_t* matching(trie_t *names, uint16_t bits, const char *pattern, pcre *re, pcre_extra *re_extra) /* {{{ */
+{
+	/* anchored patterns only need to look under their literal prefix */
+	char prefix[256];
+	re_prefix(pattern, prefix, sizeof(prefix));
+
+	matching_t m = { re, re_extra, strings_new(NULL) };
+	trie_walk(names, prefix, bits, _matching, &m);
+	logger(LOG_DEBUG, "%lu names matched m/%s/ (under prefix '%s')", m.names->num, pattern, prefix);
+	return m.names;
+}
+/* }}} */
 
 static void check_freshness(kernel_t *kernel) /* {{{ */
 {
@@ -291,6 +1129,7 @@ static void check_freshness(kernel_t *kernel) /* {{{ */
 		state->status  = state->type->status;
 		free(state->summary);
 		state->summary = strdup(state->type->summary);
+		mark_dirty(state);
 
 		if (transition)
 			broadcast_transition(kernel, state);
@@ -299,78 +1138,464 @@ static void check_freshness(kernel_t *kernel) /* {{{ */
 }
 /* }}} */
 
-static void event_free(event_t *ev) /* {{{ */
-{
-	if (!ev) return;
-	list_delete(&ev->l);
-	free(ev->name);
-	free(ev->extra);
-	free(ev);
-}
-/* }}} */
 static void buffer_event(db_t *db, event_t *ev, int max, int keep) /* {{{ */
 {
-	if (max > 0) {
-		list_push(&db->events, &ev->l);
-		db->events_count++;
-
-		if (keep == EVENTS_KEEP_NUMBER) {
-			while (db->events_count > max) {
-				event_free(list_head(&db->events, event_t, l));
-				db->events_count--;
-			}
+	if (max <= 0)
+		return;
 
-		} else {
-			int32_t now  = ev->timestamp;
+	if (keep == EVENTS_KEEP_NUMBER) {
+		/* the ring never needs to get any bigger than this */
+		ring_reserve(&db->events, max);
+		while (db->events.n >= (size_t)max)
+			ring_shift(&db->events);
+		ring_push(&db->events, ev->timestamp, ev->name, ev->extra);
 
-			for (;;) {
-				ev = list_head(&db->events, event_t, l);
-				if (ev->timestamp > now - max) break;
-				event_free(ev);
-				db->events_count--;
-			}
-		}
+	} else {
+		ring_push(&db->events, ev->timestamp, ev->name, ev->extra);
+		while (db->events.n > 0
+		    && ring_get(&db->events, 0)->timestamp <= ev->timestamp - max)
+			ring_shift(&db->events);
 	}
 }
 /* }}} */
-
-/*************************************************************************/
-
-static int core_connect_scheduler(void *zmq, void **zocket) /* {{{ */
+static void events_dump(ring_t *events, int32_t since, pcre *re, pcre_extra *re_extra, FILE *io) /* {{{ */
 {
-	assert(zmq != NULL);
-	assert(zocket != NULL);
+	size_t i;
 
-	int rc;
+	fprintf(io, "---\n");
+	fprintf(io, "# generated by bolo\n");
 
-	*zocket = zmq_socket(zmq, ZMQ_SUB);
-	if (!*zocket)
-		return -1;
+	for (i = ring_since(events, since); i < events->n; i++) {
+		ring_entry_t *e = ring_get(events, i);
+		const char *name = ring_name(events, e);
 
-	rc = zmq_connect(*zocket, "inproc://bolo/v1/scheduler.tick");
-	if (rc != 0)
-		return rc;
+		/* timestamps can go backwards; ring_since() can only
+		   skip the ones that are older than everything before */
+		if (e->timestamp < since)
+			continue;
+		if (re && pcre_exec(re, re_extra, name, strlen(name), 0, 0, NULL, 0) != 0)
+			continue;
 
-	rc = zmq_setsockopt(*zocket, ZMQ_SUBSCRIBE, "", 0);
-	if (rc != 0)
-		return rc;
+		fprintf(io, "- name:  %s\n", name);
+		fprintf(io, "  when:  %i\n", e->timestamp);
+		fprintf(io, "  extra: %s\n", ring_extra(events, e));
+	}
+}
+/* }}} */
 
-	return 0;
+static const char * trace_rule(kernel_t *kernel, const char *pdu, type_t *type, window_t *window) /* {{{ */
+{
+	char *rule = kernel->trace.rule;
+	size_t n = sizeof(kernel->trace.rule);
+
+	if (type)
+		snprintf(rule, n, "%s %s", pdu, type->name);
+	else if (window && window->name)
+		snprintf(rule, n, "%s %s", pdu, window->name);
+	else if (window)
+		snprintf(rule, n, "%s %is", pdu, window->time);
+	else
+		snprintf(rule, n, "%s", pdu);
+	return rule;
 }
 /* }}} */
-static int core_connect_supervisor(void *zmq, void **zocket) /* {{{ */
+static void trace_lag(kernel_t *kernel, const char *rule, int which, int32_t ts, uint64_t now) /* {{{ */
 {
-	assert(zmq != NULL);
-	assert(zocket != NULL);
+	trace_t *t = hash_get(&kernel->trace.lags, rule);
+	if (!t) {
+		t = vmalloc(sizeof(trace_t));
+		hash_set(&kernel->trace.lags, rule, t);
+	}
 
-	int rc;
+	trace_lag_t *lag = which == TRACE_RECEIVED ? &t->received : &t->broadcast;
+	uint64_t ms = 0, v;
+	int b = 0;
 
-	*zocket = zmq_socket(zmq, ZMQ_SUB);
-	if (!*zocket)
-		return -1;
+	/* client timestamps only have second resolution */
+	if ((uint64_t)ts * 1000 > now)
+		lag->skewed++;
+	else
+		ms = now - (uint64_t)ts * 1000;
 
-	rc = zmq_connect(*zocket, "inproc://bolo/v1/supervisor.command");
-	if (rc != 0)
+	for (v = ms; v && b < TRACE_BUCKETS - 1; v >>= 1)
+		b++;
+
+	lag->n++;
+	lag->sum += ms;
+	lag->bucket[b]++;
+	if (ms > lag->max)
+		lag->max = ms;
+}
+/* }}} */
+static uint64_t trace_pct(trace_lag_t *lag, double pct) /* {{{ */
+{
+	uint64_t want = lag->n * pct, seen = 0;
+	int b;
+
+	if (want < 1)
+		want = 1;
+	for (b = 0; b < TRACE_BUCKETS - 1; b++) {
+		seen += lag->bucket[b];
+		if (seen >= want)
+			return min(lag->max, (1ul << b));
+	}
+	return lag->max;
+}
+/* }}} */
+static void trace_dump(kernel_t *kernel, FILE *io) /* {{{ */
+{
+	fprintf(io, "trace:\n");
+	fprintf(io, "  rate:    %g\n", kernel->server->config.trace_rate);
+	fprintf(io, "  sampled: %lu\n", kernel->trace.sampled);
+	fprintf(io, "  lag:\n");
+
+	char *rule; trace_t *t;
+	for_each_key_value(&kernel->trace.lags, rule, t) {
+		fprintf(io, "    \"%s\":\n", rule);
+
+		int i;
+		for (i = 0; i < 2; i++) {
+			trace_lag_t *lag = i == 0 ? &t->received : &t->broadcast;
+			if (lag->n == 0)
+				continue;
+
+			fprintf(io, "      %s:\n", i == 0 ? "received" : "broadcast");
+			fprintf(io, "        n:       %lu\n", lag->n);
+			fprintf(io, "        skewed:  %lu\n", lag->skewed);
+			fprintf(io, "        mean_ms: %.1f\n", lag->sum * 1.0 / lag->n);
+			fprintf(io, "        p50_ms:  %lu\n", trace_pct(lag, 0.50));
+			fprintf(io, "        p90_ms:  %lu\n", trace_pct(lag, 0.90));
+			fprintf(io, "        p99_ms:  %lu\n", trace_pct(lag, 0.99));
+			fprintf(io, "        max_ms:  %lu\n", lag->max);
+		}
+	}
+}
+/* }}} */
+
+static void topk_hit(kernel_t *kernel, int list, const char *name, uint32_t hash) /* {{{ */
+{
+	if (kernel->server->config.topk_size > 0)
+		topk_add_hashed(&kernel->topk.lists[kernel->topk.cur][list], name, hash);
+}
+/* }}} */
+static void topk_rotate(kernel_t *kernel, int32_t now) /* {{{ */
+{
+	int i;
+	kernel->topk.cur ^= 1;
+	for (i = 0; i < TOPK_LISTS; i++)
+		topk_reset(&kernel->topk.lists[kernel->topk.cur][i]);
+	kernel->topk.since[kernel->topk.cur] = now;
+}
+/* }}} */
+static void topk_dump(kernel_t *kernel, FILE *io) /* {{{ */
+{
+	int gen, i, j, n;
+	for (gen = 0; gen < 2; gen++) {
+		int g = gen == 0 ? kernel->topk.cur : kernel->topk.cur ^ 1;
+		if (!kernel->topk.since[g])
+			continue;
+
+		fprintf(io, "%s:\n", gen == 0 ? "current" : "previous");
+		fprintf(io, "  since: %i\n", kernel->topk.since[g]);
+		if (gen == 1)
+			fprintf(io, "  until: %i\n", kernel->topk.since[kernel->topk.cur]);
+
+		for (i = 0; i < TOPK_LISTS; i++) {
+			topk_t *t = &kernel->topk.lists[g][i];
+			topk_entry_t **list;
+			if ((n = topk_sorted(t, &list)) < 0)
+				continue;
+
+			fprintf(io, "  %s:\n", TOPK_NAMES[i]);
+			fprintf(io, "    total: %lu\n", t->total);
+			fprintf(io, "    top:\n");
+			for (j = 0; j < n; j++) {
+				fprintf(io, "      - name:  %s\n", list[j]->name);
+				fprintf(io, "        count: %lu\n", list[j]->count);
+				fprintf(io, "        error: %lu\n", list[j]->error);
+			}
+			free(list);
+		}
+	}
+}
+/* }}} */
+static void evict_reset(kernel_t *kernel) /* {{{ */
+{
+	kernel->evict.counters = &kernel->server->db.auto_counters;
+	kernel->evict.samples  = &kernel->server->db.auto_samples;
+	kernel->evict.rates    = &kernel->server->db.auto_rates;
+}
+/* }}} */
+/* visit at most n records of an auto list, starting at the hand,
+   releasing those that have been idle too long and have no data
+   waiting for their window to close */
+#define EVICT_SWEEP(kernel,T,what,release,list,hand,n,now) do { \
+	int _n = (n); \
+	while (_n-- > 0 && !list_isempty(list)) { \
+		(hand) = (hand)->next; \
+		if ((hand) == (list)) \
+			continue; \
+		T *_x = list_object((hand), T, l); \
+		if (_x->last_seen != 0 \
+		 || (now) - _x->active <= (kernel)->server->config.evict_idle * _x->window->time) \
+			continue; \
+		(hand) = (hand)->prev; \
+		logger(LOG_DEBUG, "evicting idle " what " %s", _x->name); \
+		release(&(kernel)->server->db, _x); \
+		(kernel)->server->db.limit.evicted++; \
+	} \
+} while (0)
+static void evict_idle(kernel_t *kernel, int32_t now) /* {{{ */
+{
+	/* about a minute of ticks to get around a busy list, but always
+	   make some headway on small ones */
+	db_t *db = &kernel->server->db;
+	int n = max(1000, db->limit.count / 60);
+
+	EVICT_SWEEP(kernel, counter_t, "counter", release_counter, &db->auto_counters, kernel->evict.counters, n, now);
+	EVICT_SWEEP(kernel, sample_t,  "sample",  release_sample,  &db->auto_samples,  kernel->evict.samples,  n, now);
+	EVICT_SWEEP(kernel, rate_t,    "rate",    release_rate,    &db->auto_rates,    kernel->evict.rates,    n, now);
+}
+/* }}} */
+static void metrics_dump(kernel_t *kernel, FILE *io) /* {{{ */
+{
+	db_t *db = &kernel->server->db;
+	fprintf(io, "metrics:\n");
+	fprintf(io, "  auto:     %i\n",  db->limit.count);
+	fprintf(io, "  limit:    %i\n",  db->limit.metrics);
+	fprintf(io, "  overflow: %s\n",  db->limit.overflow == LIMIT_FOLD ? "fold" : "reject");
+	fprintf(io, "  created:  %lu\n", db->limit.created);
+	fprintf(io, "  evicted:  %lu\n", db->limit.evicted);
+	fprintf(io, "  rejected: %lu\n", db->limit.rejected);
+	fprintf(io, "  folded:   %lu\n", db->limit.folded);
+
+	fprintf(io, "savefile:\n");
+	fprintf(io, "  saves:    %lu\n", db->save.saves);
+	fprintf(io, "  rewrites: %lu\n", db->save.rewrites);
+	fprintf(io, "  slots:    %u\n",  db->save.n);
+	fprintf(io, "  size:     %lu\n", db->save.end);
+	fprintf(io, "  free:     %lu\n", db->save.free);
+	fprintf(io, "  written:  %lu\n", db->save.bytes);
+	fprintf(io, "  total:    %lu\n", db->save.total);
+
+	if (kernel->upstream) {
+		fprintf(io, "upstream:\n");
+		fprintf(io, "  endpoint:  %s\n",  kernel->server->config.upstream);
+		fprintf(io, "  forwarded: %lu\n", kernel->forward.forwarded);
+		fprintf(io, "  dropped:   %lu\n", kernel->forward.dropped);
+	}
+
+	if (kernel->tsdp) {
+		fprintf(io, "tsdp:\n");
+		fprintf(io, "  endpoint: %s\n",  kernel->server->config.broadcast_tsdp);
+		fprintf(io, "  skipped:  %lu\n", kernel->tsdp_skipped);
+	}
+
+	if (kernel->replicas) {
+		fprintf(io, "replication:\n");
+		fprintf(io, "  endpoint: %s\n",  kernel->server->config.replication);
+		fprintf(io, "  batches:  %lu\n", kernel->replica.seq);
+		fprintf(io, "  sent:     %lu\n", kernel->replica.sent);
+	}
+	if (kernel->decoders) {
+		listener_stats_t *decoders = kernel->decoders;
+		fprintf(io, "listener:\n");
+		fprintf(io, "  threads: %i\n",  decoders->threads);
+		fprintf(io, "  failed:  %lu\n", __atomic_load_n(&decoders->failed, __ATOMIC_SEQ_CST));
+	}
+	if (kernel->udp) {
+		udp_stats_t *udp = kernel->udp;
+		fprintf(io, "udp:\n");
+		fprintf(io, "  port:        %u\n",  udp->port);
+		fprintf(io, "  datagrams:   %lu\n", __atomic_load_n(&udp->datagrams,   __ATOMIC_SEQ_CST));
+		fprintf(io, "  batches:     %lu\n", __atomic_load_n(&udp->batches,     __ATOMIC_SEQ_CST));
+		fprintf(io, "  submissions: %lu\n", __atomic_load_n(&udp->submissions, __ATOMIC_SEQ_CST));
+		fprintf(io, "  malformed:   %lu\n", __atomic_load_n(&udp->malformed,   __ATOMIC_SEQ_CST));
+		fprintf(io, "  truncated:   %lu\n", __atomic_load_n(&udp->truncated,   __ATOMIC_SEQ_CST));
+		fprintf(io, "  overflowed:  %lu\n", __atomic_load_n(&udp->overflowed,  __ATOMIC_SEQ_CST));
+		fprintf(io, "  failed:      %lu\n", __atomic_load_n(&udp->failed,      __ATOMIC_SEQ_CST));
+	}
+	if (kernel->shm) {
+		shm_stats_t *shm = kernel->shm;
+		fprintf(io, "shm:\n");
+		fprintf(io, "  ring:        %s\n",  kernel->server->config.shm_ring);
+		fprintf(io, "  submissions: %lu\n", __atomic_load_n(&shm->submissions, __ATOMIC_SEQ_CST));
+		fprintf(io, "  batches:     %lu\n", __atomic_load_n(&shm->batches,     __ATOMIC_SEQ_CST));
+		fprintf(io, "  wakeups:     %lu\n", __atomic_load_n(&shm->wakeups,     __ATOMIC_SEQ_CST));
+		fprintf(io, "  malformed:   %lu\n", __atomic_load_n(&shm->malformed,   __ATOMIC_SEQ_CST));
+		fprintf(io, "  full:        %lu\n", __atomic_load_n(&shm->full,        __ATOMIC_SEQ_CST));
+	}
+	if (kernel->primary) {
+		fprintf(io, "standby:\n");
+		fprintf(io, "  primary:  %s\n",  kernel->server->config.standby_for);
+		fprintf(io, "  active:   %s\n",  kernel->replica.standby ? "no" : "yes");
+		fprintf(io, "  heard:    %i\n",  kernel->replica.heard);
+		fprintf(io, "  batches:  %lu\n", kernel->replica.last);
+		fprintf(io, "  applied:  %lu\n", kernel->replica.applied);
+		fprintf(io, "  missed:   %lu\n", kernel->replica.missed);
+	}
+}
+/* }}} */
+static void snapshot_free(snapshot_t *snap) /* {{{ */
+{
+	size_t i;
+	for (i = 0; i < snap->nstates; i++) {
+		free(snap->states[i].name);
+		free(snap->states[i].summary);
+	}
+	for (i = 0; i < snap->nkeys; i++) {
+		free(snap->keys[i].key);
+		free(snap->keys[i].value);
+	}
+	free(snap->states);
+	free(snap->keys);
+	ring_done(&snap->events);
+	free(snap);
+}
+/* }}} */
+typedef struct {
+	server_t   *server;
+	snapshot_t *snap;
+	size_t      cap;
+} snapshot_take_t;
+
+static int _snapshot_state(const char *name, uint16_t bits, void *udata)
+{
+	snapshot_take_t *t = (snapshot_take_t*)udata;
+	state_t *state = hash_get(&t->server->db.states, name);
+	if (!state)
+		return 0;
+
+	if (t->snap->nstates == t->cap) {
+		t->cap = t->cap ? t->cap * 2 : 64;
+		t->snap->states = realloc(t->snap->states, t->cap * sizeof(snap_state_t));
+	}
+	snap_state_t *x = &t->snap->states[t->snap->nstates++];
+	x->name      = strdup(name);
+	x->summary   = strdup(state->summary);
+	x->last_seen = state->last_seen;
+	x->status    = state->status;
+	x->stale     = state->stale;
+	return 0;
+}
+
+static int _snapshot_key(const char *key, uint16_t bits, void *udata)
+{
+	snapshot_take_t *t = (snapshot_take_t*)udata;
+	char *value = hash_get(&t->server->keys, key);
+	if (!value)
+		return 0;
+
+	if (t->snap->nkeys == t->cap) {
+		t->cap = t->cap ? t->cap * 2 : 64;
+		t->snap->keys = realloc(t->snap->keys, t->cap * sizeof(snap_key_t));
+	}
+	snap_key_t *x = &t->snap->keys[t->snap->nkeys++];
+	x->key   = strdup(key);
+	x->value = strdup(value);
+	return 0;
+}
+
+static snapshot_t* snapshot_take(server_t *server) /* {{{ */
+{
+	snapshot_take_t t = { server, calloc(1, sizeof(snapshot_t)), 0 };
+
+	/* the name indexes are already in order */
+	trie_walk(&server->db.names, "", PAYLOAD_STATE, _snapshot_state, &t);
+	t.cap = 0;
+	trie_walk(&server->keynames, "", 1, _snapshot_key, &t);
+
+	ring_copy(&t.snap->events, &server->db.events);
+
+	return t.snap;
+}
+/* }}} */
+static void snapshot_publish(kernel_t *kernel) /* {{{ */
+{
+	snapshots_t *s = kernel->snapshots;
+	snapshot_t *snap = snapshot_take(kernel->server);
+
+	snap = __atomic_exchange_n(&s->current, snap, __ATOMIC_SEQ_CST);
+	snap->retired = __atomic_fetch_add(&s->epoch, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&s->stale, 0, __ATOMIC_SEQ_CST);
+	snap->next = s->retired;
+	s->retired = snap;
+	kernel->dirty = 0;
+
+	/* free whatever no reader can still be looking at */
+	uint64_t oldest = UINT64_MAX;
+	int i;
+	for (i = 0; i < s->readers; i++) {
+		uint64_t e = __atomic_load_n(&s->active[i], __ATOMIC_SEQ_CST);
+		if (e && e < oldest)
+			oldest = e;
+	}
+
+	snapshot_t **x = &s->retired;
+	while (*x) {
+		if ((*x)->retired < oldest) {
+			snap = *x;
+			*x = snap->next;
+			snapshot_free(snap);
+		} else {
+			x = &(*x)->next;
+		}
+	}
+}
+/* }}} */
+static void snapshots_release(snapshots_t *s) /* {{{ */
+{
+	if (__atomic_sub_fetch(&s->refs, 1, __ATOMIC_SEQ_CST) != 0)
+		return;
+
+	snapshot_t *snap;
+	while ((snap = s->retired) != NULL) {
+		s->retired = snap->next;
+		snapshot_free(snap);
+	}
+	snapshot_free(s->current);
+	free(s->active);
+	free(s);
+}
+/* }}} */
+
+/*************************************************************************/
+
+static int core_connect_scheduler(void *zmq, void **zocket) /* {{{ */
+{
+	assert(zmq != NULL);
+	assert(zocket != NULL);
+
+	int rc;
+
+	*zocket = zmq_socket(zmq, ZMQ_SUB);
+	if (!*zocket)
+		return -1;
+
+	rc = zmq_connect(*zocket, "inproc://bolo/v1/scheduler.tick");
+	if (rc != 0)
+		return rc;
+
+	rc = zmq_setsockopt(*zocket, ZMQ_SUBSCRIBE, "", 0);
+	if (rc != 0)
+		return rc;
+
+	return 0;
+}
+/* }}} */
+static int core_connect_supervisor(void *zmq, void **zocket) /* {{{ */
+{
+	assert(zmq != NULL);
+	assert(zocket != NULL);
+
+	int rc;
+
+	*zocket = zmq_socket(zmq, ZMQ_SUB);
+	if (!*zocket)
+		return -1;
+
+	rc = zmq_connect(*zocket, "inproc://bolo/v1/supervisor.command");
+	if (rc != 0)
 		return rc;
 
 	rc = zmq_setsockopt(*zocket, ZMQ_SUBSCRIBE, "", 0);
@@ -452,6 +1677,16 @@ int core_scheduler_thread(void *zmq, int interval) /* {{{ */
 
 /*************************************************************************/
 
+/* a binary TSDP PDU comes in as a single frame, and its first octet
+   (version, in the upper nibble, and opcode) is never anything that
+   could start the type name of a textual PDU. */
+static int _pdu_is_tsdp(pdu_t *pdu)
+{
+	return pdu_size(pdu) == 1
+	    && pdu_segment_size(pdu, 0) >= 4
+	    && (pdu_segment(pdu, 0)[0] >> 4) == TSDP_VERSION;
+}
+
 static int _pdu_is(pdu_t *pdu, const char *type, int min, int max)
 {
 	assert(pdu != NULL);
@@ -462,31 +1697,1921 @@ static int _pdu_is(pdu_t *pdu, const char *type, int min, int max)
 	return strcmp(pdu_type(pdu), type) == 0;
 }
 
-static void * _kernel_thread(void *_) /* {{{ */
-{
-	assert(_ != NULL);
+/*************************************************************************/
+
+static void reader_refresh(reader_t *reader)
+{
+	/* the kernel only takes a new snapshot when asked */
+	if (pdu_send_and_free(pdu_make("SNAPSHOT", 0), reader->kernel) != 0)
+		return;
+
+	/* (nothing comes back if we are shutting down) */
+	pdu_t *r = pdu_recv(reader->kernel);
+	if (r)
+		pdu_free(r);
+}
+
+static snapshot_t* reader_enter(reader_t *reader)
+{
+	snapshots_t *s = reader->snapshots;
+	if (__atomic_load_n(&s->stale, __ATOMIC_SEQ_CST))
+		reader_refresh(reader);
+
+	__atomic_store_n(&s->active[reader->id],
+		__atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&s->current, __ATOMIC_SEQ_CST);
+}
+
+static void reader_leave(reader_t *reader)
+{
+	__atomic_store_n(&reader->snapshots->active[reader->id], 0, __ATOMIC_SEQ_CST);
+}
+
+static int _by_name(const void *k, const void *x)
+{
+	/* snap_state_t and snap_key_t both lead with their name */
+	return strcmp((const char *)k, *(char * const *)x);
+}
+
+static pdu_t* yaml_reply(pdu_t *pdu, const char *type, FILE *io) /* {{{ */
+{
+	pdu_t *a;
+
+	fflush(io);
+	int fd = fileno(io);
+	long off = lseek(fd, 0, SEEK_END);
+	lseek(fd, 0, SEEK_SET);
+
+	char *data = mmap(NULL, off, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		a = pdu_reply(pdu, "ERROR", 1, "Internal error");
+
+	} else {
+		a = pdu_reply(pdu, type, 1, data);
+		munmap(data, off);
+	}
+
+	fclose(io);
+	return a;
+}
+/* }}} */
+static pdu_t* reader_forward(reader_t *reader, pdu_t *pdu) /* {{{ */
+{
+	char *s;
+	int i;
+
+	pdu_t *q = pdu_make(pdu_type(pdu), 0);
+	for (i = 1; i < pdu_size(pdu); i++) {
+		pdu_extendf(q, "%s", s = pdu_string(pdu, i));
+		free(s);
+	}
+	if (pdu_send_and_free(q, reader->kernel) != 0)
+		return pdu_reply(pdu, "ERROR", 1, "Internal error");
+
+	/* the kernel answers every management request, so this
+	   only comes back empty-handed if we are shutting down */
+	pdu_t *r = pdu_recv(reader->kernel);
+	if (!r)
+		return NULL;
+
+	pdu_t *a = pdu_reply(pdu, pdu_type(r), 0);
+	for (i = 1; i < pdu_size(r); i++) {
+		pdu_extendf(a, "%s", s = pdu_string(r, i));
+		free(s);
+	}
+	pdu_free(r);
+	return a;
+}
+/* }}} */
+static pdu_t* reader_answer(reader_t *reader, pdu_t *pdu) /* {{{ */
+{
+	snapshot_t *snap;
+	pdu_t *a;
+	size_t i;
+
+	/* [ STATE | name ] {{{ */
+	if (_pdu_is(pdu, "STATE", 2, 2)) {
+		char *name = pdu_string(pdu, 1);
+		snap = reader_enter(reader);
+		snap_state_t *state = bsearch(name, snap->states, snap->nstates, sizeof(snap_state_t), _by_name);
+		if (!state) {
+			a = pdu_reply(pdu, "ERROR", 1, "State Not Found");
+		} else {
+			a = pdu_reply(pdu, "STATE", 1, name);
+			pdu_extendf(a, "%i", state->last_seen);
+			pdu_extendf(a, "%s", state->stale ? "stale" : "fresh");
+			pdu_extendf(a, "%s", statstr(state->status));
+			pdu_extendf(a, "%s", state->summary);
+		}
+		reader_leave(reader);
+		free(name);
+		return a;
+	}
+	/* }}} */
+	/* [ DUMP ] {{{ */
+	if (_pdu_is(pdu, "DUMP", 1, 1)) {
+		FILE *io = tmpfile();
+		if (!io) {
+			logger(LOG_ERR, "reader cannot dump state; unable to create temporary file: %s", strerror(errno));
+			return pdu_reply(pdu, "ERROR", 1, "Internal error");
+		}
+
+		fprintf(io, "---\n");
+		fprintf(io, "# generated by bolo\n");
+
+		snap = reader_enter(reader);
+		for (i = 0; i < snap->nstates; i++) {
+			snap_state_t *state = &snap->states[i];
+			fprintf(io, "%s:\n", state->name);
+			fprintf(io, "  status:    %s\n", statstr(state->status));
+			fprintf(io, "  message:   %s\n", state->summary);
+			fprintf(io, "  last_seen: %i\n", state->last_seen);
+			fprintf(io, "  fresh:     %s\n", state->stale ? "no" : "yes");
+		}
+		reader_leave(reader);
+
+		return yaml_reply(pdu, "DUMP", io);
+	}
+	/* }}} */
+	/* [ GET.KEYS | name+ ] {{{ */
+	if (_pdu_is(pdu, "GET.KEYS", 2, 0)) {
+		a = pdu_reply(pdu, "VALUES", 0);
+		int n;
+
+		snap = reader_enter(reader);
+		for (n = 1; n < pdu_size(pdu); n++) {
+			char *key = pdu_string(pdu, n);
+			snap_key_t *k = bsearch(key, snap->keys, snap->nkeys, sizeof(snap_key_t), _by_name);
+			if (k) {
+				pdu_extendf(a, "%s", k->key);
+				pdu_extendf(a, "%s", k->value);
+			}
+			free(key);
+		}
+		reader_leave(reader);
+		return a;
+	}
+	/* }}} */
+	/* [ SEARCH.KEYS | pattern ] {{{ */
+	if (_pdu_is(pdu, "SEARCH.KEYS", 2, 2)) {
+		const char *re_err;
+		int re_off;
+
+		char *pattern = pdu_string(pdu, 1);
+		pcre *re = pcre_compile(pattern, 0, &re_err, &re_off, NULL);
+		if (!re) {
+			a = pdu_reply(pdu, "ERROR", 1, re_err);
+			free(pattern);
+			return a;
+		}
+		pcre_extra *re_extra = pcre_study(re, 0, &re_err);
+
+		/* keys are sorted, so anchored patterns only need to
+		   look at the run of keys that start with their prefix */
+		char prefix[256];
+		size_t len = re_prefix(pattern, prefix, sizeof(prefix));
+
+		a = pdu_reply(pdu, "KEYS", 0);
+		snap = reader_enter(reader);
+
+		size_t lo = 0, hi = snap->nkeys;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (strcmp(snap->keys[mid].key, prefix) < 0) lo = mid + 1;
+			else                                         hi = mid;
+		}
+		for (i = lo; i < snap->nkeys && strncmp(snap->keys[i].key, prefix, len) == 0; i++) {
+			const char *key = snap->keys[i].key;
+			if (pcre_exec(re, re_extra, key, strlen(key), 0, 0, NULL, 0) == 0)
+				pdu_extendf(a, "%s", key);
+		}
+
+		reader_leave(reader);
+		pcre_free_study(re_extra);
+		pcre_free(re);
+		free(pattern);
+		return a;
+	}
+	/* }}} */
+	/* [ GET.EVENTS | since | pattern? ] {{{ */
+	if (_pdu_is(pdu, "GET.EVENTS", 2, 3)) {
+		char *s = pdu_string(pdu, 1); int32_t since = strtol(s, NULL, 10); free(s);
+
+		pcre *re = NULL;
+		pcre_extra *re_extra = NULL;
+		if (pdu_size(pdu) == 3) {
+			const char *re_err;
+			int re_off;
+
+			char *pattern = pdu_string(pdu, 2);
+			re = pcre_compile(pattern, 0, &re_err, &re_off, NULL);
+			free(pattern);
+			if (!re)
+				return pdu_reply(pdu, "ERROR", 1, re_err);
+			re_extra = pcre_study(re, 0, &re_err);
+		}
+
+		FILE *io = tmpfile();
+		if (!io) {
+			logger(LOG_ERR, "reader cannot dump events; unable to create temporary file: %s", strerror(errno));
+			if (re) {
+				pcre_free_study(re_extra);
+				pcre_free(re);
+			}
+			return pdu_reply(pdu, "ERROR", 1, "Internal error");
+		}
+
+		snap = reader_enter(reader);
+		events_dump(&snap->events, since, re, re_extra, io);
+		reader_leave(reader);
+
+		if (re) {
+			pcre_free_study(re_extra);
+			pcre_free(re);
+		}
+		return yaml_reply(pdu, "EVENTS", io);
+	}
+	/* }}} */
+
+	/* everything else needs the kernel */
+	return reader_forward(reader, pdu);
+}
+/* }}} */
+static void * _reader_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	reader_t *reader = (reader_t*)_;
+
+	zmq_pollitem_t poller[2] = {
+		{ reader->control, 0, ZMQ_POLLIN, 0 },
+		{ reader->queries, 0, ZMQ_POLLIN, 0 },
+	};
+	while (zmq_poll(poller, 2, -1) >= 0) {
+		if (poller[0].revents & ZMQ_POLLIN) {
+			logger(LOG_DEBUG, "reader %i received TERMINATE", reader->id);
+			break;
+		}
+		if (!(poller[1].revents & ZMQ_POLLIN))
+			continue;
+
+		/* requests come from the proxy, with the client's
+		   identity out front; it has to go back out first */
+		zmq_msg_t peer;
+		zmq_msg_init(&peer);
+		if (zmq_msg_recv(&peer, reader->queries, 0) < 0) {
+			zmq_msg_close(&peer);
+			break;
+		}
+
+		pdu_t *pdu = pdu_recv(reader->queries);
+		if (!pdu) {
+			zmq_msg_close(&peer);
+			break;
+		}
+
+		pdu_t *a = reader_answer(reader, pdu);
+		pdu_free(pdu);
+		if (!a) {
+			zmq_msg_close(&peer);
+			break;
+		}
+
+		zmq_msg_send(&peer, reader->queries, ZMQ_SNDMORE);
+		pdu_send_and_free(a, reader->queries);
+	}
+
+	logger(LOG_DEBUG, "reader %i: shutting down", reader->id);
+
+	zmq_close(reader->control);
+	zmq_close(reader->queries);
+	zmq_close(reader->kernel);
+	snapshots_release(reader->snapshots);
+	free(reader);
+
+	return NULL;
+}
+/* }}} */
+static void * _proxy_thread(void *_) /* {{{ */
+{
+	void **z = (void **)_;
+
+	/* runs until the context is terminated */
+	zmq_proxy(z[0], z[1], NULL);
+
+	zmq_close(z[0]);
+	zmq_close(z[1]);
+	free(z);
+	return NULL;
+}
+/* }}} */
+static int core_reader_threads(void *zmq, kernel_t *kernel) /* {{{ */
+{
+	server_t *server = kernel->server;
+	int rc, i, n = server->config.query_threads;
+
+	snapshots_t *s = vmalloc(sizeof(snapshots_t));
+	s->readers = n;
+	s->active  = calloc(n, sizeof(uint64_t));
+	s->epoch   = 1;
+	s->refs    = n + 1;
+	s->current = snapshot_take(server);
+	kernel->snapshots = s;
+
+	void **z = calloc(2, sizeof(void *));
+	logger(LOG_DEBUG, "kernel: binding management ROUTER socket to %s, for %i reader(s)",
+		server->config.controller, n);
+	z[0] = zmq_socket(zmq, ZMQ_ROUTER);
+	if (!z[0])
+		return -1;
+	rc = zmq_bind(z[0], server->config.controller);
+	if (rc != 0)
+		return rc;
+
+	z[1] = zmq_socket(zmq, ZMQ_DEALER);
+	if (!z[1])
+		return -1;
+	rc = zmq_bind(z[1], "inproc://bolo/v1/management.readers");
+	if (rc != 0)
+		return rc;
+
+	for (i = 0; i < n; i++) {
+		reader_t *reader = vmalloc(sizeof(reader_t));
+		reader->id = i;
+		reader->snapshots = s;
+
+		rc = core_connect_supervisor(zmq, &reader->control);
+		if (rc != 0)
+			return rc;
+
+		reader->queries = zmq_socket(zmq, ZMQ_DEALER);
+		if (!reader->queries)
+			return -1;
+		rc = zmq_connect(reader->queries, "inproc://bolo/v1/management.readers");
+		if (rc != 0)
+			return rc;
+
+		reader->kernel = zmq_socket(zmq, ZMQ_DEALER);
+		if (!reader->kernel)
+			return -1;
+		rc = zmq_connect(reader->kernel, "inproc://bolo/v1/kernel.management");
+		if (rc != 0)
+			return rc;
+
+		pthread_t tid;
+		rc = pthread_create(&tid, NULL, _reader_thread, reader);
+		if (rc != 0)
+			return rc;
+	}
+
+	pthread_t tid;
+	rc = pthread_create(&tid, NULL, _proxy_thread, z);
+	if (rc != 0)
+		return rc;
+
+	return 0;
+}
+/* }}} */
+
+/*************************************************************************/
+
+static char* _tsdp_string(const tsdp_t *t, int i, char **s) /* {{{ */
+{
+	/* copy frame i out to *s (and move *s past it), if it is a
+	   STRING that can be one; see update_tsdp() */
+	const void *v;
+	int len;
+	if (tsdp_get_frame_view(t, i, TSDP_TYPE_STRING, &v, &len) != 0
+	 || memchr(v, '\0', len) != NULL)
+		return NULL;
+
+	char *str = *s;
+	memcpy(str, v, len);
+	str[len] = '\0';
+	*s += len + 1;
+	return str;
+}
+/* }}} */
+static update_t* update_tsdp(const tsdp_t *t, uint64_t traced) /* {{{ */
+{
+	int type = UPDATE_NONE, min = 3, max = 3;
+	int n = tsdp_get_size(t);
+	if (tsdp_get_opcode(t) == TSDP_OP_SUBMIT) {
+		switch (tsdp_get_payloads(t)) {
+		case TSDP_PAYLOAD_STATE:  type = UPDATE_STATE;                      break;
+		case TSDP_PAYLOAD_TALLY:  type = UPDATE_COUNTER;                    break;
+		case TSDP_PAYLOAD_SAMPLE: type = UPDATE_SAMPLE;   max = 0;          break;
+		case TSDP_PAYLOAD_DELTA:  type = UPDATE_RATE;                       break;
+		case TSDP_PAYLOAD_EVENT:  type = UPDATE_EVENT;                      break;
+		case TSDP_PAYLOAD_FACT:   type = UPDATE_SET_KEYS; min = 2; max = 0; break;
+		}
+	}
+	if (type == UPDATE_NONE || n < min || (max && n > max)
+	 || (type == UPDATE_SET_KEYS && n % 2 != 0)) {
+		logger(LOG_WARNING, "unhandled TSDP [%s] PDU (payloads %#x, of %i frames) received on listener port",
+			tsdp_opcode_str(tsdp_get_opcode(t)), tsdp_get_payloads(t), n);
+		return vcalloc(1, sizeof(update_t));
+	}
+
+	/* strings are copied in after the SAMPLE values, as they are
+	   for textual PDUs; numbers go straight into the update_t */
+	size_t len = 0;
+	int i, ok = 1, nvalues = type == UPDATE_SAMPLE ? n - 2 : 0;
+	for (i = 0; i < n; i++)
+		if (tsdp_get_frame_type(t, i) == TSDP_TYPE_STRING)
+			len += tsdp_get_frame_size(t, i) + 1;
+
+	update_t *u = vcalloc(1, sizeof(update_t) + nvalues * sizeof(double) + len);
+	u->traced = traced;
+	u->values = (double *)(u + 1);
+
+	char *s = (char *)(u->values + nvalues);
+	tsdp_tstamp_t ms = 0;
+	uint64_t v = 0;
+	if (type != UPDATE_SET_KEYS) {
+		ok = tsdp_get_tstamp(t, 0, &ms) == 0
+		  && (u->name = _tsdp_string(t, 1, &s)) != NULL;
+		u->ts = ms / 1000;
+	}
+
+	switch (type) {
+	/* [ TSTAMP | name | message ], with the status code in the flags */
+	case UPDATE_STATE:
+		u->code  = tsdp_get_flags(t) & 0x3;
+		ok = ok && (u->extra = _tsdp_string(t, 2, &s)) != NULL && *u->extra;
+		break;
+
+	/* [ TSTAMP | name | UINT increment ] */
+	case UPDATE_COUNTER:
+		ok = ok && tsdp_get_uint(t, 2, &v) == 0;
+		u->i[0] = v;
+		break;
+
+	/* [ TSTAMP | name | FLOAT value+ ] */
+	case UPDATE_SAMPLE:
+		for (i = 0; ok && i < nvalues; i++)
+			ok = tsdp_get_float(t, 2 + i, &u->values[i]) == 0;
+		u->n = nvalues;
+		break;
+
+	/* [ TSTAMP | name | UINT value ] */
+	case UPDATE_RATE:
+		ok = ok && tsdp_get_uint(t, 2, &v) == 0;
+		u->i[0] = v;
+		break;
+
+	/* [ TSTAMP | name | description ] */
+	case UPDATE_EVENT:
+		ok = ok && (u->extra = _tsdp_string(t, 2, &s)) != NULL;
+		break;
+
+	/* [ (key | value)+ ] */
+	case UPDATE_SET_KEYS:
+		u->name = s;
+		for (i = 0; ok && i < n; i++)
+			ok = _tsdp_string(t, i, &s) != NULL;
+		u->n = n / 2;
+		break;
+	}
+
+	if (!ok || (type != UPDATE_EVENT && type != UPDATE_SET_KEYS && !*u->name)) {
+		logger(LOG_WARNING, "received malformed TSDP [SUBMIT] PDU (payloads %#x, of %i frames)",
+			tsdp_get_payloads(t), n);
+		u->type = UPDATE_NONE;
+		return u;
+	}
+
+	u->type = type;
+	u->hash = topk_hash(u->name);
+	return u;
+}
+/* }}} */
+static update_t* update_decode(pdu_t *pdu, uint64_t traced) /* {{{ */
+{
+	if (_pdu_is_tsdp(pdu)) {
+		tsdp_t *t;
+		int rc = tsdp_unpack(&t, pdu_segment(pdu, 0), pdu_segment_size(pdu, 0));
+		if (rc != 0) {
+			logger(LOG_WARNING, "received malformed TSDP PDU (%i octets) on listener port: %s",
+				pdu_segment_size(pdu, 0), -rc <= TSDP_BIGGEST_ERROR ? tsdp_error_str(-rc) : strerror(-rc));
+			return vcalloc(1, sizeof(update_t));
+		}
+		update_t *u = update_tsdp(t, traced);
+		tsdp_destroy(t);
+		return u;
+	}
+
+	int type = UPDATE_NONE;
+	if      (_pdu_is(pdu, "STATE",      5, 5)) type = UPDATE_STATE;
+	else if (_pdu_is(pdu, "COUNTER",    4, 4)) type = UPDATE_COUNTER;
+	else if (_pdu_is(pdu, "SAMPLE",     4, 0)) type = UPDATE_SAMPLE;
+	else if (_pdu_is(pdu, "RATE",       4, 4)) type = UPDATE_RATE;
+	else if (_pdu_is(pdu, "SAMPLE.AGG", 9, 9)) type = UPDATE_SAMPLE_AGG;
+	else if (_pdu_is(pdu, "RATE.AGG",   6, 6)) type = UPDATE_RATE_AGG;
+	else if (_pdu_is(pdu, "EVENT",      4, 4)) type = UPDATE_EVENT;
+	else if (_pdu_is(pdu, "SET.KEYS",   3, 0) && (pdu_size(pdu) - 1) % 2 == 0) type = UPDATE_SET_KEYS;
+	else
+		logger(LOG_WARNING, "unhandled [%s] PDU (of %i frames) received on listener port",
+			pdu_type(pdu), pdu_size(pdu));
+
+	/* every frame (but the type) is copied in as a string,
+	   after the SAMPLE values; see update_t */
+	size_t i, len = 0, nframes = type == UPDATE_NONE ? 0 : pdu_size(pdu);
+	int nvalues = type == UPDATE_SAMPLE ? nframes - 3 : 0;
+	for (i = 1; i < nframes; i++)
+		len += pdu_segment_size(pdu, i) + 1;
+
+	update_t *u = vcalloc(1, sizeof(update_t) + nvalues * sizeof(double) + len);
+	u->traced = traced;
+	u->values = (double *)(u + 1);
+
+	char *f[9] = { NULL }, *s = (char *)(u->values + nvalues);
+	for (i = 1; i < nframes; i++) {
+		size_t n = pdu_segment_size(pdu, i);
+		memcpy(s, pdu_segment(pdu, i), n);
+		s[n] = '\0';
+		if (i < 9)
+			f[i] = s;
+		if (type == UPDATE_SAMPLE && i >= 3)
+			u->values[i - 3] = bolo_strtod(s, NULL);
+		s += n + 1;
+	}
+
+	switch (type) {
+	case UPDATE_NONE:
+		return u;
+
+	/* [ STATE | ts | name | code | message ] */
+	case UPDATE_STATE:
+		u->ts    = bolo_strtou(f[1], NULL);
+		u->name  = f[2];
+		u->code  = bolo_strtoi(f[3], NULL);
+		u->extra = f[4];
+		if (!*u->name || !*u->extra) {
+			logger(LOG_WARNING, "received malformed [STATE] PDU (no %s)",
+				(!*u->name ? "name" : "message"));
+			u->type = UPDATE_NONE;
+			return u;
+		}
+		break;
+
+	/* [ COUNTER | ts | name | increment ] */
+	case UPDATE_COUNTER:
+		u->ts   = bolo_strtou(f[1], NULL);
+		u->name = f[2];
+		u->i[0] = bolo_strtoi(f[3], NULL);
+		break;
+
+	/* [ SAMPLE | ts | name | value+ ] */
+	case UPDATE_SAMPLE:
+		u->ts   = bolo_strtou(f[1], NULL);
+		u->name = f[2];
+		u->n    = nvalues;
+		break;
+
+	/* [ RATE | ts | name | value ] */
+	case UPDATE_RATE:
+		u->ts   = bolo_strtou(f[1], NULL);
+		u->name = f[2];
+		u->i[0] = bolo_strtou(f[3], NULL);
+		break;
+
+	/* [ SAMPLE.AGG | ts | name | n | min | max | sum | mean | var ] */
+	case UPDATE_SAMPLE_AGG:
+		u->ts   = bolo_strtou(f[1], NULL);
+		u->name = f[2];
+		u->i[0] = bolo_strtou(f[3], NULL);
+		for (i = 0; i < 5; i++)
+			u->d[i] = bolo_strtod(f[4 + i], NULL);
+		break;
+
+	/* [ RATE.AGG | ts | name | first-seen | last-seen | diff ] */
+	case UPDATE_RATE_AGG:
+		u->ts   = bolo_strtou(f[1], NULL);
+		u->name = f[2];
+		u->i[0] = bolo_strtoi(f[3], NULL);
+		u->i[1] = bolo_strtoi(f[4], NULL);
+		u->i[2] = bolo_strtou(f[5], NULL);
+		break;
+
+	/* [ EVENT | ts | name | description ] */
+	case UPDATE_EVENT:
+		u->ts    = bolo_strtoi(f[1], NULL);
+		u->name  = f[2];
+		u->extra = f[3];
+		break;
+
+	/* [ SET.KEYS | (key|value)+ ] */
+	case UPDATE_SET_KEYS:
+		u->name = f[1];
+		u->n    = (nframes - 1) / 2;
+		break;
+	}
+
+	if (type != UPDATE_EVENT && type != UPDATE_SET_KEYS && !*u->name) {
+		logger(LOG_WARNING, "received malformed [%s] PDU (no name)", pdu_type(pdu));
+		u->type = UPDATE_NONE;
+		return u;
+	}
+
+	u->type = type;
+	u->hash = topk_hash(u->name);
+	return u;
+}
+/* }}} */
+static void update_apply(kernel_t *kernel, update_t *u) /* {{{ */
+{
+	int32_t ts = u->ts;
+	const char *name = u->name;
+
+	switch (u->type) {
+	case UPDATE_STATE: { /* {{{ */
+		uint8_t code = u->code;
+		const char *msg = u->extra;
+
+		state_t *state = find_state(&kernel->server->db, name);
+		topk_hit(kernel, state ? TOPK_STATE : TOPK_UNMATCHED, name, u->hash);
+		if (state && state->ignore == 0) {
+			logger(LOG_INFO, "updating state %s, status=%i, ts=%i, msg=[%s]", name, code, ts, msg);
+			int transition = state->stale || state->status != code;
+
+			free(state->summary);
+			state->status    = code;
+			state->summary   = strdup(msg);
+			state->last_seen = ts;
+			state->expiry    = ts + state->type->freshness;
+			state->stale     = 0;
+			mark_dirty(state);
+
+			if (u->traced) {
+				trace_lag(kernel, trace_rule(kernel, "STATE", state->type, NULL), TRACE_RECEIVED, ts, u->traced);
+				kernel->trace.ts = ts;
+			}
+			if (transition)
+				broadcast_transition(kernel, state);
+			broadcast_state(kernel, state);
+			kernel->trace.ts = 0;
+
+		} else {
+			logger(LOG_INFO, "ignoring update for unknown state %s, status=%i, ts=%i, msg=[%s]", name, code, ts, msg);
+		}
+		return;
+	}
+	/* }}} */
+	case UPDATE_COUNTER: { /* {{{ */
+		int64_t incr = u->i[0];
+
+		counter_t *counter = find_counter(&kernel->server->db, name);
+		topk_hit(kernel, counter ? TOPK_COUNTER : TOPK_UNMATCHED, name, u->hash);
+		if (counter && counter->ignore == 0) {
+			/* check for window closure */
+			if (counter->last_seen > 0 && counter->last_seen != ts
+			 && winstart(counter, counter->last_seen) != winstart(counter, ts)) {
+				logger(LOG_INFO, "counter window rollover detected between %i and %i",
+					winstart(counter, counter->last_seen), ts);
+				broadcast_counter(kernel, counter);
+				counter_reset(counter);
+			}
+
+			logger(LOG_INFO, "updating counter %s, ts=%i, incr=%li", name, ts, incr);
+			counter->last_seen = ts;
+			counter->value += incr;
+			mark_dirty(counter);
+
+			if (u->traced) {
+				trace_lag(kernel, trace_rule(kernel, "COUNTER", NULL, counter->window), TRACE_RECEIVED, ts, u->traced);
+				if (!counter->traced)
+					counter->traced = ts;
+			}
+
+		} else {
+			logger(LOG_WARNING, "ignoring update for unknown counter %s, ts=%i, incr=%li", name, ts, incr);
+		}
+		return;
+	}
+	/* }}} */
+	case UPDATE_SAMPLE: { /* {{{ */
+		sample_t *sample = find_sample(&kernel->server->db, name);
+		topk_hit(kernel, sample ? TOPK_SAMPLE : TOPK_UNMATCHED, name, u->hash);
+
+		if (sample && sample->ignore == 0) {
+			/* check for window closure */
+			if (sample->last_seen > 0 && sample->last_seen != ts
+			 && winstart(sample, sample->last_seen) != winstart(sample, ts)) {
+				logger(LOG_INFO, "sample window rollover detected between %i and %i",
+					winstart(sample, sample->last_seen), ts);
+				broadcast_sample(kernel, sample);
+				sample_reset(sample);
+			}
+
+			int i;
+			for (i = 0; i < u->n; i++) {
+				double v = u->values[i];
+
+				logger(LOG_INFO, "%s sample set %s, ts=%i, value=%e", (sample->last_seen ? "updating" : "starting"), name, ts, v);
+				if (sample_data(sample, v) != 0) {
+					logger(LOG_ERR, "failed to update sample set %s, ts=%i, value=%e", name, ts, v);
+					continue;
+				}
+
+				sample->last_seen = ts;
+			}
+
+			if (u->traced) {
+				trace_lag(kernel, trace_rule(kernel, "SAMPLE", NULL, sample->window), TRACE_RECEIVED, ts, u->traced);
+				if (!sample->traced)
+					sample->traced = ts;
+			}
+		} else {
+			logger(LOG_WARNING, "ignoring update for unknown sample set %s, ts=%i", name, ts);
+		}
+		return;
+	}
+	/* }}} */
+	case UPDATE_RATE: { /* {{{ */
+		uint64_t v = (uint64_t)u->i[0];
+
+		rate_t *rate = find_rate(&kernel->server->db, name);
+		topk_hit(kernel, rate ? TOPK_RATE : TOPK_UNMATCHED, name, u->hash);
+		if (rate && rate->ignore == 0) {
+			/* check for window closure */
+			if (rate->last_seen > 0 && rate->last_seen != ts
+			 && winstart(rate, rate->last_seen) != winstart(rate, ts)) {
+				logger(LOG_INFO, "rate window rollover detected between %i and %i",
+					winstart(rate, rate->last_seen), ts);
+				broadcast_rate(kernel, rate);
+				rate_reset(rate);
+			}
+
+			if (!rate->first_seen)
+				rate->first_seen = ts;
+			logger(LOG_INFO, "%s rate set %s, ts=%i, value=%lu", (rate->last_seen ? "updating" : "starting"), name, ts, v);
+			if (rate_data(rate, v) != 0) {
+				logger(LOG_ERR, "failed to update rate set %s, ts=%i, value=%lu", name, ts, v);
+			} else {
+				rate->last_seen = ts;
+			}
+
+			if (u->traced) {
+				trace_lag(kernel, trace_rule(kernel, "RATE", NULL, rate->window), TRACE_RECEIVED, ts, u->traced);
+				if (!rate->traced)
+					rate->traced = ts;
+			}
+
+		} else {
+			logger(LOG_WARNING, "ignoring update for unknown rate set %s, ts=%i, value=%lu", name, ts, v);
+		}
+		return;
+	}
+	/* }}} */
+	case UPDATE_SAMPLE_AGG: { /* {{{ */
+		uint64_t n    = (uint64_t)u->i[0];
+		double   min  = u->d[0];
+		double   max  = u->d[1];
+		double   sum  = u->d[2];
+		double   mean = u->d[3];
+		double   var  = u->d[4];
+
+		sample_t *sample = find_sample(&kernel->server->db, name);
+		topk_hit(kernel, sample ? TOPK_SAMPLE : TOPK_UNMATCHED, name, u->hash);
+
+		if (sample && sample->ignore == 0) {
+			/* check for window closure */
+			if (sample->last_seen > 0 && sample->last_seen != ts
+			 && winstart(sample, sample->last_seen) != winstart(sample, ts)) {
+				logger(LOG_INFO, "sample window rollover detected between %i and %i",
+					winstart(sample, sample->last_seen), ts);
+				broadcast_sample(kernel, sample);
+				sample_reset(sample);
+			}
+
+			logger(LOG_INFO, "merging %lu values into sample set %s, ts=%i, mean=%e", n, name, ts, mean);
+			if (sample_merge(sample, n, min, max, sum, mean, var) != 0) {
+				logger(LOG_WARNING, "received malformed [SAMPLE.AGG] PDU for %s (min %e, max %e, mean %e, var %e)",
+					name, min, max, mean, var);
+			} else if (n > 0) {
+				sample->last_seen = ts;
+			}
+
+			if (u->traced) {
+				trace_lag(kernel, trace_rule(kernel, "SAMPLE", NULL, sample->window), TRACE_RECEIVED, ts, u->traced);
+				if (!sample->traced)
+					sample->traced = ts;
+			}
+		} else {
+			logger(LOG_WARNING, "ignoring update for unknown sample set %s, ts=%i", name, ts);
+		}
+		return;
+	}
+	/* }}} */
+	case UPDATE_RATE_AGG: { /* {{{ */
+		int32_t  first = u->i[0];
+		int32_t  last  = u->i[1];
+		uint64_t diff  = (uint64_t)u->i[2];
+
+		rate_t *rate = find_rate(&kernel->server->db, name);
+		topk_hit(kernel, rate ? TOPK_RATE : TOPK_UNMATCHED, name, u->hash);
+		if (rate && rate->ignore == 0) {
+			/* check for window closure */
+			if (rate->last_seen > 0 && rate->last_seen != ts
+			 && winstart(rate, rate->last_seen) != winstart(rate, ts)) {
+				logger(LOG_INFO, "rate window rollover detected between %i and %i",
+					winstart(rate, rate->last_seen), ts);
+				broadcast_rate(kernel, rate);
+				rate_reset(rate);
+			}
+
+			logger(LOG_INFO, "merging into rate set %s, ts=%i, diff=%lu over %i-%i", name, ts, diff, first, last);
+			if (rate_merge(rate, first, last, diff) != 0)
+				logger(LOG_ERR, "failed to merge into rate set %s, ts=%i", name, ts);
+
+			if (u->traced) {
+				trace_lag(kernel, trace_rule(kernel, "RATE", NULL, rate->window), TRACE_RECEIVED, ts, u->traced);
+				if (!rate->traced)
+					rate->traced = ts;
+			}
+
+		} else {
+			logger(LOG_WARNING, "ignoring update for unknown rate set %s, ts=%i, diff=%lu", name, ts, diff);
+		}
+		return;
+	}
+	/* }}} */
+	case UPDATE_EVENT: { /* {{{ */
+		event_t ev;
+		ev.timestamp = ts;
+		ev.name      = u->name;
+		ev.extra     = u->extra;
+		topk_hit(kernel, TOPK_EVENT, ev.name, u->hash);
+
+		if (u->traced) {
+			trace_lag(kernel, trace_rule(kernel, "EVENT", NULL, NULL), TRACE_RECEIVED, ev.timestamp, u->traced);
+			kernel->trace.ts = ev.timestamp;
+		}
+		broadcast_event(kernel, &ev);
+		kernel->trace.ts = 0;
+
+		buffer_event(&kernel->server->db, &ev,
+			kernel->server->config.events_max,
+			kernel->server->config.events_keep);
+		return;
+	}
+	/* }}} */
+	case UPDATE_SET_KEYS: { /* {{{ */
+		char *key = u->name, *value;
+		int i;
+		for (i = 0; i < u->n; i++) {
+			value = key + strlen(key) + 1;
+
+			logger(LOG_INFO, "set key %s = '%s'", key, value);
+			set_key(kernel, key, strdup(value));
+			key = value + strlen(value) + 1;
+		}
+		return;
+	}
+	/* }}} */
+	}
+}
+/* }}} */
+static void submit(kernel_t *kernel, pdu_t *raw, update_t *u) /* {{{ */
+{
+	/* agents only come to us once the primary is gone */
+	if (kernel->replica.standby && !kernel->replica.replaying)
+		promote(kernel, "a submission came in on the listener");
+	/* (followers can have followers of their own) */
+	if (kernel->replicas && raw)
+		replicate(kernel, raw);
+	kernel->dirty = 1;
+
+	if (u->traced)
+		kernel->trace.sampled++;
+	update_apply(kernel, u);
+}
+/* }}} */
+static void submit_pdu(kernel_t *kernel, pdu_t *pdu) /* {{{ */
+{
+	/* sample a fraction of submissions for latency tracing;
+	   the receipt time is taken before we do any real work. */
+	uint64_t traced = 0;
+	if (kernel->server->config.trace_rate > 0 && probable(kernel->server->config.trace_rate))
+		traced = time_ms();
+
+	update_t *u = update_decode(pdu, traced);
+	submit(kernel, pdu, u);
+	free(u);
+}
+/* }}} */
+
+static int update_send_batch(update_t **u, int n, void *kernel) /* {{{ */
+{
+	/* the kernel takes them from here, and frees them */
+	pdu_t *p = pdu_make("UPDATE", 0);
+	pdu_extend(p, u, n * sizeof(*u));
+	if (pdu_send_and_free(p, kernel) == 0)
+		return 0;
+
+	while (n-- > 0) {
+		pdu_free(u[n]->raw);
+		free(u[n]);
+	}
+	return -1;
+}
+/* }}} */
+static int update_send(update_t *u, void *kernel) /* {{{ */
+{
+	return update_send_batch(&u, 1, kernel);
+}
+/* }}} */
+static void listener_release(listener_stats_t *stats) /* {{{ */
+{
+	if (__atomic_sub_fetch(&stats->refs, 1, __ATOMIC_SEQ_CST) == 0)
+		free(stats);
+}
+/* }}} */
+static void * _dispatch_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	dispatcher_t *d = (dispatcher_t*)_;
+	zmq_pollitem_t poller[2] = {
+		{ d->control,  0, ZMQ_POLLIN, 0 },
+		{ d->listener, 0, ZMQ_POLLIN, 0 },
+	};
+	zmq_msg_t f[3];
+	size_t len;
+	int i, n, key, more, err;
+
+	while (zmq_poll(poller, 2, -1) >= 0) {
+		if (poller[0].revents & ZMQ_POLLIN) {
+			logger(LOG_DEBUG, "dispatcher received TERMINATE");
+			break;
+		}
+		if (!(poller[1].revents & ZMQ_POLLIN))
+			continue;
+
+		/* hold on to [ TYPE | ts | name ], so that every submission
+		   for the same name goes to the same decoder, in order.
+		   SET.KEYS goes by its first key. */
+		key = 2;
+		more = 1;
+		for (n = 0; more && n <= key; n++) {
+			zmq_msg_init(&f[n]);
+			if (zmq_msg_recv(&f[n], d->listener, 0) < 0) {
+				for (i = 0; i <= n; i++)
+					zmq_msg_close(&f[i]);
+				goto done;
+			}
+			len = sizeof(more);
+			zmq_getsockopt(d->listener, ZMQ_RCVMORE, &more, &len);
+
+			if (n == 0 && zmq_msg_size(&f[0]) == 8
+			 && memcmp(zmq_msg_data(&f[0]), "SET.KEYS", 8) == 0)
+				key = 1;
+		}
+
+		/* binary TSDP comes in one frame, and goes by its name */
+		uint32_t h = 2166136261u;
+		const uint8_t *b = zmq_msg_data(&f[min(key, n - 1)]);
+		len = zmq_msg_size(&f[min(key, n - 1)]);
+		if (n == 1 && !more && len >= 4 && (b[0] >> 4) == TSDP_VERSION)
+			b = tsdp_packed_key(b, len, &len);
+		for (; len > 0; len--) {
+			h ^= *b++;
+			h *= 16777619u;
+		}
+		void *decoder = d->decoders[h % d->n];
+
+		/* zmq only takes a frame off our hands if it sends it; once
+		   one doesn't go, the rest of the submission is dropped (but
+		   still read, so that the next one starts where it should) */
+		err = 0;
+		for (i = 0; i < n; i++) {
+			if (!err && zmq_msg_send(&f[i], decoder, i + 1 < n || more ? ZMQ_SNDMORE : 0) >= 0)
+				continue;
+			if (!err)
+				err = errno;
+			zmq_msg_close(&f[i]);
+		}
+		while (more) {
+			zmq_msg_init(&f[0]);
+			if (zmq_msg_recv(&f[0], d->listener, 0) < 0) {
+				zmq_msg_close(&f[0]);
+				goto done;
+			}
+			len = sizeof(more);
+			zmq_getsockopt(d->listener, ZMQ_RCVMORE, &more, &len);
+			if (!err && zmq_msg_send(&f[0], decoder, more ? ZMQ_SNDMORE : 0) >= 0)
+				continue;
+			if (!err)
+				err = errno;
+			zmq_msg_close(&f[0]);
+		}
+		if (err) {
+			logger(LOG_ERR, "dispatcher: failed to hand a submission to decoder %i: %s",
+				(int)(h % d->n), zmq_strerror(err));
+			__atomic_add_fetch(&d->stats->failed, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+
+done:
+	logger(LOG_DEBUG, "dispatcher: shutting down");
+
+	for (i = 0; i < d->n; i++)
+		zmq_close(d->decoders[i]);
+	zmq_close(d->listener);
+	zmq_close(d->control);
+	listener_release(d->stats);
+	free(d->decoders);
+	free(d);
+
+	return NULL;
+}
+/* }}} */
+static void * _decoder_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	decoder_t *decoder = (decoder_t*)_;
+
+	zmq_pollitem_t poller[2] = {
+		{ decoder->control, 0, ZMQ_POLLIN, 0 },
+		{ decoder->queue,   0, ZMQ_POLLIN, 0 },
+	};
+	while (zmq_poll(poller, 2, -1) >= 0) {
+		if (poller[0].revents & ZMQ_POLLIN) {
+			logger(LOG_DEBUG, "decoder %i received TERMINATE", decoder->id);
+			break;
+		}
+		if (!(poller[1].revents & ZMQ_POLLIN))
+			continue;
+
+		pdu_t *pdu = pdu_recv(decoder->queue);
+		if (!pdu)
+			break;
+
+		/* the receipt time is taken here, for tracing, so that
+		   time spent waiting on the kernel counts as lag */
+		uint64_t traced = 0;
+		if (decoder->trace_rate > 0 && probable(decoder->trace_rate))
+			traced = time_ms();
+
+		update_t *u = update_decode(pdu, traced);
+		if (decoder->keep)
+			u->raw = pdu;
+		else
+			pdu_free(pdu);
+
+		if (update_send(u, decoder->kernel) != 0) {
+			/* (update_send() has freed it); names that hash to us
+			   keep coming our way, so we have to keep going */
+			logger(LOG_ERR, "decoder %i: failed to hand an update to the kernel: %s",
+				decoder->id, strerror(errno));
+			__atomic_add_fetch(&decoder->stats->failed, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	logger(LOG_DEBUG, "decoder %i: shutting down", decoder->id);
+
+	zmq_close(decoder->control);
+	zmq_close(decoder->queue);
+	zmq_close(decoder->kernel);
+	listener_release(decoder->stats);
+	free(decoder);
+
+	return NULL;
+}
+/* }}} */
+static int core_listener_threads(void *zmq, kernel_t *kernel) /* {{{ */
+{
+	server_t *server = kernel->server;
+	int rc, i, n = server->config.listener_threads;
+
+	dispatcher_t *d = vmalloc(sizeof(dispatcher_t));
+	d->n = n;
+	d->decoders = calloc(n, sizeof(void *));
+
+	d->stats = vmalloc(sizeof(listener_stats_t));
+	d->stats->refs    = 2 + n;
+	d->stats->threads = n;
+	kernel->decoders = d->stats;
+
+	rc = core_connect_supervisor(zmq, &d->control);
+	if (rc != 0)
+		return rc;
+
+	logger(LOG_DEBUG, "kernel: binding listener PULL socket to %s, for %i decoder(s)",
+		server->config.listener, n);
+	d->listener = zmq_socket(zmq, ZMQ_PULL);
+	if (!d->listener)
+		return -1;
+	rc = zmq_bind(d->listener, server->config.listener);
+	if (rc != 0)
+		return rc;
+
+	for (i = 0; i < n; i++) {
+		char *endpoint = string("inproc://bolo/v1/listener.decoder.%i", i);
+		d->decoders[i] = zmq_socket(zmq, ZMQ_PUSH);
+		if (!d->decoders[i])
+			return -1;
+		rc = zmq_bind(d->decoders[i], endpoint);
+		if (rc != 0)
+			return rc;
+
+		decoder_t *decoder = vmalloc(sizeof(decoder_t));
+		decoder->id = i;
+		decoder->trace_rate = server->config.trace_rate;
+		decoder->keep = server->config.replication != NULL;
+		decoder->stats = d->stats;
+
+		rc = core_connect_supervisor(zmq, &decoder->control);
+		if (rc != 0)
+			return rc;
+
+		decoder->queue = zmq_socket(zmq, ZMQ_PULL);
+		if (!decoder->queue)
+			return -1;
+		rc = zmq_connect(decoder->queue, endpoint);
+		if (rc != 0)
+			return rc;
+		free(endpoint);
+
+		decoder->kernel = zmq_socket(zmq, ZMQ_PUSH);
+		if (!decoder->kernel)
+			return -1;
+		rc = zmq_connect(decoder->kernel, "inproc://bolo/v1/kernel.updates");
+		if (rc != 0)
+			return rc;
+
+		pthread_t tid;
+		rc = pthread_create(&tid, NULL, _decoder_thread, decoder);
+		if (rc != 0)
+			return rc;
+	}
+
+	pthread_t tid;
+	rc = pthread_create(&tid, NULL, _dispatch_thread, d);
+	if (rc != 0)
+		return rc;
+
+	return 0;
+}
+/* }}} */
+
+static void udp_count(uint64_t *counter, uint64_t n) /* {{{ */
+{
+	__atomic_add_fetch(counter, n, __ATOMIC_SEQ_CST);
+}
+/* }}} */
+static void udp_release(udp_stats_t *stats) /* {{{ */
+{
+	if (__atomic_sub_fetch(&stats->refs, 1, __ATOMIC_SEQ_CST) == 0)
+		free(stats);
+}
+/* }}} */
+static int udp_submit(udp_t *udp, pdu_t *pdu, update_t *u) /* {{{ */
+{
+	if (udp->keep)
+		u->raw = pdu;
+	else
+		pdu_free(pdu);
+
+	if (update_send(u, udp->kernel) != 0) {
+		logger(LOG_ERR, "udp: failed to hand an update to the kernel: %s",
+			strerror(errno));
+		return -1;
+	}
+	udp_count(&udp->stats->submissions, 1);
+	return 0;
+}
+/* }}} */
+/* these return -1 if they had to give up on the rest of a datagram */
+static int udp_tsdp(udp_t *udp, const uint8_t *buf, size_t len) /* {{{ */
+{
+	/* packed TSDP SUBMIT PDUs, one after the other (as per
+	   tsdp_stream_pack()), decoded in place */
+	tsdp_stream_t *stream = udp->stream;
+	const tsdp_t *t;
+	int rc;
+
+	if (tsdp_stream_reset(stream) != 0
+	 || tsdp_stream_feed(stream, buf, len) != 0) {
+		logger(LOG_ERR, "udp: failed to set up a TSDP decoder: %s", strerror(errno));
+		return -1;
+	}
+	while ((rc = tsdp_stream_next(stream, &t)) == 1) {
+		uint64_t traced = 0;
+		if (udp->trace_rate > 0 && probable(udp->trace_rate))
+			traced = time_ms();
+
+		update_t *u = update_tsdp(t, traced);
+		if (u->type == UPDATE_NONE) {
+			udp_count(&udp->stats->malformed, 1);
+			free(u);
+			continue;
+		}
+
+		pdu_t *pdu = NULL;
+		if (udp->keep) {
+			/* replicas get it as it would have come in on the listener */
+			size_t n = tsdp_packed_size(t);
+			uint8_t *raw = vmalloc(n);
+			tsdp_pack(raw, n, t);
+			pdu = pdu_new();
+			pdu_extend(pdu, raw, n);
+			free(raw);
+		}
+		if (udp_submit(udp, pdu, u) != 0)
+			return -1;
+	}
+	if (rc < 0) {
+		logger(LOG_WARNING, "udp: received malformed TSDP datagram: %s",
+			-rc <= TSDP_BIGGEST_ERROR ? tsdp_error_str(-rc) : strerror(-rc));
+		udp_count(&udp->stats->malformed, 1);
+	}
+	return 0;
+}
+/* }}} */
+static int udp_datagram(udp_t *udp, char *buf, size_t len) /* {{{ */
+{
+	if (len >= 4 && ((uint8_t)buf[0] >> 4) == TSDP_VERSION)
+		return udp_tsdp(udp, (const uint8_t *)buf, len);
+
+	/* otherwise, one submission per line, as for `bolo send -t stream` */
+	char *line, *next;
+	for (line = buf; line && *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		if (*line && line[strlen(line) - 1] == '\r')
+			line[strlen(line) - 1] = '\0';
+
+		char *s = line;
+		while (*s && isspace(*s)) s++;
+		if (!*s)
+			continue;
+
+		pdu_t *pdu = bolo_stream_pdu(s);
+		if (!pdu) {
+			logger(LOG_WARNING, "udp: received malformed submission [%s]", s);
+			udp_count(&udp->stats->malformed, 1);
+			continue;
+		}
+
+		uint64_t traced = 0;
+		if (udp->trace_rate > 0 && probable(udp->trace_rate))
+			traced = time_ms();
+
+		update_t *u = update_decode(pdu, traced);
+		if (udp_submit(udp, pdu, u) != 0)
+			return -1;
+	}
+	return 0;
+}
+/* }}} */
+static void * _udp_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	udp_t *udp = (udp_t*)_;
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec   iov[UDP_BATCH];
+	char *bufs = vmalloc(UDP_BATCH * (UDP_DATAGRAM_MAX + 1));
+#ifdef SO_RXQ_OVFL
+	char cmsgs[UDP_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+#endif
+	int i, n;
+
+	zmq_pollitem_t poller[2] = {
+		{ udp->control, 0,       ZMQ_POLLIN, 0 },
+		{ NULL,         udp->fd, ZMQ_POLLIN, 0 },
+	};
+	while (zmq_poll(poller, 2, -1) >= 0) {
+		if (poller[0].revents & ZMQ_POLLIN) {
+			logger(LOG_DEBUG, "udp received TERMINATE");
+			break;
+		}
+		if (!(poller[1].revents & ZMQ_POLLIN))
+			continue;
+
+		/* drain the socket, a batch at a time */
+		do {
+			memset(msgs, 0, sizeof(msgs));
+			for (i = 0; i < UDP_BATCH; i++) {
+				iov[i].iov_base = bufs + i * (UDP_DATAGRAM_MAX + 1);
+				iov[i].iov_len  = UDP_DATAGRAM_MAX;
+				msgs[i].msg_hdr.msg_iov    = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+#ifdef SO_RXQ_OVFL
+				msgs[i].msg_hdr.msg_control    = cmsgs[i];
+				msgs[i].msg_hdr.msg_controllen = sizeof(cmsgs[i]);
+#endif
+			}
+
+			n = recvmmsg(udp->fd, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+			if (n < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					logger(LOG_ERR, "udp: failed to receive datagrams: %s", strerror(errno));
+				break;
+			}
+			udp_count(&udp->stats->batches, 1);
+			udp_count(&udp->stats->datagrams, n);
+
+			for (i = 0; i < n; i++) {
+#ifdef SO_RXQ_OVFL
+				/* the OS tells us how many it has had to drop, so far */
+				struct cmsghdr *c;
+				for (c = CMSG_FIRSTHDR(&msgs[i].msg_hdr); c; c = CMSG_NXTHDR(&msgs[i].msg_hdr, c)) {
+					if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+						uint32_t dropped;
+						memcpy(&dropped, CMSG_DATA(c), sizeof(dropped));
+						__atomic_store_n(&udp->stats->overflowed, dropped, __ATOMIC_SEQ_CST);
+					}
+				}
+#endif
+				if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+					logger(LOG_WARNING, "udp: dropping datagram longer than %i bytes", UDP_DATAGRAM_MAX);
+					udp_count(&udp->stats->truncated, 1);
+					continue;
+				}
+
+				char *buf = iov[i].iov_base;
+				buf[msgs[i].msg_len] = '\0';
+				if (udp_datagram(udp, buf, msgs[i].msg_len) != 0) {
+					/* what's left of it goes, but the next
+					   one may well make it; only a control
+					   message (or shutdown) stops us */
+					udp_count(&udp->stats->failed, 1);
+				}
+			}
+		} while (n == UDP_BATCH);
+	}
+
+	logger(LOG_DEBUG, "udp: shutting down");
+
+	close(udp->fd);
+	tsdp_stream_destroy(udp->stream);
+	zmq_close(udp->control);
+	zmq_close(udp->kernel);
+	udp_release(udp->stats);
+	free(bufs);
+	free(udp);
+
+	return NULL;
+}
+/* }}} */
+static int core_udp_thread(void *zmq, kernel_t *kernel) /* {{{ */
+{
+	server_t *server = kernel->server;
+	int rc;
+
+	udp_t *udp = vmalloc(sizeof(udp_t));
+	udp->trace_rate = server->config.trace_rate;
+	udp->keep = server->config.replication != NULL;
+
+	udp->stats = vmalloc(sizeof(udp_stats_t));
+	udp->stats->refs = 2;
+	udp->stats->port = server->config.udp_port;
+	kernel->udp = udp->stats;
+
+	/* one TSDP decoder, for good; a datagram holds whole PDUs,
+	   so nothing is ever carried over from one to the next */
+	if (tsdp_stream_new(&udp->stream, UDP_DATAGRAM_MAX) != 0) {
+		logger(LOG_CRIT, "kernel: failed to set up the udp TSDP decoder: %s", strerror(errno));
+		return -1;
+	}
+
+	logger(LOG_DEBUG, "kernel: binding udp socket to port %u", server->config.udp_port);
+	udp->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (udp->fd < 0)
+		return -1;
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(server->config.udp_port);
+	addr.sin_addr.s_addr = INADDR_ANY;
+
+	int on = 1;
+	setsockopt(udp->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_RXQ_OVFL
+	setsockopt(udp->fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+	if (server->config.udp_buffer > 0
+	 && setsockopt(udp->fd, SOL_SOCKET, SO_RCVBUF, &server->config.udp_buffer, sizeof(server->config.udp_buffer)) != 0)
+		logger(LOG_WARNING, "kernel: failed to set udp receive buffer to %i bytes: %s",
+			server->config.udp_buffer, strerror(errno));
+
+	if (bind(udp->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		logger(LOG_CRIT, "kernel: failed to bind udp socket to port %u: %s",
+			server->config.udp_port, strerror(errno));
+		return -1;
+	}
+
+	rc = core_connect_supervisor(zmq, &udp->control);
+	if (rc != 0)
+		return rc;
+
+	udp->kernel = zmq_socket(zmq, ZMQ_PUSH);
+	if (!udp->kernel)
+		return -1;
+	rc = zmq_connect(udp->kernel, "inproc://bolo/v1/kernel.updates");
+	if (rc != 0)
+		return rc;
+
+	pthread_t tid;
+	rc = pthread_create(&tid, NULL, _udp_thread, udp);
+	if (rc != 0)
+		return rc;
+
+	return 0;
+}
+/* }}} */
+
+static void shm_release(shm_stats_t *stats) /* {{{ */
+{
+	if (__atomic_sub_fetch(&stats->refs, 1, __ATOMIC_SEQ_CST) == 0)
+		free(stats);
+}
+/* }}} */
+static shm_record_t * shm_next(shm_t *shm) /* {{{ */
+{
+	return (shm_record_t *)(shm_data(shm->ring) + (shm->head & (shm->size - 1)));
+}
+/* }}} */
+static update_t * shm_update(shm_t *shm, shm_record_t *r, uint32_t size, uint32_t frames) /* {{{ */
+{
+	/* [ uint32_t len | frame ]..., the first of which is the type
+	   (or the whole of a binary TSDP submission).  size and frames
+	   were read (once) and checked by shm_drain(); a client could
+	   still be scribbling on the header, so it isn't read again */
+	uint8_t *p   = (uint8_t *)(r + 1);
+	uint8_t *end = (uint8_t *)r + size;
+	char type[32];
+	uint32_t len, i;
+	pdu_t *pdu = NULL;
+
+	for (i = 0; i < frames; i++) {
+		if (p + sizeof(len) > end)
+			goto bad;
+		memcpy(&len, p, sizeof(len));
+		p += sizeof(len);
+		if (len > end - p)
+			goto bad;
+
+		if (i == 0 && len >= 4 && (p[0] >> 4) == TSDP_VERSION) {
+			/* binary TSDP (see update_tsdp()) */
+			pdu = pdu_new();
+			pdu_extend(pdu, p, len);
+		} else if (i == 0) {
+			if (len >= sizeof(type))
+				goto bad;
+			memcpy(type, p, len);
+			type[len] = '\0';
+			pdu = pdu_make(type, 0);
+		} else {
+			pdu_extend(pdu, p, len);
+		}
+		p += len;
+	}
+	if (!pdu)
+		goto bad;
+
+	uint64_t traced = 0;
+	if (shm->trace_rate > 0 && probable(shm->trace_rate))
+		traced = time_ms();
+
+	update_t *u = update_decode(pdu, traced);
+	if (shm->keep)
+		u->raw = pdu;
+	else
+		pdu_free(pdu);
+	return u;
+
+bad:
+	logger(LOG_WARNING, "shm: received malformed record (%u bytes, %u frames)",
+		size, frames);
+	__atomic_add_fetch(&shm->stats->malformed, 1, __ATOMIC_SEQ_CST);
+	pdu_free(pdu);
+	return NULL;
+}
+/* }}} */
+static int shm_drain(shm_t *shm) /* {{{ */
+{
+	shm_header_t *ring = shm->ring;
+	update_t *batch[SHM_BATCH];
+	int n = 0;
+
+	while (n < SHM_BATCH) {
+		/* the record's header is read once, here; everything
+		   after the bounds check goes by these copies */
+		shm_record_t *r = shm_next(shm);
+		uint32_t size   = __atomic_load_n(&r->size, __ATOMIC_SEQ_CST);
+		uint32_t frames = __atomic_load_n(&r->frames, __ATOMIC_RELAXED);
+		if (!size)
+			break;
+		if (size < sizeof(shm_record_t) || size % SHM_ALIGN != 0
+		 || (shm->head & (shm->size - 1)) + size > shm->size) {
+			logger(LOG_CRIT, "shm: ring %s is corrupt (a %u byte record at %lu); giving up on it",
+				shm->path, size, shm->head);
+			return -1;
+		}
+
+		if (frames) {
+			update_t *u = shm_update(shm, r, size, frames);
+			if (u)
+				batch[n++] = u;
+		}
+
+		/* writers only see this space again once we move head,
+		   and it has to be zeroed by then (see shm_header_t) */
+		memset(r, 0, size);
+		shm->head += size;
+		__atomic_store_n(&ring->head, shm->head, __ATOMIC_RELEASE);
+	}
+	if (n == 0)
+		return 0;
+
+	if (update_send_batch(batch, n, shm->kernel) != 0) {
+		logger(LOG_ERR, "shm: failed to hand updates to the kernel: %s",
+			strerror(errno));
+		return -1;
+	}
+	__atomic_add_fetch(&shm->stats->submissions, n, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&shm->stats->batches,     1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&shm->stats->full,
+		__atomic_load_n(&ring->full, __ATOMIC_RELAXED), __ATOMIC_SEQ_CST);
+	return n;
+}
+/* }}} */
+static void * _shm_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	shm_t *shm = (shm_t*)_;
+	shm_header_t *ring = shm->ring;
+	int n, busy = 0;
+
+	zmq_pollitem_t poller[3] = {
+		{ shm->control, 0,         ZMQ_POLLIN, 0 },
+		{ NULL,         shm->wake, ZMQ_POLLIN, 0 },
+		{ NULL,         shm->fd,   ZMQ_POLLIN, 0 },
+	};
+	for (;;) {
+		n = shm_drain(shm);
+		if (n < 0)
+			break;
+
+		/* while there's more where that came from, only look
+		   up from the ring every so often, and without waiting */
+		if (n == SHM_BATCH && ++busy % 64 != 0)
+			continue;
+
+		if (n < SHM_BATCH) {
+			busy = 0;
+			__atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&shm_next(shm)->size, __ATOMIC_SEQ_CST)) {
+				/* someone got one in before we could nod off */
+				__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+				continue;
+			}
+		}
+
+		if (zmq_poll(poller, 3, busy ? 0 : -1) < 0)
+			break;
+		__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+
+		if (poller[0].revents & ZMQ_POLLIN) {
+			logger(LOG_DEBUG, "shm received TERMINATE");
+			break;
+		}
+		if (poller[1].revents & ZMQ_POLLIN) {
+			uint64_t v;
+			if (read(shm->wake, &v, sizeof(v)) == sizeof(v))
+				__atomic_add_fetch(&shm->stats->wakeups, 1, __ATOMIC_SEQ_CST);
+		}
+		if (poller[2].revents & ZMQ_POLLIN) {
+			/* a new client; hand it our eventfd, so that
+			   it can wake us up when we are sleeping */
+			int c = accept(shm->fd, NULL, NULL);
+			if (c < 0)
+				continue;
+
+			char byte = 0;
+			struct iovec iov = { &byte, 1 };
+			char control[CMSG_SPACE(sizeof(int))];
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			memset(control, 0, sizeof(control));
+			msg.msg_iov        = &iov;
+			msg.msg_iovlen     = 1;
+			msg.msg_control    = control;
+			msg.msg_controllen = sizeof(control);
+
+			struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+			cm->cmsg_level = SOL_SOCKET;
+			cm->cmsg_type  = SCM_RIGHTS;
+			cm->cmsg_len   = CMSG_LEN(sizeof(int));
+			memcpy(CMSG_DATA(cm), &shm->wake, sizeof(int));
+
+			if (sendmsg(c, &msg, MSG_NOSIGNAL) != 1)
+				logger(LOG_WARNING, "shm: failed to hand wakeup fd to a new client: %s",
+					strerror(errno));
+			close(c);
+		}
+	}
+
+	logger(LOG_DEBUG, "shm: shutting down");
+
+	/* clients that still have it mapped will see this,
+	   and fail with EPIPE, instead of filling it up */
+	__atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+	munmap(ring, shm->len);
+	unlink(shm->path);
+	unlink(shm->door);
+	close(shm->fd);
+	close(shm->wake);
+	zmq_close(shm->control);
+	zmq_close(shm->kernel);
+	shm_release(shm->stats);
+	free(shm->path);
+	free(shm->door);
+	free(shm);
+
+	return NULL;
+}
+/* }}} */
+static int core_shm_thread(void *zmq, kernel_t *kernel) /* {{{ */
+{
+	server_t *server = kernel->server;
+	int rc, fd;
+
+	shm_t *shm = vmalloc(sizeof(shm_t));
+	shm->trace_rate = server->config.trace_rate;
+	shm->keep = server->config.replication != NULL;
+	shm->path = strdup(server->config.shm_ring);
+	shm->door = string("%s.sock", server->config.shm_ring);
+
+	shm->stats = vmalloc(sizeof(shm_stats_t));
+	shm->stats->refs = 2;
+	kernel->shm = shm->stats;
+
+	int mode = server->config.shm_mode ? server->config.shm_mode : DEFAULT_SHM_MODE;
+	uint64_t size = 4096;
+	while (size < (uint64_t)(server->config.shm_size > 0 ? server->config.shm_size : DEFAULT_SHM_SIZE))
+		size <<= 1;
+	shm->len = SHM_HEADER + size;
+
+	/* start from scratch; whatever was in a previous
+	   ring was already lost, along with its aggregator */
+	logger(LOG_DEBUG, "kernel: creating %lu byte shm ring at %s", size, shm->path);
+	unlink(shm->path);
+	fd = open(shm->path, O_RDWR|O_CREAT|O_EXCL, 0600);
+	if (fd < 0) {
+		logger(LOG_CRIT, "kernel: failed to create shm ring %s: %s",
+			shm->path, strerror(errno));
+		return -1;
+	}
+	/* whoever can write the ring can submit anything (or wedge it);
+	   fchmod(), so that shm.mode isn't at the mercy of our umask */
+	if (fchmod(fd, mode) != 0) {
+		logger(LOG_CRIT, "kernel: failed to set mode %04o on shm ring %s: %s",
+			mode, shm->path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (ftruncate(fd, shm->len) != 0) {
+		logger(LOG_CRIT, "kernel: failed to size shm ring %s to %lu bytes: %s",
+			shm->path, shm->len, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	shm->ring = mmap(NULL, shm->len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm->ring == MAP_FAILED) {
+		logger(LOG_CRIT, "kernel: failed to map shm ring %s: %s",
+			shm->path, strerror(errno));
+		return -1;
+	}
+	shm->ring->version = SHM_VERSION;
+	shm->ring->size    = size;
+	shm->size = size;
+	shm->head = 0;
+	memcpy(shm->ring->magic, SHM_MAGIC, 8);
+
+	shm->wake = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (shm->wake < 0)
+		return -1;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(shm->door) >= sizeof(addr.sun_path)) {
+		logger(LOG_CRIT, "kernel: shm ring path %s is too long", shm->path);
+		return -1;
+	}
+	strcpy(addr.sun_path, shm->door);
+
+	unlink(shm->door);
+	shm->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (shm->fd < 0)
+		return -1;
+	/* no one can connect until we listen(), so there's
+	   no window where the socket has the wrong mode */
+	if (bind(shm->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+	 || chmod(shm->door, mode) != 0
+	 || listen(shm->fd, 64) != 0) {
+		logger(LOG_CRIT, "kernel: failed to listen on %s: %s",
+			shm->door, strerror(errno));
+		return -1;
+	}
+
+	rc = core_connect_supervisor(zmq, &shm->control);
+	if (rc != 0)
+		return rc;
+
+	shm->kernel = zmq_socket(zmq, ZMQ_PUSH);
+	if (!shm->kernel)
+		return -1;
+	rc = zmq_connect(shm->kernel, "inproc://bolo/v1/kernel.updates");
+	if (rc != 0)
+		return rc;
+
+	pthread_t tid;
+	rc = pthread_create(&tid, NULL, _shm_thread, shm);
+	if (rc != 0)
+		return rc;
+
+	return 0;
+}
+/* }}} */
+
+/*************************************************************************/
+
+static void * _kernel_thread(void *_) /* {{{ */
+{
+	assert(_ != NULL);
+
+	kernel_t *kernel = (kernel_t*)_;
+	reactor_go(kernel->reactor);
+
+	logger(LOG_DEBUG, "kernel: shutting down");
+
+	zmq_close(kernel->control);
+	zmq_close(kernel->tock);
+	if (kernel->listener)   zmq_close(kernel->listener);
+	if (kernel->broadcast)  zmq_close(kernel->broadcast);
+	if (kernel->tsdp)       zmq_close(kernel->tsdp);
+	if (kernel->management) zmq_close(kernel->management);
+	if (kernel->beacon)     zmq_close(kernel->beacon);
+	if (kernel->upstream)   zmq_close(kernel->upstream);
+	if (kernel->replicas)   zmq_close(kernel->replicas);
+	if (kernel->primary)    zmq_close(kernel->primary);
+	if (kernel->updates)    zmq_close(kernel->updates);
+	if (kernel->decoders)   listener_release(kernel->decoders);
+	if (kernel->udp)        udp_release(kernel->udp);
+	if (kernel->shm)        shm_release(kernel->shm);
+	pdu_free(kernel->replica.batch);
+
+	reactor_free(kernel->reactor);
+	hash_done(&kernel->trace.lags, 1);
+	hash_done(&kernel->keys.dirty, 0);
+	int i;
+	for (i = 0; i < 2 * TOPK_LISTS; i++)
+		topk_done(&kernel->topk.lists[i / TOPK_LISTS][i % TOPK_LISTS]);
+	if (kernel->snapshots)
+		snapshots_release(kernel->snapshots);
+	deconfigure(kernel->server);
+	free(kernel->server);
+	free(kernel);
+
+	logger(LOG_DEBUG, "kernel: terminated");
+	return NULL;
+}
+/* }}} */
+static int forget(kernel_t *kernel, pdu_t *pdu, const char **err) /* {{{ */
+{
+	/* [ FORGET | type | pattern | ig ], from the management port
+	   or (for followers) replayed from the primary */
+	const char *re_err;
+	char *pattern, *s;
+	int   re_off;
+	pcre *re;
+
+	s = pdu_string(pdu, 1); uint16_t payload   = strtoul(s, NULL, 10); free(s);
+	s = pdu_string(pdu, 3); uint8_t  ignore    = strtoul(s, NULL, 10); free(s);
+	pattern = pdu_string(pdu, 2);
+	re = pcre_compile(pattern, 0, &re_err, &re_off, NULL);
+
+	if (!re) {
+		*err = re_err;
+		free(pattern);
+		return -1;
+
+	} else {
+		pcre_extra *re_extra = pcre_study(re, 0, &re_err);
+		strings_t *names = matching(&kernel->server->db.names, payload, pattern, re, re_extra);
+		int counter = 0, total = 0, i;
+		if (payload_is(payload, PAYLOAD_STATE)) {
+			state_t *dp;
+			counter = 0;
+			for_each_string(names, i) {
+				if (!(dp = hash_get(&kernel->server->db.states, names->strings[i])))
+					continue;
+
+				if (ignore) {
+					dp->ignore =1;
+					mark_dirty(dp);
+				} else {
+					release_state(&kernel->server->db, dp);
+				}
+				counter++;
+			}
+			total += counter;
+			logger(LOG_DEBUG, "removing [%i] states matching pattern [%s] from monitoring", counter, pattern);
+		}
+
+		if (payload_is(payload, PAYLOAD_COUNTER)) {
+			counter_t *dp;
+			counter = 0;
+			for_each_string(names, i) {
+				if (!(dp = hash_get(&kernel->server->db.counters, names->strings[i])))
+					continue;
+
+				if (ignore) {
+					dp->ignore =1;
+					mark_dirty(dp);
+				} else {
+					release_counter(&kernel->server->db, dp);
+				}
+				counter++;
+			}
+			total += counter;
+			logger(LOG_DEBUG, "removing [%i] counters matching pattern [%s] from monitoring", counter, pattern);
+		}
+
+		if (payload_is(payload, PAYLOAD_SAMPLE)) {
+			sample_t *dp;
+			counter = 0;
+			for_each_string(names, i) {
+				if (!(dp = hash_get(&kernel->server->db.samples, names->strings[i])))
+					continue;
 
-	kernel_t *kernel = (kernel_t*)_;
-	reactor_go(kernel->reactor);
+				if (ignore) {
+					dp->ignore =1;
+					mark_dirty(dp);
+				} else {
+					release_sample(&kernel->server->db, dp);
+				}
+				counter++;
+			}
+			total += counter;
+			logger(LOG_DEBUG, "removing [%i] samples matching pattern [%s] from monitoring", counter, pattern);
+		}
 
-	logger(LOG_DEBUG, "kernel: shutting down");
+		if (payload_is(payload, PAYLOAD_RATE)) {
+			rate_t *dp;
+			counter = 0;
+			for_each_string(names, i) {
+				if (!(dp = hash_get(&kernel->server->db.rates, names->strings[i])))
+					continue;
 
-	zmq_close(kernel->control);
-	zmq_close(kernel->tock);
-	if (kernel->listener)   zmq_close(kernel->listener);
-	if (kernel->broadcast)  zmq_close(kernel->broadcast);
-	if (kernel->management) zmq_close(kernel->management);
-	if (kernel->beacon)     zmq_close(kernel->beacon);
+				if (ignore) {
+					dp->ignore =1;
+					mark_dirty(dp);
+				} else {
+					release_rate(&kernel->server->db, dp);
+				}
+				counter++;
+			}
+			total += counter;
+			logger(LOG_DEBUG, "removing [%i] rates matching pattern [%s] from monitoring", counter, pattern);
+		}
 
-	reactor_free(kernel->reactor);
-	deconfigure(kernel->server);
-	free(kernel->server);
-	free(kernel);
+		strings_free(names);
+		evict_reset(kernel);
+		logger(LOG_INFO, "removing [%i] datapoints matching pattern [%s] from monitoring", total, pattern);
+		pcre_free_study(re_extra);
+		pcre_free(re);
+	}
 
-	logger(LOG_DEBUG, "kernel: terminated");
-	return NULL;
+	free(pattern);
+	return 0;
+}
+/* }}} */
+static void del_keys(kernel_t *kernel, pdu_t *pdu) /* {{{ */
+{
+	/* [ DEL.KEYS | name+ ] */
+	int i;
+	char *key;
+	for (i = 1; i < pdu_size(pdu); i++) {
+		key = pdu_string(pdu, i);
+		logger(LOG_INFO, "deleting key %s", key);
+		del_key(kernel, key);
+		free(key);
+	}
 }
 /* }}} */
+
 static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 {
 	assert(socket != NULL);
@@ -535,7 +3660,11 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 			}
 		}
 
-		if (kernel->beacon && kernel->sweep.last + kernel->sweep.interval < now) {
+		if (kernel->replicas)
+			replicate_flush(kernel);
+
+		if (kernel->beacon && !kernel->replica.standby
+		 && kernel->sweep.last + kernel->sweep.interval < now) {
 			kernel->sweep.last = now;
 
 			beacon_sweep(kernel, kernel->sweep.interval);
@@ -550,9 +3679,20 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 		if (kernel->savestate.last + kernel->savestate.interval < now) {
 			kernel->savestate.last = now;
 
-			broadcast_setkeys(kernel);
 			binf_write(&kernel->server->db, kernel->server->config.savefile, kernel->server->config.save_size);
-			save_keys(&kernel->server->keys, kernel->server->config.keysfile);
+			flush_keys(kernel);
+		}
+
+		if (kernel->server->config.topk_size > 0
+		 && kernel->topk.since[kernel->topk.cur] + kernel->server->config.topk_interval <= now)
+			topk_rotate(kernel, now);
+
+		if (kernel->server->config.evict_idle > 0)
+			evict_idle(kernel, now);
+
+		if (kernel->snapshots && kernel->dirty) {
+			__atomic_store_n(&kernel->snapshots->stale, 1, __ATOMIC_SEQ_CST);
+			kernel->dirty = 0;
 		}
 
 		return VIGOR_REACTOR_CONTINUE;
@@ -590,14 +3730,8 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 			fprintf(io, "---\n");
 			fprintf(io, "# generated by bolo\n");
 
-			char *name; state_t *state;
-			for_each_key_value(&kernel->server->db.states, name, state) {
-				fprintf(io, "%s:\n", name);
-				fprintf(io, "  status:    %s\n", statstr(state->status));
-				fprintf(io, "  message:   %s\n", state->summary);
-				fprintf(io, "  last_seen: %i\n", state->last_seen);
-				fprintf(io, "  fresh:     %s\n", state->stale ? "no" : "yes");
-			}
+			dump_t dump = { &kernel->server->db, io };
+			trie_walk(&kernel->server->db.names, "", PAYLOAD_STATE, _dump_state, &dump);
 
 			fflush(io);
 			int fd = fileno(io);
@@ -638,14 +3772,16 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 		/* }}} */
 		/* [ DEL.KEYS | name+ ] {{{ */
 		if (_pdu_is(pdu, "DEL.KEYS", 2, 0)) {
-			int i;
-			char *key;
-			for (i = 1; i < pdu_size(pdu); i++) {
-				key = pdu_string(pdu, i);
-				logger(LOG_INFO, "deleting key %s", key);
-				free(hash_set(&kernel->server->keys, key, NULL));
-				free(key);
-			}
+			del_keys(kernel, pdu);
+			kernel->mutated = 1;
+			pdu_send_and_free(pdu_reply(pdu, "OK", 0), socket);
+			return VIGOR_REACTOR_CONTINUE;
+		}
+		/* }}} */
+		/* [ SYNC.KEYS ] {{{ */
+		if (_pdu_is(pdu, "SYNC.KEYS", 1, 1)) {
+			/* for subscribers that missed earlier changes */
+			broadcast_setkeys(kernel, 1);
 			pdu_send_and_free(pdu_reply(pdu, "OK", 0), socket);
 			return VIGOR_REACTOR_CONTINUE;
 		}
@@ -667,15 +3803,13 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 				pdu_t *a = pdu_reply(pdu, "KEYS", 0);
 				pcre_extra *re_extra = pcre_study(re, 0, &re_err);
 
-				char *key, *value;
-				for_each_key_value(&kernel->server->keys, key, value) {
-					logger(LOG_DEBUG, "checking key '%s' against m/%s/", key, pattern);
-					if (pcre_exec(re, re_extra, key, strlen(key), 0, 0, NULL, 0) != 0)
-						continue;
-
-					logger(LOG_INFO, "key '%s' matched m/%s/, adding to reply PDU", key, pattern);
-					pdu_extendf(a, "%s", key);
+				strings_t *keys = matching(&kernel->server->keynames, 1, pattern, re, re_extra);
+				int i;
+				for_each_string(keys, i) {
+					logger(LOG_INFO, "key '%s' matched m/%s/, adding to reply PDU", keys->strings[i], pattern);
+					pdu_extendf(a, "%s", keys->strings[i]);
 				}
+				strings_free(keys);
 
 				pdu_send_and_free(a, socket);
 				pcre_free_study(re_extra);
@@ -685,30 +3819,93 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 			return VIGOR_REACTOR_CONTINUE;
 		}
 		/* }}} */
-		/* [ GET.EVENTS | since ] {{{ */
-		if (_pdu_is(pdu, "GET.EVENTS", 2, 2)) {
+		/* [ GET.EVENTS | since | pattern? ] {{{ */
+		if (_pdu_is(pdu, "GET.EVENTS", 2, 3)) {
 			char *s = pdu_string(pdu, 1); int32_t since = strtol(s, NULL, 10); free(s);
 
+			const char *re_err;
+			int re_off;
+			pcre *re = NULL;
+			pcre_extra *re_extra = NULL;
+			if (pdu_size(pdu) == 3) {
+				char *pattern = pdu_string(pdu, 2);
+				re = pcre_compile(pattern, 0, &re_err, &re_off, NULL);
+				free(pattern);
+				if (!re) {
+					pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, re_err), socket);
+					return VIGOR_REACTOR_CONTINUE;
+				}
+				re_extra = pcre_study(re, 0, &re_err);
+			}
+
 			FILE *io = tmpfile();
 			if (!io) {
 				logger(LOG_ERR, "kernel cannot dump events; unable to create temporary file: %s", strerror(errno));
 				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, "Internal error"), socket);
+
+			} else {
+				events_dump(&kernel->server->db.events, since, re, re_extra, io);
+				pdu_send_and_free(yaml_reply(pdu, "EVENTS", io), socket);
+			}
+
+			if (re) {
+				pcre_free_study(re_extra);
+				pcre_free(re);
+			}
+			return VIGOR_REACTOR_CONTINUE;
+		}
+		/* }}} */
+		/* [ STATS ] {{{ */
+		if (_pdu_is(pdu, "STATS", 1, 1)) {
+			FILE *io = tmpfile();
+			if (!io) {
+				logger(LOG_ERR, "kernel cannot dump stats; unable to create temporary file: %s", strerror(errno));
+				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, "Internal error"), socket);
 				return VIGOR_REACTOR_CONTINUE;
 			}
 
 			fprintf(io, "---\n");
 			fprintf(io, "# generated by bolo\n");
+			trace_dump(kernel, io);
+			metrics_dump(kernel, io);
 
-			event_t *ev;
-			for_each_object(ev, &kernel->server->db.events, l) {
-				if (ev->timestamp < since)
-					continue;
+			fflush(io);
+			int fd = fileno(io);
+			long off = lseek(fd, 0, SEEK_END);
+			lseek(fd, 0, SEEK_SET);
 
-				fprintf(io, "- name:  %s\n", ev->name);
-				fprintf(io, "  when:  %i\n", ev->timestamp);
-				fprintf(io, "  extra: %s\n", ev->extra);
+			char *data = mmap(NULL, off, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED) {
+				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, "Internal error"), socket);
+
+			} else {
+				pdu_send_and_free(pdu_reply(pdu, "STATS", 1, data), socket);
+				munmap(data, off);
+			}
+
+			fclose(io);
+			return VIGOR_REACTOR_CONTINUE;
+		}
+		/* }}} */
+		/* [ TOPK ] {{{ */
+		if (_pdu_is(pdu, "TOPK", 1, 1)) {
+			if (kernel->server->config.topk_size <= 0) {
+				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, "Top-K tracking is disabled"), socket);
+				return VIGOR_REACTOR_CONTINUE;
+			}
+
+			FILE *io = tmpfile();
+			if (!io) {
+				logger(LOG_ERR, "kernel cannot dump top-k lists; unable to create temporary file: %s", strerror(errno));
+				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, "Internal error"), socket);
+				return VIGOR_REACTOR_CONTINUE;
 			}
 
+			fprintf(io, "---\n");
+			fprintf(io, "# generated by bolo\n");
+			fprintf(io, "interval: %i\n", kernel->server->config.topk_interval);
+			topk_dump(kernel, io);
+
 			fflush(io);
 			int fd = fileno(io);
 			long off = lseek(fd, 0, SEEK_END);
@@ -719,7 +3916,8 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, "Internal error"), socket);
 
 			} else {
-				pdu_send_and_free(pdu_reply(pdu, "EVENTS", 1, data), socket);
+				pdu_send_and_free(pdu_reply(pdu, "TOPK", 1, data), socket);
+				munmap(data, off);
 			}
 
 			fclose(io);
@@ -730,310 +3928,71 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 		if (_pdu_is(pdu, "SAVESTATE", 1, 1)) {
 			binf_write(&kernel->server->db, kernel->server->config.savefile, kernel->server->config.save_size);
 			binf_sync(kernel->server->config.savefile, kernel->server->config.save_size);
-			save_keys(&kernel->server->keys, kernel->server->config.keysfile);
+			compact_keys(kernel);
 
 			pdu_send_and_free(pdu_reply(pdu, "OK", 0), socket);
 			return VIGOR_REACTOR_CONTINUE;
 		}
 		/* }}} */
+		/* [ SNAPSHOT ] {{{ */
+		if (kernel->snapshots && _pdu_is(pdu, "SNAPSHOT", 1, 1)) {
+			/* a reader found the current one stale; the first to
+			   ask gets a new one taken, the rest find it there */
+			if (kernel->snapshots->stale)
+				snapshot_publish(kernel);
+			pdu_send_and_free(pdu_reply(pdu, "OK", 0), socket);
+			return VIGOR_REACTOR_CONTINUE;
+		}
+		/* }}} */
 		/* [ FORGET | type | pattern | ig ] {{{ */
 		if (_pdu_is(pdu, "FORGET", 4, 4)) {
-			const char *re_err;
-			char *pattern, *s;
-			int   re_off;
-			pcre *re;
-
-			s = pdu_string(pdu, 1); uint16_t payload   = strtoul(s, NULL, 10); free(s);
-			s = pdu_string(pdu, 3); uint8_t  ignore    = strtoul(s, NULL, 10); free(s);
-			pattern = pdu_string(pdu, 2);
-			re = pcre_compile(pattern, 0, &re_err, &re_off, NULL);
-
-			if (!re) {
-				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, re_err), socket);
-
+			const char *err;
+			if (forget(kernel, pdu, &err) != 0) {
+				pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, err), socket);
 			} else {
-				pcre_extra *re_extra = pcre_study(re, 0, &re_err);
-				int counter = 0, total = 0;
-				if (payload_is(payload, PAYLOAD_STATE)) {
-					state_t *dp;
-					char    *name;
-					counter = 0;
-					for_each_key_value(&kernel->server->db.states, name, dp) {
-						if (pcre_exec(re, re_extra, name, strlen(name), 0, 0, NULL, 0) != 0)
-							continue;
-
-						if (ignore)
-							dp->ignore =1;
-						else
-							hash_unset(&kernel->server->db.states, name);
-						counter++;
-					}
-					total += counter;
-					logger(LOG_DEBUG, "removing [%i] states matching pattern [%s] from monitoring", counter, pattern);
-				}
-
-				if (payload_is(payload, PAYLOAD_COUNTER)) {
-					counter_t *dp;
-					char      *name;
-					counter = 0;
-					for_each_key_value(&kernel->server->db.counters, name, dp) {
-						if (pcre_exec(re, re_extra, name, strlen(name), 0, 0, NULL, 0) != 0)
-							continue;
-
-						if (ignore)
-							dp->ignore =1;
-						else
-							hash_unset(&kernel->server->db.counters, name);
-						counter++;
-					}
-					total += counter;
-					logger(LOG_DEBUG, "removing [%i] counters matching pattern [%s] from monitoring", counter, pattern);
-				}
-
-				if (payload_is(payload, PAYLOAD_SAMPLE)) {
-					sample_t *dp;
-					char     *name;
-					counter = 0;
-					for_each_key_value(&kernel->server->db.samples, name, dp) {
-						if (pcre_exec(re, re_extra, name, strlen(name), 0, 0, NULL, 0) != 0)
-							continue;
-
-						if (ignore)
-							dp->ignore =1;
-						else
-							hash_unset(&kernel->server->db.samples, name);
-						counter++;
-					}
-					total += counter;
-					logger(LOG_DEBUG, "removing [%i] samples matching pattern [%s] from monitoring", counter, pattern);
-				}
-
-				if (payload_is(payload, PAYLOAD_RATE)) {
-					rate_t *dp;
-					char   *name;
-					counter = 0;
-					for_each_key_value(&kernel->server->db.rates, name, dp) {
-						if (pcre_exec(re, re_extra, name, strlen(name), 0, 0, NULL, 0) != 0)
-							continue;
-
-						if (ignore)
-							dp->ignore =1;
-						else
-							hash_unset(&kernel->server->db.rates, name);
-						counter++;
-					}
-					total += counter;
-					logger(LOG_DEBUG, "removing [%i] rates matching pattern [%s] from monitoring", counter, pattern);
-				}
-
-				logger(LOG_INFO, "removing [%i] datapoints matching pattern [%s] from monitoring", total, pattern);
+				kernel->mutated = 1;
 				pdu_send_and_free(pdu_reply(pdu, "OK", 0), socket);
 			}
-
-			free(pattern);
 			return VIGOR_REACTOR_CONTINUE;
 		}
 		/* }}} */
 
 		logger(LOG_WARNING, "unhandled [%s] PDU (of %i frames) received on management port",
 			pdu_type(pdu), pdu_size(pdu));
+		pdu_send_and_free(pdu_reply(pdu, "ERROR", 1, "Unrecognized request"), socket);
 		return VIGOR_REACTOR_CONTINUE;
 	}
 
-	if (socket == kernel->listener) {
-		/* [ STATE | ts | name | code | message ] {{{ */
-		if (_pdu_is(pdu, "STATE", 5, 5)) {
-			char *s;
-
-			s = pdu_string(pdu, 1); uint32_t ts   = strtoul(s, NULL, 10); free(s);
-			s = pdu_string(pdu, 3); uint8_t  code = atoi(s); free(s);
-			char *name = pdu_string(pdu, 2);
-			char *msg  = pdu_string(pdu, 4);
-
-			if (name && *name && msg && *msg) {
-				state_t *state = find_state(&kernel->server->db, name);
-				if (state && state->ignore == 0) {
-					logger(LOG_INFO, "updating state %s, status=%i, ts=%i, msg=[%s]", name, code, ts, msg);
-					int transition = state->stale || state->status != code;
-
-					free(state->summary);
-					state->status    = code;
-					state->summary   = strdup(msg);
-					state->last_seen = ts;
-					state->expiry    = ts + state->type->freshness;
-					state->stale     = 0;
-
-					if (transition)
-						broadcast_transition(kernel, state);
-					broadcast_state(kernel, state);
-
-				} else {
-					logger(LOG_INFO, "ignoring update for unknown state %s, status=%i, ts=%i, msg=[%s]", name, code, ts, msg);
-				}
-
-			} else {
-				logger(LOG_WARNING, "received malformed [STATE] PDU (no %s)",
-					(!name || !*name ? "name" : "message"));
-			}
-
-			free(name);
-			free(msg);
-
-			return VIGOR_REACTOR_CONTINUE;
-		}
-		/* }}} */
-		/* [ COUNTER | ts | name | increment ] {{{ */
-		if (_pdu_is(pdu, "COUNTER", 4, 4)) {
-			char *s;
-			s = pdu_string(pdu, 1); uint32_t ts   = strtoul(s, NULL, 10); free(s);
-			s = pdu_string(pdu, 3);  int32_t incr = strtol (s, NULL, 10); free(s);
-			char *name = pdu_string(pdu, 2);
-
-			if (name && *name) {
-				counter_t *counter = find_counter(&kernel->server->db, name);
-				if (counter && counter->ignore == 0) {
-					/* check for window closure */
-					if (counter->last_seen > 0 && counter->last_seen != ts
-					 && winstart(counter, counter->last_seen) != winstart(counter, ts)) {
-						logger(LOG_INFO, "counter window rollover detected between %i and %i",
-							winstart(counter, counter->last_seen), ts);
-						broadcast_counter(kernel, counter);
-						counter_reset(counter);
-					}
-
-					logger(LOG_INFO, "updating counter %s, ts=%i, incr=%i", name, ts, incr);
-					counter->last_seen = ts;
-					counter->value += incr;
-
-				} else {
-					logger(LOG_WARNING, "ignoring update for unknown counter %s, ts=%i, incr=%i", name, ts, incr);
-				}
-			} else {
-				logger(LOG_WARNING, "received malformed [COUNTER] PDU (no name)");
-			}
-			free(name);
-
-			return VIGOR_REACTOR_CONTINUE;
-		}
-		/* }}} */
-		/* [ SAMPLE | ts | name | value+ ] {{{ */
-		if (_pdu_is(pdu, "SAMPLE", 4, 0)) {
-			char *s;
-			s = pdu_string(pdu, 1); uint32_t ts = strtoul(s, NULL, 10); free(s);
-			char *name = pdu_string(pdu, 2);
-
-			if (name && *name) {
-				sample_t *sample = find_sample(&kernel->server->db, name);
-
-				if (sample && sample->ignore == 0) {
-					/* check for window closure */
-					if (sample->last_seen > 0 && sample->last_seen != ts
-					 && winstart(sample, sample->last_seen) != winstart(sample, ts)) {
-						logger(LOG_INFO, "sample window rollover detected between %i and %i",
-							winstart(sample, sample->last_seen), ts);
-						broadcast_sample(kernel, sample);
-						sample_reset(sample);
-					}
-
-					int i;
-					for (i = 3; i < pdu_size(pdu); i++) {
-						s = pdu_string(pdu, i); double v = strtod(s, NULL); free(s);
-
-						logger(LOG_INFO, "%s sample set %s, ts=%i, value=%e", (sample->last_seen ? "updating" : "starting"), name, ts, v);
-						if (sample_data(sample, v) != 0) {
-							logger(LOG_ERR, "failed to update sample set %s, ts=%i, value=%e", name, ts, v);
-							continue;
-						}
-
-						sample->last_seen = ts;
-					}
-				} else {
-					logger(LOG_WARNING, "ignoring update for unknown sample set %s, ts=%i", name, ts);
-				}
-			} else {
-				logger(LOG_WARNING, "received malformed [SAMPLE] PDU (no name)");
-			}
-			free(name);
-
-			return VIGOR_REACTOR_CONTINUE;
-		}
-		/* }}} */
-		/* [ RATE | ts | name | value ] {{{ */
-		if (_pdu_is(pdu, "RATE", 4, 4)) {
-			char *s;
-			s = pdu_string(pdu, 1); uint32_t ts = strtoul (s, NULL, 10); free(s);
-			s = pdu_string(pdu, 3); uint64_t v  = strtoull(s, NULL, 10); free(s);
-			char *name = pdu_string(pdu, 2);
-
-			if (name && *name) {
-				rate_t *rate = find_rate(&kernel->server->db, name);
-				if (rate && rate->ignore == 0) {
-					/* check for window closure */
-					if (rate->last_seen > 0 && rate->last_seen != ts
-					 && winstart(rate, rate->last_seen) != winstart(rate, ts)) {
-						logger(LOG_INFO, "rate window rollover detected between %i and %i",
-							winstart(rate, rate->last_seen), ts);
-						broadcast_rate(kernel, rate);
-						rate_reset(rate);
-					}
-
-					if (!rate->first_seen)
-						rate->first_seen = ts;
-					logger(LOG_INFO, "%s rate set %s, ts=%i, value=%lu", (rate->last_seen ? "updating" : "starting"), name, ts, v);
-					if (rate_data(rate, v) != 0) {
-						logger(LOG_ERR, "failed to update rate set %s, ts=%i, value=%lu", name, ts, v);
-					} else {
-						rate->last_seen = ts;
-					}
-
-				} else {
-					logger(LOG_WARNING, "ignoring update for unknown rate set %s, ts=%i, value=%lu", name, ts, v);
-				}
-			} else {
-				logger(LOG_WARNING, "received malformed [RATE] PDU (no name)");
-			}
-			free(name);
-
-			return VIGOR_REACTOR_CONTINUE;
-		}
-		/* }}} */
-		/* [ EVENT | ts | name | description ] {{{ */
-		if (_pdu_is(pdu, "EVENT", 4, 4)) {
-			event_t *ev = vmalloc(sizeof(event_t));
-
-			char *s = pdu_string(pdu, 1); ev->timestamp = strtol(s, NULL, 10); free(s);
-			ev->name  = pdu_string(pdu, 2);
-			ev->extra = pdu_string(pdu, 3);
-			broadcast_event(kernel, ev);
+	if (socket == kernel->primary) {
+		if (_pdu_is(pdu, "REPLICATE", 2, 0))
+			replicate_apply(kernel, pdu);
+		else
+			logger(LOG_WARNING, "unhandled [%s] PDU (of %i frames) received from %s",
+				pdu_type(pdu), pdu_size(pdu), kernel->server->config.standby_for);
+		return VIGOR_REACTOR_CONTINUE;
+	}
 
-			buffer_event(&kernel->server->db, ev,
-				kernel->server->config.events_max,
-				kernel->server->config.events_keep);
+	if (socket == kernel->listener) {
+		submit_pdu(kernel, pdu);
+		return VIGOR_REACTOR_CONTINUE;
+	}
 
+	if (socket == kernel->updates) {
+		/* [ UPDATE | update_t*... ] */
+		update_t *u;
+		size_t i, n = 0;
+		if (!_pdu_is(pdu, "UPDATE", 2, 2)
+		 || (n = pdu_segment_size(pdu, 1)) == 0 || n % sizeof(u) != 0) {
+			logger(LOG_ERR, "unhandled [%s] PDU (of %i frames) received on kernel.updates",
+				pdu_type(pdu), pdu_size(pdu));
 			return VIGOR_REACTOR_CONTINUE;
 		}
-		/* }}} */
-		/* [ SET.KEYS | (key|value)+ ] {{{ */
-		if (_pdu_is(pdu, "SET.KEYS", 3, 0) && (pdu_size(pdu) - 1) % 2 == 0) {
-			char *key, *value;
-			int i;
-			for (i = 1; i < pdu_size(pdu); i += 2) {
-				key   = pdu_string(pdu, i);
-				value = pdu_string(pdu, i + 1);
-
-				logger(LOG_INFO, "set key %s = '%s'", key, value);
-				char *existing = hash_set(&kernel->server->keys, key, value);
-				free(key);
-				if (existing != value)
-					free(existing);
-			}
-
-			return VIGOR_REACTOR_CONTINUE;
+		for (i = 0; i < n; i += sizeof(u)) {
+			memcpy(&u, pdu_segment(pdu, 1) + i, sizeof(u));
+			submit(kernel, u->raw, u);
+			pdu_free(u->raw);
+			free(u);
 		}
-		/* }}} */
-
-		logger(LOG_WARNING, "unhandled [%s] PDU (of %i frames) received on listener port",
-			pdu_type(pdu), pdu_size(pdu));
 		return VIGOR_REACTOR_CONTINUE;
 	}
 
@@ -1041,6 +4000,24 @@ static int _kernel_reactor(void *socket, pdu_t *pdu, void *_) /* {{{ */
 	return VIGOR_REACTOR_HALT;
 }
 /* }}} */
+static int _kernel_management(void *socket, pdu_t *pdu, void *_) /* {{{ */
+{
+	kernel_t *kernel = (kernel_t*)_;
+	kernel->mutated = 0;
+
+	int rc = _kernel_reactor(socket, pdu, _);
+
+	/* followers have to forget what we forgot, or they will
+	   bring it all back when they take over */
+	if (kernel->mutated && kernel->replicas)
+		replicate(kernel, pdu);
+
+	/* so that readers see the effects of FORGET et al. straight away */
+	if (kernel->mutated && kernel->snapshots)
+		__atomic_store_n(&kernel->snapshots->stale, 1, __ATOMIC_SEQ_CST);
+	return rc;
+}
+/* }}} */
 int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 {
 	assert(zmq != NULL);
@@ -1054,6 +4031,14 @@ int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 	kernel->sweep.interval = server->interval.sweep;
 	/* set the savestate interval */
 	kernel->savestate.interval = server->interval.savestate;
+
+	if (server->config.topk_size > 0) {
+		int i;
+		for (i = 0; i < 2 * TOPK_LISTS; i++)
+			topk_init(&kernel->topk.lists[i / TOPK_LISTS][i % TOPK_LISTS], server->config.topk_size);
+		kernel->topk.since[0] = time_s();
+	}
+	evict_reset(kernel);
 	if (kernel->server->config.savefile) {
 		if (binf_read(&kernel->server->db, kernel->server->config.savefile, kernel->server->config.save_size) != 0) {
 			logger(LOG_WARNING, "kernel failed to read state from %s: %s",
@@ -1062,10 +4047,25 @@ int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 	}
 
 	if (kernel->server->config.keysfile) {
-		if (read_keys(&kernel->server->keys, kernel->server->config.keysfile) != 0) {
+		if (read_keys(&kernel->server->keys, &kernel->server->keynames, kernel->server->config.keysfile) != 0) {
 			logger(LOG_WARNING, "kernel failed to read keys from %s: %s",
 					kernel->server->config.keysfile, strerror(errno));
 		}
+
+		/* replay whatever changed after the keysfile was last
+		   written, and fold it all back into a fresh keysfile */
+		char *key, *value;
+		char *log = string("%s.log", kernel->server->config.keysfile);
+		int replay = access(log, F_OK) == 0;
+		if (replay)
+			read_keys(&kernel->server->keys, &kernel->server->keynames, log);
+		free(log);
+
+		for_each_key_value(&kernel->server->keys, key, value)
+			if (value)
+				kernel->keys.count++;
+		if (replay)
+			compact_keys(kernel);
 	}
 
 	logger(LOG_DEBUG, "kernel: connecting kernel.control to supervisor.command");
@@ -1078,7 +4078,25 @@ int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 	if (rc != 0)
 		return rc;
 
-	if (server->config.listener) {
+	if (server->config.listener_threads > 0 || server->config.udp_port
+	 || server->config.shm_ring) {
+		logger(LOG_DEBUG, "kernel: binding kernel.updates PULL socket to inproc://bolo/v1/kernel.updates");
+		kernel->updates = zmq_socket(zmq, ZMQ_PULL);
+		if (!kernel->updates)
+			return -1;
+		rc = zmq_bind(kernel->updates, "inproc://bolo/v1/kernel.updates");
+		if (rc != 0)
+			return rc;
+	}
+
+	if (server->config.listener && server->config.listener_threads > 0) {
+		/* decoders own the listener endpoint, and
+		   pass us the submissions, already decoded */
+		rc = core_listener_threads(zmq, kernel);
+		if (rc != 0)
+			return rc;
+
+	} else if (server->config.listener) {
 		logger(LOG_DEBUG, "kernel: binding kernel.listener PULL socket to %s",
 			server->config.listener);
 		kernel->listener = zmq_socket(zmq, ZMQ_PULL);
@@ -1091,6 +4109,18 @@ int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 		logger(LOG_DEBUG, "kernel: no listener bind specified; skipping");
 	}
 
+	if (server->config.udp_port) {
+		rc = core_udp_thread(zmq, kernel);
+		if (rc != 0)
+			return rc;
+	}
+
+	if (server->config.shm_ring) {
+		rc = core_shm_thread(zmq, kernel);
+		if (rc != 0)
+			return rc;
+	}
+
 	if (server->config.broadcast) {
 		logger(LOG_DEBUG, "kernel: binding kernel.broadcast PUB socket to %s",
 			server->config.broadcast);
@@ -1104,6 +4134,17 @@ int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 		logger(LOG_DEBUG, "kernel: no broadcast bind specified; skipping");
 	}
 
+	if (server->config.broadcast_tsdp) {
+		logger(LOG_DEBUG, "kernel: binding kernel.tsdp PUB socket to %s",
+			server->config.broadcast_tsdp);
+		kernel->tsdp = zmq_socket(zmq, ZMQ_PUB);
+		if (!kernel->tsdp)
+			return -1;
+		rc = zmq_bind(kernel->tsdp, server->config.broadcast_tsdp);
+		if (rc != 0)
+			return rc;
+	}
+
 	if (server->config.beacon) {
 		logger(LOG_DEBUG, "kernel: binding kernel.beacon PUB socket to %s",
 			server->config.beacon);
@@ -1117,15 +4158,67 @@ int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 		logger(LOG_DEBUG, "kernel: no beacon bind specified; skipping");
 	}
 
+	if (server->config.upstream) {
+		logger(LOG_DEBUG, "kernel: connecting kernel.upstream PUSH socket to %s",
+			server->config.upstream);
+		kernel->upstream = zmq_socket(zmq, ZMQ_PUSH);
+		if (!kernel->upstream)
+			return -1;
+		/* never block the kernel on an upstream that can't keep up */
+		int zero = 0, linger = 1000;
+		zmq_setsockopt(kernel->upstream, ZMQ_SNDTIMEO, &zero,   sizeof(zero));
+		zmq_setsockopt(kernel->upstream, ZMQ_LINGER,   &linger, sizeof(linger));
+		rc = zmq_connect(kernel->upstream, server->config.upstream);
+		if (rc != 0)
+			return rc;
+	}
+
+	if (server->config.replication) {
+		logger(LOG_DEBUG, "kernel: binding kernel.replicas PUB socket to %s",
+			server->config.replication);
+		kernel->replicas = zmq_socket(zmq, ZMQ_PUB);
+		if (!kernel->replicas)
+			return -1;
+		rc = zmq_bind(kernel->replicas, server->config.replication);
+		if (rc != 0)
+			return rc;
+	}
+
+	if (server->config.standby_for) {
+		logger(LOG_DEBUG, "kernel: connecting kernel.primary SUB socket to %s",
+			server->config.standby_for);
+		kernel->primary = zmq_socket(zmq, ZMQ_SUB);
+		if (!kernel->primary)
+			return -1;
+		rc = zmq_setsockopt(kernel->primary, ZMQ_SUBSCRIBE, "", 0);
+		if (rc != 0)
+			return rc;
+		rc = zmq_connect(kernel->primary, server->config.standby_for);
+		if (rc != 0)
+			return rc;
+		kernel->replica.standby = 1;
+	}
+
 	if (server->config.controller) {
-		logger(LOG_DEBUG, "kernel: binding kernel.management ROUTER socket to %s",
-			server->config.controller);
+		/* with query.threads, readers own the controller endpoint,
+		   and pass us anything they can't answer from a snapshot */
+		const char *endpoint = server->config.query_threads > 0
+			? "inproc://bolo/v1/kernel.management"
+			: server->config.controller;
+
+		logger(LOG_DEBUG, "kernel: binding kernel.management ROUTER socket to %s", endpoint);
 		kernel->management = zmq_socket(zmq, ZMQ_ROUTER);
 		if (!kernel->management)
 			return -1;
-		rc = zmq_bind(kernel->management, server->config.controller);
+		rc = zmq_bind(kernel->management, endpoint);
 		if (rc != 0)
 			return rc;
+
+		if (server->config.query_threads > 0) {
+			rc = core_reader_threads(zmq, kernel);
+			if (rc != 0)
+				return rc;
+		}
 	} else {
 		logger(LOG_DEBUG, "kernel: no management bind specified; skipping");
 	}
@@ -1152,9 +4245,23 @@ int core_kernel_thread(void *zmq, server_t *server) /* {{{ */
 			return rc;
 	}
 
+	if (kernel->primary) {
+		logger(LOG_DEBUG, "kernel: registering kernel.primary with event reactor");
+		rc = reactor_set(kernel->reactor, kernel->primary, _kernel_reactor, kernel);
+		if (rc != 0)
+			return rc;
+	}
+
+	if (kernel->updates) {
+		logger(LOG_DEBUG, "kernel: registering kernel.updates with event reactor");
+		rc = reactor_set(kernel->reactor, kernel->updates, _kernel_reactor, kernel);
+		if (rc != 0)
+			return rc;
+	}
+
 	if (kernel->management) {
 		logger(LOG_DEBUG, "kernel: registering kernel.management with event reactor");
-		rc = reactor_set(kernel->reactor, kernel->management, _kernel_reactor, kernel);
+		rc = reactor_set(kernel->reactor, kernel->management, _kernel_management, kernel);
 		if (rc != 0)
 			return rc;
 	}
@@ -18,6 +18,7 @@
  */
 
 #include "bolo.h"
+#include <math.h>
 
 void sample_reset(sample_t *sample)
 {
@@ -27,6 +28,7 @@ void sample_reset(sample_t *sample)
 	sample->sum  = sample->n     = 0;
 	sample->mean = sample->mean_ = 0;
 	sample->var  = sample->var_  = 0;
+	mark_dirty(sample);
 }
 
 int sample_data(sample_t *s, double v)
@@ -46,6 +48,46 @@ int sample_data(sample_t *s, double v)
 	s->var_ = s->var;
 	s->var = ( (s->n - 1) * s->var_ + ( (v - s->mean_) * (v - s->mean) ) ) / s->n;
 
+	mark_dirty(s);
+	return 0;
+}
+
+int sample_merge(sample_t *s, uint64_t n, double min, double max, double sum, double mean, double var)
+{
+	if (n == 0)
+		return 0;
+
+	/* clients aggregate for themselves, now; don't trust them.
+	   (NaN gets through every comparison, so check for it first) */
+	if (!isfinite(min) || !isfinite(max) || !isfinite(sum)
+	 || !isfinite(mean) || !isfinite(var))
+		return 1;
+	if (min > max || var < 0 || mean < min || mean > max)
+		return 1;
+
+	if (s->n == 0) {
+		s->min = min;
+		s->max = max;
+	} else {
+		if (min < s->min) s->min = min;
+		if (max > s->max) s->max = max;
+	}
+	s->sum += sum;
+
+	/* combine the two (population) variances, per Chan et al.,
+	   so that merging windows gives the same answer as feeding
+	   every value through sample_data() would have */
+	double delta = mean - s->mean;
+	uint64_t total = s->n + n;
+
+	s->mean_ = s->mean;
+	s->mean  = s->mean_ + delta * n / total;
+
+	s->var_ = s->var;
+	s->var  = ( s->n * s->var_ + n * var + delta * delta * s->n * n / total ) / total;
+
+	s->n = total;
+	mark_dirty(s);
 	return 0;
 }
 
@@ -53,12 +95,14 @@ void counter_reset(counter_t *counter)
 {
 	counter->last_seen = 0;
 	counter->value = 0;
+	mark_dirty(counter);
 }
 
 void rate_reset(rate_t *r)
 {
 	r->first_seen = r->last_seen = 0;
 	r->first = r->last = 0;
+	mark_dirty(r);
 }
 
 int rate_data(rate_t *r, uint64_t v)
@@ -66,6 +110,33 @@ int rate_data(rate_t *r, uint64_t v)
 	r->last = v;
 	if (!r->last_seen)
 		r->first = v;
+	mark_dirty(r);
+	return 0;
+}
+
+uint64_t rate_diff(rate_t *r)
+{
+	if (r->last >= r->first)
+		return r->last - r->first;
+
+	if (r->first < 0xffff) /* 32-bit rollover */
+		return 0xffff - r->first + r->last;
+	else /* 64-bit rollover */
+		return 0xffffffff - r->first + r->last;
+}
+
+int rate_merge(rate_t *r, int32_t first, int32_t last, uint64_t diff)
+{
+	/* keep a running total, starting from zero, and stretch
+	   the window to cover everyone's first and last readings */
+	if (!r->last_seen) {
+		r->first = r->last = 0;
+		r->first_seen = first;
+	}
+	r->last += diff;
+	if (first < r->first_seen) r->first_seen = first;
+	if (last  > r->last_seen)  r->last_seen  = last;
+	mark_dirty(r);
 	return 0;
 }
 
@@ -74,19 +145,32 @@ double rate_calc(rate_t *r, int32_t span)
 	if (!r->last_seen)
 		return 0.0;
 
-	uint64_t diff;
-	if (r->last >= r->first) {
-		diff = r->last - r->first;
-	} else {
-		if (r->first < 0xffff) { /* 32-bit rollover */
-			diff = 0xffff - r->first + r->last;
-		} else { /* 64-bit rollover */
-			diff = 0xffffffff - r->first + r->last;
-		}
-	}
-	return diff * 1.0 / (r->last_seen - r->first_seen) * span;
+	return rate_diff(r) * 1.0 / (r->last_seen - r->first_seen) * span;
+}
+
+/* may we auto-create another record for this rule?
+   (limit.rule and limit.metrics; zero means unlimited) */
+static int s_admit(db_t *db, int limit, int count)
+{
+	if (limit && count >= limit)
+		return 0;
+	if (db->limit.metrics && db->limit.count >= db->limit.metrics)
+		return 0;
+	return 1;
 }
 
+#define ADMITTED(db,re,x) do { \
+	(x)->rule = (re); \
+	(re)->count++; \
+	(db)->limit.count++; \
+	(db)->limit.created++; \
+} while (0)
+
+#define RELEASED(db,x) do { \
+	(x)->rule->count--; \
+	(db)->limit.count--; \
+} while (0)
+
 state_t *find_state(db_t *db, const char *name)
 {
 	state_t *x = hash_get(&db->states, name);
@@ -96,14 +180,22 @@ state_t *find_state(db_t *db, const char *name)
 	re_state_t *re;
 	for_each_object(re, &db->state_matches, l) {
 		if (pcre_exec(re->re, re->re_extra, name, strlen(name), 0, 0, NULL, 0) == 0) {
+			if (!s_admit(db, re->limit, re->count)) {
+				/* there is no sensible way to fold states together */
+				db->limit.rejected++;
+				return NULL;
+			}
+
 			x = calloc(1, sizeof(state_t));
 			hash_set(&db->states, name, x);
+			trie_insert(&db->names, name, PAYLOAD_STATE);
 			x->name    = strdup(name);
 			x->type    = re->type;
 			x->status  = PENDING;
 			x->expiry  = re->type->freshness + time_s();
 			x->summary = strdup("(state is pending results)");
 			x->ignore  = 0;
+			ADMITTED(db, re, x);
 			return x;
 		}
 	}
@@ -114,18 +206,44 @@ state_t *find_state(db_t *db, const char *name)
 counter_t *find_counter(db_t *db, const char *name)
 {
 	counter_t *x = hash_get(&db->counters, name);
-	if (x) return x;
+	if (x) {
+		x->active = time_s();
+		return x;
+	}
 
 	/* check the regex rules */
 	re_counter_t *re;
 	for_each_object(re, &db->counter_matches, l) {
 		if (pcre_exec(re->re, re->re_extra, name, strlen(name), 0, 0, NULL, 0) == 0) {
+			int fold = 0;
+			if (!s_admit(db, re->limit, re->count)) {
+				if (db->limit.overflow != LIMIT_FOLD) {
+					db->limit.rejected++;
+					return NULL;
+				}
+
+				/* fold into a single, explicit __overflow__ counter */
+				db->limit.folded++;
+				if ((x = hash_get(&db->counters, OVERFLOW_NAME)) != NULL) {
+					x->active = time_s();
+					return x;
+				}
+				name = OVERFLOW_NAME;
+				fold = 1;
+			}
+
 			x = calloc(1, sizeof(counter_t));
 			hash_set(&db->counters, name, x);
+			trie_insert(&db->names, name, PAYLOAD_COUNTER);
 			x->name    = strdup(name);
 			x->window  = re->window;
 			x->value   = 0;
 			x->ignore  = 0;
+			x->active  = time_s();
+			if (!fold) {
+				ADMITTED(db, re, x);
+				list_push(&db->auto_counters, &x->l);
+			}
 			return x;
 		}
 	}
@@ -136,18 +254,44 @@ counter_t *find_counter(db_t *db, const char *name)
 sample_t *find_sample(db_t *db, const char *name)
 {
 	sample_t *x = hash_get(&db->samples, name);
-	if (x) return x;
+	if (x) {
+		x->active = time_s();
+		return x;
+	}
 
 	/* check the regex rules */
-	re_counter_t *re;
+	re_sample_t *re;
 	for_each_object(re, &db->sample_matches, l) {
 		if (pcre_exec(re->re, re->re_extra, name, strlen(name), 0, 0, NULL, 0) == 0) {
+			int fold = 0;
+			if (!s_admit(db, re->limit, re->count)) {
+				if (db->limit.overflow != LIMIT_FOLD) {
+					db->limit.rejected++;
+					return NULL;
+				}
+
+				/* fold into a single, explicit __overflow__ sample */
+				db->limit.folded++;
+				if ((x = hash_get(&db->samples, OVERFLOW_NAME)) != NULL) {
+					x->active = time_s();
+					return x;
+				}
+				name = OVERFLOW_NAME;
+				fold = 1;
+			}
+
 			x = calloc(1, sizeof(sample_t));
 			hash_set(&db->samples, name, x);
+			trie_insert(&db->names, name, PAYLOAD_SAMPLE);
 			x->name    = strdup(name);
 			x->window  = re->window;
 			x->n       = 0;
 			x->ignore  = 0;
+			x->active  = time_s();
+			if (!fold) {
+				ADMITTED(db, re, x);
+				list_push(&db->auto_samples, &x->l);
+			}
 			return x;
 		}
 	}
@@ -158,20 +302,101 @@ sample_t *find_sample(db_t *db, const char *name)
 rate_t *find_rate(db_t *db, const char *name)
 {
 	rate_t *x = hash_get(&db->rates, name);
-	if (x) return x;
+	if (x) {
+		x->active = time_s();
+		return x;
+	}
 
 	/* check the regex rules */
 	re_rate_t *re;
 	for_each_object(re, &db->rate_matches, l) {
 		if (pcre_exec(re->re, re->re_extra, name, strlen(name), 0, 0, NULL, 0) == 0) {
+			int fold = 0;
+			if (!s_admit(db, re->limit, re->count)) {
+				if (db->limit.overflow != LIMIT_FOLD) {
+					db->limit.rejected++;
+					return NULL;
+				}
+
+				/* fold into a single, explicit __overflow__ rate */
+				db->limit.folded++;
+				if ((x = hash_get(&db->rates, OVERFLOW_NAME)) != NULL) {
+					x->active = time_s();
+					return x;
+				}
+				name = OVERFLOW_NAME;
+				fold = 1;
+			}
+
 			x = calloc(1, sizeof(rate_t));
 			hash_set(&db->rates, name, x);
-			x->name   = strdup(name);
-			x->window = re->window;
-			x->ignore = 0;
+			trie_insert(&db->names, name, PAYLOAD_RATE);
+			x->name    = strdup(name);
+			x->window  = re->window;
+			x->ignore  = 0;
+			x->active  = time_s();
+			if (!fold) {
+				ADMITTED(db, re, x);
+				list_push(&db->auto_rates, &x->l);
+			}
 			return x;
 		}
 	}
 
 	return NULL;
 }
+
+void release_state(db_t *db, state_t *x)
+{
+	if (hash_get(&db->states, x->name) == x) {
+		hash_unset(&db->states, x->name);
+		trie_remove(&db->names, x->name, PAYLOAD_STATE);
+	}
+	if (x->rule)
+		RELEASED(db, x);
+	free(x->name);
+	free(x->summary);
+	free(x);
+}
+
+void release_counter(db_t *db, counter_t *x)
+{
+	if (hash_get(&db->counters, x->name) == x) {
+		hash_unset(&db->counters, x->name);
+		trie_remove(&db->names, x->name, PAYLOAD_COUNTER);
+	}
+	if (x->rule) {
+		list_delete(&x->l);
+		RELEASED(db, x);
+	}
+	free(x->name);
+	free(x);
+}
+
+void release_sample(db_t *db, sample_t *x)
+{
+	if (hash_get(&db->samples, x->name) == x) {
+		hash_unset(&db->samples, x->name);
+		trie_remove(&db->names, x->name, PAYLOAD_SAMPLE);
+	}
+	if (x->rule) {
+		list_delete(&x->l);
+		RELEASED(db, x);
+	}
+	free(x->name);
+	free(x);
+}
+
+void release_rate(db_t *db, rate_t *x)
+{
+	if (hash_get(&db->rates, x->name) == x) {
+		hash_unset(&db->rates, x->name);
+		trie_remove(&db->names, x->name, PAYLOAD_RATE);
+	}
+	if (x->rule) {
+		list_delete(&x->l);
+		RELEASED(db, x);
+	}
+	free(x->name);
+	free(x);
+}
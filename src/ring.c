@@ -0,0 +1,232 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bolo.h"
+
+/*
+   The event buffer.
+
+   Events go in at the tail and come off the head, so they are kept
+   in a ring of fixed-size entries; the variable-length bits (name and
+   extra data) are packed, back to back, into a second ring of bytes
+   (the arena).  An event's strings never straddle the end of the
+   arena; if they don't fit in what's left, they go at the start, and
+   the gap is reclaimed when the head catches up with it.
+
+   Neither ring shrinks.  Both grow (by doubling, copying everything
+   over in order) when a push doesn't fit, so it is up to the caller
+   to shift old events off first, if it wants to stay within a size.
+
+   Each entry also records the latest timestamp seen up to and
+   including it, which never goes down, even if submitted timestamps
+   do; ring_since() binary searches on that.
+
+   Events are numbered as they are pushed, and grouped into batches
+   of consecutive events, for saving (see binf.c).
+ */
+
+#define RING_BATCH        256   /* events */
+#define RING_BATCH_BYTES  32768
+
+#define s_entry(r,i) (&(r)->entries[((r)->head + (i)) % (r)->cap])
+
+void ring_init(ring_t *r)
+{
+	memset(r, 0, sizeof(*r));
+	list_init(&r->batches);
+}
+
+void ring_done(ring_t *r)
+{
+	ring_batch_t *b, *tmp;
+	if (r->batches.next) {
+		for_each_object_safe(b, tmp, &r->batches, l) {
+			list_delete(&b->l);
+			free(b);
+		}
+	}
+	free(r->entries);
+	free(r->arena);
+	ring_init(r);
+}
+
+static void s_grow(ring_t *r, size_t cap, size_t size)
+{
+	ring_entry_t *entries = vmalloc(cap * sizeof(ring_entry_t));
+	char *arena = vmalloc(size);
+	size_t i, end = 0;
+
+	for (i = 0; i < r->n; i++) {
+		ring_entry_t *e = s_entry(r, i);
+		entries[i] = *e;
+		entries[i].off = end;
+		memcpy(arena + end, r->arena + e->off, e->len);
+		end += e->len;
+	}
+
+	free(r->entries);
+	free(r->arena);
+	r->entries = entries;
+	r->cap     = cap;
+	r->head    = 0;
+	r->arena   = arena;
+	r->size    = size;
+	r->start   = 0;
+	r->end     = end;
+}
+
+void ring_reserve(ring_t *r, size_t n)
+{
+	if (n <= r->cap)
+		return;
+	/* guess at 64 bytes of strings per event, to start */
+	s_grow(r, n, r->size > n * 64 ? r->size : n * 64);
+}
+
+/* where len bytes would go in the arena, or -1 if they won't fit */
+static ssize_t s_place(ring_t *r, size_t len)
+{
+	if (r->n == 0)
+		return len <= r->size ? 0 : -1;
+
+	if (r->end > r->start) {
+		if (r->end + len <= r->size)
+			return r->end;
+		return len < r->start ? 0 : -1;
+	}
+	return r->end + len < r->start ? (ssize_t)r->end : -1;
+}
+
+void ring_push(ring_t *r, int32_t ts, const char *name, const char *extra)
+{
+	size_t nlen = strlen(name) + 1;
+	size_t len  = nlen + strlen(extra) + 1;
+	ssize_t off;
+
+	if (r->n == r->cap)
+		s_grow(r, r->cap ? r->cap * 2 : 64, r->size);
+	while ((off = s_place(r, len)) < 0) {
+		size_t size = r->size ? r->size * 2 : 4096;
+		while (size < len * 2)
+			size *= 2;
+		s_grow(r, r->cap, size);
+	}
+
+	ring_entry_t *e = s_entry(r, r->n);
+	e->timestamp = ts;
+	e->latest    = r->n > 0 && s_entry(r, r->n - 1)->latest > ts
+	             ? s_entry(r, r->n - 1)->latest : ts;
+	e->off       = off;
+	e->len       = len;
+	memcpy(r->arena + off,        name,  nlen);
+	memcpy(r->arena + off + nlen, extra, len - nlen);
+
+	if (r->n == 0)
+		r->start = off;
+	r->end = off + len;
+	r->n++;
+
+	/* batch it up, for saving */
+	uint64_t seq = r->seq + r->n - 1;
+	ring_batch_t *b = list_isempty(&r->batches) ? NULL
+	                : list_tail(&r->batches, ring_batch_t, l);
+	if (!b || r->sealed || b->last - b->first >= RING_BATCH
+	 || (b->bytes > 0 && b->bytes + 4 + len > RING_BATCH_BYTES)) {
+		b = vmalloc(sizeof(ring_batch_t));
+		b->first = b->last = seq;
+		list_push(&r->batches, &b->l);
+		r->sealed = 0;
+	}
+	b->last++;
+	b->bytes += 4 + len;
+	mark_dirty(b);
+}
+
+void ring_shift(ring_t *r)
+{
+	if (r->n == 0)
+		return;
+
+	ring_entry_t *e = s_entry(r, 0);
+	if (!list_isempty(&r->batches)) {
+		ring_batch_t *b = list_head(&r->batches, ring_batch_t, l);
+		b->first++;
+		b->bytes -= 4 + e->len;
+		mark_dirty(b);
+		if (b->first >= b->last) {
+			list_delete(&b->l);
+			free(b);
+		}
+	}
+
+	r->head = (r->head + 1) % r->cap;
+	r->seq++;
+	r->n--;
+	if (r->n == 0)
+		r->start = r->end = 0;
+	else
+		r->start = s_entry(r, 0)->off;
+}
+
+void ring_seal(ring_t *r)
+{
+	r->sealed = 1;
+}
+
+ring_entry_t* ring_get(ring_t *r, size_t i)
+{
+	return i < r->n ? s_entry(r, i) : NULL;
+}
+
+size_t ring_since(ring_t *r, int32_t ts)
+{
+	size_t lo = 0, hi = r->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (s_entry(r, mid)->latest < ts)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void ring_copy(ring_t *dst, ring_t *src)
+{
+	ring_init(dst);
+	if (src->n == 0)
+		return;
+
+	size_t i, end = 0;
+	for (i = 0; i < src->n; i++)
+		end += s_entry(src, i)->len;
+
+	dst->entries = vmalloc(src->n * sizeof(ring_entry_t));
+	dst->arena   = vmalloc(end);
+	dst->cap     = dst->n = src->n;
+	dst->size    = end;
+
+	for (i = 0; i < src->n; i++) {
+		ring_entry_t *e = s_entry(src, i);
+		dst->entries[i] = *e;
+		dst->entries[i].off = dst->end;
+		memcpy(dst->arena + dst->end, src->arena + e->off, e->len);
+		dst->end += e->len;
+	}
+}
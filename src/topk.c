@@ -0,0 +1,195 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bolo.h"
+
+/*
+   Space-Saving heavy-hitter tracking (Metwally, Agrawal & El Abbadi).
+
+   We keep exactly k counters.  A name we are already tracking has its
+   count bumped; a new name takes over the counter with the smallest
+   count, inheriting that count (+1) and remembering it as its error
+   bound.  Any name that occurs more than 1/k of the time is guaranteed
+   to be in the list.
+
+   Names are indexed by a small open-addressed hash table (not a vigor
+   hash_t, which never forgets a key) so that memory stays bounded no
+   matter how many distinct names churn through.
+ */
+
+#define EMPTY -1
+
+static uint32_t s_hash(const char *s)
+{
+	uint32_t h = 2166136261u;
+	while (*s) {
+		h ^= (uint8_t)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static int s_find(topk_t *t, const char *name, uint32_t hash)
+{
+	uint32_t i;
+	for (i = hash & t->mask; t->slots[i] != EMPTY; i = (i + 1) & t->mask) {
+		topk_entry_t *e = &t->entries[t->slots[i]];
+		if (e->hash == hash && strcmp(e->name, name) == 0)
+			return i;
+	}
+	return -(int)i - 2; /* where it would go */
+}
+
+static void s_unslot(topk_t *t, uint32_t i)
+{
+	/* backward-shift deletion, so that lookups never need tombstones */
+	uint32_t j = i, h;
+	for (;;) {
+		j = (j + 1) & t->mask;
+		if (t->slots[j] == EMPTY)
+			break;
+
+		h = t->entries[t->slots[j]].hash & t->mask;
+		if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+			continue;
+
+		t->slots[i] = t->slots[j];
+		i = j;
+	}
+	t->slots[i] = EMPTY;
+}
+
+int topk_init(topk_t *t, int k)
+{
+	memset(t, 0, sizeof(*t));
+	if (k < 1)
+		return -1;
+
+	uint32_t size = 8;
+	while (size < (uint32_t)k * 2)
+		size <<= 1;
+
+	t->k       = k;
+	t->mask    = size - 1;
+	t->entries = calloc(k, sizeof(topk_entry_t));
+	t->slots   = malloc(size * sizeof(int32_t));
+	if (!t->entries || !t->slots) {
+		topk_done(t);
+		return -1;
+	}
+
+	uint32_t i;
+	for (i = 0; i < size; i++)
+		t->slots[i] = EMPTY;
+	return 0;
+}
+
+void topk_reset(topk_t *t)
+{
+	int i;
+	for (i = 0; i < t->n; i++) {
+		free(t->entries[i].name);
+		t->entries[i].name = NULL;
+	}
+	for (i = 0; i <= (int)t->mask; i++)
+		t->slots[i] = EMPTY;
+	t->n = 0;
+	t->total = 0;
+}
+
+void topk_done(topk_t *t)
+{
+	if (t->slots)
+		topk_reset(t);
+	free(t->entries);
+	free(t->slots);
+	memset(t, 0, sizeof(*t));
+}
+
+uint32_t topk_hash(const char *name)
+{
+	return s_hash(name);
+}
+
+void topk_add(topk_t *t, const char *name)
+{
+	if (name)
+		topk_add_hashed(t, name, s_hash(name));
+}
+
+void topk_add_hashed(topk_t *t, const char *name, uint32_t hash)
+{
+	if (!t->k || !name)
+		return;
+
+	int i = s_find(t, name, hash);
+	t->total++;
+
+	if (i >= 0) {
+		t->entries[t->slots[i]].count++;
+		return;
+	}
+
+	if (t->n < t->k) {
+		topk_entry_t *e = &t->entries[t->n];
+		e->name  = strdup(name);
+		e->hash  = hash;
+		e->count = 1;
+		e->error = 0;
+		t->slots[-i - 2] = t->n++;
+		return;
+	}
+
+	/* evict the least frequent name; O(k), but k is small */
+	int m, min = 0;
+	for (m = 1; m < t->n; m++)
+		if (t->entries[m].count < t->entries[min].count)
+			min = m;
+
+	topk_entry_t *e = &t->entries[min];
+	s_unslot(t, s_find(t, e->name, e->hash));
+	free(e->name);
+	e->name  = strdup(name);
+	e->hash  = hash;
+	e->error = e->count;
+	e->count++;
+
+	i = s_find(t, name, hash);
+	t->slots[-i - 2] = min;
+}
+
+static int s_by_count(const void *a, const void *b)
+{
+	const topk_entry_t *x = *(const topk_entry_t **)a;
+	const topk_entry_t *y = *(const topk_entry_t **)b;
+	return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+int topk_sorted(topk_t *t, topk_entry_t ***list)
+{
+	int i;
+	*list = calloc(t->n ? t->n : 1, sizeof(topk_entry_t *));
+	if (!*list)
+		return -1;
+
+	for (i = 0; i < t->n; i++)
+		(*list)[i] = &t->entries[i];
+	qsort(*list, t->n, sizeof(topk_entry_t *), s_by_count);
+	return t->n;
+}
@@ -0,0 +1,300 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bolo.h"
+
+/*
+   A path-compressed radix trie, used as an ordered secondary index
+   over names that otherwise live in (unordered) vigor hashes.
+
+   Each node holds the bytes of the edge leading into it, and the set
+   of bits (i.e. PAYLOAD_* types) for which the path from the root to
+   it is a key.  Children are kept sorted by the first byte of their
+   edge, so that walks visit keys in lexical order, and no two
+   children share a first byte.  The root has an empty edge.
+
+   A zeroed trie_t is a valid, empty trie.
+ */
+
+typedef struct {
+	char   *buf;
+	size_t  len, cap;
+} path_t;
+
+static size_t s_common(const char *a, size_t alen, const char *b)
+{
+	size_t i;
+	for (i = 0; i < alen && b[i] && a[i] == b[i]; i++)
+		;
+	return i;
+}
+
+/* index of the child whose edge starts with c, or where it would go */
+static int s_child(trie_t *t, uint8_t c, int *found)
+{
+	int lo = 0, hi = t->n;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		uint8_t x = (uint8_t)t->kids[mid]->edge[0];
+		if (x == c) {
+			*found = 1;
+			return mid;
+		}
+		if (x < c) lo = mid + 1;
+		else       hi = mid;
+	}
+	*found = 0;
+	return lo;
+}
+
+static trie_t* s_node(const char *edge, size_t len)
+{
+	trie_t *t = calloc(1, sizeof(trie_t));
+	t->edge = malloc(len + 1);
+	memcpy(t->edge, edge, len);
+	t->edge[len] = '\0';
+	t->len = len;
+	return t;
+}
+
+static void s_adopt(trie_t *t, int at, trie_t *kid)
+{
+	t->kids = realloc(t->kids, (t->n + 1) * sizeof(trie_t *));
+	memmove(&t->kids[at + 1], &t->kids[at], (t->n - at) * sizeof(trie_t *));
+	t->kids[at] = kid;
+	t->n++;
+}
+
+static void s_free(trie_t *t)
+{
+	int i;
+	for (i = 0; i < t->n; i++) {
+		s_free(t->kids[i]);
+		free(t->kids[i]);
+	}
+	free(t->kids);
+	free(t->edge);
+}
+
+void trie_init(trie_t *t)
+{
+	memset(t, 0, sizeof(*t));
+}
+
+void trie_done(trie_t *t)
+{
+	s_free(t);
+	memset(t, 0, sizeof(*t));
+}
+
+void trie_insert(trie_t *t, const char *key, uint16_t bits)
+{
+	int i, found;
+	for (;;) {
+		if (!*key) {
+			t->bits |= bits;
+			return;
+		}
+
+		i = s_child(t, (uint8_t)*key, &found);
+		if (!found) {
+			trie_t *leaf = s_node(key, strlen(key));
+			leaf->bits = bits;
+			s_adopt(t, i, leaf);
+			return;
+		}
+
+		trie_t *kid = t->kids[i];
+		size_t c = s_common(kid->edge, kid->len, key);
+		if (c < kid->len) {
+			/* split the edge; the new node takes the common part */
+			trie_t *mid = s_node(kid->edge, c);
+			memmove(kid->edge, kid->edge + c, kid->len - c + 1);
+			kid->len -= c;
+			s_adopt(mid, 0, kid);
+			t->kids[i] = mid;
+			kid = mid;
+		}
+
+		t = kid;
+		key += c;
+	}
+}
+
+/* fold a valueless node with a single child into that child */
+static void s_merge(trie_t *t)
+{
+	trie_t *kid = t->kids[0];
+	t->edge = realloc(t->edge, t->len + kid->len + 1);
+	memcpy(t->edge + t->len, kid->edge, kid->len + 1);
+	t->len += kid->len;
+	t->bits = kid->bits;
+
+	free(t->kids);
+	t->kids = kid->kids;
+	t->n    = kid->n;
+	free(kid->edge);
+	free(kid);
+}
+
+void trie_remove(trie_t *t, const char *key, uint16_t bits)
+{
+	if (!*key) {
+		t->bits &= ~bits;
+		return;
+	}
+
+	int i, found;
+	i = s_child(t, (uint8_t)*key, &found);
+	if (!found)
+		return;
+
+	trie_t *kid = t->kids[i];
+	if (s_common(kid->edge, kid->len, key) < kid->len)
+		return;
+
+	trie_remove(kid, key + kid->len, bits);
+	if (kid->bits)
+		return;
+
+	if (kid->n == 0) {
+		s_free(kid);
+		free(kid);
+		memmove(&t->kids[i], &t->kids[i + 1], (t->n - i - 1) * sizeof(trie_t *));
+		t->n--;
+
+	} else if (kid->n == 1) {
+		s_merge(kid);
+	}
+}
+
+static void s_push(path_t *p, const char *edge, size_t len)
+{
+	if (p->len + len + 1 > p->cap) {
+		p->cap = (p->len + len + 1) * 2;
+		p->buf = realloc(p->buf, p->cap);
+	}
+	memcpy(p->buf + p->len, edge, len);
+	p->len += len;
+	p->buf[p->len] = '\0';
+}
+
+static int s_walk(trie_t *t, path_t *p, uint16_t bits, trie_fn fn, void *udata)
+{
+	size_t len = p->len;
+	s_push(p, t->edge, t->len);
+
+	int i, rc = 0;
+	if (t->bits & bits)
+		rc = (*fn)(p->buf, t->bits & bits, udata);
+
+	for (i = 0; rc == 0 && i < t->n; i++)
+		rc = s_walk(t->kids[i], p, bits, fn, udata);
+
+	p->len = len;
+	return rc;
+}
+
+int trie_walk(trie_t *t, const char *prefix, uint16_t bits, trie_fn fn, void *udata)
+{
+	path_t p = { NULL, 0, 0 };
+	trie_t *from = t;
+	int i, found, rc = 0;
+
+	/* find the highest node whose keys all start with prefix */
+	while (*prefix) {
+		i = s_child(t, (uint8_t)*prefix, &found);
+		if (!found)
+			goto done;
+
+		trie_t *kid = t->kids[i];
+		size_t c = s_common(kid->edge, kid->len, prefix);
+		if (!prefix[c]) {
+			from = kid;
+			break;
+		}
+		if (c < kid->len)
+			goto done;
+
+		s_push(&p, kid->edge, kid->len);
+		prefix += c;
+		t = kid;
+	}
+
+	rc = s_walk(from, &p, bits, fn, udata);
+
+done:
+	free(p.buf);
+	return rc;
+}
+
+/*
+   Extract the literal prefix that every string matched by a regular
+   expression must start with, so that trie_walk() can narrow the set
+   of names that need to be run through PCRE.  Only patterns anchored
+   with a leading `^' have one; anything we aren't sure about ends the
+   prefix early, which is always safe -- the regex still gets run.
+
+   Returns the length of the prefix written to buf (NUL-terminated).
+ */
+size_t re_prefix(const char *re, char *buf, size_t len)
+{
+	const char *p;
+	size_t n = 0;
+
+	/* top-level alternation could un-anchor the pattern */
+	for (p = re; *p; p++) {
+		if (*p == '\\' && p[1]) p++;
+		else if (*p == '|') goto none;
+	}
+
+	if (*re++ != '^')
+		goto none;
+
+	while (*re && n < len - 1) {
+		char c = *re;
+		if (c == '\\') {
+			/* \d, \w, \Q etc. are not literals; \. \- \: are */
+			if (!re[1] || isalnum((unsigned char)re[1]))
+				break;
+			c = re[1];
+			re += 2;
+
+		} else if (strchr(".[]()*+?{}|^$", c)) {
+			break;
+
+		} else {
+			re++;
+		}
+
+		/* the last literal may be optional, or repeated */
+		if (*re == '*' || *re == '?' || *re == '{')
+			break;
+		buf[n++] = c;
+		if (*re == '+')
+			break;
+	}
+
+	buf[n] = '\0';
+	return n;
+
+none:
+	buf[0] = '\0';
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLO_T_LIB_H
+#define BOLO_T_LIB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+   The C side of t/lib, for the check programs that `make check'
+   builds, and that run_check_program runs for a few seeds.
+
+   Each one takes -n ITERATIONS and -s SEED (and maybe options of its
+   own), draws its numbers from rnd(), reports what it finds wrong
+   through fail(), and ends with check_done(), which prints the
+   "failures: N" line the t/ script looks for.
+ */
+
+static int FAILURES = 0;
+
+#define fail(...) do { \
+	fprintf(stderr, "FAIL: " __VA_ARGS__); \
+	fprintf(stderr, "\n"); \
+	FAILURES++; \
+} while (0)
+
+static uint64_t SEED = 1;
+
+/* xorshift64*, same as bench/ */
+static inline uint64_t rnd_r(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+static inline uint64_t rnd(void)
+{
+	return rnd_r(&SEED);
+}
+
+/* parses -n (returned, or `n' if not given) and -s (into SEED), and
+   hands any of the `opts' getopt() finds to fn, which returns non-zero
+   to reject its argument.  returns -1, having printed a usage line
+   (with `usage' for the rest of it), if there is anything wrong */
+static inline long check_options(int argc, char **argv, long n,
+                                 const char *opts, int (*fn)(int, const char *),
+                                 const char *usage)
+{
+	char spec[64];
+	int c;
+
+	snprintf(spec, sizeof(spec), "n:s:%s", opts ? opts : "");
+	while ((c = getopt(argc, argv, spec)) != -1) {
+		switch (c) {
+		case 'n': n    = strtol(optarg, NULL, 10);   break;
+		case 's': SEED = strtoull(optarg, NULL, 10); break;
+		case '?': goto usage;
+		default:
+			if (!fn || fn(c, optarg) != 0)
+				goto usage;
+		}
+	}
+	if (SEED == 0)
+		SEED = 1;
+	if (n < 1)
+		goto usage;
+	return n;
+
+usage:
+	fprintf(stderr, "Usage: %s [-n ITERATIONS] [-s SEED]%s%s\n",
+		argv[0], usage ? " " : "", usage ? usage : "");
+	return -1;
+}
+
+static inline int check_done(void)
+{
+	printf("failures: %i\n", FAILURES);
+	return FAILURES ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,265 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   t/num-check - check libbolo's number codec against libc, for t/num
+
+   -n times over, a double is drawn (from raw bit patterns, from short
+   decimals like the ones people submit, from sums and means like the
+   ones the kernel computes, and from decimals sitting right on a "%e"
+   rounding boundary), and:
+
+     1. bolo_etoa() has to match printf("%e"), octet for octet;
+     2. bolo_dtoa() has to read back (via strtod) as exactly the same
+        double, and its digits have to be the fewest that do, i.e. the
+        same as the shortest "%.Ne" that reads back;
+     3. bolo_strtod() has to match strtod() on each of those, and on
+        "%.17g", "%g" and "%.3f", both in value and in where it stops.
+
+   The same goes for a 64-bit integer (of a random number of digits),
+   through bolo_utoa / bolo_itoa against printf, and bolo_strtou /
+   bolo_strtoi against strtoull / strtoll.  Finally, a list of awkward
+   strings (signs, whitespace, hex, overflow, trailing junk...) are
+   parsed both ways.
+
+   Anything that doesn't match is reported on standard error, and
+   makes for a non-zero exit.
+ */
+
+#include <bolo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <float.h>
+#include <math.h>
+#include <locale.h>
+#include "lib.h"
+
+static int same(double a, double b) /* {{{ */
+{
+	/* bit for bit, so that -0 isn't 0, and NaN is NaN */
+	return memcmp(&a, &b, sizeof(double)) == 0;
+}
+/* }}} */
+static double random_double(void) /* {{{ */
+{
+	char buf[64];
+	union { double d; uint64_t u; } b;
+	int i, n;
+	double sum;
+
+	switch (rnd() % 5) {
+	case 0: /* anything finite */
+		do b.u = rnd(); while (isnan(b.d) || isinf(b.d));
+		return b.d;
+
+	case 1: /* a short decimal, as submitted */
+		snprintf(buf, sizeof(buf), "%s%lu.%0*lu", rnd() % 4 ? "" : "-",
+			(unsigned long)(rnd() % 100000), (int)(rnd() % 4 + 1),
+			(unsigned long)(rnd() % 10000));
+		return strtod(buf, NULL);
+
+	case 2: /* a mean, as computed */
+		n = rnd() % 10 + 1;
+		for (sum = 0, i = 0; i < n; i++)
+			sum += (rnd() % 100000) / 100.0;
+		return sum / n;
+
+	case 3: /* right on a %e rounding boundary */
+		snprintf(buf, sizeof(buf), "%lu.%06lu5e%i", (unsigned long)(rnd() % 9 + 1),
+			(unsigned long)(rnd() % 1000000), (int)(rnd() % 80) - 40);
+		return strtod(buf, NULL);
+
+	default: /* anywhere between 1e-60 and 1e60, ten digits */
+		snprintf(buf, sizeof(buf), "%lu.%09lue%i", (unsigned long)(rnd() % 9 + 1),
+			(unsigned long)(rnd() % 1000000000), (int)(rnd() % 120) - 60);
+		return strtod(buf, NULL);
+	}
+}
+/* }}} */
+
+static void digits(char *out, const char *s) /* {{{ */
+{
+	/* just the significant digits of s, up to the exponent */
+	char *p = out;
+	for (; *s && *s != 'e'; s++)
+		if (*s >= '0' && *s <= '9' && (p != out || *s != '0'))
+			*p++ = *s;
+	while (p > out + 1 && p[-1] == '0')
+		p--;
+	*p = '\0';
+}
+/* }}} */
+static void check_parse(const char *s) /* {{{ */
+{
+	char *e1, *e2;
+	double d1 = strtod(s, &e1);
+	double d2 = bolo_strtod(s, &e2);
+	if (!same(d1, d2) || e1 != e2)
+		fail("bolo_strtod(\"%s\") = %.17g (+%li), strtod says %.17g (+%li)",
+			s, d2, (long)(e2 - s), d1, (long)(e1 - s));
+
+	unsigned long long u1 = strtoull(s, &e1, 10);
+	uint64_t           u2 = bolo_strtou(s, &e2);
+	if (u1 != u2 || e1 != e2)
+		fail("bolo_strtou(\"%s\") = %llu (+%li), strtoull says %llu (+%li)",
+			s, (unsigned long long)u2, (long)(e2 - s), u1, (long)(e1 - s));
+
+	long long i1 = strtoll(s, &e1, 10);
+	int64_t   i2 = bolo_strtoi(s, &e2);
+	if (i1 != i2 || e1 != e2)
+		fail("bolo_strtoi(\"%s\") = %lli (+%li), strtoll says %lli (+%li)",
+			s, (long long)i2, (long)(e2 - s), i1, (long)(e1 - s));
+}
+/* }}} */
+static void check_double(double v) /* {{{ */
+{
+	char want[64], got[BOLO_NUM_MAX], a[64], b[64];
+	int n;
+
+	snprintf(want, sizeof(want), "%e", v);
+	n = bolo_etoa(got, v);
+	if (strcmp(want, got) != 0 || n != (int)strlen(want))
+		fail("bolo_etoa(%a) = '%s' (%i), printf says '%s'", v, got, n, want);
+	check_parse(got);
+
+	n = bolo_dtoa(got, v);
+	if (n != (int)strlen(got) || n >= BOLO_NUM_MAX)
+		fail("bolo_dtoa(%a) = '%s', but said it was %i long", v, got, n);
+	if (!same(strtod(got, NULL), v))
+		fail("bolo_dtoa(%a) = '%s', which reads back as %a", v, got, strtod(got, NULL));
+	if (!isnan(v) && !isinf(v)) {
+		int prec;
+		for (prec = 0; prec < 17; prec++) {
+			snprintf(want, sizeof(want), "%.*e", prec, v);
+			if (same(strtod(want, NULL), v))
+				break;
+		}
+		digits(a, want);
+		digits(b, got);
+		if (strcmp(a, b) != 0)
+			fail("bolo_dtoa(%a) = '%s', but the shortest is '%s'", v, got, want);
+	}
+	check_parse(got);
+
+	snprintf(want, sizeof(want), "%.17g", v); check_parse(want);
+	snprintf(want, sizeof(want), "%g",    v); check_parse(want);
+	if (fabs(v) < 1e30) {
+		snprintf(want, sizeof(want), "%.3f", v); check_parse(want);
+	}
+}
+/* }}} */
+static void check_integer(uint64_t u) /* {{{ */
+{
+	char want[64], got[BOLO_NUM_MAX];
+	int n;
+
+	snprintf(want, sizeof(want), "%llu", (unsigned long long)u);
+	n = bolo_utoa(got, u);
+	if (strcmp(want, got) != 0 || n != (int)strlen(want))
+		fail("bolo_utoa(%s) = '%s' (%i)", want, got, n);
+	check_parse(got);
+
+	snprintf(want, sizeof(want), "%lli", (long long)u);
+	n = bolo_itoa(got, (int64_t)u);
+	if (strcmp(want, got) != 0 || n != (int)strlen(want))
+		fail("bolo_itoa(%s) = '%s' (%i)", want, got, n);
+	check_parse(got);
+}
+/* }}} */
+
+static const char *AWKWARD[] = {
+	"", "-", "+", ".", "-.", "1.", ".5", "-.5", "+1.5", "1e", "1e+", "1e-",
+	"1e5x", "1.5e+00 ", "1,5", " 12", "\t12", "12 ", "-0", "-0.0", "+0",
+	"0x10", "0X1p3", "-0x1", "inf", "-inf", "INFINITY", "nan", "-nan(123)",
+	"0000000000000000000000000012", "0.000000000000000000000000000001",
+	"1234567890123456789", "12345678901234567890", "123456789012345678901",
+	"18446744073709551615", "18446744073709551616", "-18446744073709551615",
+	"9223372036854775807", "9223372036854775808", "-9223372036854775808",
+	"-9223372036854775809", "999999999999999999", "-999999999999999999",
+	"9007199254740992", "9007199254740993", "9007199254740993.0",
+	"1e22", "1e23", "1e-22", "1e-23", "4.9e-324", "2.2250738585072014e-308",
+	"1.7976931348623157e+308", "1.7976931348623159e+308", "1e400", "1e-400",
+	"1e99999999999", "0.1", "0.30000000000000004", "123.456e-7", "1_000",
+	"2.500000e-01", "4.100000e+00", "1792349664", "-42",
+	NULL,
+};
+
+static const double SPECIAL[] = {
+	0.0, 1.0, -1.0, 0.1, 0.5, 1.5, 2.5, 1e6, 1e7, 1e16, 1e17, 1e21, 1e22,
+	1e23, 123456789012345678.0, 9.9999995, 9.9999994999999, 0.000099999995,
+	1e-5, 1e-4, 0.0001234, 5e-324, 2.2250738585072014e-308, DBL_MAX,
+	4294967295.0, 18446744073709551616.0, 1048576.5, 0.125, 1.0 / 3,
+};
+
+int main(int argc, char **argv)
+{
+	long iterations = check_options(argc, argv, 10000, NULL, NULL, NULL);
+	if (iterations < 0)
+		return 2;
+
+	long i, strings = 0;
+	for (i = 0; AWKWARD[i]; i++, strings++)
+		check_parse(AWKWARD[i]);
+
+	for (i = 0; i < (long)(sizeof(SPECIAL) / sizeof(SPECIAL[0])); i++) {
+		check_double(SPECIAL[i]);
+		check_double(-SPECIAL[i]);
+		check_double(nextafter(SPECIAL[i], 0));
+		check_double(nextafter(SPECIAL[i], INFINITY));
+	}
+	check_double(INFINITY);
+	check_double(-INFINITY);
+	check_double(NAN);
+
+	for (i = 0; i < iterations; i++) {
+		check_double(random_double());
+		check_integer(rnd() >> (rnd() % 64));
+	}
+
+	/* whatever locale the program is in, PDUs use a '.'; this
+	   only finds out if one with a ',' happens to be installed */
+	static const char *COMMAS[] = { "de_DE.UTF-8", "fr_FR.UTF-8", "de_DE", "fr_FR", NULL };
+	for (i = 0; COMMAS[i]; i++) {
+		if (!setlocale(LC_NUMERIC, COMMAS[i]) || strcmp(localeconv()->decimal_point, ",") != 0)
+			continue;
+
+		char buf[BOLO_NUM_MAX], *end;
+		double v = bolo_strtod("0x1.8p1", &end); /* (hex goes to libc) */
+		if (v != 3.0 || *end)
+			fail("in %s, bolo_strtod('0x1.8p1') = %a, stopping at '%s'", COMMAS[i], v, end);
+		v = bolo_strtod("1.25e99999", &end); /* (so does overflow) */
+		if (!isinf(v) || *end)
+			fail("in %s, bolo_strtod('1.25e99999') = %a, stopping at '%s'", COMMAS[i], v, end);
+		bolo_dtoa(buf, 0.1 + 0.2);
+		if (strchr(buf, ','))
+			fail("in %s, bolo_dtoa(0.1 + 0.2) = '%s'", COMMAS[i], buf);
+		bolo_etoa(buf, 5e-324);
+		if (strchr(buf, ','))
+			fail("in %s, bolo_etoa(5e-324) = '%s'", COMMAS[i], buf);
+		setlocale(LC_NUMERIC, "C");
+		break;
+	}
+
+	printf("doubles: %li\n", iterations);
+	printf("integers: %li\n", iterations);
+	printf("strings: %li\n", strings);
+	return check_done();
+}
@@ -0,0 +1,317 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   t/submitter-check - check libbolo's submitter, for t/submitter
+
+   A PULL socket in this process stands in for the aggregator, and
+   the submitter is given an interval long enough that it never
+   flushes on its own, so that everything that arrives was asked for:
+
+     1. a handful of COUNTER increments and SAMPLE values go in, and
+        nothing comes out until bolo_submitter_flush(), which has to
+        have sent one COUNTER (with the total) and one SAMPLE.AGG
+        (with exactly the right n, min, max, sum, mean and var) by
+        the time it returns;
+
+     2. -t threads make -n calls each, across a few names, mixing
+        counters and samples; after a flush, the COUNTER totals for
+        each name have to add up, and the SAMPLE.AGGs (one per name
+        per thread) have to combine to the n, min, max, mean and
+        var of every value submitted for it;
+
+     3. whatever is submitted after the last flush has to be sent
+        by bolo_submitter_free().
+
+   Anything that doesn't match is reported on standard error, and
+   makes for a non-zero exit.
+ */
+
+#include <bolo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <math.h>
+#include "lib.h"
+
+#define ENDPOINT "inproc://t/submitter-check"
+#define NAMES    16
+
+/* what went in (per thread, then added up), or came out */
+typedef struct {
+	uint64_t counted;
+	uint64_t n;
+	double   min, max, sum, sumsq;  /* sumsq: what went in */
+	double   mean, m2;              /* m2:    what came out */
+} tally_t;
+
+typedef struct {
+	pthread_t         tid;
+	uint64_t          seed;
+	long              calls;
+	tally_t           in[NAMES];
+} worker_t;
+
+static bolo_submitter_t SUBMITTER;
+static int THREADS = 4; /* -t */
+
+static int threads_opt(int c, const char *arg) /* {{{ */
+{
+	THREADS = atoi(arg);
+	return THREADS < 1;
+}
+/* }}} */
+
+static void * _worker(void *_) /* {{{ */
+{
+	worker_t *w = (worker_t *)_;
+	char name[64];
+	long i;
+
+	for (i = 0; i < w->calls; i++) {
+		uint64_t r = rnd_r(&w->seed);
+		int k = r % NAMES;
+		tally_t *t = &w->in[k];
+
+		if ((r >> 8) % 4 == 0) {
+			double v = (double)((r >> 16) % 100000) / 100. - 250.;
+			snprintf(name, sizeof(name), "check.sample.%i", k);
+			bolo_submitter_sample(SUBMITTER, name, v);
+			if (t->n == 0 || v < t->min) t->min = v;
+			if (t->n == 0 || v > t->max) t->max = v;
+			t->n++;
+			t->sum   += v;
+			t->sumsq += v * v;
+
+		} else {
+			unsigned int incr = (r >> 16) % 10 + 1;
+			snprintf(name, sizeof(name), "check.counter.%i", k);
+			bolo_submitter_counter(SUBMITTER, name, incr);
+			t->counted += incr;
+		}
+	}
+	return NULL;
+}
+/* }}} */
+
+static int close_to(double a, double b) /* {{{ */
+{
+	/* sums of a few thousand values, in different orders */
+	return fabs(a - b) <= 1e-9 * (fabs(a) + fabs(b)) + 1e-9;
+}
+/* }}} */
+static double number(pdu_t *p, int i) /* {{{ */
+{
+	char *s = pdu_string(p, i);
+	double v = bolo_strtod(s, NULL);
+	free(s);
+	return v;
+}
+/* }}} */
+static int receive(void *sink, tally_t *counters, tally_t *samples, int timeout) /* {{{ */
+{
+	/* take whatever shows up within timeout ms of the last one;
+	   flush has already sent it, so it won't take long */
+	int n = 0;
+	for (;;) {
+		zmq_pollitem_t poller[1] = { { sink, 0, ZMQ_POLLIN } };
+		if (zmq_poll(poller, 1, timeout) <= 0)
+			return n;
+
+		pdu_t *p = pdu_recv(sink);
+		if (!p)
+			continue;
+		n++;
+
+		char *name = pdu_size(p) > 2 ? pdu_string(p, 2) : strdup("");
+		int k;
+		if (strcmp(pdu_type(p), "COUNTER") == 0 && pdu_size(p) == 4
+		 && sscanf(name, "check.counter.%i", &k) == 1 && k >= 0 && k < NAMES) {
+			counters[k].counted += (uint64_t)number(p, 3);
+
+		} else if (strcmp(pdu_type(p), "SAMPLE.AGG") == 0 && pdu_size(p) == 9
+		        && sscanf(name, "check.sample.%i", &k) == 1 && k >= 0 && k < NAMES) {
+			/* combine them as the kernel would (Chan et al.) */
+			tally_t *t = &samples[k];
+			uint64_t n2  = (uint64_t)number(p, 3);
+			double   min = number(p, 4), max  = number(p, 5), sum = number(p, 6),
+			         mean = number(p, 7), var = number(p, 8);
+
+			if (!close_to(sum, mean * n2))
+				fail("SAMPLE.AGG for %s: sum %e, but %lu values of mean %e",
+					name, sum, (unsigned long)n2, mean);
+			if (t->n == 0 || min < t->min) t->min = min;
+			if (t->n == 0 || max > t->max) t->max = max;
+
+			double delta = mean - t->mean;
+			uint64_t n1 = t->n;
+			t->n    += n2;
+			t->sum  += sum;
+			t->mean += delta * n2 / t->n;
+			t->m2   += var * n2 + delta * delta * n1 * n2 / t->n;
+
+		} else {
+			fail("unexpected [%s] PDU (of %lu frames) for '%s'", pdu_type(p), (unsigned long)pdu_size(p), name);
+		}
+		free(name);
+		pdu_free(p);
+	}
+}
+/* }}} */
+
+int main(int argc, char **argv)
+{
+	int i, k;
+	long calls = check_options(argc, argv, 10000, "t:", threads_opt, "[-t THREADS]");
+	if (calls < 0)
+		return 2;
+	int threads = THREADS;
+
+	void *zmq = zmq_ctx_new();
+	int hwm = 0;
+	void *sink = zmq_socket(zmq, ZMQ_PULL);
+	if (!sink
+	 || zmq_setsockopt(sink, ZMQ_RCVHWM, &hwm, sizeof(hwm)) != 0
+	 || zmq_bind(sink, ENDPOINT) != 0) {
+		fprintf(stderr, "failed to bind %s: %s\n", ENDPOINT, zmq_strerror(errno));
+		return 2;
+	}
+
+	/* an hour is as good as never */
+	SUBMITTER = bolo_submitter_new(zmq, ENDPOINT, 3600 * 1000, 1 << 20);
+	if (!SUBMITTER) {
+		fprintf(stderr, "failed to create a submitter: %s\n", strerror(errno));
+		return 2;
+	}
+
+	/* 1. bolo_submitter_flush() {{{ */
+	tally_t counters[NAMES], samples[NAMES];
+	memset(counters, 0, sizeof(counters));
+	memset(samples,  0, sizeof(samples));
+
+	bolo_submitter_counter(SUBMITTER, "check.counter.0", 3);
+	bolo_submitter_counter(SUBMITTER, "check.counter.0", 4);
+	for (i = 1; i <= 5; i++)
+		bolo_submitter_sample(SUBMITTER, "check.sample.0", (double)i);
+
+	if (receive(sink, counters, samples, 100) != 0)
+		fail("the submitter sent something before it was flushed");
+
+	bolo_submitter_flush(SUBMITTER);
+	int got = receive(sink, counters, samples, 100);
+	if (got != 2)
+		fail("bolo_submitter_flush() sent %i PDUs (expected 2)", got);
+	if (counters[0].counted != 7)
+		fail("bolo_submitter_flush() sent COUNTER check.counter.0 %lu (expected 7)",
+			(unsigned long)counters[0].counted);
+	if (samples[0].n != 5 || samples[0].min != 1 || samples[0].max != 5
+	 || samples[0].sum != 15 || samples[0].mean != 3 || samples[0].m2 != 10)
+		fail("bolo_submitter_flush() sent SAMPLE.AGG check.sample.0 n=%lu min=%e max=%e"
+		     " sum=%e mean=%e var=%e (expected 5 1 5 15 3 2)",
+			(unsigned long)samples[0].n, samples[0].min, samples[0].max,
+			samples[0].sum, samples[0].mean, samples[0].n ? samples[0].m2 / samples[0].n : 0.);
+	printf("flush: %i\n", got);
+	/* }}} */
+
+	/* 2. threads {{{ */
+	worker_t *workers = calloc(threads, sizeof(worker_t));
+	for (i = 0; i < threads; i++) {
+		workers[i].seed  = SEED + i;
+		workers[i].calls = calls;
+		if (pthread_create(&workers[i].tid, NULL, _worker, &workers[i]) != 0) {
+			fprintf(stderr, "failed to start worker thread: %s\n", strerror(errno));
+			return 2;
+		}
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(workers[i].tid, NULL);
+
+	memset(counters, 0, sizeof(counters));
+	memset(samples,  0, sizeof(samples));
+	bolo_submitter_flush(SUBMITTER);
+	receive(sink, counters, samples, 100);
+
+	uint64_t counted = 0, sampled = 0;
+	for (k = 0; k < NAMES; k++) {
+		tally_t want;
+		memset(&want, 0, sizeof(want));
+		for (i = 0; i < threads; i++) {
+			tally_t *t = &workers[i].in[k];
+			if (t->n && (want.n == 0 || t->min < want.min)) want.min = t->min;
+			if (t->n && (want.n == 0 || t->max > want.max)) want.max = t->max;
+			want.counted += t->counted;
+			want.n       += t->n;
+			want.sum     += t->sum;
+			want.sumsq   += t->sumsq;
+		}
+		counted += counters[k].counted;
+		sampled += samples[k].n;
+
+		if (counters[k].counted != want.counted)
+			fail("COUNTER check.counter.%i came to %lu (expected %lu)", k,
+				(unsigned long)counters[k].counted, (unsigned long)want.counted);
+		if (samples[k].n != want.n) {
+			fail("SAMPLE.AGGs for check.sample.%i came to n=%lu (expected %lu)", k,
+				(unsigned long)samples[k].n, (unsigned long)want.n);
+			continue;
+		}
+		if (want.n == 0)
+			continue;
+
+		double mean = want.sum / want.n;
+		double var  = want.sumsq / want.n - mean * mean;
+		if (samples[k].min != want.min || samples[k].max != want.max)
+			fail("SAMPLE.AGGs for check.sample.%i came to min=%e max=%e (expected %e %e)", k,
+				samples[k].min, samples[k].max, want.min, want.max);
+		if (!close_to(samples[k].mean, mean))
+			fail("SAMPLE.AGGs for check.sample.%i came to mean=%.17g (expected %.17g)", k,
+				samples[k].mean, mean);
+		if (fabs(samples[k].m2 / want.n - var) > 1e-6 * var + 1e-9)
+			fail("SAMPLE.AGGs for check.sample.%i came to var=%.17g (expected %.17g)", k,
+				samples[k].m2 / want.n, var);
+	}
+	printf("counted: %lu\n", (unsigned long)counted);
+	printf("sampled: %lu\n", (unsigned long)sampled);
+	if (counted + sampled == 0)
+		fail("%i thread(s) made %li calls each, and none of them were sent", threads, calls);
+	/* }}} */
+
+	/* 3. bolo_submitter_free() {{{ */
+	memset(counters, 0, sizeof(counters));
+	memset(samples,  0, sizeof(samples));
+
+	bolo_submitter_counter(SUBMITTER, "check.counter.1", 42);
+	bolo_submitter_sample(SUBMITTER, "check.sample.1", 0.25);
+	bolo_submitter_free(SUBMITTER);
+	got = receive(sink, counters, samples, 500);
+	if (got != 2 || counters[1].counted != 42 || samples[1].n != 1 || samples[1].mean != 0.25)
+		fail("bolo_submitter_free() sent %i PDUs (COUNTER %lu, SAMPLE.AGG n=%lu mean=%e);"
+		     " expected COUNTER 42 and SAMPLE.AGG n=1 mean=0.25", got,
+			(unsigned long)counters[1].counted, (unsigned long)samples[1].n, samples[1].mean);
+	printf("free: %i\n", got);
+	/* }}} */
+
+	free(workers);
+	zmq_close(sink);
+	zmq_ctx_destroy(zmq);
+	return check_done();
+}
@@ -0,0 +1,520 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   t/tsdp-fuzz - round-trip the TSDP codec, for t/tsdp
+
+   First, a handful of PDUs are checked against octets worked out
+   by hand from the wire format, and a handful of malformed buffers
+   against the errors they ought to get.
+
+   Then, -n times over:
+
+     1. a random PDU is built, with tsdp_create / tsdp_extend;
+     2. it gets packed, and has to come out at tsdp_packed_size;
+     3. that gets unpacked, and has to match the original, field by
+        field and frame by frame, with every frame a view into the
+        packed buffer (not a copy of it);
+     4. that gets packed again, and has to match the first packing,
+        octet for octet;
+     5. the packed buffer gets mangled (flipped bits, truncated or
+        padded), and unpacked again.  That may fail, but if it does
+        not, the result has to pack right back to the mangled input,
+        since there is only one way to encode any given PDU.
+
+   Finally, batches of PDUs are packed one after another, as they
+   would be on a TCP connection, and fed back through a stream
+   decoder a few octets (or a few kilobytes) at a time.  They all
+   have to come out, in order and intact.
+
+   Anything that doesn't hold is reported on standard error, and
+   makes for a non-zero exit.  Run it under valgrind (or a build with
+   -fsanitize=address) to check the codec for stray reads and writes.
+ */
+
+#include <tsdp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "lib.h"
+
+static void hexdump(const char *label, const uint8_t *buf, size_t len) /* {{{ */
+{
+	size_t i;
+	fprintf(stderr, "  %s (%lu):", label, (unsigned long)len);
+	for (i = 0; i < len && i < 64; i++)
+		fprintf(stderr, " %02x", buf[i]);
+	fprintf(stderr, "%s\n", len > 64 ? " ..." : "");
+}
+/* }}} */
+
+/* compare two pdus; returns 0 if they are the same */
+static int same(const tsdp_t *a, const tsdp_t *b) /* {{{ */
+{
+	if (tsdp_get_version(a)  != tsdp_get_version(b)
+	 || tsdp_get_opcode(a)   != tsdp_get_opcode(b)
+	 || tsdp_get_flags(a)    != tsdp_get_flags(b)
+	 || tsdp_get_payloads(a) != tsdp_get_payloads(b)
+	 || tsdp_get_size(a)     != tsdp_get_size(b))
+		return 1;
+
+	int i;
+	for (i = 0; i < tsdp_get_size(a); i++) {
+		int type = tsdp_get_frame_type(a, i);
+		if (type != tsdp_get_frame_type(b, i))
+			return 1;
+
+		const void *x, *y;
+		int xlen, ylen;
+		if (tsdp_get_frame_view(a, i, type, &x, &xlen) != 0
+		 || tsdp_get_frame_view(b, i, type, &y, &ylen) != 0
+		 || xlen != ylen || (xlen > 0 && memcmp(x, y, xlen) != 0))
+			return 1;
+	}
+	return 0;
+}
+/* }}} */
+static tsdp_t* random_pdu(void) /* {{{ */
+{
+	static uint8_t data[TSDP_MAX_FRAME];
+	tsdp_t *pdu;
+
+	if (tsdp_create(&pdu, TSDP_VERSION, rnd() % (TSDP_BIGGEST_OPCODE + 1)) != 0) {
+		fail("tsdp_create() failed: %s", strerror(errno));
+		exit(2);
+	}
+	tsdp_set_flags(pdu,    rnd() & 0xff);
+	tsdp_set_payloads(pdu, rnd() & 0xffff);
+
+	/* mostly small pdus, with mostly small frames (like
+	   the real thing), but every so often, a big one */
+	int i, n = rnd() % 8 == 0 ? rnd() % 64 : rnd() % 6;
+	for (i = 0; i < n; i++) {
+		int j, len = rnd() % 16 == 0 ? rnd() % (TSDP_MAX_FRAME + 1) : rnd() % 24;
+		for (j = 0; j < len; j++)
+			data[j] = rnd() & 0xff;
+		if (tsdp_extend(pdu, rnd() % (TSDP_BIGGEST_TYPE + 1), data, len) != 0) {
+			fail("tsdp_extend() of a %i-octet frame failed: %s", len, strerror(errno));
+			exit(2);
+		}
+	}
+	return pdu;
+}
+/* }}} */
+
+static void check_vectors(void) /* {{{ */
+{
+	tsdp_t *pdu, *got;
+	uint8_t buf[64];
+	size_t i;
+	int rc;
+
+	/* a heartbeat is nothing but a header */
+	static const uint8_t heartbeat[] = { 0x10, 0x00, 0x00, 0x00 };
+	tsdp_create(&pdu, TSDP_VERSION, TSDP_OP_HEARTBEAT);
+	rc = tsdp_pack(buf, sizeof(buf), pdu);
+	if (rc != sizeof(heartbeat) || memcmp(buf, heartbeat, rc) != 0)
+		fail("HEARTBEAT packed wrong (rc %i)", rc);
+	if (tsdp_unpack(&got, heartbeat, sizeof(heartbeat)) != 0)
+		fail("HEARTBEAT didn't unpack: %s", tsdp_error_str(errno));
+	else if (same(pdu, got) != 0)
+		fail("HEARTBEAT didn't round-trip");
+	else
+		tsdp_destroy(got);
+	tsdp_destroy(pdu);
+
+	/* SUBMIT SAMPLE [tstamp] [string "cpu"] [float] */
+	static const uint8_t submit[] = {
+		0x11, 0x00, 0x00, 0x01,
+		0x40, 0x08, 0, 0, 0, 0, 0x57, 0xf7, 0x5a, 0x00,
+		0x30, 0x03, 'c', 'p', 'u',
+		0xa0, 0x08, 0x40, 0x09, 0x21, 0xfb, 0x54, 0x44, 0x2d, 0x18,
+	};
+	tsdp_create(&pdu, TSDP_VERSION, TSDP_OP_SUBMIT);
+	tsdp_set_payloads(pdu, TSDP_PAYLOAD_SAMPLE);
+	tsdp_extend(pdu, TSDP_TYPE_TSTAMP, submit + 6,  8);
+	tsdp_extend(pdu, TSDP_TYPE_STRING, "cpu",       3);
+	tsdp_extend(pdu, TSDP_TYPE_FLOAT,  submit + 21, 8);
+	if (tsdp_packed_size(pdu) != sizeof(submit))
+		fail("SUBMIT should need %lu octets, not %i",
+			(unsigned long)sizeof(submit), tsdp_packed_size(pdu));
+	rc = tsdp_pack(buf, sizeof(buf), pdu);
+	if (rc != sizeof(submit) || memcmp(buf, submit, rc) != 0) {
+		fail("SUBMIT packed wrong (rc %i)", rc);
+		hexdump("expected", submit, sizeof(submit));
+		hexdump("got", buf, rc > 0 ? rc : 0);
+	}
+	if (tsdp_pack(buf, sizeof(submit) - 1, pdu) != -TSDP_E2SMALL)
+		fail("SUBMIT packed into a buffer that was too small");
+
+	if (tsdp_unpack(&got, submit, sizeof(submit)) != 0) {
+		fail("SUBMIT didn't unpack: %s", tsdp_error_str(errno));
+	} else {
+		const void *v;
+		int len;
+		if (same(pdu, got) != 0)
+			fail("SUBMIT didn't round-trip");
+		if (tsdp_get_frame_view(got, 1, TSDP_TYPE_STRING, &v, &len) != 0
+		 || v != submit + 16 || len != 3)
+			fail("SUBMIT frame #1 isn't a view into the packed buffer");
+		if (tsdp_get_frame_view(got, 1, TSDP_TYPE_FLOAT, &v, &len) != -TSDP_EBADTYPE)
+			fail("SUBMIT frame #1 can be viewed as the wrong type");
+		if (tsdp_get_frame_view(got, 3, TSDP_TYPE_NIL, &v, &len) != -EINVAL)
+			fail("SUBMIT frame #3 (of 3) can be viewed");
+
+		/* extending an unpacked pdu leaves the views be */
+		if (tsdp_extend(got, TSDP_TYPE_STRING, "extra", 5) != 0)
+			fail("can't extend an unpacked SUBMIT: %s", strerror(errno));
+		if (tsdp_get_frame_view(got, 1, TSDP_TYPE_STRING, &v, &len) != 0
+		 || v != submit + 16)
+			fail("extending an unpacked SUBMIT moved its frames");
+		if (tsdp_get_frame_view(got, 3, TSDP_TYPE_STRING, &v, &len) != 0
+		 || len != 5 || memcmp(v, "extra", 5) != 0)
+			fail("extending an unpacked SUBMIT lost the new frame");
+		if (tsdp_packed_size(got) != sizeof(submit) + 2 + 5)
+			fail("extending an unpacked SUBMIT didn't account for the new frame");
+		tsdp_destroy(got);
+	}
+	tsdp_destroy(pdu);
+
+	/* the same SUBMIT, built from typed values */
+	tsdp_create(&pdu, TSDP_VERSION, TSDP_OP_SUBMIT);
+	tsdp_set_payloads(pdu, TSDP_PAYLOAD_SAMPLE);
+	tsdp_extend_tstamp(pdu, 1475828224LL);
+	tsdp_extend_string(pdu, "cpu");
+	tsdp_extend_float(pdu,  3.141592653589793);
+	rc = tsdp_pack(buf, sizeof(buf), pdu);
+	if (rc != sizeof(submit) || memcmp(buf, submit, rc) != 0) {
+		fail("SUBMIT (of typed values) packed wrong (rc %i)", rc);
+		hexdump("expected", submit, sizeof(submit));
+		hexdump("got", buf, rc > 0 ? rc : 0);
+	}
+	tsdp_destroy(pdu);
+
+	/* UINTs take as few octets as they can, and come back whole */
+	static const struct {
+		uint64_t v;
+		int      len;
+	} UINTS[] = {
+		{ 0, 1 }, { 0xff, 1 }, { 0x100, 2 }, { 0xffff, 2 }, { 0x10000, 4 },
+		{ 0xffffffffULL, 4 }, { 0x100000000ULL, 8 }, { 0xffffffffffffffffULL, 8 },
+	};
+	static const double FLOATS[] = { 0.0, -0.0, 1.5, -1e-300, 1e300, 3.141592653589793 };
+	tsdp_create(&pdu, TSDP_VERSION, TSDP_OP_SUBMIT);
+	for (i = 0; i < sizeof(UINTS) / sizeof(UINTS[0]); i++)
+		tsdp_extend_uint(pdu, UINTS[i].v);
+	for (i = 0; i < sizeof(FLOATS) / sizeof(FLOATS[0]); i++)
+		tsdp_extend_float(pdu, FLOATS[i]);
+	tsdp_extend_tstamp(pdu, -1);
+	for (i = 0; i < sizeof(UINTS) / sizeof(UINTS[0]); i++) {
+		uint64_t v;
+		if (tsdp_get_uint(pdu, i, &v) != 0 || v != UINTS[i].v)
+			fail("UINT %#lx didn't come back", (unsigned long)UINTS[i].v);
+		if (tsdp_get_frame_size(pdu, i) != UINTS[i].len)
+			fail("UINT %#lx took %i octets, not %i", (unsigned long)UINTS[i].v,
+				tsdp_get_frame_size(pdu, i), UINTS[i].len);
+	}
+	for (i = 0; i < sizeof(FLOATS) / sizeof(FLOATS[0]); i++) {
+		double v;
+		int at = sizeof(UINTS) / sizeof(UINTS[0]) + i;
+		if (tsdp_get_float(pdu, at, &v) != 0 || memcmp(&v, &FLOATS[i], sizeof(v)) != 0)
+			fail("FLOAT %g didn't come back", FLOATS[i]);
+	}
+	tsdp_tstamp_t ts;
+	if (tsdp_get_tstamp(pdu, tsdp_get_size(pdu) - 1, &ts) != 0 || ts != -1)
+		fail("TSTAMP -1 didn't come back");
+	uint64_t u;
+	if (tsdp_get_uint(pdu, tsdp_get_size(pdu) - 1, &u) != -TSDP_EBADTYPE)
+		fail("a TSTAMP came back as a UINT");
+	tsdp_destroy(pdu);
+
+	/* 4-octet FLOATs are single-precision */
+	static const uint8_t single[] = { 0x11, 0, 0, 1, 0xa0, 0x04, 0x3f, 0xc0, 0x00, 0x00 };
+	if (tsdp_unpack(&got, single, sizeof(single)) != 0) {
+		fail("single-precision FLOAT didn't unpack: %s", tsdp_error_str(errno));
+	} else {
+		double v;
+		if (tsdp_get_float(got, 0, &v) != 0 || v != 1.5)
+			fail("single-precision FLOAT didn't come back as 1.5");
+		tsdp_destroy(got);
+	}
+
+	/* frames can't be bigger than 12 bits, or of made-up types */
+	tsdp_create(&pdu, TSDP_VERSION, TSDP_OP_SUBMIT);
+	if (tsdp_extend(pdu, TSDP_TYPE_STRING, submit, TSDP_MAX_FRAME + 1) != -EINVAL)
+		fail("a frame bigger than TSDP_MAX_FRAME was allowed");
+	if (tsdp_extend(pdu, TSDP_BIGGEST_TYPE + 1, submit, 1) != -EINVAL)
+		fail("a frame of an unknown type was allowed");
+	if (tsdp_get_size(pdu) != 0)
+		fail("failed tsdp_extend() calls added frames anyway");
+	tsdp_destroy(pdu);
+
+	/* malformed buffers */
+	static const struct {
+		const char *what;
+		int         error;
+		size_t      len;
+		uint8_t     buf[16];
+	} BAD[] = {
+		{ "a short header",        TSDP_E2SMALL,  3, { 0x11, 0, 0 } },
+		{ "version 2",             EINVAL,        4, { 0x21, 0, 0, 0 } },
+		{ "an unknown opcode",     EINVAL,        4, { 0x16, 0, 0, 0 } },
+		{ "a short frame header",  TSDP_E2SMALL,  5, { 0x11, 0, 0, 1, 0xb0 } },
+		{ "a short frame",         TSDP_E2SMALL,  8, { 0x11, 0, 0, 1, 0xb0, 0x03, 'c', 'p' } },
+		{ "an unknown frame type", EINVAL,        6, { 0x11, 0, 0, 1, 0xd0, 0x00 } },
+		{ "no final frame",        TSDP_ENOFF,    6, { 0x11, 0, 0, 1, 0x30, 0x00 } },
+		{ "an early final frame",  TSDP_EEARLYFF, 8, { 0x11, 0, 0, 1, 0xb0, 0x00, 0xb0, 0x00 } },
+	};
+	for (i = 0; i < sizeof(BAD) / sizeof(BAD[0]); i++) {
+		got = NULL;
+		rc = tsdp_unpack(&got, BAD[i].buf, BAD[i].len);
+		if (rc != -BAD[i].error) {
+			fail("unpacking %s returned %i, not %i", BAD[i].what, rc, -BAD[i].error);
+			tsdp_destroy(got);
+		}
+	}
+}
+/* }}} */
+
+static long check_stream(long batches) /* {{{ */
+{
+	static tsdp_t *sent[64];
+	size_t cap = 64 * (4 + 64 * (2 + TSDP_MAX_FRAME));
+	uint8_t *buf = malloc(cap);
+	tsdp_stream_t *stream;
+	const tsdp_t *got;
+	long b, streamed = 0;
+	int i, n, rc;
+
+	for (b = 0; b < batches; b++) {
+		/* pack a batch of pdus, one after another */
+		size_t len = 0;
+		n = rnd() % 64 + 1;
+		for (i = 0; i < n; i++) {
+			if (rnd() % 8 == 0) {
+				/* heartbeats have no final frame of their own */
+				tsdp_create(&sent[i], TSDP_VERSION, TSDP_OP_HEARTBEAT);
+			} else {
+				sent[i] = random_pdu();
+			}
+			const void *v;
+			int vlen;
+			if (tsdp_get_size(sent[i]) == 1
+			 && tsdp_get_frame_view(sent[i], 0, TSDP_TYPE_NIL, &v, &vlen) == 0 && vlen == 0) {
+				/* on a stream, this *is* a frameless pdu */
+				tsdp_destroy(sent[i]);
+				i--;
+				continue;
+			}
+			rc = tsdp_stream_pack(buf + len, cap - len, sent[i]);
+			if (rc != tsdp_stream_packed_size(sent[i])) {
+				fail("stream batch #%li: packed %i octets, but needed %i",
+					b, rc, tsdp_stream_packed_size(sent[i]));
+				exit(2);
+			}
+			len += rc;
+		}
+
+		/* and feed it back in, in odd-sized bites */
+		tsdp_stream_new(&stream, n * (4 + 64 * (2 + TSDP_MAX_FRAME)));
+		size_t at = 0;
+		int next = 0;
+		while (at < len) {
+			size_t bite = rnd() % 2 ? rnd() % 8 + 1 : rnd() % 8192 + 1;
+			if (bite > len - at)
+				bite = len - at;
+			if (tsdp_stream_feed(stream, buf + at, bite) != 0) {
+				fail("stream batch #%li: couldn't feed in %lu octets: %s",
+					b, (unsigned long)bite, strerror(errno));
+				break;
+			}
+			at += bite;
+
+			while ((rc = tsdp_stream_next(stream, &got)) == 1) {
+				if (next >= n)
+					fail("stream batch #%li: got more pdus than were sent", b);
+				else if (same(sent[next], got) != 0)
+					fail("stream batch #%li: pdu #%i didn't round-trip", b, next);
+				else if (tsdp_packed_size(got) != tsdp_packed_size(sent[next]))
+					fail("stream batch #%li: pdu #%i came out a different size", b, next);
+				next++;
+			}
+			if (rc != 0) {
+				fail("stream batch #%li: failed after pdu #%i: %s", b, next, tsdp_error_str(-rc));
+				break;
+			}
+		}
+		if (next != n)
+			fail("stream batch #%li: sent %i pdus, but got %i", b, n, next);
+		streamed += next;
+
+		/* a stream is as good as dead after a bad pdu... */
+		if (tsdp_stream_feed(stream, (const uint8_t *)"\x21\0\0\0\x80\0", 6) != 0
+		 || tsdp_stream_next(stream, &got) != -EINVAL
+		 || tsdp_stream_next(stream, &got) != -EINVAL)
+			fail("stream batch #%li: a version 2 pdu didn't stop the stream", b);
+
+		/* ...until it is reset, and then it is as good as new */
+		if (tsdp_stream_reset(stream) != 0
+		 || tsdp_stream_feed(stream, buf, len) != 0)
+			fail("stream batch #%li: couldn't reset the stream: %s", b, strerror(errno));
+		for (i = 0; (rc = tsdp_stream_next(stream, &got)) == 1; i++)
+			if (i >= n || same(sent[i], got) != 0)
+				fail("stream batch #%li: pdu #%i didn't round-trip after a reset", b, i);
+		if (rc != 0 || i != n)
+			fail("stream batch #%li: got %i of %i pdus after a reset (rc %i)", b, i, n, rc);
+		tsdp_stream_destroy(stream);
+
+		/* ...or a pdu that is too big */
+		tsdp_stream_new(&stream, 32);
+		tsdp_stream_feed(stream, buf, len);
+		while ((rc = tsdp_stream_next(stream, &got)) == 1)
+			if (tsdp_stream_packed_size(got) > 32)
+				fail("stream batch #%li: got a pdu bigger than max", b);
+		if (rc != 0 && rc != -TSDP_E2BIG)
+			fail("stream batch #%li: a pdu that was too big returned %i", b, rc);
+		tsdp_stream_destroy(stream);
+
+		/* mangled streams can fail, but not go wrong */
+		int flips = rnd() % 4 + 1;
+		while (flips-- > 0)
+			buf[rnd() % len] ^= 1 << (rnd() % 8);
+		tsdp_stream_new(&stream, 0);
+		for (at = 0; at < len; at += 1024) {
+			tsdp_stream_feed(stream, buf + at, len - at < 1024 ? len - at : 1024);
+			while ((rc = tsdp_stream_next(stream, &got)) == 1)
+				;
+			if (rc < 0)
+				break;
+		}
+		tsdp_stream_destroy(stream);
+
+		for (i = 0; i < n; i++)
+			tsdp_destroy(sent[i]);
+	}
+
+	/* can't feed more in until what was fed has been drained */
+	tsdp_stream_new(&stream, 0);
+	static const uint8_t two[] = { 0x10, 0, 0, 0, 0x80, 0, 0x10, 0, 0, 0, 0x80, 0 };
+	tsdp_stream_feed(stream, two, sizeof(two));
+	if (tsdp_stream_next(stream, &got) != 1 || tsdp_get_size(got) != 0)
+		fail("a streamed HEARTBEAT didn't come out frameless");
+	if (tsdp_stream_feed(stream, two, sizeof(two)) != -EBUSY)
+		fail("a stream could be fed before it had been drained");
+	tsdp_stream_destroy(stream);
+
+	free(buf);
+	return streamed;
+}
+/* }}} */
+
+int main(int argc, char **argv)
+{
+	long iterations = check_options(argc, argv, 10000, NULL, NULL, NULL);
+	if (iterations < 0)
+		return 2;
+
+	check_vectors();
+
+	size_t cap = 4 + 64 * (2 + TSDP_MAX_FRAME) + 16;
+	uint8_t *packed  = malloc(cap);
+	uint8_t *again   = malloc(cap);
+	uint8_t *mangled = malloc(cap);
+
+	long i, decoded = 0;
+	for (i = 0; i < iterations; i++) {
+		tsdp_t *pdu = random_pdu(), *got;
+
+		int len = tsdp_packed_size(pdu);
+		int rc  = tsdp_pack(packed, cap, pdu);
+		if (rc != len) {
+			fail("#%li: packed %i octets, but needed %i", i, rc, len);
+			tsdp_destroy(pdu);
+			continue;
+		}
+
+		if (tsdp_unpack(&got, packed, len) != 0) {
+			fail("#%li: couldn't unpack what was just packed: %s", i, tsdp_error_str(errno));
+			hexdump("packed", packed, len);
+			tsdp_destroy(pdu);
+			continue;
+		}
+		if (same(pdu, got) != 0)
+			fail("#%li: unpacked pdu doesn't match the original", i);
+
+		int f;
+		for (f = 0; f < tsdp_get_size(got); f++) {
+			const void *v;
+			int vlen;
+			tsdp_get_frame_view(got, f, tsdp_get_frame_type(got, f), &v, &vlen);
+			if ((const uint8_t *)v < packed || (const uint8_t *)v + vlen > packed + len) {
+				fail("#%li: frame #%i of the unpacked pdu isn't a view", i, f);
+				break;
+			}
+		}
+
+		rc = tsdp_pack(again, cap, got);
+		if (rc != len || memcmp(packed, again, len) != 0) {
+			fail("#%li: repacking the unpacked pdu changed it", i);
+			hexdump("packed", packed, len);
+			hexdump("repacked", again, rc > 0 ? rc : 0);
+		}
+		tsdp_destroy(got);
+		tsdp_destroy(pdu);
+
+		/* now, mess it up */
+		int mlen = len;
+		memcpy(mangled, packed, len);
+		switch (rnd() % 4) {
+		case 0: mlen = rnd() % len + 1;              break; /* truncate */
+		case 1: mlen = len + rnd() % 16;                    /* pad */
+		        for (f = len; f < mlen; f++)
+		                mangled[f] = rnd() & 0xff;
+		        break;
+		}
+		int flips = rnd() % 4;
+		while (flips-- > 0)
+			mangled[rnd() % mlen] ^= 1 << (rnd() % 8);
+
+		if (tsdp_unpack(&got, mangled, mlen) != 0)
+			continue;
+
+		decoded++;
+		rc = tsdp_pack(again, cap, got);
+		if (rc != mlen || memcmp(mangled, again, mlen) != 0) {
+			fail("#%li: mangled pdu unpacked, but didn't repack the same", i);
+			hexdump("mangled", mangled, mlen);
+			hexdump("repacked", again, rc > 0 ? rc : 0);
+		}
+		tsdp_destroy(got);
+	}
+
+	free(packed);
+	free(again);
+	free(mangled);
+
+	long streamed = check_stream(iterations / 100 + 1);
+
+	printf("round-trips: %li\n", iterations);
+	printf("mangled, but decoded: %li\n", decoded);
+	printf("streamed: %li\n", streamed);
+	return check_done();
+}
@@ -29,8 +29,8 @@ int tsdp_create(tsdp_t **pdu, int version, int opcode)
 		return -errno;
 	}
 
-	*pdu = malloc(sizeof(tsdp_t));
-	if (!pdu) {
+	*pdu = calloc(1, sizeof(tsdp_t));
+	if (!*pdu) {
 		errno = ENOMEM;
 		return -errno;
 	}
@@ -39,6 +39,8 @@ int tsdp_create(tsdp_t **pdu, int version, int opcode)
 	(*pdu)->opcode   = opcode;
 	(*pdu)->payloads = 0;
 	(*pdu)->flags    = 0;
+	(*pdu)->frames   = (*pdu)->local;
+	(*pdu)->octets   = __TSDP_HEADER_LEN;
 
 	return 0;
 }
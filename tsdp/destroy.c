@@ -28,16 +28,11 @@ int tsdp_destroy(tsdp_t *pdu)
 		return 0;
 	}
 
-	struct __tsdp_frame *next, *frame = pdu->frames;
-	while (frame != NULL) {
-		next = frame->next;
-
-		free(frame->data);
-		free(frame);
-
-		frame = next;
+	/* frame data is either in the heap, or someone else's */
+	if (pdu->frames != pdu->local) {
+		free(pdu->frames);
 	}
-
+	free(pdu->heap);
 	free(pdu);
 	return 0;
 }
@@ -23,23 +23,57 @@
 #include <errno.h>
 #include "internal.h"
 
-int tsdp_extend(tsdp_t *pdu, int type, void *data, int len)
+int tsdp_extend(tsdp_t *pdu, int type, const void *data, int len)
 {
-	struct __tsdp_frame **frame = &pdu->frames;
-	while (*frame != NULL) {
-		*frame = (*frame)->next;
-	}
-	*frame = malloc(sizeof(struct __tsdp_frame));
-	if (!*frame) {
-		errno = ENOMEM;
+	if (pdu == NULL || !__tsdp_valid_type(type)
+	 || len < 0 || len > TSDP_MAX_FRAME || (len > 0 && data == NULL)) {
+		errno = EINVAL;
 		return -errno;
 	}
 
-	(*frame)->type = type;
-	(*frame)->size = len;
-	(*frame)->data = malloc(len);
-	memcpy((*frame)->data, data, len);
+	if (pdu->nframes == pdu->room) {
+		int room = pdu->room ? pdu->room * 2 : 8;
+		struct __tsdp_frame *frames;
+
+		if (pdu->frames == pdu->local) {
+			frames = malloc(room * sizeof(struct __tsdp_frame));
+			if (frames && pdu->nframes) {
+				memcpy(frames, pdu->local, pdu->nframes * sizeof(struct __tsdp_frame));
+			}
+		} else {
+			frames = realloc(pdu->frames, room * sizeof(struct __tsdp_frame));
+		}
+		if (!frames) {
+			errno = ENOMEM;
+			return -errno;
+		}
+		pdu->frames = frames;
+		pdu->room   = room;
+	}
+
+	if (pdu->heaplen + len > pdu->heapcap) {
+		size_t cap = pdu->heapcap ? pdu->heapcap : 256;
+		while (cap < pdu->heaplen + len) {
+			cap *= 2;
+		}
+		uint8_t *heap = realloc(pdu->heap, cap);
+		if (!heap) {
+			errno = ENOMEM;
+			return -errno;
+		}
+		pdu->heap    = heap;
+		pdu->heapcap = cap;
+	}
 
-	pdu->nframes++;
+	struct __tsdp_frame *frame = &pdu->frames[pdu->nframes++];
+	frame->type = type;
+	frame->size = len;
+	frame->data = NULL;
+	frame->heap = pdu->heaplen;
+	if (len > 0) {
+		memcpy(pdu->heap + pdu->heaplen, data, len);
+	}
+	pdu->heaplen += len;
+	pdu->octets  += __TSDP_FRAME_LEN + len;
 	return 0;
 }
@@ -23,14 +23,12 @@
 #include <errno.h>
 #include "internal.h"
 
-static struct __tsdp_frame* _nthframe(const tsdp_t *pdu, int n)
+static const struct __tsdp_frame* _nthframe(const tsdp_t *pdu, int n)
 {
-	struct __tsdp_frame *frame = pdu->frames;
-	while (frame != NULL && n > 0) {
-		frame = frame->next;
-		n--;
+	if (n < 0 || n >= pdu->nframes) {
+		return NULL;
 	}
-	return frame;
+	return &pdu->frames[n];
 }
 
 int tsdp_get_version(const tsdp_t *pdu)
@@ -85,12 +83,12 @@ int tsdp_get_size(const tsdp_t *pdu)
 
 int tsdp_get_frame_type(const tsdp_t *pdu, int n)
 {
-	if (pdu == NULL || n > pdu->nframes) {
+	if (pdu == NULL) {
 		errno = EINVAL;
 		return -errno;
 	}
 
-	struct __tsdp_frame *frame = _nthframe(pdu, n);
+	const struct __tsdp_frame *frame = _nthframe(pdu, n);
 	if (!frame) {
 		errno = EINVAL;
 		return -errno;
@@ -101,12 +99,12 @@ int tsdp_get_frame_type(const tsdp_t *pdu, int n)
 
 int tsdp_get_frame_size(const tsdp_t *pdu, int n)
 {
-	if (pdu == NULL || n > pdu->nframes) {
+	if (pdu == NULL) {
 		errno = EINVAL;
 		return -errno;
 	}
 
-	struct __tsdp_frame *frame = _nthframe(pdu, n);
+	const struct __tsdp_frame *frame = _nthframe(pdu, n);
 	if (!frame) {
 		errno = EINVAL;
 		return -errno;
@@ -118,12 +116,12 @@ int tsdp_get_frame_size(const tsdp_t *pdu, int n)
 int tsdp_get_frame_value(const tsdp_t *pdu, int n, int type, void **data, int *len)
 {
 	if (pdu == NULL || data == NULL || len == NULL
-	 || n > pdu->nframes || !__tsdp_valid_type(type)) {
+	 || !__tsdp_valid_type(type)) {
 		errno = EINVAL;
 		return -errno;
 	}
 
-	struct __tsdp_frame *frame = _nthframe(pdu, n);
+	const struct __tsdp_frame *frame = _nthframe(pdu, n);
 	if (!frame) {
 		errno = EINVAL;
 		return -errno;
@@ -136,6 +134,36 @@ int tsdp_get_frame_value(const tsdp_t *pdu, int n, int type, void **data, int *l
 
 	*len  = frame->size;
 	*data = malloc(*len);
-	memcpy(*data, frame->data, *len);
+	if (*len > 0 && !*data) {
+		errno = ENOMEM;
+		return -errno;
+	}
+	memcpy(*data, __tsdp_frame_data(pdu, frame), *len);
+	return 0;
+}
+
+int tsdp_get_frame_view(const tsdp_t *pdu, int n, int type, const void **data, int *len)
+{
+	if (pdu == NULL || data == NULL || len == NULL
+	 || !__tsdp_valid_type(type)) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	const struct __tsdp_frame *frame = _nthframe(pdu, n);
+	if (!frame) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	if (frame->type != type) {
+		errno = TSDP_EBADTYPE;
+		return -errno;
+	}
+
+	/* no copy; good until the next tsdp_extend() (or until the
+	   buffer this pdu was unpacked from goes away, if it was) */
+	*len  = frame->size;
+	*data = __tsdp_frame_data(pdu, frame);
 	return 0;
 }
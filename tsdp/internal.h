@@ -28,13 +28,17 @@ struct __tsdp_frame {
 	/* how many octets of data are in this frame. */
 	int size;
 
-	/* the actual data, in raw network form. */
-	uint8_t *data;
-
-	/* pointer to the next __tsdp_frame structure
-	   for the current pdu, or NULL if this is the
-	   final frame */
-	struct __tsdp_frame *next;
+	/* the actual data, in raw network form.  for pdus
+	   that came from tsdp_unpack(), this points into
+	   the caller's buffer; it is only valid for as long
+	   as that buffer is. */
+	const uint8_t *data;
+
+	/* for frames added by tsdp_extend(), the offset of
+	   the data in the pdu's own heap (see below), or -1
+	   if data points somewhere else.  the heap can move
+	   as it grows, so we can't just keep a pointer. */
+	int heap;
 };
 
 struct __tsdp_pdu {
@@ -56,22 +60,40 @@ struct __tsdp_pdu {
 	    on the opcode in use). */
 	int payloads;
 
-	/* a pointer to the first frame of this pdu,
-	   or NULL if there are no frames. */
+	/* the frames of this pdu, in order, in one
+	   contiguous array of (at least) nframes.  this
+	   starts out pointing at local[], below, and only
+	   gets its own allocation if tsdp_extend() needs
+	   more room than that. */
 	struct __tsdp_frame *frames;
-
-	/* a cache counter that tracks how many frames
-	   exist in the frames list, for basic sanity
-	   checking of frame accessor functions (i.e.
-	   for out-of-bounds errors). */
 	int nframes;
+	int room;
+
+	/* octets owned by this pdu, holding the data
+	   of every frame added via tsdp_extend(). */
+	uint8_t *heap;
+	size_t   heaplen;
+	size_t   heapcap;
 
 	/* a cache variable that keeps track of how many
 	   octets it would take to binary-pack this pdu. */
 	int octets;
+
+	/* frames allocated along with the pdu itself;
+	   tsdp_unpack() sizes this to fit. */
+	struct __tsdp_frame local[];
 };
 
-#define __tsdp_valid_opcode(x) (((x) & TSDP_RESERVED_OP)   == 0)
-#define __tsdp_valid_type(x)   (((x) & TSDP_RESERVED_TYPE) == 0)
+#define __tsdp_frame_data(pdu,f) \
+	((f)->heap < 0 ? (f)->data : (pdu)->heap + (f)->heap)
+
+#define __tsdp_valid_opcode(x) ((x) >= 0 && (x) <= TSDP_BIGGEST_OPCODE)
+#define __tsdp_valid_type(x)   ((x) >= 0 && (x) <= TSDP_BIGGEST_TYPE)
+
+/* every pdu starts with a 4-octet header, and every
+   frame with a 2-octet header of its own. */
+#define __TSDP_HEADER_LEN 4
+#define __TSDP_FRAME_LEN  2
+#define __TSDP_F_FINAL    0x80
 
 #endif
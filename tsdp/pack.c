@@ -19,50 +19,53 @@
 
 #include <tsdp.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include "internal.h"
 
-int tsdp_pack(uint8_t **buf, size_t *len, const tsdp_t *pdu)
+int tsdp_packed_size(const tsdp_t *pdu)
 {
-	if (buf == NULL || len == NULL || pdu == NULL) {
+	if (pdu == NULL) {
 		errno = EINVAL;
 		return -errno;
 	}
 
-	if (pdu->octets < 4) {
-		errno = TSDP_E2SMALL;
+	return pdu->octets;
+}
+
+int tsdp_pack(uint8_t *buf, size_t len, const tsdp_t *pdu)
+{
+	if (buf == NULL || pdu == NULL) {
+		errno = EINVAL;
 		return -errno;
 	}
 
-	*len = (size_t)pdu->octets;
-	*buf = calloc(*len, sizeof(uint8_t));
+	if (len < (size_t)pdu->octets) {
+		errno = TSDP_E2SMALL;
+		return -errno;
+	}
 
 	size_t i = 0;
-	*buf[i++] = ((pdu->version  & 0xf) << 4)
-	          | ((pdu->opcode   & 0xf));
-	*buf[i++] = ((pdu->flags    & 0xff));
-	*buf[i++] = ((pdu->payloads & 0xff00) >> 8);
-	*buf[i++] = ((pdu->payloads & 0x00ff));
+	buf[i++] = ((pdu->version  & 0xf) << 4)
+	         | ((pdu->opcode   & 0xf));
+	buf[i++] = ((pdu->flags    & 0xff));
+	buf[i++] = ((pdu->payloads & 0xff00) >> 8);
+	buf[i++] = ((pdu->payloads & 0x00ff));
 
-	struct __tsdp_frame *frame = pdu->frames;
-	while (frame != NULL) {
-		if (pdu->octets < i + 2 + frame->size) {
-			free(*buf);
-			*buf = NULL;
-			*len = 0;
-			errno = TSDP_E2SMALL;
-			return -errno;
-		}
-		*buf[i++] = ((frame->type & 0x7) << 4)
-		          | ((frame->next == NULL ? 0 : 0x8))
-		          | ((frame->size & 0xf00) >> 8);
-		*buf[i++] = ((frame->size & 0x0ff));
+	int n;
+	for (n = 0; n < pdu->nframes; n++) {
+		const struct __tsdp_frame *frame = &pdu->frames[n];
+
+		buf[i++] = ((n == pdu->nframes - 1 ? __TSDP_F_FINAL : 0))
+		         | ((frame->type & 0x7) << 4)
+		         | ((frame->size & 0xf00) >> 8);
+		buf[i++] = ((frame->size & 0x0ff));
 
-		size_t j;
-		for (j = 0; j < frame->size; j++, i++) {
-			*buf[i] = frame->data[j];
+		if (frame->size > 0) {
+			memcpy(buf + i, __tsdp_frame_data(pdu, frame), frame->size);
+			i += frame->size;
 		}
 	}
 
-	return 0;
+	return (int)i;
 }
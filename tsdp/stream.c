@@ -0,0 +1,343 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tsdp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "internal.h"
+
+struct __tsdp_stream {
+	/* the pdu we hand out, over and over; its frames
+	   point into either chunk or carry (below) */
+	tsdp_t *pdu;
+
+	/* what we were last fed, and how far into it we are */
+	const uint8_t *chunk;
+	size_t         len;
+	size_t         pos;
+
+	/* the start of a pdu that didn't fit in one chunk;
+	   this never holds more than the one pdu, and once
+	   that has been handed out, it is emptied on the
+	   next call to tsdp_stream_next() */
+	uint8_t *carry;
+	size_t   carrylen;
+	size_t   carrycap;
+	int      handed;
+
+	size_t max;
+	int    error;   /* sticky */
+};
+
+int tsdp_stream_packed_size(const tsdp_t *pdu)
+{
+	if (pdu == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	return pdu->octets + (pdu->nframes == 0 ? __TSDP_FRAME_LEN : 0);
+}
+
+int tsdp_stream_pack(uint8_t *buf, size_t len, const tsdp_t *pdu)
+{
+	if (buf == NULL || pdu == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	if (pdu->nframes > 0) {
+		return tsdp_pack(buf, len, pdu);
+	}
+
+	if (len < __TSDP_HEADER_LEN + __TSDP_FRAME_LEN) {
+		errno = TSDP_E2SMALL;
+		return -errno;
+	}
+
+	int n = tsdp_pack(buf, len, pdu);
+	if (n < 0) {
+		return n;
+	}
+	buf[n++] = __TSDP_F_FINAL | (TSDP_TYPE_NIL << 4);
+	buf[n++] = 0;
+	return n;
+}
+
+int tsdp_stream_new(tsdp_stream_t **stream, size_t max)
+{
+	if (stream == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	*stream = calloc(1, sizeof(tsdp_stream_t));
+	if (!*stream) {
+		errno = ENOMEM;
+		return -errno;
+	}
+
+	(*stream)->pdu = calloc(1, sizeof(tsdp_t));
+	if (!(*stream)->pdu) {
+		free(*stream);
+		*stream = NULL;
+		errno = ENOMEM;
+		return -errno;
+	}
+
+	(*stream)->max = max ? max : TSDP_STREAM_MAX;
+	return 0;
+}
+
+int tsdp_stream_destroy(tsdp_stream_t *stream)
+{
+	if (stream == NULL) {
+		return 0;
+	}
+
+	tsdp_destroy(stream->pdu);
+	free(stream->carry);
+	free(stream);
+	return 0;
+}
+
+int tsdp_stream_reset(tsdp_stream_t *stream)
+{
+	if (stream == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	stream->chunk    = NULL;
+	stream->len      = 0;
+	stream->pos      = 0;
+	stream->carrylen = 0;
+	stream->handed   = 0;
+	stream->error    = 0;
+	return 0;
+}
+
+int tsdp_stream_feed(tsdp_stream_t *stream, const uint8_t *buf, size_t len)
+{
+	if (stream == NULL || (buf == NULL && len > 0)) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	if (stream->pos < stream->len) {
+		errno = EBUSY;
+		return -errno;
+	}
+
+	stream->chunk = buf;
+	stream->len   = len;
+	stream->pos   = 0;
+	return 0;
+}
+
+/* how many octets, from the start of buf, the next pdu takes
+   up, if all of them are there.  if not, 0, with want set to how
+   many more it would take to get any further.  -errno if the pdu
+   is no good. */
+static int _scan(const uint8_t *buf, size_t len, size_t max, size_t *want)
+{
+	if (len < __TSDP_HEADER_LEN) {
+		*want = __TSDP_HEADER_LEN - len;
+		return 0;
+	}
+
+	if (((buf[0] >> 4) & 0xf) != TSDP_VERSION
+	 || !__tsdp_valid_opcode(buf[0] & 0xf)) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	size_t i = __TSDP_HEADER_LEN;
+	for (;;) {
+		if (i + __TSDP_FRAME_LEN > len) {
+			*want = i + __TSDP_FRAME_LEN - len;
+			return 0;
+		}
+		if (!__tsdp_valid_type((buf[i] >> 4) & 0x7)) {
+			errno = EINVAL;
+			return -errno;
+		}
+
+		int final = buf[i] & __TSDP_F_FINAL;
+		i += __TSDP_FRAME_LEN + (((buf[i] & 0x0f) << 8) | buf[i+1]);
+		if (i > max) {
+			errno = TSDP_E2BIG;
+			return -errno;
+		}
+		if (i > len) {
+			*want = i - len;
+			return 0;
+		}
+		if (final) {
+			return (int)i;
+		}
+	}
+}
+
+/* point the stream's pdu at the len octets (already _scan'd) at buf */
+static int _fill(tsdp_stream_t *stream, const uint8_t *buf, size_t len)
+{
+	tsdp_t *pdu = stream->pdu;
+	pdu->version  = (buf[0] >> 4) & 0xf;
+	pdu->opcode   = (buf[0] & 0xf);
+	pdu->flags    = buf[1];
+	pdu->payloads = (buf[2] << 8) | buf[3];
+	pdu->nframes  = 0;
+	pdu->octets   = len;
+
+	size_t i = __TSDP_HEADER_LEN;
+	while (i < len) {
+		if (pdu->nframes == pdu->room) {
+			int room = pdu->room ? pdu->room * 2 : 8;
+			struct __tsdp_frame *frames = realloc(pdu->frames, room * sizeof(struct __tsdp_frame));
+			if (!frames) {
+				errno = ENOMEM;
+				return -errno;
+			}
+			pdu->frames = frames;
+			pdu->room   = room;
+		}
+
+		struct __tsdp_frame *frame = &pdu->frames[pdu->nframes++];
+		frame->type = (buf[i] >> 4) & 0x7;
+		frame->size = ((buf[i] & 0x0f) << 8) | buf[i+1];
+		frame->data = buf + i + __TSDP_FRAME_LEN;
+		frame->heap = -1;
+		i += __TSDP_FRAME_LEN + frame->size;
+	}
+
+	/* a lone, empty NIL frame is how a frameless pdu ends */
+	if (pdu->nframes == 1 && pdu->frames[0].type == TSDP_TYPE_NIL
+	 && pdu->frames[0].size == 0) {
+		pdu->nframes = 0;
+		pdu->octets -= __TSDP_FRAME_LEN;
+	}
+	return 0;
+}
+
+static int _carry(tsdp_stream_t *stream, const uint8_t *buf, size_t len)
+{
+	if (stream->carrylen + len > stream->carrycap) {
+		size_t cap = stream->carrycap ? stream->carrycap : 256;
+		while (cap < stream->carrylen + len) {
+			cap *= 2;
+		}
+		uint8_t *carry = realloc(stream->carry, cap);
+		if (!carry) {
+			errno = ENOMEM;
+			return -errno;
+		}
+		stream->carry    = carry;
+		stream->carrycap = cap;
+	}
+
+	memcpy(stream->carry + stream->carrylen, buf, len);
+	stream->carrylen += len;
+	return 0;
+}
+
+static int _fail(tsdp_stream_t *stream, int rc)
+{
+	stream->error = -rc;
+	stream->pos   = stream->len;
+	return rc;
+}
+
+int tsdp_stream_next(tsdp_stream_t *stream, const tsdp_t **pdu)
+{
+	if (stream == NULL || pdu == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	if (stream->error) {
+		errno = stream->error;
+		return -errno;
+	}
+
+	/* whatever we handed out of carry last time is done with */
+	if (stream->handed) {
+		stream->carrylen = 0;
+		stream->handed   = 0;
+	}
+
+	int rc, n;
+	size_t want;
+
+	/* finish off the pdu that started in an earlier chunk,
+	   taking only as much of this one as it needs */
+	while (stream->carrylen > 0) {
+		n = _scan(stream->carry, stream->carrylen, stream->max, &want);
+		if (n < 0) {
+			return _fail(stream, n);
+		}
+
+		if (n > 0) {
+			if ((rc = _fill(stream, stream->carry, n)) != 0) {
+				return _fail(stream, rc);
+			}
+			stream->handed = 1;
+			*pdu = stream->pdu;
+			return 1;
+		}
+
+		if (stream->pos == stream->len) {
+			return 0;
+		}
+		if (want > stream->len - stream->pos) {
+			want = stream->len - stream->pos;
+		}
+		if ((rc = _carry(stream, stream->chunk + stream->pos, want)) != 0) {
+			return _fail(stream, rc);
+		}
+		stream->pos += want;
+	}
+
+	if (stream->pos == stream->len) {
+		return 0;
+	}
+
+	/* the common case: the whole pdu is right there */
+	n = _scan(stream->chunk + stream->pos, stream->len - stream->pos, stream->max, &want);
+	if (n < 0) {
+		return _fail(stream, n);
+	}
+
+	if (n > 0) {
+		if ((rc = _fill(stream, stream->chunk + stream->pos, n)) != 0) {
+			return _fail(stream, rc);
+		}
+		stream->pos += n;
+		*pdu = stream->pdu;
+		return 1;
+	}
+
+	/* what's left is the start of a pdu; hang onto it */
+	if ((rc = _carry(stream, stream->chunk + stream->pos, stream->len - stream->pos)) != 0) {
+		return _fail(stream, rc);
+	}
+	stream->pos = stream->len;
+	return 0;
+}
@@ -21,10 +21,11 @@
 
 static const char *__tsdp_errors[] = {
 	"Success!",
-	"Buffer too size for requested operation", /* TSDP_E2SMALL   */
-	"Early final frame found",                 /* TSDP_EEARLYFF  */
-	"No final frame found",                    /* TSDP_ENOFF     */
-	"Frame type mismatch",                     /* TSDP_EBADTYPE  */
+	"Buffer too small for requested operation", /* TSDP_E2SMALL   */
+	"Early final frame found",                  /* TSDP_EEARLYFF  */
+	"No final frame found",                     /* TSDP_ENOFF     */
+	"Frame type mismatch",                      /* TSDP_EBADTYPE  */
+	"PDU too big",                              /* TSDP_E2BIG     */
 };
 
 const char* tsdp_error_str(int error)
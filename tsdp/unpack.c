@@ -22,118 +22,116 @@
 #include <errno.h>
 #include "internal.h"
 
-int tsdp_unpack(tsdp_t **pdu, const uint8_t *buf, size_t len)
+/* walk the frames of the pdu in buf, without keeping
+   any of them, to find out how many there are, and
+   whether they are well-formed enough to bother with. */
+static int _count(const uint8_t *buf, size_t len)
 {
-	int rc;
-	if (pdu == NULL || buf == NULL || len == 0) {
-		errno = EINVAL;
-		return -errno;
-	}
+	size_t i = __TSDP_HEADER_LEN;
+	int n = 0;
 
-	if (len < 4) {
-		errno = TSDP_E2SMALL;
-		return -errno;
-	}
-
-	*pdu = malloc(sizeof(struct __tsdp_frame));
-	if (!pdu) {
-		errno = ENOMEM;
-		return -errno;
-	}
-	(*pdu)->octets = len; /* speculative for now, but will be born out by
-	                         the remainder of this function (if false, we'll
-	                         bail out and return an error to the caller...) */
-
-	size_t i = 0;
-	rc = tsdp_set_version((*pdu), (buf[i] >> 4) & 0xf);
-	if (rc != 0) {
-		tsdp_destroy(*pdu);
-		*pdu = NULL;
-		return rc;
-	}
-
-	rc = tsdp_set_opcode((*pdu), (buf[i] & 0xf));
-	if (rc != 0) {
-		tsdp_destroy(*pdu);
-		*pdu = NULL;
-		return rc;
-	}
-
-	i++;
-	rc = tsdp_set_flags((*pdu), buf[i]);
-	if (rc != 0) {
-		tsdp_destroy(*pdu);
-		*pdu = NULL;
-		return rc;
-	}
-
-	i++;
-	rc = tsdp_set_payloads((*pdu), (buf[i] << 8) | (buf[i+1]));
-	if (rc != 0) {
-		tsdp_destroy(*pdu);
-		*pdu = NULL;
-		return rc;
-	}
-
-	i += 2;
-	struct __tsdp_frame **next = &((*pdu)->frames),
-	                     *frame;
 	while (i < len) {
-		frame = malloc(sizeof(struct __tsdp_frame));
-		if (!frame) {
-			tsdp_destroy(*pdu);
-			*pdu = NULL;
-			errno = ENOMEM;
+		if (i + __TSDP_FRAME_LEN > len) {
+			errno = TSDP_E2SMALL;
 			return -errno;
 		}
-
-		int final = (buf[i] & 0x80);
-		frame->type = ((buf[i] >> 4) & 0x3);
-		frame->size = ((buf[i] & 0x0f) << 8); /* higher nibble of size ... */
-
-		i++;
-		if (i >= len) {
-			tsdp_destroy(*pdu);
-			*pdu = NULL;
-			free(frame);
-			errno = TSDP_E2SMALL;
+		if (!__tsdp_valid_type((buf[i] >> 4) & 0x7)) {
+			errno = EINVAL;
 			return -errno;
 		}
 
-		frame->size += buf[i];
-		i++;
-		if (i + frame->size >= len) {
-			tsdp_destroy(*pdu);
-			*pdu = NULL;
-			free(frame);
+		int final = buf[i] & __TSDP_F_FINAL;
+		size_t size = ((buf[i] & 0x0f) << 8) | buf[i+1];
+		i += __TSDP_FRAME_LEN;
+
+		if (i + size > len) {
 			errno = TSDP_E2SMALL;
 			return -errno;
 		}
-
-		size_t j;
-		for (j = 0; j < frame->size; j++, i++) {
-			frame->data[j] = buf[i];
-		}
-
-		*next = frame;
-		next = &frame->next;
-		(*pdu)->nframes++;
+		i += size;
+		n++;
 
 		if (final) {
 			if (i < len) {
-				tsdp_destroy(*pdu);
-				*pdu = NULL;
 				errno = TSDP_EEARLYFF;
 				return -errno;
 			}
 
 		} else if (i == len) {
-			tsdp_destroy(*pdu);
-			*pdu = NULL;
 			errno = TSDP_ENOFF;
 			return -errno;
 		}
 	}
 
+	return n;
+}
+
+int tsdp_unpack(tsdp_t **pdu, const uint8_t *buf, size_t len)
+{
+	if (pdu == NULL || buf == NULL || len == 0) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	if (len < __TSDP_HEADER_LEN) {
+		errno = TSDP_E2SMALL;
+		return -errno;
+	}
+
+	if (((buf[0] >> 4) & 0xf) != TSDP_VERSION
+	 || !__tsdp_valid_opcode(buf[0] & 0xf)) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	int n = _count(buf, len);
+	if (n < 0) {
+		return n;
+	}
+
+	/* one allocation, for the pdu and all of its frames */
+	*pdu = malloc(sizeof(tsdp_t) + n * sizeof(struct __tsdp_frame));
+	if (!*pdu) {
+		errno = ENOMEM;
+		return -errno;
+	}
+
+	(*pdu)->version  = (buf[0] >> 4) & 0xf;
+	(*pdu)->opcode   = (buf[0] & 0xf);
+	(*pdu)->flags    = buf[1];
+	(*pdu)->payloads = (buf[2] << 8) | buf[3];
+	(*pdu)->frames   = (*pdu)->local;
+	(*pdu)->nframes  = n;
+	(*pdu)->room     = n;
+	(*pdu)->heap     = NULL;
+	(*pdu)->heaplen  = 0;
+	(*pdu)->heapcap  = 0;
+	(*pdu)->octets   = len;
+
+	size_t i = __TSDP_HEADER_LEN;
+	struct __tsdp_frame *frame = (*pdu)->frames;
+	for (; n > 0; n--, frame++) {
+		frame->type = (buf[i] >> 4) & 0x7;
+		frame->size = ((buf[i] & 0x0f) << 8) | buf[i+1];
+		frame->data = buf + i + __TSDP_FRAME_LEN;
+		frame->heap = -1;
+		i += __TSDP_FRAME_LEN + frame->size;
+	}
+
 	return 0;
 }
+
+const uint8_t* tsdp_packed_key(const uint8_t *buf, size_t len, size_t *n)
+{
+	size_t i = __TSDP_HEADER_LEN;
+	while (i + __TSDP_FRAME_LEN <= len) {
+		*n = ((buf[i] & 0x0f) << 8) | buf[i+1];
+		if (((buf[i] >> 4) & 0x7) == TSDP_TYPE_STRING && i + __TSDP_FRAME_LEN + *n <= len)
+			return buf + i + __TSDP_FRAME_LEN;
+		if (buf[i] & __TSDP_F_FINAL)
+			break;
+		i += __TSDP_FRAME_LEN + *n;
+	}
+	*n = len;
+	return buf;
+}
@@ -0,0 +1,146 @@
+/*
+  Copyright (c) 2016 The Bolo Authors.  All Rights Reserved.
+
+  This file is part of Bolo.
+
+  Bolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  Bolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with Bolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tsdp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "internal.h"
+
+/* numbers go over the wire in network (big-endian) order:
+   UINTs in as few of 1, 2, 4 or 8 octets as they fit in,
+   FLOATs as IEEE-754 doubles (or singles, on the way in),
+   and TSTAMPs as 8 octets of milliseconds since the epoch. */
+
+static int _put(tsdp_t *pdu, int type, uint64_t v, int len)
+{
+	uint8_t buf[8];
+	int i;
+	for (i = len - 1; i >= 0; i--, v >>= 8) {
+		buf[i] = v & 0xff;
+	}
+	return tsdp_extend(pdu, type, buf, len);
+}
+
+static int _get(const tsdp_t *pdu, int n, int type, uint64_t *v, int *len)
+{
+	const void *data;
+	int rc = tsdp_get_frame_view(pdu, n, type, &data, len);
+	if (rc != 0) {
+		return rc;
+	}
+	if (*len < 1 || *len > 8) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	const uint8_t *b = data;
+	int i;
+	for (*v = 0, i = 0; i < *len; i++) {
+		*v = (*v << 8) | b[i];
+	}
+	return 0;
+}
+
+int tsdp_extend_uint(tsdp_t *pdu, uint64_t v)
+{
+	return _put(pdu, TSDP_TYPE_UINT, v,
+		v <= 0xff ? 1 : v <= 0xffff ? 2 : v <= 0xffffffffULL ? 4 : 8);
+}
+
+int tsdp_extend_float(tsdp_t *pdu, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return _put(pdu, TSDP_TYPE_FLOAT, bits, 8);
+}
+
+int tsdp_extend_tstamp(tsdp_t *pdu, tsdp_tstamp_t ms)
+{
+	return _put(pdu, TSDP_TYPE_TSTAMP, (uint64_t)ms, 8);
+}
+
+int tsdp_extend_string(tsdp_t *pdu, const char *s)
+{
+	if (s == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+	return tsdp_extend(pdu, TSDP_TYPE_STRING, s, strlen(s));
+}
+
+int tsdp_get_uint(const tsdp_t *pdu, int n, uint64_t *v)
+{
+	int len;
+	if (v == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+	return _get(pdu, n, TSDP_TYPE_UINT, v, &len);
+}
+
+int tsdp_get_float(const tsdp_t *pdu, int n, double *v)
+{
+	uint64_t bits;
+	int rc, len;
+
+	if (v == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+	if ((rc = _get(pdu, n, TSDP_TYPE_FLOAT, &bits, &len)) != 0) {
+		return rc;
+	}
+
+	if (len == 8) {
+		memcpy(v, &bits, sizeof(*v));
+		return 0;
+	}
+	if (len == 4) {
+		uint32_t b32 = bits;
+		float f;
+		memcpy(&f, &b32, sizeof(f));
+		*v = f;
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -errno;
+}
+
+int tsdp_get_tstamp(const tsdp_t *pdu, int n, tsdp_tstamp_t *ms)
+{
+	uint64_t v;
+	int rc, len;
+
+	if (ms == NULL) {
+		errno = EINVAL;
+		return -errno;
+	}
+	if ((rc = _get(pdu, n, TSDP_TYPE_TSTAMP, &v, &len)) != 0) {
+		return rc;
+	}
+	if (len != 8) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	*ms = (tsdp_tstamp_t)v;
+	return 0;
+}
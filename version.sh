@@ -8,7 +8,7 @@ LIB_CURRENT=1
 LIB_REVISION=0
 LIB_AGE=0
 
-TSDP_CURRENT=1
+TSDP_CURRENT=2
 TSDP_REVISION=0
 TSDP_AGE=0
 